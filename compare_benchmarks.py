@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+"""Compares results of QBRecordCollectionBenchmark.
+
+Save results with:
+
+    bin/QBRecordCollectionBenchmark --benchmark_out=results.json \\
+        --benchmark_out_format=json
+
+Then:
+
+    compare_benchmarks.py results.json
+
+prints, for each query benchmark, the time taken by QBRecordCollection and by
+the baseline (baseline::QBFindMatchingRecords) and the speedup, and
+
+    compare_benchmarks.py before.json after.json [--threshold=0.1]
+
+prints the change in time of every benchmark between two runs, marking those
+that slowed down by more than the threshold (a fraction), and exits with
+status 1 if there are any.
+"""
+
+import argparse
+import json
+import sys
+
+NEW = "<QBRecordCollection>"
+BASELINE = "<Baseline>"
+
+
+def load_times(path):
+    """Returns {benchmark name: CPU time in ns} for the results in `path`.
+
+    With --benchmark_repetitions, the mean of the repetitions is used.
+    """
+    with open(path) as f:
+        results = json.load(f)
+    units = {"ns": 1, "us": 1e3, "ms": 1e6, "s": 1e9}
+    times = {}
+    means = {}
+    for b in results["benchmarks"]:
+        time = b["cpu_time"] * units[b.get("time_unit", "ns")]
+        if b.get("run_type") == "aggregate":
+            if b.get("aggregate_name") == "mean":
+                means[b["run_name"]] = time
+        else:
+            times.setdefault(b.get("run_name", b["name"]), time)
+    times.update(means)
+    return times
+
+
+def format_ns(ns):
+    for unit, scale in (("s", 1e9), ("ms", 1e6), ("us", 1e3)):
+        if ns >= scale:
+            return "%.3g %s" % (ns / scale, unit)
+    return "%.3g ns" % ns
+
+
+def compare_with_baseline(times):
+    rows = [(name.replace(NEW, ""), time, times.get(name.replace(NEW, BASELINE)))
+            for name, time in times.items() if NEW in name]
+    if not rows:
+        print("no QBRecordCollection query benchmarks found")
+        return 1
+    width = max(len(name) for name, _, _ in rows)
+    print("%-*s %12s %12s %10s" % (width, "BENCHMARK", "NEW", "BASELINE",
+                                   "SPEEDUP"))
+    for name, time, base in rows:
+        speedup = "%.1fx" % (base / time) if base else "-"
+        print("%-*s %12s %12s %10s" % (width, name, format_ns(time),
+                                       format_ns(base) if base else "-",
+                                       speedup))
+    return 0
+
+
+def compare_runs(before, after, threshold):
+    names = [name for name in after if name in before]
+    if not names:
+        print("no benchmarks in common")
+        return 1
+    width = max(len(name) for name in names)
+    print("%-*s %12s %12s %8s" % (width, "BENCHMARK", "BEFORE", "AFTER",
+                                  "CHANGE"))
+    regressions = 0
+    for name in names:
+        change = after[name] / before[name] - 1
+        regressed = change > threshold
+        regressions += regressed
+        print("%-*s %12s %12s %+7.1f%%%s" % (
+            width, name, format_ns(before[name]), format_ns(after[name]),
+            change * 100, "  REGRESSION" if regressed else ""))
+    if regressions:
+        print("%d of %d benchmarks slowed down by more than %.0f%%" %
+              (regressions, len(names), threshold * 100))
+    return 1 if regressions else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawTextHelpFormatter)
+    parser.add_argument("results", nargs="+", metavar="RESULTS.json",
+                        help="one run (compared with the baseline), or two "
+                        "(compared with each other)")
+    parser.add_argument("--threshold", type=float, default=0.1,
+                        help="slowdown counted as a regression (default 0.1)")
+    args = parser.parse_args()
+
+    if len(args.results) == 1:
+        return compare_with_baseline(load_times(args.results[0]))
+    if len(args.results) == 2:
+        return compare_runs(load_times(args.results[0]),
+                            load_times(args.results[1]), args.threshold)
+    parser.error("expected one or two results files")
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,184 @@
+// Implementation of ColumnStore, a columnar (structure of arrays) table of
+// records.
+//
+// A ColumnStore<std::tuple<Ts...>> holds a sequence of rows, numbered in
+// insertion order by dense 32-bit row ordinals, with each column in its own
+// contiguous array rather than each row in its own tuple:
+//
+//  - Numeric columns are plain `std::vector`s of values.
+//
+//  - String columns (`StringColumn`) pack all the characters of all values
+//    into one append-only character arena, with an array of end offsets to
+//    delimit them, so that a string costs its length plus one offset instead
+//    of a 32 byte `std::string` (and a separate heap allocation when too long
+//    for the small string buffer).
+//
+// Scanning a column therefore touches only that column's data, and the
+// values read by consecutive rows are adjacent in memory.
+//
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "memory_usage.hpp"
+#include "tuples.hpp"
+
+//------------------------------------------------------------------------------
+
+// A column of strings, stored end to end in a single character arena.
+//
+class StringColumn {
+public:
+  // Appends `value` to the column.
+  //
+  void push_back(std::string_view value) {
+    chars_.insert(chars_.end(), value.begin(), value.end());
+    ends_.emplace_back(chars_.size());
+  }
+
+  // Returns the value in row `row`; valid until the column is next modified.
+  //
+  std::string_view operator[](std::size_t row) const {
+    assert(row < ends_.size());
+    const std::size_t begin = row == 0 ? 0 : ends_[row - 1];
+    return std::string_view{chars_.data() + begin, ends_[row] - begin};
+  }
+
+  // Returns the number of rows.
+  //
+  std::size_t size() const { return ends_.size(); }
+
+  // Returns the offset in `chars()` of the end of the value in row `row`.
+  //
+  std::size_t end_offset(std::size_t row) const { return ends_[row]; }
+
+  // Returns the character arena: the values of all rows, concatenated.
+  //
+  std::string_view chars() const {
+    return std::string_view{chars_.data(), chars_.size()};
+  }
+
+  // Releases unused capacity, e.g. after a bulk load.
+  //
+  void shrink_to_fit() {
+    chars_.shrink_to_fit();
+    ends_.shrink_to_fit();
+  }
+
+private:
+  // The values of all rows, concatenated.
+  //
+  std::vector<char> chars_;
+
+  // The offset in `chars_` of the end of each row's value.
+  //
+  std::vector<std::size_t> ends_;
+
+  friend std::size_t heap_bytes(const StringColumn &column) {
+    return heap_bytes(column.chars_) + heap_bytes(column.ends_);
+  }
+};
+
+// The array type used by `ColumnStore` to store a column of type `T`.
+//
+template <typename T> struct ColumnArray { using type = std::vector<T>; };
+
+template <> struct ColumnArray<std::string> { using type = StringColumn; };
+
+template <typename T> using ColumnArrayT = typename ColumnArray<T>::type;
+
+//------------------------------------------------------------------------------
+
+template <typename Record> class ColumnStore;
+
+// Table of records of type `std::tuple<Ts...>`, stored column-wise.
+//
+template <typename... Ts> class ColumnStore<std::tuple<Ts...>> {
+  static_assert(sizeof...(Ts) > 0, "ColumnStore needs at least one column");
+
+public:
+  using record_type = std::tuple<Ts...>;
+
+  // Identifies a row; rows are numbered 0, 1, 2, ... in insertion order.
+  //
+  using row_type = std::uint32_t;
+
+  // Appends `record` as a new row, returning its ordinal.  `record` may also
+  // be any tuple whose elements convert to the columns' values, such as one
+  // with `std::string_view`s for the string columns.
+  //
+  template <typename Record> row_type push_back(const Record &record) {
+    assert(size() < std::numeric_limits<row_type>::max());
+    const row_type row = row_type(size());
+    for_each_upto<sizeof...(Ts)>([&](auto i) {
+      constexpr int I = decltype(i)::value;
+      std::get<I>(columns_).push_back(std::get<I>(record));
+    });
+    return row;
+  }
+
+  // Returns the value of column `I` in row `row`; a `std::string_view` into
+  // the arena (valid until the store is next modified) for string columns,
+  // and a copy of the value for all others.
+  //
+  template <int I> auto get(row_type row) const {
+    using Value = std::tuple_element_t<I, record_type>;
+    if constexpr (std::is_same_v<Value, std::string>) {
+      return std::get<I>(columns_)[row];
+    } else {
+      return Value{std::get<I>(columns_)[row]};
+    }
+  }
+
+  // Returns a copy of row `row`.
+  //
+  record_type get_record(row_type row) const {
+    return get_record_impl(row,
+                           std::make_integer_sequence<int, sizeof...(Ts)>{});
+  }
+
+  // Returns the whole of column `I`, for scans; a `std::vector` for numeric
+  // columns, a `StringColumn` for string columns.
+  //
+  template <int I> const auto &column() const { return std::get<I>(columns_); }
+
+  // Returns the number of rows.
+  //
+  std::size_t size() const { return std::get<0>(columns_).size(); }
+
+  // Returns the memory used by the store, including spare capacity.
+  //
+  MemoryUsage memory_usage() const {
+    MemoryUsage usage;
+    for_each_upto<sizeof...(Ts)>([&](auto i) {
+      usage.bytes += heap_bytes(std::get<decltype(i)::value>(columns_));
+    });
+    usage.num_entries = size();
+    return usage;
+  }
+
+  // Releases unused capacity, e.g. after a bulk load.
+  //
+  void shrink_to_fit() {
+    for_each_upto<sizeof...(Ts)>([&](auto i) {
+      std::get<decltype(i)::value>(columns_).shrink_to_fit();
+    });
+  }
+
+private:
+  template <int... Is>
+  record_type get_record_impl(row_type row,
+                              std::integer_sequence<int, Is...>) const {
+    return record_type{Ts(get<Is>(row))...};
+  }
+
+  std::tuple<ColumnArrayT<Ts>...> columns_;
+};
@@ -0,0 +1,121 @@
+#include "column_store.hpp"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "dense_id_map.hpp"
+
+namespace {
+
+using Record = std::tuple<unsigned, std::string, long, std::string>;
+
+std::string random_string(std::default_random_engine &rng, int max_length) {
+  std::uniform_int_distribution<int> pick_length(0, max_length);
+  std::uniform_int_distribution<int> pick_char('a', 'z');
+  std::string s(pick_length(rng), ' ');
+  for (char &ch : s) {
+    ch = char(pick_char(rng));
+  }
+  return s;
+}
+
+TEST(StringColumnTest, Smoke) {
+  StringColumn column;
+  EXPECT_EQ(column.size(), 0u);
+
+  column.push_back("abc");
+  column.push_back("");
+  column.push_back("de");
+
+  EXPECT_EQ(column.size(), 3u);
+  EXPECT_EQ(column[0], "abc");
+  EXPECT_EQ(column[1], "");
+  EXPECT_EQ(column[2], "de");
+  EXPECT_EQ(column.chars(), "abcde");
+}
+
+TEST(ColumnStoreTest, RandomVsRows) {
+  std::default_random_engine rng{/*seed=*/1};
+  std::uniform_int_distribution<long> pick_long(-1000, 1000);
+
+  ColumnStore<Record> store;
+  std::vector<Record> expected;
+  for (unsigned i = 0; i < 10000; ++i) {
+    Record record{i * 7, random_string(rng, 40), pick_long(rng),
+                  random_string(rng, 10)};
+    EXPECT_EQ(store.push_back(record), i);
+    expected.emplace_back(std::move(record));
+  }
+  store.shrink_to_fit();
+
+  ASSERT_EQ(store.size(), expected.size());
+  for (unsigned row = 0; row < expected.size(); ++row) {
+    EXPECT_EQ(store.get_record(row), expected[row]);
+    EXPECT_EQ(store.get<0>(row), std::get<0>(expected[row]));
+    EXPECT_EQ(store.get<1>(row), std::get<1>(expected[row]));
+    EXPECT_EQ(store.get<2>(row), std::get<2>(expected[row]));
+    EXPECT_EQ(store.get<3>(row), std::get<3>(expected[row]));
+  }
+  EXPECT_EQ(store.column<2>().size(), expected.size());
+  EXPECT_EQ(store.column<3>().size(), expected.size());
+}
+
+// Checks that a scan of the column store (plus its id-to-row map) sees the
+// same values as lookups of row tuples stored by id, as previously used by
+// `QBRecordCollection`.  (BM_ScanRecords in qb_record_collection_benchmark.cpp
+// compares their footprint and scan speed.)
+//
+TEST(ColumnStoreTest, MatchesRowTuples) {
+  using RowTuple = std::tuple<std::string, long, std::string>;
+
+  constexpr unsigned kCount = 10 * 1000;
+
+  // Strings of up to 24 characters, so some exceed the small string buffer.
+  //
+  std::default_random_engine rng{/*seed=*/1};
+  std::uniform_int_distribution<long> pick_long(-1000, 1000);
+  std::vector<unsigned> ids(kCount);
+  std::iota(ids.begin(), ids.end(), 0);
+  std::shuffle(ids.begin(), ids.end(), rng);
+  std::vector<Record> records;
+  for (unsigned id : ids) {
+    records.emplace_back(id, random_string(rng, 24), pick_long(rng),
+                         random_string(rng, 24));
+  }
+
+  DenseIdMap<unsigned, RowTuple> rows;
+  ColumnStore<Record> store;
+  DenseIdMap<unsigned, std::uint32_t> row_by_id;
+  for (const Record &record : records) {
+    rows.insert(std::get<0>(record), drop_first(record));
+    row_by_id.insert(std::get<0>(record), store.push_back(record));
+  }
+  store.shrink_to_fit();
+
+  long row_sum = 0, column_sum = 0;
+  for (unsigned id = 0; id < kCount; ++id) {
+    const RowTuple &row = *rows.find(id);
+    row_sum += std::get<1>(row) + long(std::get<2>(row).size());
+
+    const std::uint32_t *store_row = row_by_id.find(id);
+    ASSERT_NE(store_row, nullptr);
+    EXPECT_EQ(store.get_record(*store_row),
+              std::tuple_cat(std::make_tuple(id), row));
+  }
+  const std::vector<long> &numbers = store.column<2>();
+  const StringColumn &strings = store.column<3>();
+  for (std::size_t row = 0; row < store.size(); ++row) {
+    column_sum += numbers[row] + long(strings[row].size());
+  }
+  EXPECT_EQ(row_sum, column_sum);
+}
+
+} // namespace
@@ -0,0 +1,51 @@
+#include "concurrent_qb_record_collection.hpp"
+
+#include <thread>
+#include <utility>
+
+auto ConcurrentQBRecordCollection::snapshot() const -> Snapshot {
+  for (;;) {
+    const int side = active_.load();
+    std::atomic<std::size_t> &readers = readers_[side].count;
+    readers.fetch_add(1);
+    // If the side is still active, the writer will see this reader before it
+    // modifies the side (both operations are sequentially consistent);
+    // otherwise, back off without touching it and try the new active side.
+    //
+    if (active_.load() == side) {
+      return Snapshot{&sides_[side], &readers};
+    }
+    readers.fetch_sub(1, std::memory_order_release);
+  }
+}
+
+bool ConcurrentQBRecordCollection::insert(record_type &&record) {
+  std::lock_guard<std::mutex> lock{write_mutex_};
+  const int standby = 1 - active_.load(std::memory_order_relaxed);
+  if (!sides_[standby].insert(record_type{record})) {
+    return false;
+  }
+  log_.emplace_back(std::move(record));
+  return true;
+}
+
+void ConcurrentQBRecordCollection::publish() {
+  std::lock_guard<std::mutex> lock{write_mutex_};
+  if (log_.empty()) {
+    return;
+  }
+  const int old_active = active_.load(std::memory_order_relaxed);
+  active_.store(1 - old_active);
+
+  // Wait for the readers of the old side to finish.  New readers may still
+  // bump its count briefly before backing off, but never touch its data.
+  //
+  while (readers_[old_active].count.load() != 0) {
+    std::this_thread::yield();
+  }
+
+  for (record_type &record : log_) {
+    sides_[old_active].insert(std::move(record));
+  }
+  log_.clear();
+}
@@ -0,0 +1,115 @@
+// ConcurrentQBRecordCollection - a QBRecordCollection that can be queried by
+// many threads while records are being inserted.
+//
+// The collection keeps two copies ("sides") of the data, after the
+// Left-Right technique of Ramalhete and Correia:
+//
+//  - Readers only ever query the *active* side, which is immutable while it
+//    is active.  A reader announces itself on the side's reader count, checks
+//    that the side is still active, and then queries it without taking any
+//    locks.  Readers never wait for the writer; they only retry if a
+//    `publish` switches sides between the two steps.
+//
+//  - The writer inserts into the *standby* side, which no reader can see, and
+//    logs the inserted records.  `publish` makes the standby side active with
+//    a single atomic store, waits for the readers of the previously active
+//    side to finish, then replays the log on it, so that both sides are
+//    equal again and the next batch can start on the new standby side.
+//
+// Each record is thus indexed twice and stored twice; in return, query
+// latency is unaffected by ingestion, apart from competition for cores and
+// memory bandwidth.  Readers see each batch of inserts all at once, when it
+// is published.
+//
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+#include "qb_record_collection.hpp"
+
+class ConcurrentQBRecordCollection {
+public:
+  using record_type = QBRecordCollection::record_type;
+
+  // Read access to the published state of the collection.  Holding a snapshot
+  // keeps `publish` from completing, so snapshots should be short-lived.
+  //
+  class Snapshot {
+  public:
+    Snapshot(Snapshot &&other) noexcept
+        : collection_{other.collection_}, readers_{other.readers_} {
+      other.readers_ = nullptr;
+    }
+    Snapshot(const Snapshot &) = delete;
+    Snapshot &operator=(const Snapshot &) = delete;
+    Snapshot &operator=(Snapshot &&) = delete;
+
+    ~Snapshot() noexcept {
+      if (readers_) {
+        readers_->fetch_sub(1, std::memory_order_release);
+      }
+    }
+
+    const QBRecordCollection &operator*() const { return *collection_; }
+    const QBRecordCollection *operator->() const { return collection_; }
+
+  private:
+    friend class ConcurrentQBRecordCollection;
+
+    Snapshot(const QBRecordCollection *collection,
+             std::atomic<std::size_t> *readers)
+        : collection_{collection}, readers_{readers} {}
+
+    const QBRecordCollection *collection_;
+    std::atomic<std::size_t> *readers_;
+  };
+
+  ConcurrentQBRecordCollection() = default;
+  ConcurrentQBRecordCollection(const ConcurrentQBRecordCollection &) = delete;
+  ConcurrentQBRecordCollection &
+  operator=(const ConcurrentQBRecordCollection &) = delete;
+
+  // Returns a snapshot of the collection as of the last `publish`.  Never
+  // blocks; safe to call from any number of threads.
+  //
+  Snapshot snapshot() const;
+
+  // Inserts a new record, as `QBRecordCollection::insert` does; it becomes
+  // visible to readers at the next `publish`.  Calls to `insert` and `publish`
+  // are serialized by a mutex, so any thread may write.
+  //
+  bool insert(record_type &&record);
+
+  // Makes all records inserted since the last call visible to new snapshots.
+  // Waits for the snapshots of the previous state to be released.
+  //
+  void publish();
+
+private:
+  // The reader count of one side, on its own cache line so that readers of
+  // one side don't slow down the writer's checks of the other.
+  //
+  struct alignas(64) ReaderCount {
+    std::atomic<std::size_t> count{0};
+  };
+
+  // The two copies of the data; `sides_[active_]` is the one readers query.
+  //
+  QBRecordCollection sides_[2];
+  std::atomic<int> active_{0};
+
+  // The number of snapshots (or would-be snapshots) of each side.
+  //
+  mutable ReaderCount readers_[2];
+
+  // Serializes writers.
+  //
+  std::mutex write_mutex_;
+
+  // The records inserted into the standby side since the last `publish`.
+  //
+  std::vector<record_type> log_;
+};
@@ -0,0 +1,102 @@
+#include "concurrent_qb_record_collection.hpp"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using record_type = ConcurrentQBRecordCollection::record_type;
+
+record_type make_record(unsigned id) {
+  return record_type{id, "name" + std::to_string(id), long(id % 100),
+                     id % 2 ? "odd" : "even"};
+}
+
+// Returns the number of records in `db`.
+//
+std::size_t record_count(const QBRecordCollection &db) {
+  return db.count_matching_records({}, PredicateOp::kAnd);
+}
+
+TEST(ConcurrentQBRecordCollectionTest, PublishMakesInsertsVisible) {
+  ConcurrentQBRecordCollection db;
+  EXPECT_EQ(record_count(*db.snapshot()), 0u);
+
+  EXPECT_TRUE(db.insert(make_record(1)));
+  EXPECT_TRUE(db.insert(make_record(2)));
+  EXPECT_FALSE(db.insert(make_record(1)));
+  EXPECT_EQ(record_count(*db.snapshot()), 0u);
+
+  db.publish();
+  EXPECT_EQ(record_count(*db.snapshot()), 2u);
+  EXPECT_THAT(db.snapshot()->find_matching_records("column1", "name2"),
+              ::testing::ElementsAre(make_record(2)));
+
+  // Both sides hold all the published records.
+  //
+  EXPECT_FALSE(db.insert(make_record(2)));
+  EXPECT_TRUE(db.insert(make_record(3)));
+  db.publish();
+  db.publish();
+  EXPECT_TRUE(db.insert(make_record(4)));
+  db.publish();
+  const auto snapshot = db.snapshot();
+  EXPECT_EQ(record_count(*snapshot), 4u);
+  EXPECT_EQ(snapshot->count_matching_records("column3", "odd"), 2u);
+}
+
+// Readers query while a writer inserts and publishes batches; every snapshot
+// must hold a whole number of batches, never fewer than the reader saw
+// before.
+//
+TEST(ConcurrentQBRecordCollectionTest, ConcurrentReaders) {
+  constexpr unsigned kBatchSize = 100;
+  constexpr unsigned kBatches = 50;
+
+  ConcurrentQBRecordCollection db;
+  std::atomic<bool> done{false};
+
+  std::vector<std::thread> readers;
+  std::atomic<std::size_t> failures{0};
+  for (int i = 0; i < 3; ++i) {
+    readers.emplace_back([&] {
+      std::size_t last_count = 0;
+      while (!done) {
+        const auto snapshot = db.snapshot();
+        const std::size_t count = record_count(*snapshot);
+        const std::size_t odd =
+            snapshot->count_matching_records("column3", "d");
+        if (count % kBatchSize != 0 || count < last_count ||
+            odd != count / 2 ||
+            (count > 0 &&
+             snapshot
+                 ->find_matching_records("column0", std::to_string(count - 1))
+                 .empty())) {
+          ++failures;
+        }
+        last_count = count;
+      }
+    });
+  }
+
+  for (unsigned batch = 0; batch < kBatches; ++batch) {
+    for (unsigned i = 0; i < kBatchSize; ++i) {
+      db.insert(make_record(batch * kBatchSize + i));
+    }
+    db.publish();
+  }
+  done = true;
+  for (std::thread &reader : readers) {
+    reader.join();
+  }
+
+  EXPECT_EQ(failures, 0u);
+  EXPECT_EQ(record_count(*db.snapshot()), kBatchSize * kBatches);
+}
+
+} // namespace
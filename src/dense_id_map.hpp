@@ -0,0 +1,229 @@
+// Implementation of DenseIdMap, a primary key store for mostly dense integer
+// ids.
+//
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "memory_usage.hpp"
+
+//------------------------------------------------------------------------------
+
+// Map from unsigned integer ids to values of type `T`, optimized for ids that
+// are mostly dense (e.g. 0, 1, 2, ... assigned in any order).
+//
+// Values are stored in a vector indexed by id, with a bitmap recording which
+// slots are in use, so that a lookup is a bit test plus a single indexed load
+// rather than a hash computation and a chase through a bucket list.  To bound
+// the space wasted on unused slots, the vector only grows to cover a new id if
+// that keeps it at most `kMaxSlack` times larger than the number of entries;
+// ids too far beyond the dense range (sparse outliers) are stored in a hash
+// table instead, and moved into the vector once it grows to cover them.
+//
+// As with `std::vector`, inserting may move existing values, invalidating
+// pointers to them.
+//
+template <typename Id, typename T> class DenseIdMap {
+  static_assert(std::is_unsigned_v<Id>, "DenseIdMap ids must be unsigned");
+  static_assert(std::is_default_constructible_v<T>,
+                "DenseIdMap values must be default constructible");
+
+public:
+  // The dense vector may grow to this many slots regardless of the number of
+  // entries.
+  //
+  static constexpr std::size_t kMinDenseSize = 1024;
+
+  // The dense vector never grows to more than this many slots per entry.
+  //
+  static constexpr std::size_t kMaxSlack = 2;
+
+  // Returns a pointer to the value for `id`, or nullptr if there is none.
+  //
+  const T *find(Id id) const {
+    if (std::size_t(id) < dense_.size()) {
+      return is_present(id) ? &dense_[id] : nullptr;
+    }
+    if (sparse_.empty()) {
+      return nullptr;
+    }
+    const auto iter = sparse_.find(id);
+    return iter == sparse_.end() ? nullptr : &iter->second;
+  }
+
+  // Returns true iff there is a value for `id`.
+  //
+  bool contains(Id id) const { return find(id) != nullptr; }
+
+  // Inserts `value` under `id`, returning a pointer to the stored value; if
+  // there already is a value for `id`, returns nullptr and leaves the map
+  // unchanged.
+  //
+  const T *insert(Id id, T value) {
+    if (std::size_t(id) >= dense_.size()) {
+      if (sparse_.count(id)) {
+        return nullptr;
+      }
+      if (!grow_to_cover(id)) {
+        ++size_;
+        return &sparse_.emplace(id, std::move(value)).first->second;
+      }
+    }
+    if (is_present(id)) {
+      return nullptr;
+    }
+    set_present(id);
+    dense_[id] = std::move(value);
+    ++size_;
+    return &dense_[id];
+  }
+
+  // Removes the value for `id`.  Returns false if there is none.  The dense
+  // vector never shrinks.
+  //
+  bool erase(Id id) {
+    if (std::size_t(id) < dense_.size()) {
+      if (!is_present(id)) {
+        return false;
+      }
+      present_[id / 64] &= ~(std::uint64_t{1} << (id % 64));
+      dense_[id] = T{};
+    } else if (sparse_.erase(id) == 0) {
+      return false;
+    }
+    --size_;
+    return true;
+  }
+
+  // Returns the number of entries.
+  //
+  std::size_t size() const { return size_; }
+
+  // Returns the number of entries stored in the hash table rather than the
+  // dense vector.
+  //
+  std::size_t sparse_size() const { return sparse_.size(); }
+
+  // Returns the memory used by the map.
+  //
+  MemoryUsage memory_usage() const {
+    MemoryUsage usage;
+    usage.bytes = heap_bytes(dense_) + heap_bytes(present_) +
+                  sparse_.get_allocator().bytes_allocated();
+    usage.num_entries = size_;
+    return usage;
+  }
+
+private:
+  bool is_present(Id id) const { return (present_[id / 64] >> (id % 64)) & 1; }
+
+  void set_present(Id id) {
+    present_[id / 64] |= std::uint64_t{1} << (id % 64);
+  }
+
+  // Grows the dense vector to cover `id` if that respects the space bound,
+  // moving any sparse entries it now covers into it.  Returns false if `id`
+  // should be stored in the hash table instead.
+  //
+  bool grow_to_cover(Id id) {
+    // Always grow geometrically, so that there are O(log n) growth steps (each
+    // of which scans the hash table) however the ids arrive; a factor of 1.5
+    // rather than 2 limits the overshoot past the largest id.
+    //
+    const std::size_t new_size =
+        std::max({std::size_t(id) + 1, dense_.size() + dense_.size() / 2,
+                  kMinDenseSize});
+    if (new_size > std::max(kMinDenseSize, kMaxSlack * (size_ + 1))) {
+      return false;
+    }
+    dense_.resize(new_size);
+    present_.resize((new_size + 63) / 64);
+
+    for (auto iter = sparse_.begin(); iter != sparse_.end();) {
+      if (std::size_t(iter->first) < new_size) {
+        set_present(iter->first);
+        dense_[iter->first] = std::move(iter->second);
+        iter = sparse_.erase(iter);
+      } else {
+        ++iter;
+      }
+    }
+    if (sparse_.empty()) {
+      // Release the bucket array too.
+      //
+      sparse_ = {};
+    }
+    return true;
+  }
+
+  // Values for ids less than `dense_.size()`; only meaningful where the
+  // corresponding bit of `present_` is set.
+  //
+  std::vector<T> dense_;
+
+  // One bit per slot of `dense_`, set iff the slot holds a value.
+  //
+  std::vector<std::uint64_t> present_;
+
+  // Values for ids not less than `dense_.size()`.
+  //
+  std::unordered_map<Id, T, std::hash<Id>, std::equal_to<Id>,
+                     CountingAllocator<std::pair<const Id, T>>>
+      sparse_;
+
+  // The total number of entries.
+  //
+  std::size_t size_ = 0;
+};
+
+//------------------------------------------------------------------------------
+
+// DenseIdMap for ids that are all congruent to `residue` modulo `stride`, such
+// as the ids of one of `stride` partitions split by `id % stride`.  Entries
+// are keyed by `id / stride`, so that such ids are as dense as the whole set
+// they were taken from, rather than `stride` times sparser.
+//
+// Ids with any other residue are never present; inserting one is an error.
+//
+template <typename Id, typename T> class StridedIdMap {
+public:
+  explicit StridedIdMap(Id stride = 1, Id residue = 0)
+      : stride_{stride}, residue_{residue} {
+    assert(stride_ > 0 && residue_ < stride_);
+  }
+
+  const T *find(Id id) const {
+    return id % stride_ == residue_ ? map_.find(id / stride_) : nullptr;
+  }
+
+  bool contains(Id id) const { return find(id) != nullptr; }
+
+  const T *insert(Id id, T value) {
+    assert(id % stride_ == residue_);
+    return map_.insert(id / stride_, std::move(value));
+  }
+
+  bool erase(Id id) {
+    return id % stride_ == residue_ && map_.erase(id / stride_);
+  }
+
+  // Removes all entries, keeping the stride and residue.
+  //
+  void clear() { map_ = {}; }
+
+  std::size_t size() const { return map_.size(); }
+  std::size_t sparse_size() const { return map_.sparse_size(); }
+  MemoryUsage memory_usage() const { return map_.memory_usage(); }
+
+private:
+  Id stride_;
+  Id residue_;
+  DenseIdMap<Id, T> map_;
+};
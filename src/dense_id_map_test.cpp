@@ -0,0 +1,168 @@
+#include "dense_id_map.hpp"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+
+namespace {
+
+TEST(DenseIdMapTest, Smoke) {
+  DenseIdMap<unsigned, std::string> map;
+  EXPECT_EQ(map.find(0), nullptr);
+
+  ASSERT_NE(map.insert(3, "three"), nullptr);
+  ASSERT_NE(map.insert(0, "zero"), nullptr);
+  EXPECT_EQ(map.insert(3, "again"), nullptr);
+  ASSERT_NE(map.insert(0xffffffffu, "max"), nullptr);
+
+  EXPECT_EQ(map.size(), 3u);
+  EXPECT_EQ(map.sparse_size(), 1u);
+  EXPECT_EQ(*map.find(3), "three");
+  EXPECT_EQ(*map.find(0), "zero");
+  EXPECT_EQ(*map.find(0xffffffffu), "max");
+  EXPECT_FALSE(map.contains(1));
+  EXPECT_FALSE(map.contains(5000));
+  EXPECT_EQ(map.insert(0xffffffffu, "again"), nullptr);
+}
+
+TEST(DenseIdMapTest, Erase) {
+  DenseIdMap<unsigned, std::string> map;
+  ASSERT_NE(map.insert(3, "three"), nullptr);
+  ASSERT_NE(map.insert(0xffffffffu, "max"), nullptr);
+
+  EXPECT_TRUE(map.erase(3));
+  EXPECT_FALSE(map.erase(3));
+  EXPECT_FALSE(map.erase(4));
+  EXPECT_FALSE(map.erase(5000));
+  EXPECT_TRUE(map.erase(0xffffffffu));
+  EXPECT_EQ(map.size(), 0u);
+  EXPECT_EQ(map.sparse_size(), 0u);
+  EXPECT_FALSE(map.contains(3));
+  EXPECT_FALSE(map.contains(0xffffffffu));
+
+  ASSERT_NE(map.insert(3, "again"), nullptr);
+  EXPECT_EQ(*map.find(3), "again");
+  EXPECT_EQ(map.size(), 1u);
+}
+
+// One of 8 partitions of dense ids, split by `id % 8`, stays dense.
+//
+TEST(StridedIdMapTest, PartitionStaysDense) {
+  constexpr unsigned kStride = 8;
+  StridedIdMap<unsigned, unsigned> map{kStride, /*residue=*/3};
+  for (unsigned id = 3; id < 100 * 1000; id += kStride) {
+    ASSERT_NE(map.insert(id, id), nullptr);
+  }
+  EXPECT_EQ(map.size(), 12500u);
+  EXPECT_EQ(map.sparse_size(), 0u);
+  EXPECT_EQ(*map.find(8003), 8003u);
+  EXPECT_FALSE(map.contains(8004));
+  EXPECT_FALSE(map.erase(8004));
+  EXPECT_TRUE(map.erase(8003));
+  EXPECT_FALSE(map.contains(8003));
+
+  map.clear();
+  EXPECT_EQ(map.size(), 0u);
+  ASSERT_NE(map.insert(11, 11), nullptr);
+  EXPECT_FALSE(map.contains(1));
+}
+
+TEST(DenseIdMapTest, OutliersMoveIntoDenseRange) {
+  DenseIdMap<unsigned, unsigned> map;
+
+  // Ids far beyond the dense range go to the hash table at first...
+  //
+  constexpr unsigned kCount = 100000;
+  std::vector<unsigned> ids(kCount);
+  std::iota(ids.rbegin(), ids.rend(), 0);
+  ASSERT_NE(map.insert(ids[0], ids[0]), nullptr);
+  EXPECT_EQ(map.sparse_size(), 1u);
+
+  // ...but once enough ids have been inserted that a dense vector covering
+  // them is within the space bound, they are all stored densely.
+  //
+  std::shuffle(ids.begin() + 1, ids.end(), std::default_random_engine{1});
+  for (unsigned i = 1; i < kCount; ++i) {
+    ASSERT_NE(map.insert(ids[i], ids[i]), nullptr);
+  }
+  EXPECT_EQ(map.size(), kCount);
+  EXPECT_EQ(map.sparse_size(), 0u);
+  for (unsigned id = 0; id < kCount; ++id) {
+    ASSERT_NE(map.find(id), nullptr);
+    EXPECT_EQ(*map.find(id), id);
+  }
+}
+
+TEST(DenseIdMapTest, RandomVsUnorderedMap) {
+  std::default_random_engine rng{/*seed=*/1};
+
+  // Dense, mostly dense with outliers, and fully sparse id distributions.
+  //
+  for (unsigned range : {20000u, 40000u, 0xffffffffu}) {
+    std::uniform_int_distribution<unsigned> pick_id(0, range);
+
+    DenseIdMap<unsigned, unsigned> actual;
+    std::unordered_map<unsigned, unsigned> expected;
+    for (unsigned i = 0; i < 20000; ++i) {
+      const unsigned id =
+          i % 10 == 0 ? pick_id(rng) | (1u << 31) : pick_id(rng);
+      const bool inserted = expected.emplace(id, i).second;
+      ASSERT_EQ(actual.insert(id, unsigned(i)) != nullptr, inserted);
+    }
+    EXPECT_EQ(actual.size(), expected.size());
+    for (const auto & [ id, value ] : expected) {
+      ASSERT_NE(actual.find(id), nullptr);
+      EXPECT_EQ(*actual.find(id), value);
+    }
+    for (int i = 0; i < 20000; ++i) {
+      const unsigned id = pick_id(rng);
+      EXPECT_EQ(actual.contains(id), expected.count(id) == 1);
+    }
+  }
+}
+
+// Checks point lookups, including of absent ids, against the hash map
+// previously used as the primary key store, with record-like values.
+// (BM_IdMapInsert and BM_IdMapFind in qb_record_collection_benchmark.cpp
+// compare their cost.)
+//
+TEST(DenseIdMapTest, MatchesUnorderedMap) {
+  using Record = std::tuple<std::string, long, std::string>;
+
+  constexpr unsigned kCount = 10 * 1000;
+  constexpr unsigned kLookups = 100 * 1000;
+
+  std::default_random_engine rng{/*seed=*/1};
+  std::vector<unsigned> ids(kCount);
+  std::iota(ids.begin(), ids.end(), 0);
+  std::shuffle(ids.begin(), ids.end(), rng);
+
+  std::unordered_map<unsigned, const Record> hash_map;
+  DenseIdMap<unsigned, Record> dense_map;
+  for (unsigned id : ids) {
+    hash_map.emplace(id, Record{"", long(id), ""});
+    dense_map.insert(id, Record{"", long(id), ""});
+  }
+
+  std::uniform_int_distribution<unsigned> pick_id(0, kCount + kCount / 10);
+  long hash_sum = 0, dense_sum = 0;
+  for (unsigned n = 0; n < kLookups; ++n) {
+    const unsigned probe = pick_id(rng);
+    const auto iter = hash_map.find(probe);
+    if (iter != hash_map.end()) {
+      hash_sum += std::get<1>(iter->second);
+    }
+    if (const Record *record = dense_map.find(probe)) {
+      dense_sum += std::get<1>(*record);
+    }
+  }
+  EXPECT_EQ(hash_sum, dense_sum);
+}
+
+} // namespace
@@ -0,0 +1,51 @@
+// Helpers for writing files durably, shared by the snapshot writer and the
+// write-ahead log.
+//
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// Writes all `size` bytes at `data` to the file descriptor `fd`, retrying
+// partial and interrupted writes.  Returns false, with `errno` set, on
+// failure.
+//
+inline bool write_fully(int fd, const void *data, std::size_t size) {
+  const char *p = static_cast<const char *>(data);
+  while (size > 0) {
+    const ssize_t n = ::write(fd, p, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+// Syncs the directory containing `path`, so that a file newly created in it,
+// or renamed into it, survives a crash.  Returns false, with `errno` set, on
+// failure.
+//
+inline bool sync_parent_directory(const std::string &path) {
+  const std::size_t slash = path.rfind('/');
+  const std::string dir = slash == std::string::npos ? "."
+                          : slash == 0              ? "/"
+                                                    : path.substr(0, slash);
+  const int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+  if (fd < 0) {
+    return false;
+  }
+  const bool synced = ::fsync(fd) == 0;
+  const int saved_errno = errno;
+  ::close(fd);
+  errno = saved_errno;
+  return synced;
+}
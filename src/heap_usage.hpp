@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+
+#if defined(__linux__)
+#include <malloc.h>
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#endif
+
+// `mallinfo2` is new in glibc 2.33; older versions only have `mallinfo`,
+// whose `int` fields wrap past 2GB.
+//
+#if defined(__GLIBC__) && defined(__GLIBC_PREREQ)
+#if __GLIBC_PREREQ(2, 33)
+#define QB_HAVE_MALLINFO2 1
+#endif
+#endif
+
+// Returns the number of bytes currently allocated from the process heap, or 0
+// if this is not supported on the current platform.  Intended for measuring
+// the footprint of a data structure by sampling before and after building it.
+//
+inline std::size_t heap_bytes_in_use() {
+#if defined(QB_HAVE_MALLINFO2)
+  const struct mallinfo2 info = mallinfo2();
+  return info.uordblks + info.hblkhd;
+#elif defined(__GLIBC__)
+  const struct mallinfo info = mallinfo();
+  return std::size_t(unsigned(info.uordblks)) + unsigned(info.hblkhd);
+#elif defined(__APPLE__)
+  malloc_statistics_t stats;
+  malloc_zone_statistics(nullptr, &stats);
+  return stats.size_in_use;
+#else
+  return 0;
+#endif
+}
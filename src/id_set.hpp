@@ -0,0 +1,374 @@
+// Implementation of IdSet, a compressed set of unsigned integer row ids.
+//
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "visitor.hpp"
+
+//------------------------------------------------------------------------------
+
+// Set of unsigned integer ids (of at most 32 bits), used to collect and
+// deduplicate query results.
+//
+// The representation is modeled on Roaring bitmaps (Chambi, Lemire, Kaser and
+// Godin, "Better bitmap performance with Roaring bitmaps", 2016): ids are
+// partitioned by their high 16 bits into containers, kept sorted by key.  Each
+// container stores the low 16 bits of its ids either as a sorted array (while
+// it holds at most `kMaxArraySize` ids) or as a 2^16-bit bitmap.  Sparse sets
+// thus cost about 2 bytes per id, dense sets about 1 bit per id, and
+// insertion, membership testing and ordered iteration are all cheap.
+//
+template <typename Id> class IdSet {
+  static_assert(std::is_unsigned_v<Id> && sizeof(Id) <= sizeof(std::uint32_t),
+                "IdSet supports unsigned ids of up to 32 bits");
+
+public:
+  // Array containers are converted to bitmaps when they grow past this size;
+  // at this point both representations use 8KB.
+  //
+  static constexpr std::size_t kMaxArraySize = 4096;
+
+  // Inserts `id`, returning true iff it was not already present.
+  //
+  bool insert(Id id) {
+    Container &container = find_or_create_container(high_bits(id));
+    const std::uint16_t low = low_bits(id);
+
+    if (container.bitmap) {
+      std::uint64_t &word = (*container.bitmap)[low / 64];
+      const std::uint64_t mask = std::uint64_t{1} << (low % 64);
+      if (word & mask) {
+        return false;
+      }
+      word |= mask;
+    } else {
+      auto pos =
+          std::lower_bound(container.array.begin(), container.array.end(), low);
+      if (pos != container.array.end() && *pos == low) {
+        return false;
+      }
+      container.array.insert(pos, low);
+      if (container.array.size() > kMaxArraySize) {
+        convert_to_bitmap(container);
+      }
+    }
+    ++container.cardinality;
+    ++size_;
+    return true;
+  }
+
+  // Returns true iff `id` is in the set.
+  //
+  bool contains(Id id) const {
+    const Container *container = find_container(high_bits(id));
+    if (!container) {
+      return false;
+    }
+    const std::uint16_t low = low_bits(id);
+    if (container->bitmap) {
+      return ((*container->bitmap)[low / 64] >> (low % 64)) & 1;
+    }
+    return std::binary_search(container->array.begin(), container->array.end(),
+                              low);
+  }
+
+  // Returns the number of ids in the set.
+  //
+  std::size_t size() const { return size_; }
+
+  // Returns true iff the set is empty.
+  //
+  bool empty() const { return size_ == 0; }
+
+  // Removes all ids from the set.
+  //
+  void clear() {
+    containers_.clear();
+    size_ = 0;
+    last_ = 0;
+  }
+
+  // Removes all ids that are not also in `other`.
+  //
+  // Complexity: O(size() + other.size()), or less where containers are
+  // bitmaps or have no counterpart in the other set.
+  //
+  void intersect_with(const IdSet &other) {
+    std::vector<Container> result;
+    size_ = 0;
+    auto theirs = other.containers_.begin();
+    for (Container &mine : containers_) {
+      while (theirs != other.containers_.end() && theirs->key < mine.key) {
+        ++theirs;
+      }
+      if (theirs == other.containers_.end()) {
+        break;
+      }
+      if (theirs->key != mine.key) {
+        continue;
+      }
+      intersect_container(mine, *theirs);
+      if (mine.cardinality != 0) {
+        size_ += mine.cardinality;
+        result.emplace_back(std::move(mine));
+      }
+    }
+    containers_ = std::move(result);
+    last_ = 0;
+  }
+
+  // Adds all ids in `other`.
+  //
+  // Complexity: O(size() + other.size())
+  //
+  void union_with(const IdSet &other) {
+    std::vector<Container> result;
+    result.reserve(std::max(containers_.size(), other.containers_.size()));
+    size_ = 0;
+    auto mine = containers_.begin();
+    auto theirs = other.containers_.begin();
+    while (mine != containers_.end() || theirs != other.containers_.end()) {
+      if (theirs == other.containers_.end() ||
+          (mine != containers_.end() && mine->key < theirs->key)) {
+        result.emplace_back(std::move(*mine++));
+      } else if (mine == containers_.end() || theirs->key < mine->key) {
+        result.emplace_back(copy_container(*theirs++));
+      } else {
+        union_container(*mine, *theirs++);
+        result.emplace_back(std::move(*mine++));
+      }
+      size_ += result.back().cardinality;
+    }
+    containers_ = std::move(result);
+    last_ = 0;
+  }
+
+  // Invokes the visitor `fn` (see visitor.hpp) on each id in the set, in
+  // ascending order.  Returns false iff `fn` stopped the iteration early.
+  //
+  template <typename Fn /* void(Id) */> bool for_each(Fn &&fn) const {
+    for (const Container &container : containers_) {
+      const std::uint32_t base = std::uint32_t(container.key) << 16;
+      if (container.bitmap) {
+        for (int i = 0; i < int(container.bitmap->size()); ++i) {
+          std::uint64_t word = (*container.bitmap)[i];
+          while (word != 0) {
+            const int bit = __builtin_ctzll(word);
+            if (!invoke_visitor(fn, Id(base | (i * 64 + bit)))) {
+              return false;
+            }
+            word &= word - 1;
+          }
+        }
+      } else {
+        for (std::uint16_t low : container.array) {
+          if (!invoke_visitor(fn, Id(base | low))) {
+            return false;
+          }
+        }
+      }
+    }
+    return true;
+  }
+
+private:
+  using Bitmap = std::array<std::uint64_t, (1 << 16) / 64>;
+
+  struct Container {
+    // The high 16 bits shared by all ids in this container.
+    //
+    std::uint16_t key;
+
+    // The number of ids in this container.
+    //
+    std::uint32_t cardinality = 0;
+
+    // The sorted low 16 bits of each id, if `bitmap` is null.
+    //
+    std::vector<std::uint16_t> array;
+
+    // The low 16 bits of each id as a bitmap, for dense containers.
+    //
+    std::unique_ptr<Bitmap> bitmap;
+  };
+
+  static std::uint16_t high_bits(Id id) {
+    return std::uint16_t(std::uint32_t(id) >> 16);
+  }
+
+  static std::uint16_t low_bits(Id id) { return std::uint16_t(id & 0xffff); }
+
+  static void convert_to_bitmap(Container &container) {
+    container.bitmap = std::make_unique<Bitmap>();
+    container.bitmap->fill(0);
+    for (std::uint16_t low : container.array) {
+      (*container.bitmap)[low / 64] |= std::uint64_t{1} << (low % 64);
+    }
+    container.array.clear();
+    container.array.shrink_to_fit();
+  }
+
+  static void convert_to_array(Container &container) {
+    container.array.clear();
+    container.array.reserve(container.cardinality);
+    for (int i = 0; i < int(container.bitmap->size()); ++i) {
+      std::uint64_t word = (*container.bitmap)[i];
+      while (word != 0) {
+        container.array.emplace_back(
+            std::uint16_t(i * 64 + __builtin_ctzll(word)));
+        word &= word - 1;
+      }
+    }
+    container.bitmap.reset();
+  }
+
+  static bool bitmap_contains(const Bitmap &bitmap, std::uint16_t low) {
+    return (bitmap[low / 64] >> (low % 64)) & 1;
+  }
+
+  static Container copy_container(const Container &container) {
+    Container copy;
+    copy.key = container.key;
+    copy.cardinality = container.cardinality;
+    copy.array = container.array;
+    if (container.bitmap) {
+      copy.bitmap = std::make_unique<Bitmap>(*container.bitmap);
+    }
+    return copy;
+  }
+
+  // Sets `mine` to its intersection with `theirs`, which has the same key.
+  //
+  static void intersect_container(Container &mine, const Container &theirs) {
+    if (mine.bitmap && theirs.bitmap) {
+      std::uint32_t cardinality = 0;
+      for (std::size_t i = 0; i < mine.bitmap->size(); ++i) {
+        (*mine.bitmap)[i] &= (*theirs.bitmap)[i];
+        cardinality += __builtin_popcountll((*mine.bitmap)[i]);
+      }
+      mine.cardinality = cardinality;
+      if (cardinality <= kMaxArraySize) {
+        convert_to_array(mine);
+      }
+      return;
+    }
+    if (mine.bitmap) {
+      // Keep the ids of `theirs` (an array) that are in `mine`.
+      //
+      std::vector<std::uint16_t> array;
+      for (std::uint16_t low : theirs.array) {
+        if (bitmap_contains(*mine.bitmap, low)) {
+          array.emplace_back(low);
+        }
+      }
+      mine.bitmap.reset();
+      mine.array = std::move(array);
+    } else if (theirs.bitmap) {
+      mine.array.erase(std::remove_if(mine.array.begin(), mine.array.end(),
+                                      [&](std::uint16_t low) {
+                                        return !bitmap_contains(*theirs.bitmap,
+                                                                low);
+                                      }),
+                       mine.array.end());
+    } else {
+      std::vector<std::uint16_t> array;
+      std::set_intersection(mine.array.begin(), mine.array.end(),
+                            theirs.array.begin(), theirs.array.end(),
+                            std::back_inserter(array));
+      mine.array = std::move(array);
+    }
+    mine.cardinality = mine.array.size();
+  }
+
+  // Sets `mine` to its union with `theirs`, which has the same key.
+  //
+  static void union_container(Container &mine, const Container &theirs) {
+    if (!mine.bitmap && !theirs.bitmap) {
+      std::vector<std::uint16_t> array;
+      array.reserve(mine.array.size() + theirs.array.size());
+      std::set_union(mine.array.begin(), mine.array.end(),
+                     theirs.array.begin(), theirs.array.end(),
+                     std::back_inserter(array));
+      mine.array = std::move(array);
+      mine.cardinality = mine.array.size();
+      if (mine.array.size() > kMaxArraySize) {
+        convert_to_bitmap(mine);
+      }
+      return;
+    }
+    if (!mine.bitmap) {
+      convert_to_bitmap(mine);
+    }
+    if (theirs.bitmap) {
+      for (std::size_t i = 0; i < mine.bitmap->size(); ++i) {
+        (*mine.bitmap)[i] |= (*theirs.bitmap)[i];
+      }
+    } else {
+      for (std::uint16_t low : theirs.array) {
+        (*mine.bitmap)[low / 64] |= std::uint64_t{1} << (low % 64);
+      }
+    }
+    std::uint32_t cardinality = 0;
+    for (std::uint64_t word : *mine.bitmap) {
+      cardinality += __builtin_popcountll(word);
+    }
+    mine.cardinality = cardinality;
+  }
+
+  const Container *find_container(std::uint16_t key) const {
+    const auto pos = lower_bound(key);
+    if (pos == containers_.end() || pos->key != key) {
+      return nullptr;
+    }
+    return &*pos;
+  }
+
+  Container &find_or_create_container(std::uint16_t key) {
+    // Results tend to arrive clustered by id, so check the most recently used
+    // container first.
+    //
+    if (last_ < containers_.size() && containers_[last_].key == key) {
+      return containers_[last_];
+    }
+    auto pos = lower_bound(key);
+    if (pos == containers_.end() || pos->key != key) {
+      pos = containers_.emplace(pos);
+      pos->key = key;
+    }
+    last_ = pos - containers_.begin();
+    return *pos;
+  }
+
+  auto lower_bound(std::uint16_t key) const {
+    return std::lower_bound(
+        containers_.begin(), containers_.end(), key,
+        [](const Container &c, std::uint16_t k) { return c.key < k; });
+  }
+
+  auto lower_bound(std::uint16_t key) {
+    return std::lower_bound(
+        containers_.begin(), containers_.end(), key,
+        [](const Container &c, std::uint16_t k) { return c.key < k; });
+  }
+
+  // All non-empty containers, sorted by key.
+  //
+  std::vector<Container> containers_;
+
+  // The total number of ids in the set.
+  //
+  std::size_t size_ = 0;
+
+  // Index of the most recently inserted-to container.
+  //
+  std::size_t last_ = 0;
+};
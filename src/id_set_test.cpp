@@ -0,0 +1,126 @@
+#include "id_set.hpp"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <set>
+
+namespace {
+
+template <typename Id> std::vector<Id> to_vector(const IdSet<Id> &ids) {
+  std::vector<Id> result;
+  ids.for_each([&](Id id) { result.emplace_back(id); });
+  return result;
+}
+
+TEST(IdSetTest, Smoke) {
+  IdSet<unsigned> ids;
+  EXPECT_TRUE(ids.empty());
+  EXPECT_THAT(to_vector(ids), ::testing::IsEmpty());
+
+  EXPECT_TRUE(ids.insert(70000));
+  EXPECT_TRUE(ids.insert(5));
+  EXPECT_FALSE(ids.insert(5));
+  EXPECT_TRUE(ids.insert(0xffffffffu));
+  EXPECT_TRUE(ids.insert(0));
+
+  EXPECT_EQ(ids.size(), 4u);
+  EXPECT_TRUE(ids.contains(5));
+  EXPECT_TRUE(ids.contains(70000));
+  EXPECT_FALSE(ids.contains(6));
+  EXPECT_FALSE(ids.contains(70001));
+  EXPECT_FALSE(ids.contains(1 << 20));
+  EXPECT_THAT(to_vector(ids),
+              ::testing::ElementsAre(0, 5, 70000, 0xffffffffu));
+
+  ids.clear();
+  EXPECT_TRUE(ids.empty());
+  EXPECT_FALSE(ids.contains(5));
+}
+
+TEST(IdSetTest, RandomVsStdSet) {
+  std::default_random_engine rng{/*seed=*/1};
+
+  // Mix of sparse and dense ranges, so that both array and bitmap containers
+  // are exercised.
+  //
+  for (unsigned range : {1000u, 20000u, 300000u, 0xffffffffu}) {
+    std::uniform_int_distribution<unsigned> pick_id(0, range);
+
+    IdSet<unsigned> actual;
+    std::set<unsigned> expected;
+    for (int i = 0; i < 50000; ++i) {
+      const unsigned id = pick_id(rng);
+      ASSERT_EQ(actual.insert(id), expected.insert(id).second);
+    }
+
+    EXPECT_EQ(actual.size(), expected.size());
+    EXPECT_EQ(to_vector(actual),
+              std::vector<unsigned>(expected.begin(), expected.end()));
+    for (int i = 0; i < 1000; ++i) {
+      const unsigned id = pick_id(rng);
+      EXPECT_EQ(actual.contains(id), expected.count(id) == 1);
+    }
+  }
+}
+
+TEST(IdSetTest, IntersectAndUnionVsStdSet) {
+  std::default_random_engine rng{/*seed=*/1};
+
+  // Pairs of sets of differing densities, so that every combination of array
+  // and bitmap containers is exercised.
+  //
+  for (unsigned range_a : {20000u, 300000u}) {
+    for (unsigned range_b : {20000u, 300000u, 0xffffffffu}) {
+      for (int count_b : {100, 50000}) {
+        std::uniform_int_distribution<unsigned> pick_a(0, range_a);
+        std::uniform_int_distribution<unsigned> pick_b(0, range_b);
+
+        IdSet<unsigned> a, b;
+        std::set<unsigned> expected_a, expected_b;
+        for (int i = 0; i < 50000; ++i) {
+          const unsigned id = pick_a(rng);
+          a.insert(id);
+          expected_a.insert(id);
+        }
+        for (int i = 0; i < count_b; ++i) {
+          const unsigned id = pick_b(rng);
+          b.insert(id);
+          expected_b.insert(id);
+        }
+
+        std::vector<unsigned> expected_and, expected_or;
+        std::set_intersection(expected_a.begin(), expected_a.end(),
+                              expected_b.begin(), expected_b.end(),
+                              std::back_inserter(expected_and));
+        std::set_union(expected_a.begin(), expected_a.end(),
+                       expected_b.begin(), expected_b.end(),
+                       std::back_inserter(expected_or));
+
+        IdSet<unsigned> actual_and, actual_or;
+        actual_and.union_with(a);
+        actual_and.intersect_with(b);
+        actual_or.union_with(b);
+        actual_or.union_with(a);
+
+        EXPECT_EQ(actual_and.size(), expected_and.size());
+        EXPECT_EQ(to_vector(actual_and), expected_and);
+        EXPECT_EQ(actual_or.size(), expected_or.size());
+        EXPECT_EQ(to_vector(actual_or), expected_or);
+
+        // The results remain usable as ordinary sets.
+        //
+        EXPECT_EQ(actual_and.insert(7), !std::binary_search(
+                                            expected_and.begin(),
+                                            expected_and.end(), 7u));
+        EXPECT_TRUE(actual_and.contains(7));
+        EXPECT_EQ(to_vector(a).size(), expected_a.size());
+      }
+    }
+  }
+}
+
+} // namespace
@@ -0,0 +1,136 @@
+// MemoryUsage, a report of the heap memory used by a data structure, and
+// CountingAllocator, which measures it for node-based standard containers.
+//
+// Each index and store reports its own usage through a `memory_usage()`
+// member, so that different index types can be compared on the same data
+// (see `QBRecordCollection::memory_usage`).  Contiguous containers are
+// measured by their capacity, which is exactly what they allocate; containers
+// that allocate a node per element (`std::unordered_map`) can't be measured
+// that way, so they allocate through a `CountingAllocator` instead.
+//
+// Sizes are of the memory requested from the allocator; the heap's own
+// overhead and fragmentation are not included.
+//
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+//------------------------------------------------------------------------------
+
+// The heap memory used by a data structure, and statistics on its shape that
+// explain it.  Statistics that don't apply to a structure are 0.
+//
+struct MemoryUsage {
+  // Bytes allocated, including spare capacity.
+  //
+  std::size_t bytes = 0;
+
+  // The number of entries stored: rows of a record store, (key, id) entries
+  // of an index, or, for a suffix index, ids stored for suffixes.
+  //
+  std::size_t num_entries = 0;
+
+  // For tries, the number of nodes, and of nodes with at least one child.
+  //
+  std::size_t num_nodes = 0;
+  std::size_t num_inner_nodes = 0;
+
+  // For string indices, the total length of the indexed values.
+  //
+  std::size_t indexed_chars = 0;
+
+  // Returns the average number of children of the inner nodes of a trie.
+  //
+  double average_fanout() const {
+    return num_inner_nodes == 0 ? 0.0
+                                : double(num_nodes - 1) / num_inner_nodes;
+  }
+
+  // Returns the bytes used per character indexed by a string index.
+  //
+  double bytes_per_indexed_char() const {
+    return indexed_chars == 0 ? 0.0 : double(bytes) / indexed_chars;
+  }
+
+  MemoryUsage &operator+=(const MemoryUsage &other) {
+    bytes += other.bytes;
+    num_entries += other.num_entries;
+    num_nodes += other.num_nodes;
+    num_inner_nodes += other.num_inner_nodes;
+    indexed_chars += other.indexed_chars;
+    return *this;
+  }
+};
+
+// Returns the bytes allocated by `v`.
+//
+template <typename T, typename Alloc>
+std::size_t heap_bytes(const std::vector<T, Alloc> &v) {
+  return v.capacity() * sizeof(T);
+}
+
+// Returns the bytes allocated by `s`; none if it fits in the string object
+// itself.
+//
+inline std::size_t heap_bytes(const std::string &s) {
+  return s.capacity() > std::string{}.capacity() ? s.capacity() + 1 : 0;
+}
+
+//------------------------------------------------------------------------------
+
+// Standard allocator that keeps count of the bytes it has allocated and not
+// yet freed.  Copies of an allocator (including the rebound copies a
+// container makes for its nodes) share the count, except that copying a
+// container starts a new count for the copy.
+//
+template <typename T> class CountingAllocator {
+public:
+  using value_type = T;
+  using propagate_on_container_copy_assignment = std::true_type;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+
+  CountingAllocator() : bytes_{std::make_shared<std::size_t>(0)} {}
+
+  template <typename U>
+  CountingAllocator(const CountingAllocator<U> &other) : bytes_{other.bytes_} {}
+
+  T *allocate(std::size_t n) {
+    T *p = std::allocator<T>{}.allocate(n);
+    *bytes_ += n * sizeof(T);
+    return p;
+  }
+
+  void deallocate(T *p, std::size_t n) {
+    *bytes_ -= n * sizeof(T);
+    std::allocator<T>{}.deallocate(p, n);
+  }
+
+  CountingAllocator select_on_container_copy_construction() const {
+    return CountingAllocator{};
+  }
+
+  // Returns the bytes allocated and not yet freed by this allocator and the
+  // copies sharing its count.
+  //
+  std::size_t bytes_allocated() const { return *bytes_; }
+
+  template <typename U>
+  bool operator==(const CountingAllocator<U> &other) const {
+    return bytes_ == other.bytes_;
+  }
+
+  template <typename U>
+  bool operator!=(const CountingAllocator<U> &other) const {
+    return !(*this == other);
+  }
+
+private:
+  template <typename U> friend class CountingAllocator;
+
+  std::shared_ptr<std::size_t> bytes_;
+};
@@ -0,0 +1,177 @@
+// Helpers for running independent tasks on a pool of threads.
+//
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Returns the default number of threads for parallel work: the number of
+// hardware threads, or 1 if that is unknown.
+//
+inline unsigned default_thread_count() {
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Runs all of `tasks` to completion on a pool of up to `num_threads` threads
+// (including the calling thread), each thread taking the next task not yet
+// started until there are none left.  If any task throws, the remaining
+// tasks are not started, and the first exception is rethrown once the
+// running tasks have finished.
+//
+inline void run_tasks(const std::vector<std::function<void()>> &tasks,
+                      unsigned num_threads) {
+  std::atomic<std::size_t> next{0};
+  std::exception_ptr error;
+  std::mutex error_mutex;
+
+  const auto work = [&] {
+    for (std::size_t i = next++; i < tasks.size(); i = next++) {
+      try {
+        tasks[i]();
+      } catch (...) {
+        std::lock_guard<std::mutex> lock{error_mutex};
+        if (!error) {
+          error = std::current_exception();
+        }
+        next = tasks.size();
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  const std::size_t num_workers =
+      std::min<std::size_t>(std::max(num_threads, 1u), tasks.size());
+  for (std::size_t i = 1; i < num_workers; ++i) {
+    threads.emplace_back(work);
+  }
+  work();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+// A fixed set of worker threads that run batches of tasks, for work that is
+// fanned out repeatedly (e.g. per query) and too short to pay for starting
+// threads each time.
+//
+// Any number of threads may call `run` at once; their tasks share the
+// workers, in the order submitted.
+//
+class ThreadPool {
+public:
+  // Creates a pool of `num_threads - 1` workers; the thread calling `run` is
+  // the last one.
+  //
+  explicit ThreadPool(unsigned num_threads) {
+    for (unsigned i = 1; i < num_threads; ++i) {
+      workers_.emplace_back([this] {
+        std::unique_lock<std::mutex> lock{mutex_};
+        for (;;) {
+          work_ready_.wait(lock, [&] { return stopping_ || !queue_.empty(); });
+          if (queue_.empty()) {
+            return;
+          }
+          run_one(lock);
+        }
+      });
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  ~ThreadPool() noexcept {
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      stopping_ = true;
+    }
+    work_ready_.notify_all();
+    for (std::thread &worker : workers_) {
+      worker.join();
+    }
+  }
+
+  // Returns the number of threads that run tasks, including the caller.
+  //
+  unsigned size() const { return unsigned(workers_.size()) + 1; }
+
+  // Runs all of `tasks` to completion, on the workers and the calling thread.
+  // If any task throws, the first exception is rethrown once the other tasks
+  // have finished.
+  //
+  void run(const std::vector<std::function<void()>> &tasks) {
+    Batch batch;
+    batch.remaining = tasks.size();
+
+    std::unique_lock<std::mutex> lock{mutex_};
+    for (const std::function<void()> &task : tasks) {
+      queue_.emplace_back(&task, &batch);
+    }
+    work_ready_.notify_all();
+
+    // Help out until the batch is done, then wait for the stragglers.
+    //
+    while (batch.remaining != 0 && !queue_.empty()) {
+      run_one(lock);
+    }
+    batch_done_.wait(lock, [&] { return batch.remaining == 0; });
+
+    if (batch.error) {
+      std::rethrow_exception(batch.error);
+    }
+  }
+
+private:
+  struct Batch {
+    std::size_t remaining = 0;
+    std::exception_ptr error;
+  };
+
+  // Runs the task at the front of the queue, with `mutex_` (held by `lock`)
+  // released.
+  //
+  void run_one(std::unique_lock<std::mutex> &lock) {
+    const auto [task, batch] = queue_.front();
+    queue_.pop_front();
+
+    lock.unlock();
+    std::exception_ptr error;
+    try {
+      (*task)();
+    } catch (...) {
+      error = std::current_exception();
+    }
+    lock.lock();
+
+    if (error && !batch->error) {
+      batch->error = error;
+    }
+    if (--batch->remaining == 0) {
+      batch_done_.notify_all();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable work_ready_;
+  std::condition_variable batch_done_;
+
+  // Tasks not yet started, with the batch each belongs to.
+  //
+  std::deque<std::pair<const std::function<void()> *, Batch *>> queue_;
+  bool stopping_ = false;
+
+  std::vector<std::thread> workers_;
+};
@@ -0,0 +1,89 @@
+#include "parallel.hpp"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Returns `count` tasks that each add their index to `sum`.
+//
+std::vector<std::function<void()>> summing_tasks(int count,
+                                                 std::atomic<long> &sum) {
+  std::vector<std::function<void()>> tasks;
+  for (int i = 0; i < count; ++i) {
+    tasks.emplace_back([&sum, i] { sum += i; });
+  }
+  return tasks;
+}
+
+TEST(RunTasksTest, RunsEveryTask) {
+  for (const unsigned num_threads : {0, 1, 3, 16}) {
+    std::atomic<long> sum{0};
+    run_tasks(summing_tasks(100, sum), num_threads);
+    EXPECT_EQ(sum, 4950) << num_threads;
+  }
+  run_tasks({}, 4);
+}
+
+TEST(RunTasksTest, RethrowsFirstError) {
+  std::vector<std::function<void()>> tasks = {
+      [] {}, [] { throw std::runtime_error{"task failed"}; }, [] {}};
+  EXPECT_THROW(run_tasks(tasks, 2), std::runtime_error);
+}
+
+TEST(ThreadPoolTest, RunsEveryTask) {
+  for (const unsigned num_threads : {1, 2, 5}) {
+    ThreadPool pool{num_threads};
+    EXPECT_EQ(pool.size(), num_threads);
+    for (int round = 0; round < 10; ++round) {
+      std::atomic<long> sum{0};
+      pool.run(summing_tasks(100, sum));
+      EXPECT_EQ(sum, 4950);
+    }
+    pool.run({});
+  }
+}
+
+TEST(ThreadPoolTest, ConcurrentCallers) {
+  ThreadPool pool{3};
+  std::vector<std::thread> callers;
+  std::atomic<int> failures{0};
+  for (int i = 0; i < 4; ++i) {
+    callers.emplace_back([&] {
+      for (int round = 0; round < 50; ++round) {
+        std::atomic<long> sum{0};
+        pool.run(summing_tasks(20, sum));
+        if (sum != 190) {
+          ++failures;
+        }
+      }
+    });
+  }
+  for (std::thread &caller : callers) {
+    caller.join();
+  }
+  EXPECT_EQ(failures, 0);
+}
+
+TEST(ThreadPoolTest, RethrowsError) {
+  ThreadPool pool{2};
+  std::atomic<long> sum{0};
+  std::vector<std::function<void()>> tasks = summing_tasks(10, sum);
+  tasks.emplace_back([] { throw std::runtime_error{"task failed"}; });
+  EXPECT_THROW(pool.run(tasks), std::runtime_error);
+  EXPECT_EQ(sum, 45);
+
+  // The pool is still usable.
+  //
+  sum = 0;
+  pool.run(summing_tasks(10, sum));
+  EXPECT_EQ(sum, 45);
+}
+
+} // namespace
@@ -4,16 +4,38 @@
 #pragma once
 
 #include <algorithm>
+#include <functional>
+#include <memory>
 #include <string_view>
-#include <unordered_map>
+#include <type_traits>
+#include <vector>
 
-#include <boost/lexical_cast.hpp>
+#include <boost/optional/optional.hpp>
 
+#include "id_set.hpp"
+#include "memory_usage.hpp"
+#include "parallel.hpp"
+#include "range_predicate.hpp"
+#include "sorted_column_index.hpp"
 #include "string_trie.hpp"
 #include "tuples.hpp"
+#include "visitor.hpp"
+
+// The index data structure used by default by `QBColumnLookup` for each column
+// type.
+//
+template <typename UniqueId, typename Value> struct DefaultColumnIndex;
+
+template <typename UniqueId> struct DefaultColumnIndex<UniqueId, long> {
+  using type = SortedColumnIndex<long, UniqueId>;
+};
+
+template <typename UniqueId> struct DefaultColumnIndex<UniqueId, std::string> {
+  using type = StringTrie<UniqueId>;
+};
 
 /* Lookup table type for a given column type (Value) and unique id type
- * (UniqueId).
+ * (UniqueId), backed by an index data structure of type `Index`.
  *
  * Instantiations of this template must meet the following type requirements:
  *
@@ -26,47 +48,280 @@
  * T value;
  * col.insert(id, value);
  *
- * // Invoke `emitRecord` for all row ids in the lookup table whose value
- * // matches `matchString`.
+ * // Remove that row again; it must not have been removed already.
+ * col.erase(id, value);
+ *
+ * // Add the ids of all rows in the lookup table whose value matches
+ * // `matchString` to `matches`.
  * std::string_view matchString;
- * std::function<void(UniqueId)> emitRecord;
- * col.find_matching_records(matchString, emitRecord);
+ * IdSet<Id> matches;
+ * col.find_matches(matchString, matches);
+ *
+ * // Same as `col.find_matches(matchStrings[i], matches[i])` for each `i`;
+ * // `matches` must be the same size as `matchStrings`.
+ * std::vector<std::string_view> matchStrings;
+ * std::vector<IdSet<Id>> matches;
+ * col.find_matches_batch(matchStrings, matches);
+ *
+ * // Invoke the visitor `emitRecord` (any callable; see visitor.hpp) exactly
+ * // once for each row id in the lookup table whose value matches
+ * // `matchString`, in index order, until it returns `VisitResult::kStop`.
+ * // Returns false iff the iteration was stopped.
+ * auto emitRecord = [](Id id) { ...; return VisitResult::kContinue; };
+ * bool finished = col.for_each_match(matchString, emitRecord);
+ *
+ * // Return the number of distinct row ids whose value matches `matchString`,
+ * // and whether there are any.
+ * std::size_t count = col.count_matches(matchString);
+ * bool found = col.any_match(matchString);
+ *
+ * // Estimate `count_matches(matchString)` without finding the matches, for
+ * // query planning; boost::none if the index can't.
+ * boost::optional<std::size_t> estimate = col.estimate_matches(matchString);
+ *
+ * // Same as `col.estimate_matches(matchStrings[i])` for each `i`.
+ * std::vector<boost::optional<std::size_t>> estimates =
+ *     col.estimate_matches_batch(matchStrings);
+ *
+ * // Insert rows [begin, end) of the columns `ids` and `values` (anything
+ * // indexable by row), as if by `col.insert(ids[row], values[row])` for each
+ * // row in order, using up to `num_threads` threads.
+ * std::size_t begin, end;
+ * unsigned num_threads;
+ * col.bulk_insert(ids, values, begin, end, num_threads);
+ *
+ * // Reorganize the index for faster queries, e.g. after a bulk load.
+ * col.compact();
+ *
+ * // Return the memory used by the index (see memory_usage.hpp).
+ * MemoryUsage usage = col.memory_usage();
  * ```
  */
-template <typename UniqueId, typename Value> class QBColumnLookup;
+template <typename UniqueId, typename Value,
+          typename Index = typename DefaultColumnIndex<UniqueId, Value>::type>
+class QBColumnLookup;
 
-// Column lookup table for `long` types; requires exact match of values.  Uses
-// hash table to do lookup.
+// Column lookup table for `long` types; matches values equal to a number, or
+// within a comparison/range predicate (see `parse_range_predicate`).
 //
-template <typename UniqueId> class QBColumnLookup<UniqueId, long> {
+// `Index` may be any type with the same `insert`, `for_each_in_range`,
+// `count_in_range`, `compact` and `memory_usage` members as
+// `SortedColumnIndex<long, UniqueId>` (the default), and `erase` if rows are
+// erased.
+//
+template <typename UniqueId, typename Index>
+class QBColumnLookup<UniqueId, long, Index> {
 public:
   void insert(UniqueId rowId, long columnValue);
 
-  void for_each_match(std::string_view matchString,
-                      std::function<void(UniqueId)> emitRecord) const;
+  void erase(UniqueId rowId, long columnValue) {
+    impl_.erase(columnValue, rowId);
+  }
+
+  void find_matches(std::string_view matchString,
+                    IdSet<UniqueId> &matches) const;
+
+  void find_matches_batch(const std::vector<std::string_view> &matchStrings,
+                          std::vector<IdSet<UniqueId>> &matches) const {
+    for (std::size_t i = 0; i < matchStrings.size(); ++i) {
+      find_matches(matchStrings[i], matches[i]);
+    }
+  }
+
+  template <typename Fn /* VisitResult(UniqueId) */>
+  bool for_each_match(std::string_view matchString, Fn &&emitRecord) const;
+
+  std::size_t count_matches(std::string_view matchString) const;
+
+  bool any_match(std::string_view matchString) const;
+
+  // Entries are appended to the index, so this is a single task; `num_threads`
+  // is ignored.
+  //
+  template <typename Ids, typename Values>
+  void bulk_insert(const Ids &ids, const Values &values, std::size_t begin,
+                   std::size_t end, unsigned num_threads);
+
+  // Counting is cheap (O(log n)), so the estimate is exact.
+  //
+  boost::optional<std::size_t>
+  estimate_matches(std::string_view matchString) const {
+    return count_matches(matchString);
+  }
+
+  std::vector<boost::optional<std::size_t>> estimate_matches_batch(
+      const std::vector<std::string_view> &matchStrings) const {
+    std::vector<boost::optional<std::size_t>> estimates;
+    for (const std::string_view matchString : matchStrings) {
+      estimates.emplace_back(estimate_matches(matchString));
+    }
+    return estimates;
+  }
+
+  void compact() { impl_.compact(); }
+
+  MemoryUsage memory_usage() const { return impl_.memory_usage(); }
 
 private:
-  std::unordered_multimap<long, UniqueId> impl_;
+  Index impl_;
 };
 
 // Column lookup table for `std::string` types; supports substring matching.
-// Uses StringTrie to do efficient lookups at the cost of additional memory and
-// insertion time.
+// Uses a suffix index (StringTrie by default) to do efficient lookups at the
+// cost of additional memory and insertion time.
+//
+// `Index` may be any type with the same `insert_suffixes`,
+// `for_each_prefix_match` and `memory_usage` members as `StringTrie<UniqueId>`;
+// e.g.
+// `RadixTrie<UniqueId>`.  If it also has `count_prefix_matches` (as the tries
+// do), counts are answered directly by the index; otherwise they are computed
+// by collecting the matches.  Matches are estimated by `count_prefix_matches`
+// or, failing that, by `estimate_prefix_matches` (as `TrigramIndex` has).
+// Erasing rows needs `erase_suffixes` (as `StringTrie` has).
 //
-template <typename UniqueId> class QBColumnLookup<UniqueId, std::string> {
+template <typename UniqueId, typename Index>
+class QBColumnLookup<UniqueId, std::string, Index> {
 public:
   void insert(UniqueId rowId, std::string_view value);
 
-  void for_each_match(std::string_view matchString,
-                      std::function<void(UniqueId)> emitRecord) const;
+  void erase(UniqueId rowId, std::string_view value) {
+    impl_->erase_suffixes(value, rowId);
+    indexed_chars_ -= value.size();
+  }
+
+  void find_matches(std::string_view matchString,
+                    IdSet<UniqueId> &matches) const;
+
+  // If `Index` has `for_each_prefix_match_batch` (as `StringTrie` does), the
+  // index is searched for all of `matchStrings` at once, sharing the descent
+  // for common prefixes; pass them sorted for the most sharing.
+  //
+  void find_matches_batch(const std::vector<std::string_view> &matchStrings,
+                          std::vector<IdSet<UniqueId>> &matches) const;
+
+  template <typename Fn /* VisitResult(UniqueId) */>
+  bool for_each_match(std::string_view matchString, Fn &&emitRecord) const;
+
+  std::size_t count_matches(std::string_view matchString) const;
+
+  bool any_match(std::string_view matchString) const;
+
+  boost::optional<std::size_t>
+  estimate_matches(std::string_view matchString) const;
+
+  // Shares descents as `find_matches_batch` does if `Index` has
+  // `count_prefix_matches_batch`.
+  //
+  std::vector<boost::optional<std::size_t>> estimate_matches_batch(
+      const std::vector<std::string_view> &matchStrings) const;
+
+  // If `Index` has a `merge` member (as `StringTrie` does), the rows are split
+  // into consecutive shards of at least `kMinRowsPerShard` rows, one per
+  // thread, each indexed separately and then merged in order.  Otherwise they
+  // are inserted by the calling thread.
+  //
+  template <typename Ids, typename Values>
+  void bulk_insert(const Ids &ids, const Values &values, std::size_t begin,
+                   std::size_t end, unsigned num_threads);
+
+  static constexpr std::size_t kMinRowsPerShard = 1024;
+
+  // Builds the index if it is built in bulk (i.e., has a `build` member, as
+  // `SuffixArrayIndex` does); the other string indices are always fully
+  // organized for queries.
+  //
+  void compact() {
+    if constexpr (HasBuild<Index>::value) {
+      impl_->build();
+    }
+  }
+
+  // The usage of the index, with `indexed_chars` set to the total length of
+  // the values indexed.
+  //
+  MemoryUsage memory_usage() const {
+    MemoryUsage usage = impl_->memory_usage();
+    usage.bytes += sizeof(Index);
+    usage.indexed_chars = indexed_chars_;
+    return usage;
+  }
 
 private:
+  // True iff `Index` can count matches without visiting them.
+  //
+  template <typename I, typename = void>
+  struct HasPrefixMatchCount : std::false_type {};
+
+  template <typename I>
+  struct HasPrefixMatchCount<
+      I, std::void_t<decltype(std::declval<const I &>().count_prefix_matches(
+             std::string_view{}))>> : std::true_type {};
+
+  // True iff `Index` can estimate (an upper bound on) the number of matches
+  // without visiting them.
+  //
+  template <typename I, typename = void>
+  struct HasPrefixMatchEstimate : std::false_type {};
+
+  template <typename I>
+  struct HasPrefixMatchEstimate<
+      I,
+      std::void_t<decltype(std::declval<const I &>().estimate_prefix_matches(
+          std::string_view{}))>> : std::true_type {};
+
+  // True iff `Index` can search for many prefixes at once.
+  //
+  template <typename I, typename = void>
+  struct HasPrefixMatchBatch : std::false_type {};
+
+  template <typename I>
+  struct HasPrefixMatchBatch<
+      I, std::void_t<decltype(std::declval<const I &>()
+                                  .for_each_prefix_match_batch(
+                                      std::vector<std::string_view>{},
+                                      std::declval<void (*)(std::size_t,
+                                                            UniqueId)>()))>>
+      : std::true_type {};
+
+  // True iff `Index` can count the matches of many prefixes at once.
+  //
+  template <typename I, typename = void>
+  struct HasPrefixMatchCountBatch : std::false_type {};
+
+  template <typename I>
+  struct HasPrefixMatchCountBatch<
+      I, std::void_t<decltype(std::declval<const I &>()
+                                  .count_prefix_matches_batch(
+                                      std::vector<std::string_view>{}))>>
+      : std::true_type {};
+
+  // True iff `Index` can absorb another index built separately.
+  //
+  template <typename I, typename = void>
+  struct HasMerge : std::false_type {};
+
+  template <typename I>
+  struct HasMerge<I, std::void_t<decltype(std::declval<I &>().merge(
+                         std::declval<const I &>()))>> : std::true_type {};
+
+  // True iff `Index` is built in bulk, after its keys are inserted.
+  //
+  template <typename I, typename = void>
+  struct HasBuild : std::false_type {};
+
+  template <typename I>
+  struct HasBuild<I, std::void_t<decltype(std::declval<I &>().build())>>
+      : std::true_type {};
+
   // TODO - fix this; this is needed because the way we are generically
   // transforming a record tuple into a tuple of QBColumnLookup objects requires
   // copy/move construction (which is currently not implemented in StringTrie).
   //
-  std::unique_ptr<StringTrie<UniqueId>> impl_ =
-      std::make_unique<StringTrie<UniqueId>>();
+  std::unique_ptr<Index> impl_ = std::make_unique<Index>();
+
+  // The total length of the values in the index.
+  //
+  std::size_t indexed_chars_ = 0;
 };
 
 //
@@ -98,40 +353,204 @@ using LookupsForRecord =
 
 // -- Integer (long) lookup ----------------------------------------------------
 //
-template <typename UniqueId>
-void QBColumnLookup<UniqueId, long>::insert(UniqueId rowId, long columnValue) {
-  impl_.emplace(columnValue, rowId);
+template <typename UniqueId, typename Index>
+void QBColumnLookup<UniqueId, long, Index>::insert(UniqueId rowId,
+                                                   long columnValue) {
+  impl_.insert(columnValue, rowId);
+}
+
+template <typename UniqueId, typename Index>
+void QBColumnLookup<UniqueId, long, Index>::find_matches(
+    std::string_view matchString, IdSet<UniqueId> &matches) const {
+  const ValueRange<long> range = parse_range_predicate<long>(matchString);
+  impl_.for_each_in_range(range.lo, range.hi,
+                          [&](UniqueId id) { matches.insert(id); });
 }
 
-template <typename UniqueId>
-void QBColumnLookup<UniqueId, long>::for_each_match(
-    std::string_view matchString,
-    std::function<void(UniqueId)> emitRecord) const {
+template <typename UniqueId, typename Index>
+template <typename Fn>
+bool QBColumnLookup<UniqueId, long, Index>::for_each_match(
+    std::string_view matchString, Fn &&emitRecord) const {
   // Parse the matchString.
   //
-  const long matchNumber = boost::lexical_cast<long>(matchString);
+  const ValueRange<long> range = parse_range_predicate<long>(matchString);
 
-  // Find it in the hash table.
+  // Emit all matches; each row has only one value, so these are already
+  // distinct.
   //
-  const auto found = impl_.equal_range(matchNumber);
+  return impl_.for_each_in_range(range.lo, range.hi, emitRecord);
+}
 
-  // Emit all matches.
-  //
-  std::for_each(found.first, found.second,
-                [&](const auto &item) { emitRecord(item.second); });
+template <typename UniqueId, typename Index>
+std::size_t QBColumnLookup<UniqueId, long, Index>::count_matches(
+    std::string_view matchString) const {
+  const ValueRange<long> range = parse_range_predicate<long>(matchString);
+  return impl_.count_in_range(range.lo, range.hi);
+}
+
+template <typename UniqueId, typename Index>
+bool QBColumnLookup<UniqueId, long, Index>::any_match(
+    std::string_view matchString) const {
+  const ValueRange<long> range = parse_range_predicate<long>(matchString);
+  return !impl_.for_each_in_range(range.lo, range.hi,
+                                  [](UniqueId) { return VisitResult::kStop; });
+}
+
+template <typename UniqueId, typename Index>
+template <typename Ids, typename Values>
+void QBColumnLookup<UniqueId, long, Index>::bulk_insert(
+    const Ids &ids, const Values &values, std::size_t begin, std::size_t end,
+    unsigned /*num_threads*/) {
+  for (std::size_t row = begin; row < end; ++row) {
+    impl_.insert(values[row], ids[row]);
+  }
 }
 
 // -- String lookup ------------------------------------------------------------
 //
-template <typename UniqueId>
-void QBColumnLookup<UniqueId, std::string>::insert(UniqueId rowId,
-                                                   std::string_view value) {
+template <typename UniqueId, typename Index>
+void QBColumnLookup<UniqueId, std::string, Index>::insert(
+    UniqueId rowId, std::string_view value) {
   impl_->insert_suffixes(value, rowId);
+  indexed_chars_ += value.size();
+}
+
+template <typename UniqueId, typename Index>
+void QBColumnLookup<UniqueId, std::string, Index>::find_matches(
+    std::string_view matchString, IdSet<UniqueId> &matches) const {
+  // The index holds one entry per suffix, so a row is found once for each
+  // occurrence of `matchString`; the set removes the duplicates.
+  //
+  impl_->for_each_prefix_match(matchString,
+                               [&](UniqueId id) { matches.insert(id); });
+}
+
+template <typename UniqueId, typename Index>
+void QBColumnLookup<UniqueId, std::string, Index>::find_matches_batch(
+    const std::vector<std::string_view> &matchStrings,
+    std::vector<IdSet<UniqueId>> &matches) const {
+  if constexpr (HasPrefixMatchBatch<Index>::value) {
+    impl_->for_each_prefix_match_batch(
+        matchStrings,
+        [&](std::size_t i, UniqueId id) { matches[i].insert(id); });
+  } else {
+    for (std::size_t i = 0; i < matchStrings.size(); ++i) {
+      find_matches(matchStrings[i], matches[i]);
+    }
+  }
+}
+
+template <typename UniqueId, typename Index>
+template <typename Fn>
+bool QBColumnLookup<UniqueId, std::string, Index>::for_each_match(
+    std::string_view matchString, Fn &&emitRecord) const {
+  // Deduplicate as we go rather than collecting all matches first, so that a
+  // caller that only wants the first few rows doesn't pay for the rest.
+  //
+  IdSet<UniqueId> seen;
+  return impl_->for_each_prefix_match(matchString, [&](UniqueId id) {
+    if (seen.insert(id) && !invoke_visitor(emitRecord, id)) {
+      return VisitResult::kStop;
+    }
+    return VisitResult::kContinue;
+  });
 }
 
-template <typename UniqueId>
-void QBColumnLookup<UniqueId, std::string>::for_each_match(
-    std::string_view matchString,
-    std::function<void(UniqueId)> emitRecord) const {
-  impl_->for_each_prefix_match(matchString, emitRecord);
+template <typename UniqueId, typename Index>
+std::size_t QBColumnLookup<UniqueId, std::string, Index>::count_matches(
+    std::string_view matchString) const {
+  if constexpr (HasPrefixMatchCount<Index>::value) {
+    return impl_->count_prefix_matches(matchString);
+  } else {
+    IdSet<UniqueId> matches;
+    find_matches(matchString, matches);
+    return matches.size();
+  }
+}
+
+template <typename UniqueId, typename Index>
+bool QBColumnLookup<UniqueId, std::string, Index>::any_match(
+    std::string_view matchString) const {
+  // Stop at the first match found.
+  //
+  return !impl_->for_each_prefix_match(
+      matchString, [](UniqueId) { return VisitResult::kStop; });
+}
+
+template <typename UniqueId, typename Index>
+boost::optional<std::size_t>
+QBColumnLookup<UniqueId, std::string, Index>::estimate_matches(
+    std::string_view matchString) const {
+  if constexpr (HasPrefixMatchCount<Index>::value) {
+    return impl_->count_prefix_matches(matchString);
+  } else if constexpr (HasPrefixMatchEstimate<Index>::value) {
+    return impl_->estimate_prefix_matches(matchString);
+  } else {
+    return boost::none;
+  }
+}
+
+template <typename UniqueId, typename Index>
+std::vector<boost::optional<std::size_t>>
+QBColumnLookup<UniqueId, std::string, Index>::estimate_matches_batch(
+    const std::vector<std::string_view> &matchStrings) const {
+  std::vector<boost::optional<std::size_t>> estimates;
+  if constexpr (HasPrefixMatchCountBatch<Index>::value) {
+    for (const std::size_t count :
+         impl_->count_prefix_matches_batch(matchStrings)) {
+      estimates.emplace_back(count);
+    }
+  } else {
+    for (const std::string_view matchString : matchStrings) {
+      estimates.emplace_back(estimate_matches(matchString));
+    }
+  }
+  return estimates;
+}
+
+template <typename UniqueId, typename Index>
+template <typename Ids, typename Values>
+void QBColumnLookup<UniqueId, std::string, Index>::bulk_insert(
+    const Ids &ids, const Values &values, std::size_t begin, std::size_t end,
+    unsigned num_threads) {
+  for (std::size_t row = begin; row < end; ++row) {
+    indexed_chars_ += std::string_view{values[row]}.size();
+  }
+  const auto insert_rows = [&](Index &index, std::size_t first,
+                               std::size_t last) {
+    for (std::size_t row = first; row < last; ++row) {
+      index.insert_suffixes(values[row], ids[row]);
+    }
+  };
+
+  const std::size_t num_shards = std::min<std::size_t>(
+      std::max(num_threads, 1u), (end - begin) / kMinRowsPerShard);
+  if constexpr (HasMerge<Index>::value) {
+    if (num_shards > 1) {
+      // The first shard goes straight into `impl_`, after its existing rows;
+      // the others are merged into it once built.
+      //
+      std::vector<std::unique_ptr<Index>> shards(num_shards);
+      std::vector<std::function<void()>> tasks;
+      for (std::size_t i = 0; i < num_shards; ++i) {
+        tasks.emplace_back([&, i] {
+          Index *index = impl_.get();
+          if (i != 0) {
+            shards[i] = std::make_unique<Index>();
+            index = shards[i].get();
+          }
+          insert_rows(*index, begin + (end - begin) * i / num_shards,
+                      begin + (end - begin) * (i + 1) / num_shards);
+        });
+      }
+      run_tasks(tasks, num_threads);
+
+      for (std::size_t i = 1; i < num_shards; ++i) {
+        impl_->merge(*shards[i]);
+        shards[i].reset();
+      }
+      return;
+    }
+  }
+  insert_rows(*impl_, begin, end);
 }
@@ -1,7 +1,15 @@
 #include "qb_record_collection.hpp"
 
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <numeric>
+#include <vector>
+
 #include <boost/lexical_cast.hpp>
 
+#include "qb_record_snapshot.hpp"
+
 // Local helper functions.
 //
 namespace {
@@ -14,70 +22,701 @@ decltype(auto) get_unique_id(const QBRecordCollection::record_type &record) {
 
 bool QBRecordCollection::insert(record_type &&record) {
   const auto id = get_unique_id(record);
-  if (by_unique_id_.count(id)) {
+  if (row_by_unique_id_.contains(id)) {
     return false;
   }
+  if (log_) {
+    log_->append(record);
+  }
+
+  const row_type row = records_.push_back(record);
+  row_by_unique_id_.insert(id, row);
 
-  auto[iter, inserted] =
-      by_unique_id_.emplace(id, drop_first(std::move(record)));
+  for_each_upto<num_columns() - 1>([&](auto i) {
+    constexpr int I = decltype(i)::value;
+    std::get<I>(lookups_).insert(id, std::get<I + 1>(record));
+  });
 
-  assert(inserted);
+  return true;
+}
 
-  const auto &stored = iter->second;
+bool QBRecordCollection::erase(unique_id_type id) {
+  const row_type *found = row_by_unique_id_.find(id);
+  if (!found) {
+    return false;
+  }
+  const row_type row = *found;
+  if (log_) {
+    log_->append_erase(id);
+  }
 
   for_each_upto<num_columns() - 1>([&](auto i) {
     constexpr int I = decltype(i)::value;
-    std::get<I>(lookups_).insert(id, std::get<I>(stored));
+    std::get<I>(lookups_).erase(id, records_.get<I + 1>(row));
   });
+  row_by_unique_id_.erase(id);
 
   return true;
 }
 
-auto QBRecordCollection::find_matching_records(
-    std::string_view columnName, std::string_view matchString) const
-    -> std::vector<record_type> {
+bool QBRecordCollection::update(record_type &&record) {
+  const auto id = get_unique_id(record);
+  const row_type *found = row_by_unique_id_.find(id);
+  if (!found) {
+    return false;
+  }
+  const row_type old_row = *found;
+  if (records_.get_record(old_row) == record) {
+    return true;
+  }
+  if (log_) {
+    log_->append_update(record);
+  }
+
+  // Reindex the changed columns before storing the new row, which may move
+  // the old string values.
+  //
+  for_each_upto<num_columns() - 1>([&](auto i) {
+    constexpr int I = decltype(i)::value;
+    const auto old_value = records_.get<I + 1>(old_row);
+    if (!(old_value == std::get<I + 1>(record))) {
+      auto &lookup = std::get<I>(lookups_);
+      lookup.erase(id, old_value);
+      lookup.insert(id, std::get<I + 1>(record));
+    }
+  });
+
+  const row_type row = records_.push_back(record);
+  row_by_unique_id_.erase(id);
+  row_by_unique_id_.insert(id, row);
 
+  return true;
+}
+
+void QBRecordCollection::index_rows(std::size_t first_row,
+                                    unsigned num_threads) {
+  // Each string column index gets an equal share of the threads for its
+  // shards.
+  //
+  constexpr unsigned kNumLookups = num_columns() - 1;
+  const unsigned threads_per_lookup =
+      (std::max(num_threads, 1u) + kNumLookups - 1) / kNumLookups;
+
+  std::vector<std::function<void()>> tasks;
+  for_each_upto<kNumLookups>([&](auto i) {
+    constexpr int I = decltype(i)::value;
+    tasks.emplace_back([&] {
+      std::get<I>(lookups_).bulk_insert(records_.column<0>(),
+                                        records_.column<I + 1>(), first_row,
+                                        records_.size(), threads_per_lookup);
+    });
+  });
+  run_tasks(tasks, num_threads);
+}
+
+void QBRecordCollection::log_rows(std::size_t first_row) {
+  if (!log_ || first_row == records_.size()) {
+    return;
+  }
+  std::vector<record_type> records;
+  records.reserve(records_.size() - first_row);
+  for (std::size_t row = first_row; row < records_.size(); ++row) {
+    records.push_back(records_.get_record(row));
+  }
+  log_->append(records);
+}
+
+ImportStats QBRecordCollection::import_records(const std::string &path,
+                                               const ImportOptions &options,
+                                               unsigned num_threads) {
+  RecordFileReader reader{path, options};
+  ImportStats stats;
+  stats.bytes = reader.size();
+  std::vector<QBRecordView> chunk;
+  while (reader.next_chunk(chunk)) {
+    const std::size_t inserted = add_rows(chunk, num_threads);
+    log_rows(records_.size() - inserted);
+    stats.records += chunk.size();
+    stats.inserted += inserted;
+  }
+  compact();
+  return stats;
+}
+
+std::size_t QBRecordCollection::open_write_ahead_log(const std::string &path,
+                                                     SyncPolicy policy,
+                                                     unsigned num_threads) {
+  // Replay before opening the log, so the replayed mutations aren't appended
+  // to it again.
+  //
+  log_.reset();
+  std::vector<WriteAheadLog::Entry> entries = WriteAheadLog::read(path);
+
+  // Insertions not yet replayed.  A bulk load starts threads to index its
+  // batch, which only pays off for long runs of insertions; the short runs
+  // between erasures and updates in a busy log are inserted one at a time.
+  //
+  constexpr std::size_t kMinBulkReplay = 1024;
+  std::vector<record_type> inserts;
+  const auto replay_inserts = [&] {
+    if (inserts.size() < kMinBulkReplay) {
+      for (record_type &record : inserts) {
+        insert(std::move(record));
+      }
+    } else {
+      add_rows(inserts, num_threads);
+    }
+    inserts.clear();
+  };
+  for (WriteAheadLog::Entry &entry : entries) {
+    if (entry.op == LogOp::kInsert) {
+      inserts.push_back(std::move(entry.record));
+      continue;
+    }
+    replay_inserts();
+    if (entry.op == LogOp::kErase) {
+      erase(get_unique_id(entry.record));
+    } else {
+      update(std::move(entry.record));
+    }
+  }
+  replay_inserts();
+  compact();
+
+  log_ = std::make_unique<WriteAheadLog>(path, policy);
+  return entries.size();
+}
+
+void QBRecordCollection::save_snapshot(const std::string &path) const {
+  if (has_dead_rows()) {
+    write_snapshot(live_records(), path);
+  } else {
+    write_snapshot(records_, path);
+  }
+}
+
+auto QBRecordCollection::live_records() const -> RecordStore {
+  RecordStore live;
+  for (std::size_t row = 0; row < records_.size(); ++row) {
+    if (is_live_row(row_type(row))) {
+      live.push_back(records_.get_record(row_type(row)));
+    }
+  }
+  return live;
+}
+
+void QBRecordCollection::compact() {
+  if (has_dead_rows()) {
+    // The column indices refer to records by id, so only the id map needs to
+    // follow the rows as they move.
+    //
+    records_ = live_records();
+    row_by_unique_id_.clear();
+    for (std::size_t row = 0; row < records_.size(); ++row) {
+      row_by_unique_id_.insert(records_.get<0>(row_type(row)), row_type(row));
+    }
+  }
+  for_each_upto<num_columns() - 1>(
+      [&](auto i) { std::get<decltype(i)::value>(lookups_).compact(); });
+  records_.shrink_to_fit();
+}
+
+QueryPlan QBRecordCollection::explain(std::string_view columnName,
+                                      std::string_view matchString) const {
   auto maybe_column_num = parse_column_name<QBRecordTraits>(columnName);
   if (!maybe_column_num) {
-    // TODO - maybe report this error in a more dramatic way?
-    return {};
+    return QueryPlan{};
   }
   const int column_num = *maybe_column_num;
 
-  // The set of matching records to return.
-  //
-  std::vector<record_type> results;
+  QueryPlan plan = plan_query(column_num, matchString);
+  if (plan.access == QueryAccess::kUniqueId) {
+    plan.estimated_matches = row_by_unique_id_.contains(
+        boost::lexical_cast<unique_id_type>(matchString));
+  } else if (plan.access == QueryAccess::kIndex && !plan.estimated_matches) {
+    // Report the estimate even if the plan didn't need it.
+    //
+    visit_tuple_element(column_num - 1, lookups_,
+                        [&](const auto &column_lookup) {
+                          plan.estimated_matches =
+                              column_lookup.estimate_matches(matchString);
+                        });
+  }
+  return plan;
+}
 
-  // -- Local Helper Functions ---------------------------------------------
-  // Given a unique id (column0), looks up and adds the corresponding record
-  // to the result set, returning true if the record was found, false
-  // otherwise.
-  //
-  const auto addByUniqueId = [&](unique_id_type key) {
-    auto record_iter = by_unique_id_.find(key);
-    if (record_iter != by_unique_id_.end()) {
-      results.emplace_back(
-          std::tuple_cat(std::make_tuple(key), record_iter->second));
-      return true;
+QBRecordCollection::MemoryReport QBRecordCollection::memory_usage() const {
+  MemoryReport report;
+  report.records = records_.memory_usage();
+  report.columns[0] = row_by_unique_id_.memory_usage();
+  for_each_upto<num_columns() - 1>([&](auto i) {
+    constexpr int I = decltype(i)::value;
+    report.columns[I + 1] = std::get<I>(lookups_).memory_usage();
+  });
+  return report;
+}
+
+std::ostream &operator<<(std::ostream &out,
+                         const QBRecordCollection::MemoryReport &report) {
+  char line[128];
+  const auto print_line = [&](const std::string &name,
+                              const MemoryUsage &usage) {
+    std::snprintf(line, sizeof(line), "%-10s %14zu %10zu", name.c_str(),
+                  usage.bytes, usage.num_entries);
+    out << line;
+    if (usage.num_nodes != 0) {
+      std::snprintf(line, sizeof(line), " %10zu %7.2f", usage.num_nodes,
+                    usage.average_fanout());
+    } else {
+      std::snprintf(line, sizeof(line), " %10s %7s", "-", "-");
     }
-    return false;
+    out << line;
+    if (usage.indexed_chars != 0) {
+      std::snprintf(line, sizeof(line), " %11.2f\n",
+                    usage.bytes_per_indexed_char());
+    } else {
+      std::snprintf(line, sizeof(line), " %11s\n", "-");
+    }
+    out << line;
   };
-  // -----------------------------------------------------------------------
 
-  // Find and add all matching records.
-  //
+  std::snprintf(line, sizeof(line), "%-10s %14s %10s %10s %7s %11s\n",
+                "component", "bytes", "entries", "nodes", "fanout",
+                "bytes/char");
+  out << line;
+  print_line("records", report.records);
+  for (int i = 0; i < QBRecordCollection::num_columns(); ++i) {
+    print_line(QBRecordTraits::column_names()[i], report.columns[i]);
+  }
+  std::snprintf(line, sizeof(line), "%-10s %14zu\n", "total",
+                report.total_bytes());
+  return out << line;
+}
+
+QueryPlan QBRecordCollection::plan_query(int column_num,
+                                         std::string_view matchString) const {
+  QueryPlan plan;
+  plan.column = column_num;
+  plan.records = records_.size();
   if (column_num == QBRecordTraits::unique_id_column()) {
-    // Add the record with the specified id directly.
+    plan.access = QueryAccess::kUniqueId;
+    return plan;
+  }
+
+  // Only string columns can be scanned, so only their queries need an
+  // estimate.
+  //
+  plan.access = QueryAccess::kIndex;
+  for_each_upto<num_columns()>([&](auto i) {
+    constexpr int I = decltype(i)::value;
+    if constexpr (std::is_same_v<std::tuple_element_t<I, record_type>,
+                                 std::string>) {
+      if (I == column_num) {
+        plan = matchString.empty()
+                   ? plan_empty_substring_query(column_num)
+                   : plan_substring_query(
+                         column_num, records_.size(),
+                         std::get<I - 1>(lookups_).estimate_matches(
+                             matchString));
+      }
+    }
+  });
+  return plan;
+}
+
+QueryPlan QBRecordCollection::plan_empty_substring_query(int column_num) const {
+  // Every value contains the empty string, but the index holds no empty
+  // values, so only a scan finds them all.
+  //
+  QueryPlan plan;
+  plan.access = QueryAccess::kScan;
+  plan.column = column_num;
+  plan.records = records_.size();
+  plan.estimated_matches = row_by_unique_id_.size();
+  return plan;
+}
+
+std::vector<QueryPlan> QBRecordCollection::plan_queries(
+    int column_num, const std::vector<std::string_view> &matchStrings) const {
+  std::vector<QueryPlan> plans;
+  for_each_upto<num_columns()>([&](auto i) {
+    constexpr int I = decltype(i)::value;
+    if constexpr (std::is_same_v<std::tuple_element_t<I, record_type>,
+                                 std::string>) {
+      if (I == column_num) {
+        const auto estimates =
+            std::get<I - 1>(lookups_).estimate_matches_batch(matchStrings);
+        for (std::size_t j = 0; j < estimates.size(); ++j) {
+          plans.emplace_back(
+              matchStrings[j].empty()
+                  ? plan_empty_substring_query(column_num)
+                  : plan_substring_query(column_num, records_.size(),
+                                         estimates[j]));
+        }
+      }
+    }
+  });
+  if (plans.size() != matchStrings.size()) {
+    plans.clear();
+    for (const std::string_view matchString : matchStrings) {
+      plans.emplace_back(plan_query(column_num, matchString));
+    }
+  }
+  return plans;
+}
+
+auto QBRecordCollection::find_matching_ids(std::string_view columnName,
+                                           std::string_view matchString) const
+    -> IdSet<unique_id_type> {
+  IdSet<unique_id_type> matches;
+
+  auto maybe_column_num = parse_column_name<QBRecordTraits>(columnName);
+  if (!maybe_column_num) {
+    // TODO - maybe report this error in a more dramatic way?
+    return matches;
+  }
+
+  const QueryPlan plan = plan_query(*maybe_column_num, matchString);
+  switch (plan.access) {
+  case QueryAccess::kNone:
+    break;
+  case QueryAccess::kUniqueId:
+    // The id is the match.
     //
-    addByUniqueId(boost::lexical_cast<unique_id_type>(matchString));
-  } else {
-    // Use the appropriate index for the search column.
+    matches.insert(boost::lexical_cast<unique_id_type>(matchString));
+    break;
+  case QueryAccess::kScan:
+    scan_column(plan.column, matchString, [&](row_type row) {
+      matches.insert(records_.get<0>(row));
+    });
+    break;
+  case QueryAccess::kIndex:
+    // Use the appropriate index for the search column to collect the distinct
+    // ids of all matching records before materializing any of them.
     //
     visit_tuple_element(
-        column_num - 1, lookups_, [&](const auto &column_lookup) {
-          column_lookup.for_each_match(matchString, addByUniqueId);
+        plan.column - 1, lookups_, [&](const auto &column_lookup) {
+          column_lookup.find_matches(matchString, matches);
         });
+    break;
+  }
+
+  return matches;
+}
+
+void QBRecordCollection::find_matching_ids_batch(
+    int column_num, const std::vector<std::string_view> &matchStrings,
+    std::vector<IdSet<unique_id_type>> &matches) const {
+  std::vector<std::string_view> index_queries;
+  std::vector<std::size_t> index_query_nums;
+  const std::vector<QueryPlan> plans = plan_queries(column_num, matchStrings);
+  for (std::size_t i = 0; i < matchStrings.size(); ++i) {
+    const QueryPlan &plan = plans[i];
+    switch (plan.access) {
+    case QueryAccess::kNone:
+      break;
+    case QueryAccess::kUniqueId:
+      matches[i].insert(boost::lexical_cast<unique_id_type>(matchStrings[i]));
+      break;
+    case QueryAccess::kScan:
+      scan_column(plan.column, matchStrings[i], [&](row_type row) {
+        matches[i].insert(records_.get<0>(row));
+      });
+      break;
+    case QueryAccess::kIndex:
+      index_queries.emplace_back(matchStrings[i]);
+      index_query_nums.emplace_back(i);
+      break;
+    }
+  }
+  if (index_queries.empty()) {
+    return;
+  }
+
+  std::vector<IdSet<unique_id_type>> index_matches(index_queries.size());
+  visit_tuple_element(column_num - 1, lookups_, [&](const auto &column_lookup) {
+    column_lookup.find_matches_batch(index_queries, index_matches);
+  });
+  for (std::size_t j = 0; j < index_queries.size(); ++j) {
+    matches[index_query_nums[j]] = std::move(index_matches[j]);
+  }
+}
+
+auto QBRecordCollection::find_matching_records_batch(
+    std::string_view columnName,
+    const std::vector<std::string_view> &matchStrings,
+    unsigned num_threads) const -> std::vector<std::vector<record_type>> {
+  std::vector<std::vector<record_type>> results(matchStrings.size());
+  auto maybe_column_num = parse_column_name<QBRecordTraits>(columnName);
+  if (!maybe_column_num || matchStrings.empty()) {
+    return results;
   }
+  const int column_num = *maybe_column_num;
+
+  // The query numbers, in order of their patterns.
+  //
+  std::vector<std::size_t> order(matchStrings.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+    return matchStrings[a] < matchStrings[b];
+  });
+
+  const std::size_t num_groups =
+      std::min<std::size_t>(std::max(num_threads, 1u), order.size());
+  std::vector<std::function<void()>> tasks;
+  for (std::size_t g = 0; g < num_groups; ++g) {
+    tasks.emplace_back([&, g] {
+      const std::size_t begin = order.size() * g / num_groups;
+      const std::size_t end = order.size() * (g + 1) / num_groups;
+
+      std::vector<std::string_view> group;
+      for (std::size_t k = begin; k < end; ++k) {
+        group.emplace_back(matchStrings[order[k]]);
+      }
+      std::vector<IdSet<unique_id_type>> matches(group.size());
+      find_matching_ids_batch(column_num, group, matches);
+      for (std::size_t k = begin; k < end; ++k) {
+        results[order[k]] = get_records(matches[k - begin]);
+      }
+    });
+  }
+  run_tasks(tasks, num_threads);
+
+  return results;
+}
+
+auto QBRecordCollection::get_records(const IdSet<unique_id_type> &ids) const
+    -> std::vector<record_type> {
+  std::vector<record_type> results;
+  results.reserve(ids.size());
+  ids.for_each([&](unique_id_type key) {
+    if (const row_type *row = row_by_unique_id_.find(key)) {
+      results.emplace_back(records_.get_record(*row));
+    }
+  });
 
   return results;
 }
+
+auto QBRecordCollection::find_matching_records(
+    std::string_view columnName, std::string_view matchString) const
+    -> std::vector<record_type> {
+  return get_records(find_matching_ids(columnName, matchString));
+}
+
+auto QBRecordCollection::find_matching_record_refs(
+    std::string_view columnName, std::string_view matchString) const
+    -> std::vector<RecordRef> {
+  const IdSet<unique_id_type> matches =
+      find_matching_ids(columnName, matchString);
+
+  std::vector<RecordRef> results;
+  results.reserve(matches.size());
+  matches.for_each([&](unique_id_type key) {
+    if (const row_type *row = row_by_unique_id_.find(key)) {
+      results.emplace_back(records_, *row);
+    }
+  });
+
+  return results;
+}
+
+auto QBRecordCollection::find_matching_records(std::string_view columnName,
+                                               std::string_view matchString,
+                                               QueryLimits limits) const
+    -> std::vector<record_type> {
+  std::vector<record_type> results;
+  for_each_matching_record(columnName, matchString,
+                           [&](const RecordRef &ref) {
+                             results.emplace_back(ref.to_record());
+                             return VisitResult::kContinue;
+                           },
+                           limits);
+  return results;
+}
+
+std::size_t
+QBRecordCollection::count_matching_records(std::string_view columnName,
+                                           std::string_view matchString) const {
+  auto maybe_column_num = parse_column_name<QBRecordTraits>(columnName);
+  if (!maybe_column_num) {
+    return 0;
+  }
+  const int column_num = *maybe_column_num;
+
+  if (column_num == QBRecordTraits::unique_id_column()) {
+    return row_by_unique_id_.contains(
+        boost::lexical_cast<unique_id_type>(matchString));
+  }
+
+  const QueryPlan plan = plan_query(column_num, matchString);
+  if (plan.access == QueryAccess::kScan) {
+    if (matchString.empty()) {
+      // Every live record matches; see `plan_empty_substring_query`.
+      //
+      return row_by_unique_id_.size();
+    }
+    std::size_t count = 0;
+    scan_column(plan.column, matchString, [&](row_type) { ++count; });
+    return count;
+  }
+
+  std::size_t count = 0;
+  visit_tuple_element(column_num - 1, lookups_,
+                      [&](const auto &column_lookup) {
+                        count = column_lookup.count_matches(matchString);
+                      });
+  return count;
+}
+
+bool QBRecordCollection::any_match(std::string_view columnName,
+                                   std::string_view matchString) const {
+  auto maybe_column_num = parse_column_name<QBRecordTraits>(columnName);
+  if (!maybe_column_num) {
+    return false;
+  }
+  const int column_num = *maybe_column_num;
+
+  if (column_num == QBRecordTraits::unique_id_column()) {
+    return row_by_unique_id_.contains(
+        boost::lexical_cast<unique_id_type>(matchString));
+  }
+
+  const QueryPlan plan = plan_query(column_num, matchString);
+  if (plan.access == QueryAccess::kScan) {
+    return !scan_column(plan.column, matchString,
+                        [](row_type) { return VisitResult::kStop; });
+  }
+
+  bool found = false;
+  visit_tuple_element(column_num - 1, lookups_,
+                      [&](const auto &column_lookup) {
+                        found = column_lookup.any_match(matchString);
+                      });
+  return found;
+}
+
+void QBRecordCollection::filter_ids(IdSet<unique_id_type> &ids,
+                                    int column_num,
+                                    std::string_view matchString) const {
+  // Keeps the ids for which `matches(row)` is true.
+  //
+  const auto filter = [&](auto &&matches) {
+    IdSet<unique_id_type> kept;
+    ids.for_each([&](unique_id_type key) {
+      const row_type *row = row_by_unique_id_.find(key);
+      if (row && matches(*row)) {
+        kept.insert(key);
+      }
+    });
+    ids = std::move(kept);
+  };
+
+  for_each_upto<num_columns()>([&](auto i) {
+    constexpr int I = decltype(i)::value;
+    using Value = std::tuple_element_t<I, record_type>;
+    if (I != column_num) {
+      return;
+    }
+    if constexpr (I == QBRecordTraits::unique_id_column()) {
+      const auto id = boost::lexical_cast<unique_id_type>(matchString);
+      filter([&](row_type row) { return records_.get<I>(row) == id; });
+    } else if constexpr (std::is_same_v<Value, std::string>) {
+      filter([&](row_type row) {
+        return records_.get<I>(row).find(matchString) !=
+               std::string_view::npos;
+      });
+    } else {
+      const ValueRange<Value> range = parse_range_predicate<Value>(matchString);
+      filter([&](row_type row) {
+        const Value value = records_.get<I>(row);
+        return !(value < range.lo) && !(range.hi < value);
+      });
+    }
+  });
+}
+
+auto QBRecordCollection::find_matching_ids(
+    const std::vector<ColumnPredicate> &predicates, PredicateOp op) const
+    -> IdSet<unique_id_type> {
+  IdSet<unique_id_type> matches;
+
+  // Returns the ids of the existing records matching `predicate`, which must
+  // be on column `column_num`.
+  //
+  const auto find_existing_ids = [&](const ColumnPredicate &predicate,
+                                     int column_num) {
+    IdSet<unique_id_type> ids =
+        find_matching_ids(predicate.column, predicate.match);
+    if (column_num == QBRecordTraits::unique_id_column() && !ids.empty() &&
+        !row_by_unique_id_.contains(
+            boost::lexical_cast<unique_id_type>(predicate.match))) {
+      ids.clear();
+    }
+    return ids;
+  };
+
+  if (op == PredicateOp::kOr) {
+    for (const ColumnPredicate &predicate : predicates) {
+      if (auto column_num =
+              parse_column_name<QBRecordTraits>(predicate.column)) {
+        matches.union_with(find_existing_ids(predicate, *column_num));
+      }
+    }
+    return matches;
+  }
+
+  if (predicates.empty()) {
+    for (std::size_t row = 0; row < records_.size(); ++row) {
+      if (is_live_row(row_type(row))) {
+        matches.insert(records_.get<0>(row_type(row)));
+      }
+    }
+    return matches;
+  }
+
+  // Order the predicates by estimated selectivity; a predicate on an unknown
+  // column matches nothing.
+  //
+  std::vector<std::pair<QueryPlan, const ColumnPredicate *>> plans;
+  for (const ColumnPredicate &predicate : predicates) {
+    QueryPlan plan = explain(predicate.column, predicate.match);
+    if (plan.access == QueryAccess::kNone) {
+      return matches;
+    }
+    plans.emplace_back(std::move(plan), &predicate);
+  }
+  const auto estimate = [&](const QueryPlan &plan) {
+    return plan.estimated_matches.value_or(records_.size());
+  };
+  std::stable_sort(plans.begin(), plans.end(),
+                   [&](const auto &a, const auto &b) {
+                     return estimate(a.first) < estimate(b.first);
+                   });
+
+  matches =
+      find_existing_ids(*plans.front().second, plans.front().first.column);
+  for (std::size_t i = 1; i < plans.size() && !matches.empty(); ++i) {
+    const auto &[plan, predicate] = plans[i];
+    if (matches.size() < estimate(plan)) {
+      // Cheaper to check the remaining candidates than to find all the
+      // predicate's matches.
+      //
+      filter_ids(matches, plan.column, predicate->match);
+    } else {
+      matches.intersect_with(find_existing_ids(*predicate, plan.column));
+    }
+  }
+  return matches;
+}
+
+auto QBRecordCollection::find_matching_records(
+    const std::vector<ColumnPredicate> &predicates, PredicateOp op) const
+    -> std::vector<record_type> {
+  return get_records(find_matching_ids(predicates, op));
+}
+
+std::size_t QBRecordCollection::count_matching_records(
+    const std::vector<ColumnPredicate> &predicates, PredicateOp op) const {
+  return find_matching_ids(predicates, op).size();
+}
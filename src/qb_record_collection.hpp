@@ -1,12 +1,49 @@
 #pragma once
 
+#include <array>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <string>
 #include <string_view>
 #include <type_traits>
-#include <unordered_map>
 
+#include <boost/lexical_cast.hpp>
+
+#include "column_store.hpp"
+#include "dense_id_map.hpp"
+#include "id_set.hpp"
+#include "memory_usage.hpp"
+#include "parallel.hpp"
 #include "qb_column_lookup.hpp"
 #include "qb_record.hpp"
+#include "qb_record_import.hpp"
+#include "query_plan.hpp"
+#include "substring_scan.hpp"
 #include "tuples.hpp"
+#include "visitor.hpp"
+#include "write_ahead_log.hpp"
+
+// Pagination options for queries: skip the first `offset` matching records,
+// then return at most `limit`.
+//
+struct QueryLimits {
+  std::size_t offset = 0;
+  std::size_t limit = std::numeric_limits<std::size_t>::max();
+};
+
+// A condition on one column of a record: column `column` matches `match`, with
+// the same meaning as in `QBRecordCollection::find_matching_records(column,
+// match)`.
+//
+struct ColumnPredicate {
+  std::string_view column;
+  std::string_view match;
+};
+
+// How the predicates of a multi-column query are combined.
+//
+enum struct PredicateOp { kAnd, kOr };
 
 /**
  * Represents a Record Collection.
@@ -29,15 +66,18 @@ public:
   }
 
 private:
-  // Internal representation of a QBRecord.  Differs from the external
-  // representation in that it does not need to store the unique id column.
-  //
-  using QBRecordIntern = decltype(drop_first(std::declval<record_type>()));
-
   static_assert(QBRecordTraits::unique_id_column() == 0,
                 "The first column must be the unique id."); // TODO - relax this
                                                             // requirement.
 
+  // Column-wise storage for all the records in the collection.
+  //
+  using RecordStore = ColumnStore<record_type>;
+
+  // Identifies a record by its position in the `RecordStore`.
+  //
+  using row_type = RecordStore::row_type;
+
   // Lookup tables for fast matching against all columns in `record_type`.
   //
   using LookupTables = LookupsForRecord<record_type>;
@@ -45,27 +85,495 @@ private:
 public:
   using unique_id_type = traits_type::unique_id_type;
 
+  // A lightweight, non-owning reference to a record stored in the collection.
+  // String columns are exposed as `std::string_view`s into the column store,
+  // so no column values are copied.  Only valid until the collection is next
+  // modified.
+  //
+  class RecordRef {
+  public:
+    RecordRef(const RecordStore &records, row_type row)
+        : records_{&records}, row_{row} {}
+
+    // Returns the value of column `I`; `std::string_view` for string columns,
+    // a copy of the value for all others.
+    //
+    template <int I> auto get() const { return records_->get<I>(row_); }
+
+    // Returns a copy of the referenced record.
+    //
+    record_type to_record() const { return records_->get_record(row_); }
+
+  private:
+    const RecordStore *records_;
+    row_type row_;
+  };
+
+  using QueryLimits = ::QueryLimits;
+  using ColumnPredicate = ::ColumnPredicate;
+  using PredicateOp = ::PredicateOp;
+
+  // The memory used by a collection, by component; see `memory_usage`.
+  //
+  struct MemoryReport {
+    // The record store, including rows erased or updated since the last
+    // `compact`.
+    //
+    MemoryUsage records;
+
+    // The index of each column, by column number; for the unique id column,
+    // the map from ids to rows.
+    //
+    std::array<MemoryUsage, std::tuple_size<record_type>::value> columns;
+
+    // Returns the total bytes used by all the components.
+    //
+    std::size_t total_bytes() const {
+      std::size_t total = records.bytes;
+      for (const MemoryUsage &column : columns) {
+        total += column.bytes;
+      }
+      return total;
+    }
+  };
+
+  QBRecordCollection() = default;
+
+  // Creates an empty collection for records whose unique ids are all
+  // congruent to `id_residue` modulo `id_stride`, such as one shard of a
+  // `ShardedQBRecordCollection`.  Its id map is keyed by `id / id_stride` (see
+  // `StridedIdMap`), so such ids stay dense.  Records with other ids must not
+  // be inserted.
+  //
+  QBRecordCollection(unique_id_type id_stride, unique_id_type id_residue)
+      : row_by_unique_id_{id_stride, id_residue} {}
+
   // Inserts a new record into the collection.  If the record is already
   // present, return false and leave the collection unchanged.  Otherwise,
   // return true having successfully modified the collection.
   //
+  // If a write-ahead log is open (see `open_write_ahead_log`), the record is
+  // appended to it first; if that fails, `std::runtime_error` is thrown and
+  // the collection is unchanged.
+  //
   bool insert(record_type &&record);
 
+  // Removes the record with unique id `id` from the collection.  Returns false
+  // if there is none.
+  //
+  // The record is removed from the column indices straight away, so queries
+  // and counts no longer see it, but its row in the record store is only
+  // reclaimed by `compact`.  If a write-ahead log is open, the erasure is
+  // appended to it first, as for `insert`.
+  //
+  bool erase(unique_id_type id);
+
+  // Replaces the record with the unique id of `record` by `record`.  Returns
+  // false, leaving the collection unchanged, if there is none.
+  //
+  // Only the indices of the columns whose value changes are updated.  The new
+  // values are stored in a new row, and the old row is reclaimed by
+  // `compact`, as for `erase`; likewise for logging.
+  //
+  bool update(record_type &&record);
+
+  // Inserts each of `records` (any range of `record_type`), in order, as if by
+  // `insert`, skipping those whose id is already present.  Returns the number
+  // of records inserted.
+  //
+  // The records are stored first, then the index of each column is built by
+  // its own task, on up to `num_threads` threads.  String column indices that
+  // can be merged (see `QBColumnLookup::bulk_insert`) are further split into
+  // shards built on separate threads.  The collection is compacted afterwards.
+  //
+  // If a write-ahead log is open, the inserted records are appended to it
+  // together, with a single sync.  If that fails, `std::runtime_error` is
+  // thrown, and the records are in the collection but may not be durable.
+  //
+  template <typename Range>
+  std::size_t bulk_insert(const Range &records,
+                          unsigned num_threads = default_thread_count());
+
+  // Inserts the records in the delimited text file `path` (see
+  // qb_record_import.hpp), as if by `bulk_insert`, but parsing, storing and
+  // indexing `options.chunk_size` records at a time, so that the only copy of
+  // each value is the one in the record store.  The collection is compacted
+  // once, at the end.  Returns the number of records read and inserted.
+  //
+  // Throws `std::runtime_error` if the file can't be read or has a malformed
+  // record; the records of the chunks before it are inserted (and logged).
+  //
+  ImportStats import_records(const std::string &path,
+                             const ImportOptions &options = {},
+                             unsigned num_threads = default_thread_count());
+
+  // Replays the write-ahead log file `path` (see write_ahead_log.hpp) into
+  // the collection, then appends every mutation made from now on to it, made
+  // durable as `policy` requires.  Creates the log if it doesn't exist.
+  // Returns the number of entries replayed.  Throws `std::runtime_error` if
+  // the log can't be read or opened.
+  //
+  // Long runs of consecutive insertions in the log are replayed together, as
+  // by `bulk_insert`; short runs, erasures and updates one at a time.
+  // Records already in the collection are not added to the log, so this is
+  // normally called on an empty collection at startup.
+  //
+  std::size_t
+  open_write_ahead_log(const std::string &path,
+                       SyncPolicy policy = SyncPolicy::kGroupCommit,
+                       unsigned num_threads = default_thread_count());
+
+  // Writes a snapshot of the collection to the file `path`, which can later be
+  // mapped and queried by a `QBRecordSnapshot` without rebuilding any index.
+  // Throws `std::runtime_error` on failure.
+  //
+  void save_snapshot(const std::string &path) const;
+
+  // Reorganizes the column indices for faster queries, reclaims the rows of
+  // erased and updated records, and releases spare capacity in the record
+  // store.  Inserts leave the numeric column indices partially unmerged, so
+  // call this after loading (or changing) a large number of records.
+  //
+  void compact();
+
   /**
       Return records that contains a string in the StringValue field
       records - the initial set of records to filter
       matchString - the string to search for
+
+      For numeric columns, matchString may also be a comparison or range
+      predicate such as ">100" or "BETWEEN 1 AND 10"; see
+      `parse_range_predicate`.
   */
   std::vector<record_type>
   find_matching_records(std::string_view columnName,
                         std::string_view matchString) const;
 
+  // Returns `find_matching_records(columnName, matchStrings[i])` for each `i`,
+  // answering the whole batch at once: the column name is parsed once, and
+  // the column's index is searched for the patterns in sorted order, sharing
+  // the descent for their common prefixes (see
+  // `QBColumnLookup::find_matches_batch`).  The sorted patterns are split
+  // into up to `num_threads` consecutive groups, processed in parallel.
+  //
+  std::vector<std::vector<record_type>>
+  find_matching_records_batch(std::string_view columnName,
+                              const std::vector<std::string_view> &matchStrings,
+                              unsigned num_threads = 1) const;
+
+  // Same as `find_matching_records`, but only returns the page of results
+  // selected by `limits`.  The search stops as soon as the page is full.
+  //
+  // Unlike the unlimited overload, results are returned in the order the
+  // column index produces them rather than sorted by id, so pages are only
+  // stable while the collection is not modified.
+  //
+  std::vector<record_type>
+  find_matching_records(std::string_view columnName,
+                        std::string_view matchString,
+                        QueryLimits limits) const;
+
+  // Same as `find_matching_records`, but returns references to the matching
+  // records instead of copies; see `RecordRef`.  The returned references are
+  // only valid until the collection is next modified.
+  //
+  std::vector<RecordRef>
+  find_matching_record_refs(std::string_view columnName,
+                            std::string_view matchString) const;
+
+  // Invokes the visitor `fn` (see visitor.hpp) once for each record whose
+  // column `columnName` matches `matchString`, within the page selected by
+  // `limits`, streaming matches from the column index without collecting them
+  // first.  `fn` may return `VisitResult::kStop` to end the search early.
+  // Returns the number of records passed to `fn`.
+  //
+  template <typename Fn /* VisitResult(const RecordRef &) */>
+  std::size_t for_each_matching_record(std::string_view columnName,
+                                       std::string_view matchString, Fn &&fn,
+                                       QueryLimits limits = {}) const;
+
+  // Returns the number of records whose column `columnName` matches
+  // `matchString`; i.e., `find_matching_records(...).size()`.  Planned as
+  // `find_matching_records` is (see `plan_query`), and answered from the
+  // column's index or by scanning the column, without copying any records.
+  //
+  std::size_t count_matching_records(std::string_view columnName,
+                                     std::string_view matchString) const;
+
+  // Returns true iff at least one record's column `columnName` matches
+  // `matchString`.  Planned as `count_matching_records` is, but stops at the
+  // first match.
+  //
+  bool any_match(std::string_view columnName,
+                 std::string_view matchString) const;
+
+  // Returns the records that match all (`PredicateOp::kAnd`) or any
+  // (`PredicateOp::kOr`) of `predicates`, sorted by id.  Predicates on
+  // unknown columns match no records.  With no predicates, kAnd matches every
+  // record and kOr none.
+  //
+  // The ids matching each predicate are found from its column's index (or by
+  // scanning the column; see `explain`) and combined before any record is
+  // materialized.  For kAnd, predicates are applied most selective first, as
+  // estimated by the column indices; once fewer candidates remain than a
+  // predicate is estimated to match, that predicate is checked against the
+  // candidates' stored values rather than looked up.
+  //
+  std::vector<record_type>
+  find_matching_records(const std::vector<ColumnPredicate> &predicates,
+                        PredicateOp op) const;
+
+  // Returns the number of records that `find_matching_records(predicates,
+  // op)` would return, without materializing them.
+  //
+  std::size_t
+  count_matching_records(const std::vector<ColumnPredicate> &predicates,
+                         PredicateOp op) const;
+
+  // Returns the plan that the `find_matching_*` and `for_each_matching_record`
+  // functions would follow to find the records whose column `columnName`
+  // matches `matchString`; e.g., whether the column's index is walked or the
+  // column is scanned.  Does not run the query.
+  //
+  QueryPlan explain(std::string_view columnName,
+                    std::string_view matchString) const;
+
+  // Returns the heap memory used by the record store and by each column's
+  // index, with statistics on the shape of the string indices (see
+  // memory_usage.hpp).  Takes time linear in the size of the indices.
+  //
+  MemoryReport memory_usage() const;
+
 private:
-  // All the records in the collection, by primary key.
+  // Same as `bulk_insert`, but neither compacts the collection nor logs the
+  // records.
+  //
+  template <typename Range>
+  std::size_t add_rows(const Range &records, unsigned num_threads);
+
+  // Adds rows `first_row` onwards of `records_` to the column indices, on up
+  // to `num_threads` threads; see `bulk_insert`.
+  //
+  void index_rows(std::size_t first_row, unsigned num_threads);
+
+  // Returns true iff row `row` of `records_` holds a record in the collection,
+  // rather than one since erased or updated.
+  //
+  bool is_live_row(row_type row) const {
+    const row_type *live = row_by_unique_id_.find(records_.get<0>(row));
+    return live && *live == row;
+  }
+
+  // Returns true iff some rows of `records_` are not live.
+  //
+  bool has_dead_rows() const {
+    return records_.size() != row_by_unique_id_.size();
+  }
+
+  // Returns a copy of the live rows of `records_`, in order.
+  //
+  RecordStore live_records() const;
+
+  // Appends rows `first_row` onwards of `records_` to `log_`, if open.
+  //
+  void log_rows(std::size_t first_row);
+
+  // Returns the distinct unique ids of all records whose column `columnName`
+  // matches `matchString`.  For the unique id column, the id is returned
+  // without checking whether a record with that id exists.
+  //
+  IdSet<unique_id_type> find_matching_ids(std::string_view columnName,
+                                          std::string_view matchString) const;
+
+  // Sets `matches[i]` to `find_matching_ids(column, matchStrings[i])` for
+  // each `i`, where column `column_num` exists.  Queries answered by the
+  // index are searched for as one batch, in the given order.
+  //
+  void find_matching_ids_batch(
+      int column_num, const std::vector<std::string_view> &matchStrings,
+      std::vector<IdSet<unique_id_type>> &matches) const;
+
+  // Returns the distinct unique ids of all records matching `predicates`,
+  // combined by `op`; see `find_matching_records`.  Unlike the single-column
+  // overload, only ids of existing records are returned.
+  //
+  IdSet<unique_id_type>
+  find_matching_ids(const std::vector<ColumnPredicate> &predicates,
+                    PredicateOp op) const;
+
+  // Removes from `ids` the ids of records whose column `column_num` does not
+  // match `matchString`, or that don't exist.
+  //
+  void filter_ids(IdSet<unique_id_type> &ids, int column_num,
+                  std::string_view matchString) const;
+
+  // Returns copies of the records with the given ids, in ascending id order,
+  // skipping ids without a record.
   //
-  std::unordered_map<unique_id_type, const QBRecordIntern> by_unique_id_;
+  std::vector<record_type> get_records(const IdSet<unique_id_type> &ids) const;
+
+  // Returns the plan for the query for `matchString` on column `column_num`.
+  // Substring queries are answered by `scan_column` rather than the column's
+  // index when the index estimates that enough records match to make the scan
+  // cheaper (see `plan_substring_query`).
+  //
+  QueryPlan plan_query(int column_num, std::string_view matchString) const;
+
+  // Returns the plan for the query for the empty string on string column
+  // `column_num`, which matches every record.
+  //
+  QueryPlan plan_empty_substring_query(int column_num) const;
+
+  // Returns `plan_query(column_num, matchStrings[i])` for each `i`, getting
+  // the estimates for all the queries from the index at once.
+  //
+  std::vector<QueryPlan>
+  plan_queries(int column_num,
+               const std::vector<std::string_view> &matchStrings) const;
+
+  // Invokes the visitor `fn` (see visitor.hpp) on the row of each record
+  // whose string column `column_num` contains `matchString`, in row order,
+  // by scanning the column.  Returns false iff `fn` stopped the scan early.
+  //
+  template <typename Fn /* VisitResult(row_type) */>
+  bool scan_column(int column_num, std::string_view matchString,
+                   Fn &&fn) const;
+
+  // All the records in the collection, in insertion order, along with those
+  // erased or updated since the last `compact`.
+  //
+  RecordStore records_;
+
+  // The row of each record in `records_`, by primary key.
+  //
+  StridedIdMap<unique_id_type, row_type> row_by_unique_id_;
 
   // Indices of all other columns.
   //
   LookupTables lookups_;
+
+  // Where inserted records are logged, if anywhere.
+  //
+  std::unique_ptr<WriteAheadLog> log_;
 };
+
+// Prints `report` as a table with a line per component, e.g.
+//
+//   component           bytes    entries      nodes  fanout  bytes/char
+//   records             79982       2000          -       -           -
+//   column0             17000       2000          -       -           -
+//   column1          34152544      12018      24253    1.39     2841.78
+//   ...
+//   total            68429302
+//
+std::ostream &operator<<(std::ostream &out,
+                         const QBRecordCollection::MemoryReport &report);
+
+template <typename Range>
+std::size_t QBRecordCollection::bulk_insert(const Range &records,
+                                           unsigned num_threads) {
+  const std::size_t inserted = add_rows(records, num_threads);
+  compact();
+  // Compacting keeps the order of the rows, so the new ones are still last.
+  //
+  log_rows(records_.size() - inserted);
+  return inserted;
+}
+
+template <typename Range>
+std::size_t QBRecordCollection::add_rows(const Range &records,
+                                        unsigned num_threads) {
+  const std::size_t first_row = records_.size();
+  for (const auto &record : records) {
+    const unique_id_type id = std::get<0>(record);
+    if (!row_by_unique_id_.contains(id)) {
+      row_by_unique_id_.insert(id, records_.push_back(record));
+    }
+  }
+  index_rows(first_row, num_threads);
+  return records_.size() - first_row;
+}
+
+template <typename Fn>
+std::size_t QBRecordCollection::for_each_matching_record(
+    std::string_view columnName, std::string_view matchString, Fn &&fn,
+    QueryLimits limits) const {
+  std::size_t skipped = 0;
+  std::size_t emitted = 0;
+  if (limits.limit == 0) {
+    return emitted;
+  }
+
+  // Applies `limits` to the stream of matching rows, passing those in the
+  // page on to `fn`.
+  //
+  const auto emit_row = [&](row_type row) {
+    if (skipped < limits.offset) {
+      ++skipped;
+      return VisitResult::kContinue;
+    }
+    ++emitted;
+    if (!invoke_visitor(fn, RecordRef{records_, row}) ||
+        emitted == limits.limit) {
+      return VisitResult::kStop;
+    }
+    return VisitResult::kContinue;
+  };
+
+  // Same as `emit_row`, for a stream of matching ids.
+  //
+  const auto emit = [&](unique_id_type key) {
+    const row_type *row = row_by_unique_id_.find(key);
+    return row ? emit_row(*row) : VisitResult::kContinue;
+  };
+
+  auto maybe_column_num = parse_column_name<QBRecordTraits>(columnName);
+  if (!maybe_column_num) {
+    return emitted;
+  }
+
+  const QueryPlan plan = plan_query(*maybe_column_num, matchString);
+  switch (plan.access) {
+  case QueryAccess::kNone:
+    break;
+  case QueryAccess::kUniqueId:
+    emit(boost::lexical_cast<unique_id_type>(matchString));
+    break;
+  case QueryAccess::kScan:
+    scan_column(plan.column, matchString, emit_row);
+    break;
+  case QueryAccess::kIndex:
+    visit_tuple_element(
+        plan.column - 1, lookups_, [&](const auto &column_lookup) {
+          column_lookup.for_each_match(matchString, emit);
+        });
+    break;
+  }
+
+  return emitted;
+}
+
+template <typename Fn>
+bool QBRecordCollection::scan_column(int column_num,
+                                     std::string_view matchString,
+                                     Fn &&fn) const {
+  bool finished = true;
+  for_each_upto<num_columns()>([&](auto i) {
+    constexpr int I = decltype(i)::value;
+    if constexpr (std::is_same_v<std::tuple_element_t<I, record_type>,
+                                 std::string>) {
+      if (I == column_num) {
+        const bool check_live = has_dead_rows();
+        finished = for_each_row_containing(
+            records_.column<I>(), matchString, [&](std::size_t row) {
+              if (check_live && !is_live_row(row_type(row))) {
+                return VisitResult::kContinue;
+              }
+              return invoke_visitor(fn, row_type(row)) ? VisitResult::kContinue
+                                                        : VisitResult::kStop;
+            });
+      }
+    }
+  });
+  return finished;
+}
@@ -0,0 +1,1477 @@
+// Benchmarks for QBRecordCollection, and for the original implementation
+// (baseline.hpp) on the same data, using Google Benchmark.
+//
+// Most benchmarks take the number of records as their first argument, from 10
+// thousand to 10 million (or fewer, where each run would take too long or too
+// much memory); to run one size, pass e.g.
+// `--benchmark_filter='records:10000($|/)'`.  Benchmarks of several kinds of
+// query or implementation are registered once per kind, with the kind's name
+// after the benchmark's, e.g. `BM_FindId<Baseline>/hit/records:10000`.  Query
+// benchmarks come in pairs, `BM_X<QBRecordCollection>` and `BM_X<Baseline>`,
+// with the same kinds and arguments, which compare_benchmarks.py matches up.
+// Run with `--benchmark_out=FILE --benchmark_out_format=json` to save the
+// results for it.
+//
+// The component benchmarks at the end compare each of the collection's data
+// structures with the one it replaced or the alternatives considered, e.g.
+// `BM_IdMapFind<unordered_map>` and `BM_IdMapFind<DenseIdMap>`; the unit
+// tests only check that they agree.
+//
+// Records are generated as in qb_record_collection_test.cpp: ids 0..n-1 in
+// random order, strings of one to three random three-letter words, and
+// numbers in [-n/4, n/4], so each number matches about two records.
+//
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include <boost/lexical_cast.hpp>
+
+#include "baseline.hpp"
+#include "column_store.hpp"
+#include "concurrent_qb_record_collection.hpp"
+#include "dense_id_map.hpp"
+#include "heap_usage.hpp"
+#include "qb_column_lookup.hpp"
+#include "qb_record_collection.hpp"
+#include "qb_record_import.hpp"
+#include "qb_record_snapshot.hpp"
+#include "radix_trie.hpp"
+#include "sharded_qb_record_collection.hpp"
+#include "sorted_column_index.hpp"
+#include "string_trie.hpp"
+#include "substring_scan.hpp"
+#include "suffix_array.hpp"
+#include "timer.hpp"
+#include "trigram_index.hpp"
+#include "words.hpp"
+#include "write_ahead_log.hpp"
+
+namespace {
+
+using record_type = QBRecordCollection::record_type;
+
+constexpr int kMinRecords = 10 * 1000;
+constexpr int kMaxRecords = 10 * 1000 * 1000;
+
+// All three-letter dictionary words.
+//
+const std::vector<std::string> &three_letter_words() {
+  static const std::vector<std::string> words =
+      load_words([](std::string_view word) { return word.length() == 3; });
+  return words;
+}
+
+// Returns `count` records as described above.
+//
+std::vector<record_type> generate_records(int count) {
+  const std::vector<std::string> &words = three_letter_words();
+  std::default_random_engine rng{/*seed=*/1};
+  std::uniform_int_distribution<int> pick_word_index(0, words.size() - 1);
+  std::uniform_int_distribution<int> pick_word_count(1, 3);
+  std::uniform_int_distribution<long> pick_long(-count / 4, count / 4);
+
+  const auto random_string = [&] {
+    std::string s;
+    for (int n = pick_word_count(rng); n > 0; --n) {
+      s += words[pick_word_index(rng)];
+    }
+    return s;
+  };
+
+  std::vector<unsigned> ids(count);
+  std::iota(ids.begin(), ids.end(), 0);
+  std::shuffle(ids.begin(), ids.end(), rng);
+
+  std::vector<record_type> records;
+  records.reserve(count);
+  for (const unsigned id : ids) {
+    records.emplace_back(id, random_string(), pick_long(rng), random_string());
+  }
+  return records;
+}
+
+// Returns the records of size `count`, generated on first use.  Only the
+// most recently used size is kept, to bound memory use.
+//
+const std::vector<record_type> &records_of_size(int count) {
+  static std::vector<record_type> cached;
+  if (int(cached.size()) != count) {
+    cached.clear();
+    cached.shrink_to_fit();
+    cached = generate_records(count);
+  }
+  return cached;
+}
+
+// The original implementation.
+//
+using Baseline = baseline::QBRecordCollection;
+
+void load(Baseline &db, const std::vector<record_type> &records) {
+  for (const auto &[id, s1, n, s3] : records) {
+    db.push_back(baseline::QBRecord{id, s1, n, s3});
+  }
+}
+
+void load(QBRecordCollection &db, const std::vector<record_type> &records) {
+  db.bulk_insert(records);
+}
+
+std::size_t find(const Baseline &db, const std::string &column,
+                 const std::string &match) {
+  return baseline::QBFindMatchingRecords(db, column, match).size();
+}
+
+std::size_t find(const QBRecordCollection &db, const std::string &column,
+                 const std::string &match) {
+  return db.find_matching_records(column, match).size();
+}
+
+// Returns a collection of type `Impl` holding the records of size `count`,
+// loaded on first use.  As for `records_of_size`, only the most recently used
+// size is kept.
+//
+template <typename Impl> const Impl &collection_of_size(int count) {
+  static std::unique_ptr<Impl> cached;
+  static int cached_size = 0;
+  if (!cached || cached_size != count) {
+    cached.reset();
+    cached = std::make_unique<Impl>();
+    load(*cached, records_of_size(count));
+    cached_size = count;
+  }
+  return *cached;
+}
+
+// A temporary file path, removed (if the file was created) when destroyed.
+//
+class TempFile {
+public:
+  explicit TempFile(const std::string &name) {
+    const char *dir = std::getenv("TMPDIR");
+    path_ = std::string{dir ? dir : "/tmp"} + "/" + name + "." +
+            std::to_string(::getpid());
+    std::remove(path_.c_str());
+  }
+  ~TempFile() { std::remove(path_.c_str()); }
+
+  TempFile(const TempFile &) = delete;
+  TempFile &operator=(const TempFile &) = delete;
+
+  const std::string &path() const { return path_; }
+
+private:
+  std::string path_;
+};
+
+// Returns the path of a CSV file holding the records of size `count`, written
+// on first use.  As for `records_of_size`, only the most recently used size
+// is kept.
+//
+const std::string &input_file_of_size(int count) {
+  static std::unique_ptr<TempFile> cached;
+  static int cached_size = 0;
+  if (!cached || cached_size != count) {
+    cached = std::make_unique<TempFile>("benchmark_input.csv");
+    std::ofstream ofs{cached->path(), std::ios::binary};
+    for (const auto &[id, s1, n, s3] : records_of_size(count)) {
+      ofs << id << ',' << s1 << ',' << n << ',' << s3 << '\n';
+    }
+    cached_size = count;
+  }
+  return cached->path();
+}
+
+// Whether a query has a match.
+//
+enum Outcome { kMiss, kHit };
+
+const std::vector<std::pair<const char *, Outcome>> kOutcomes = {
+    {"miss", kMiss},
+    {"hit", kHit},
+};
+
+// Runs the query `column` = `matches[i]`, for each `i` in turn, against the
+// collection of `state.range(0)` records.
+//
+template <typename Impl>
+void run_queries(benchmark::State &state, const std::string &column,
+                 const std::vector<std::string> &matches) {
+  const Impl &db = collection_of_size<Impl>(state.range(0));
+  std::size_t i = 0;
+  std::size_t found = 0;
+  for (auto _ : state) {
+    found += find(db, column, matches[i]);
+    i = (i + 1) % matches.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["matches/query"] =
+      benchmark::Counter(found, benchmark::Counter::kAvgIterations);
+}
+
+// Look up ids that are present (hit) or not (miss).
+//
+template <typename Impl>
+void BM_FindId(benchmark::State &state, Outcome outcome) {
+  const int count = state.range(0);
+  std::vector<std::string> matches;
+  for (int i = 0; i < 1000; ++i) {
+    const int id = outcome == kHit ? (i * 7919) % count : count + i;
+    matches.push_back(std::to_string(id));
+  }
+  run_queries<Impl>(state, "column0", matches);
+}
+
+// Look up numbers that are present (about two matches each) or not.
+//
+template <typename Impl>
+void BM_FindNumber(benchmark::State &state, Outcome outcome) {
+  const long count = state.range(0);
+  std::vector<std::string> matches;
+  for (long i = 0; i < 1000; ++i) {
+    const long n =
+        outcome == kHit ? (i * 7919) % (count / 2) - count / 4 : count + i;
+    matches.push_back(std::to_string(n));
+  }
+  run_queries<Impl>(state, "column2", matches);
+}
+
+// Search for substrings matching no records, few records (whole words, each
+// found in a small fraction of the values), or many (single letters).
+//
+enum Selectivity { kNone, kFew, kMany };
+
+const std::vector<std::pair<const char *, Selectivity>> kSelectivities = {
+    {"none", kNone},
+    {"few", kFew},
+    {"many", kMany},
+};
+
+template <typename Impl>
+void BM_FindString(benchmark::State &state, Selectivity selectivity) {
+  const std::vector<std::string> &words = three_letter_words();
+  std::vector<std::string> matches;
+  switch (selectivity) {
+  case kNone:
+    matches = {"qqqq", "zzzz", "xjxj"};
+    break;
+  case kFew:
+    for (std::size_t i = 0; i < words.size(); i += 7) {
+      matches.push_back(words[i]);
+    }
+    break;
+  case kMany:
+    matches = {"a", "e", "i", "o", "s", "t"};
+    break;
+  }
+  run_queries<Impl>(state, "column1", matches);
+}
+
+// String patterns that are common (every three-letter word, each found in a
+// small fraction of the values) or rare (pairs of such words).
+//
+enum Frequency { kCommon, kRare };
+
+const std::vector<std::pair<const char *, Frequency>> kFrequencies = {
+    {"common", kCommon},
+    {"rare", kRare},
+};
+
+std::vector<std::string_view> patterns_of(Frequency frequency) {
+  const std::vector<std::string> &words = three_letter_words();
+  if (frequency == kCommon) {
+    return {words.begin(), words.end()};
+  }
+  static const std::vector<std::string> pairs = [&words] {
+    std::vector<std::string> pairs;
+    for (std::size_t i = 0; i + 1 < words.size(); i += 2) {
+      pairs.emplace_back(words[i] + words[i + 1]);
+    }
+    return pairs;
+  }();
+  return {pairs.begin(), pairs.end()};
+}
+
+// Runs a string query for each pattern in turn, keeping all the results, as
+// `BM_FindStringBatch` does.
+//
+void BM_FindStringEach(benchmark::State &state, Frequency frequency) {
+  const QBRecordCollection &db =
+      collection_of_size<QBRecordCollection>(state.range(0));
+  const std::vector<std::string_view> patterns = patterns_of(frequency);
+  for (auto _ : state) {
+    std::vector<std::vector<QBRecord>> results;
+    for (const std::string_view pattern : patterns) {
+      results.emplace_back(db.find_matching_records("column1", pattern));
+    }
+    benchmark::DoNotOptimize(results);
+  }
+  state.SetItemsProcessed(state.iterations() * patterns.size());
+}
+
+// Runs the same queries as one batch, on `state.range(1)` threads.
+//
+void BM_FindStringBatch(benchmark::State &state, Frequency frequency) {
+  const QBRecordCollection &db =
+      collection_of_size<QBRecordCollection>(state.range(0));
+  const std::vector<std::string_view> patterns = patterns_of(frequency);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        db.find_matching_records_batch("column1", patterns, state.range(1)));
+  }
+  state.SetItemsProcessed(state.iterations() * patterns.size());
+}
+
+// Inserts records one at a time into an empty collection.
+//
+void BM_Insert(benchmark::State &state) {
+  const std::vector<record_type> &records = records_of_size(state.range(0));
+  for (auto _ : state) {
+    auto db = std::make_unique<QBRecordCollection>();
+    for (const record_type &record : records) {
+      db->insert(record_type{record});
+    }
+    db->compact();
+    state.PauseTiming();
+    db.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * records.size());
+}
+
+// Builds the collection (storing every record and building the indices) in
+// one go, on `state.range(1)` threads.
+//
+void BM_BulkInsert(benchmark::State &state) {
+  const std::vector<record_type> &records = records_of_size(state.range(0));
+  for (auto _ : state) {
+    auto db = std::make_unique<QBRecordCollection>();
+    db->bulk_insert(records, state.range(1));
+    state.PauseTiming();
+    db.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * records.size());
+}
+
+// Destroys a collection, freeing its records and indices.
+//
+void BM_Teardown(benchmark::State &state) {
+  const std::vector<record_type> &records = records_of_size(state.range(0));
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto db = std::make_unique<QBRecordCollection>();
+    db->bulk_insert(records);
+    state.ResumeTiming();
+    db.reset();
+  }
+  state.SetItemsProcessed(state.iterations() * records.size());
+}
+
+// Applies a churn of erasures, updates and insertions, of a tenth of the
+// records each, to a collection, then compacts it; compare with
+// `BM_BulkInsert` for rebuilding it from scratch.
+//
+void BM_Churn(benchmark::State &state) {
+  const int count = state.range(0);
+  const int churn = count / 10;
+  const std::vector<record_type> &records = records_of_size(count);
+
+  // Erase ids [0, churn), update [churn, 2 * churn) and insert
+  // [count, count + churn).
+  //
+  std::vector<record_type> updates;
+  std::vector<record_type> insertions;
+  for (const record_type &record : records) {
+    const unsigned id = std::get<0>(record);
+    if (id >= unsigned(churn) && id < unsigned(2 * churn)) {
+      updates.emplace_back(record);
+      std::get<1>(updates.back()) += "x";
+    }
+    if (int(insertions.size()) < churn) {
+      insertions.emplace_back(record);
+      std::get<0>(insertions.back()) = count + insertions.size() - 1;
+    }
+  }
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto db = std::make_unique<QBRecordCollection>();
+    db->bulk_insert(records);
+    state.ResumeTiming();
+    for (int id = 0; id < churn; ++id) {
+      db->erase(id);
+    }
+    for (const record_type &record : updates) {
+      db->update(record_type{record});
+    }
+    for (const record_type &record : insertions) {
+      db->insert(record_type{record});
+    }
+    db->compact();
+    state.PauseTiming();
+    db.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * 3 * churn);
+}
+
+// Streams many-match string queries to a visitor that is either templated
+// or type-erased behind `std::function`, against either the trie (where the
+// visitor call is most of the per-value work) or a `QBColumnLookup` (which
+// also deduplicates row ids).  Items are matches.
+//
+enum Visitor { kTemplated, kErased };
+
+const std::vector<std::pair<const char *, Visitor>> kVisitors = {
+    {"templated", kTemplated},
+    {"std::function", kErased},
+};
+
+using WordTrie = StringTrie<unsigned>;
+using WordLookup = QBColumnLookup<unsigned, std::string>;
+
+void insert_word(WordTrie &trie, unsigned i, const std::string &word) {
+  trie.insert_suffixes(word, i);
+}
+
+void insert_word(WordLookup &lookup, unsigned i, const std::string &word) {
+  lookup.insert(i, word);
+}
+
+template <typename Fn>
+void for_each_match(const WordTrie &trie, const std::string &pattern,
+                    Fn &&fn) {
+  trie.for_each_prefix_match(pattern, std::forward<Fn>(fn));
+}
+
+template <typename Fn>
+void for_each_match(const WordLookup &lookup, const std::string &pattern,
+                    Fn &&fn) {
+  lookup.for_each_match(pattern, std::forward<Fn>(fn));
+}
+
+template <typename Index>
+void BM_VisitMatches(benchmark::State &state, Visitor kind) {
+  static const std::unique_ptr<Index> index = [] {
+    const std::vector<std::string> words = load_words();
+    auto index = std::make_unique<Index>();
+    for (unsigned i = 0; i < words.size(); ++i) {
+      insert_word(*index, i, words[i]);
+    }
+    return index;
+  }();
+  const std::vector<std::string> patterns = {"e", "a", "s", "in", "er"};
+
+  // Captures enough state that `std::function` can not store it inline.
+  //
+  std::size_t matches = 0;
+  unsigned long checksum = 0;
+  unsigned max_id = 0;
+  const auto visitor = [&matches, &checksum, &max_id](unsigned id) {
+    ++matches;
+    checksum += id;
+    max_id = std::max(max_id, id);
+    return VisitResult::kContinue;
+  };
+  using ErasedVisitor = std::function<VisitResult(unsigned)>;
+
+  for (auto _ : state) {
+    for (const std::string &pattern : patterns) {
+      if (kind == kErased) {
+        for_each_match(*index, pattern, ErasedVisitor{visitor});
+      } else {
+        for_each_match(*index, pattern, visitor);
+      }
+    }
+  }
+  benchmark::DoNotOptimize(checksum);
+  benchmark::DoNotOptimize(max_id);
+  state.SetItemsProcessed(matches);
+}
+
+// How an input file is parsed: by `RecordFileReader`, or line by line into
+// `std::string`s with `boost::lexical_cast` for numbers, as the importer
+// replaces.
+//
+enum Parser { kFromChars, kLexicalCast };
+
+const std::vector<std::pair<const char *, Parser>> kParsers = {
+    {"from_chars", kFromChars},
+    {"lexical_cast", kLexicalCast},
+};
+
+std::vector<record_type> parse_with_lexical_cast(const std::string &path) {
+  std::string text;
+  {
+    std::ifstream ifs{path, std::ios::binary};
+    text.assign(std::istreambuf_iterator<char>{ifs},
+                std::istreambuf_iterator<char>{});
+  }
+  std::vector<record_type> records;
+  std::istringstream iss{text};
+  std::string line;
+  while (std::getline(iss, line)) {
+    std::istringstream fields{line};
+    std::string id, s1, n, s3;
+    std::getline(fields, id, ',');
+    std::getline(fields, s1, ',');
+    std::getline(fields, n, ',');
+    std::getline(fields, s3);
+    records.emplace_back(boost::lexical_cast<unsigned>(id), std::move(s1),
+                         boost::lexical_cast<long>(n), std::move(s3));
+  }
+  return records;
+}
+
+// Parses the input file of `state.range(0)` records.
+//
+void BM_ParseRecords(benchmark::State &state, Parser parser) {
+  const std::string &path = input_file_of_size(state.range(0));
+  std::size_t bytes = 0;
+  for (auto _ : state) {
+    if (parser == kFromChars) {
+      RecordFileReader reader{path, ImportOptions{}};
+      std::vector<QBRecordView> chunk;
+      while (reader.next_chunk(chunk)) {
+        benchmark::DoNotOptimize(chunk.data());
+      }
+      bytes = reader.size();
+    } else {
+      benchmark::DoNotOptimize(parse_with_lexical_cast(path));
+    }
+  }
+  if (parser == kLexicalCast) {
+    bytes = std::ifstream{path, std::ios::binary | std::ios::ate}.tellg();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.SetBytesProcessed(state.iterations() * bytes);
+}
+
+// Imports the input file of `state.range(0)` records into an empty
+// collection, by `import_records` or by parsing it as above and calling
+// `bulk_insert`.
+//
+void BM_ImportRecords(benchmark::State &state, Parser parser) {
+  const std::string &path = input_file_of_size(state.range(0));
+  for (auto _ : state) {
+    auto db = std::make_unique<QBRecordCollection>();
+    if (parser == kFromChars) {
+      db->import_records(path);
+    } else {
+      db->bulk_insert(parse_with_lexical_cast(path));
+    }
+    state.PauseTiming();
+    db.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Whether a collection has a write-ahead log, and if so how it is synced.
+//
+const std::vector<std::pair<const char *, std::optional<SyncPolicy>>>
+    kLogPolicies = {
+        {"no-log", std::nullopt},
+        {"none", SyncPolicy::kNone},
+        {"every-append", SyncPolicy::kEveryAppend},
+        {"group-commit", SyncPolicy::kGroupCommit},
+};
+
+// Inserts records one at a time into a collection, from one thread.
+//
+void BM_LoggedInsert(benchmark::State &state,
+                     std::optional<SyncPolicy> policy) {
+  const std::vector<record_type> &records = records_of_size(kMinRecords);
+  const TempFile file{"benchmark_insert.wal"};
+  auto db = std::make_unique<QBRecordCollection>();
+  if (policy) {
+    db->open_write_ahead_log(file.path(), *policy);
+  }
+  unsigned id = 0;
+  for (auto _ : state) {
+    record_type record = records[id % records.size()];
+    std::get<0>(record) = id++;
+    db->insert(std::move(record));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Appends records to a log shared by all the benchmark's threads, where group
+// commit lets them share syncs.
+//
+void BM_ConcurrentAppend(benchmark::State &state, SyncPolicy policy) {
+  static std::unique_ptr<TempFile> file;
+  static std::unique_ptr<WriteAheadLog> log;
+  const std::vector<record_type> &records = records_of_size(kMinRecords);
+  if (state.thread_index() == 0) {
+    file = std::make_unique<TempFile>("benchmark_append.wal");
+    log = std::make_unique<WriteAheadLog>(file->path(), policy);
+  }
+  std::size_t i = state.thread_index();
+  for (auto _ : state) {
+    log->append(records[i % records.size()]);
+    i += state.threads();
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) {
+    state.counters["syncs/append"] = benchmark::Counter(
+        log->num_syncs(), benchmark::Counter::kAvgIterations);
+    log.reset();
+    file.reset();
+  }
+}
+
+// Replays a log of `state.range(0)` insertions into an empty collection.
+//
+void BM_Replay(benchmark::State &state) {
+  const TempFile file{"benchmark_replay.wal"};
+  {
+    QBRecordCollection db;
+    db.open_write_ahead_log(file.path(), SyncPolicy::kNone);
+    db.bulk_insert(records_of_size(state.range(0)));
+  }
+  for (auto _ : state) {
+    auto db = std::make_unique<QBRecordCollection>();
+    db->open_write_ahead_log(file.path(), SyncPolicy::kNone);
+    state.PauseTiming();
+    db.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Replays a log of `state.range(0)` insertions, interleaved with an update
+// or erasure (alternately) of an earlier record after every
+// `state.range(1)` insertions, into an empty collection.
+//
+void BM_ReplayInterleaved(benchmark::State &state) {
+  const TempFile file{"benchmark_replay_interleaved.wal"};
+  const std::vector<record_type> &records = records_of_size(state.range(0));
+  const std::size_t run = state.range(1);
+  {
+    QBRecordCollection db;
+    db.open_write_ahead_log(file.path(), SyncPolicy::kNone);
+    for (std::size_t i = 0; i < records.size(); ++i) {
+      db.insert(record_type{records[i]});
+      if ((i + 1) % run != 0) {
+        continue;
+      }
+      record_type earlier = records[i / 2];
+      if ((i + 1) / run % 2 == 0) {
+        db.erase(std::get<0>(earlier));
+      } else {
+        ++std::get<2>(earlier);
+        db.update(std::move(earlier));
+      }
+    }
+  }
+  for (auto _ : state) {
+    auto db = std::make_unique<QBRecordCollection>();
+    db->open_write_ahead_log(file.path(), SyncPolicy::kNone);
+    state.PauseTiming();
+    db.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * records.size());
+}
+
+// Returns the path of a snapshot of the collection of `count` records, saved
+// on first use.  As for `records_of_size`, only the most recently used size
+// is kept.
+//
+const std::string &snapshot_of_size(int count) {
+  static std::unique_ptr<TempFile> cached;
+  static int cached_size = 0;
+  if (!cached || cached_size != count) {
+    cached = std::make_unique<TempFile>("benchmark.qbsnap");
+    collection_of_size<QBRecordCollection>(count).save_snapshot(
+        cached->path());
+    cached_size = count;
+  }
+  return cached->path();
+}
+
+// Saves a snapshot of the collection of `state.range(0)` records.
+//
+void BM_SaveSnapshot(benchmark::State &state) {
+  const QBRecordCollection &db =
+      collection_of_size<QBRecordCollection>(state.range(0));
+  const TempFile file{"benchmark_save.qbsnap"};
+  for (auto _ : state) {
+    db.save_snapshot(file.path());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// How much of starting to serve queries from a snapshot is timed: opening
+// it, or opening it and answering a first query.  Compare with `BM_Insert`
+// and `BM_BulkInsert` for rebuilding the collection instead.
+//
+enum SnapshotStart { kOpen, kFirstQuery };
+
+const std::vector<std::pair<const char *, SnapshotStart>> kSnapshotStarts = {
+    {"open", kOpen},
+    {"first-query", kFirstQuery},
+};
+
+void BM_OpenSnapshot(benchmark::State &state, SnapshotStart start) {
+  const std::string &path = snapshot_of_size(state.range(0));
+  for (auto _ : state) {
+    const QBRecordSnapshot snapshot{path};
+    if (start == kFirstQuery) {
+      benchmark::DoNotOptimize(
+          snapshot.find_matching_records("column1", "abc"));
+    }
+  }
+}
+
+// Substring indices compared on the same keys: the dictionary's words, or
+// long values of twenty random words each, where the suffix-based indices
+// grow quadratically with value length.  Each key's value is its position.
+//
+enum KeySet { kWords, kLongValues };
+
+const std::vector<std::pair<const char *, KeySet>> kKeySets = {
+    {"words", kWords},
+    {"long-values", kLongValues},
+};
+
+const std::vector<std::string> &keys_of(KeySet key_set) {
+  static const std::vector<std::string> words = load_words();
+  static const std::vector<std::string> long_values = [] {
+    std::default_random_engine rng{/*seed=*/3};
+    std::uniform_int_distribution<int> pick_word(0, words.size() - 1);
+    std::vector<std::string> values;
+    for (int i = 0; i < 5000; ++i) {
+      std::string value;
+      for (int n = 0; n < 20; ++n) {
+        value += words[pick_word(rng)];
+        value += ' ';
+      }
+      values.emplace_back(std::move(value));
+    }
+    return values;
+  }();
+  return key_set == kWords ? words : long_values;
+}
+
+const std::vector<std::string> kIndexPatterns = {
+    "x",  "ill", "zing", "uniquely", "notawordXYZ", "bob", "aa",
+    "niqu", "ly", "are", "ss", "ZZG", "raft", "th", "lo", "term",
+    "expect", "lease"};
+
+// Whether `Index` must be built (as `SuffixArrayIndex` must) after
+// inserting.
+//
+template <typename Index, typename = void>
+struct HasBuild : std::false_type {};
+
+template <typename Index>
+struct HasBuild<Index, std::void_t<decltype(std::declval<Index &>().build())>>
+    : std::true_type {};
+
+template <typename Index>
+std::unique_ptr<Index> build_index(const std::vector<std::string> &keys) {
+  auto index = std::make_unique<Index>();
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    index->insert_suffixes(keys[i], int(i));
+  }
+  if constexpr (HasBuild<Index>::value) {
+    index->build();
+  }
+  return index;
+}
+
+// Builds the index, reporting the heap it uses per key and its own account
+// of that (`memory_usage`).
+//
+template <typename Index>
+void BM_BuildIndex(benchmark::State &state, KeySet key_set) {
+  const std::vector<std::string> &keys = keys_of(key_set);
+  std::size_t heap_bytes = 0;
+  std::size_t reported_bytes = 0;
+  for (auto _ : state) {
+    const std::size_t heap_before = heap_bytes_in_use();
+    auto index = build_index<Index>(keys);
+    state.PauseTiming();
+    heap_bytes = heap_bytes_in_use() - heap_before;
+    reported_bytes = index->memory_usage().bytes;
+    index.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+  state.counters["heap_bytes/key"] = double(heap_bytes) / keys.size();
+  state.counters["reported_bytes/key"] = double(reported_bytes) / keys.size();
+}
+
+// Searches the index for each pattern in turn; items are queries.
+//
+template <typename Index>
+void BM_QueryIndex(benchmark::State &state, KeySet key_set) {
+  const std::unique_ptr<Index> index = build_index<Index>(keys_of(key_set));
+  std::size_t i = 0;
+  std::size_t visits = 0;
+  for (auto _ : state) {
+    index->for_each_prefix_match(kIndexPatterns[i], [&](int) { ++visits; });
+    i = (i + 1) % kIndexPatterns.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["visits/query"] =
+      benchmark::Counter(visits, benchmark::Counter::kAvgIterations);
+}
+
+// Destroys the index.  Some indices are freed thousands of times faster than
+// they are built, so this runs a fixed number of iterations.
+//
+template <typename Index>
+void BM_TeardownIndex(benchmark::State &state, KeySet key_set) {
+  const std::vector<std::string> &keys = keys_of(key_set);
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto index = build_index<Index>(keys);
+    state.ResumeTiming();
+    index.reset();
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+// Returns the ids 0..count-1 in a random order.
+//
+std::vector<unsigned> shuffled_ids(int count) {
+  std::default_random_engine rng{/*seed=*/1};
+  std::vector<unsigned> ids(count);
+  std::iota(ids.begin(), ids.end(), 0);
+  std::shuffle(ids.begin(), ids.end(), rng);
+  return ids;
+}
+
+// A record without its id.
+//
+using RowTuple = std::tuple<std::string, long, std::string>;
+
+// Record storage compared: row tuples by id, as `QBRecordCollection` used to
+// store them, or a `ColumnStore` with a map from id to row.
+//
+enum RecordLayout { kRowTuples, kColumnStore };
+
+const std::vector<std::pair<const char *, RecordLayout>> kRecordLayouts = {
+    {"row-tuples", kRowTuples},
+    {"column-store", kColumnStore},
+};
+
+// Sums the number column and the lengths of the last string column of
+// `state.range(0)` records, reporting the heap each layout uses per record.
+// Strings are of up to 24 random letters, so some exceed the small string
+// buffer.
+//
+void BM_ScanRecords(benchmark::State &state, RecordLayout layout) {
+  std::default_random_engine rng{/*seed=*/1};
+  std::uniform_int_distribution<int> pick_length(0, 24);
+  std::uniform_int_distribution<int> pick_char('a', 'z');
+  std::uniform_int_distribution<long> pick_long(-1000, 1000);
+  const auto random_string = [&] {
+    std::string s(pick_length(rng), ' ');
+    for (char &c : s) {
+      c = pick_char(rng);
+    }
+    return s;
+  };
+  std::vector<record_type> records;
+  for (const unsigned id : shuffled_ids(state.range(0))) {
+    records.emplace_back(id, random_string(), pick_long(rng), random_string());
+  }
+
+  long sum = 0;
+  std::size_t heap_bytes = 0;
+  const std::size_t heap_before = heap_bytes_in_use();
+  if (layout == kRowTuples) {
+    auto rows = std::make_unique<DenseIdMap<unsigned, RowTuple>>();
+    for (const auto &[id, s1, n, s3] : records) {
+      rows->insert(id, RowTuple{s1, n, s3});
+    }
+    heap_bytes = heap_bytes_in_use() - heap_before;
+    for (auto _ : state) {
+      for (unsigned id = 0; id < records.size(); ++id) {
+        const RowTuple &row = *rows->find(id);
+        sum += std::get<1>(row) + long(std::get<2>(row).size());
+      }
+    }
+  } else {
+    auto store = std::make_unique<ColumnStore<record_type>>();
+    auto row_by_id = std::make_unique<DenseIdMap<unsigned, std::uint32_t>>();
+    for (const record_type &record : records) {
+      row_by_id->insert(std::get<0>(record), store->push_back(record));
+    }
+    store->shrink_to_fit();
+    heap_bytes = heap_bytes_in_use() - heap_before;
+    for (auto _ : state) {
+      const std::vector<long> &numbers = store->column<2>();
+      const StringColumn &strings = store->column<3>();
+      for (std::size_t row = 0; row < store->size(); ++row) {
+        sum += numbers[row] + long(strings[row].size());
+      }
+    }
+  }
+  benchmark::DoNotOptimize(sum);
+  state.SetItemsProcessed(state.iterations() * records.size());
+  state.counters["heap_bytes/record"] = double(heap_bytes) / records.size();
+}
+
+// Primary key maps compared, with record-like values: the hash map
+// `QBRecordCollection` used to use, or `DenseIdMap`.
+//
+using HashIdMap = std::unordered_map<unsigned, const RowTuple>;
+using DenseRowMap = DenseIdMap<unsigned, RowTuple>;
+
+void map_insert(HashIdMap &map, unsigned id, RowTuple &&row) {
+  map.emplace(id, std::move(row));
+}
+
+void map_insert(DenseRowMap &map, unsigned id, RowTuple &&row) {
+  map.insert(id, std::move(row));
+}
+
+const RowTuple *map_find(const HashIdMap &map, unsigned id) {
+  const auto iter = map.find(id);
+  return iter == map.end() ? nullptr : &iter->second;
+}
+
+const RowTuple *map_find(const DenseRowMap &map, unsigned id) {
+  return map.find(id);
+}
+
+template <typename Map>
+std::unique_ptr<Map> build_id_map(const std::vector<unsigned> &ids) {
+  auto map = std::make_unique<Map>();
+  for (const unsigned id : ids) {
+    map_insert(*map, id, RowTuple{"", long(id), ""});
+  }
+  return map;
+}
+
+// Inserts ids 0..n-1, in a random order, into an empty map, reporting the
+// heap it uses per record.
+//
+template <typename Map> void BM_IdMapInsert(benchmark::State &state) {
+  const std::vector<unsigned> ids = shuffled_ids(state.range(0));
+  std::size_t heap_bytes = 0;
+  for (auto _ : state) {
+    const std::size_t heap_before = heap_bytes_in_use();
+    auto map = build_id_map<Map>(ids);
+    state.PauseTiming();
+    heap_bytes = heap_bytes_in_use() - heap_before;
+    map.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.counters["heap_bytes/record"] =
+      double(heap_bytes) / state.range(0);
+}
+
+// Looks up random ids in the map of ids 0..n-1; a tenth of them are absent.
+//
+template <typename Map> void BM_IdMapFind(benchmark::State &state) {
+  const int count = state.range(0);
+  const std::unique_ptr<Map> map = build_id_map<Map>(shuffled_ids(count));
+  std::default_random_engine rng{/*seed=*/1};
+  std::uniform_int_distribution<unsigned> pick_id(0, count + count / 10);
+  std::vector<unsigned> probes(64 * 1024);
+  for (unsigned &probe : probes) {
+    probe = pick_id(rng);
+  }
+  std::size_t i = 0;
+  long sum = 0;
+  for (auto _ : state) {
+    if (const RowTuple *row = map_find(*map, probes[i])) {
+      sum += std::get<1>(*row);
+    }
+    i = (i + 1) % probes.size();
+  }
+  benchmark::DoNotOptimize(sum);
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Numeric column indices compared: the hash multimap `QBRecordCollection`
+// used to use, or `SortedColumnIndex`, before or after `compact`.  Keys are
+// in [-n/4, n/4], so each matches about two rows.
+//
+enum NumberIndexKind { kHashMultimap, kSorted, kSortedCompacted };
+
+const std::vector<std::pair<const char *, NumberIndexKind>> kNumberIndexKinds =
+    {
+        {"unordered_multimap", kHashMultimap},
+        {"SortedColumnIndex", kSorted},
+        {"SortedColumnIndex-compacted", kSortedCompacted},
+};
+
+using HashMultimap = std::unordered_multimap<long, unsigned>;
+using SortedIndex = SortedColumnIndex<long, unsigned>;
+
+// Returns `count` random keys as described above.
+//
+std::vector<long> random_keys(int count, unsigned seed) {
+  std::default_random_engine rng{seed};
+  std::uniform_int_distribution<long> pick_key(-count / 4, count / 4);
+  std::vector<long> keys(count);
+  for (long &key : keys) {
+    key = pick_key(rng);
+  }
+  return keys;
+}
+
+// One of the indices above, mapping `keys[id]` to each `id`.
+//
+struct NumberIndex {
+  NumberIndex(NumberIndexKind kind, const std::vector<long> &keys) {
+    if (kind == kHashMultimap) {
+      hash = std::make_unique<HashMultimap>();
+      for (unsigned id = 0; id < keys.size(); ++id) {
+        hash->emplace(keys[id], id);
+      }
+      return;
+    }
+    sorted = std::make_unique<SortedIndex>();
+    for (unsigned id = 0; id < keys.size(); ++id) {
+      sorted->insert(keys[id], id);
+    }
+    if (kind == kSortedCompacted) {
+      sorted->compact();
+    }
+  }
+
+  // Returns the number of odd ids with key `key`, visiting each match.
+  //
+  std::size_t count_odd_equal(long key) const {
+    std::size_t found = 0;
+    if (hash) {
+      const auto range = hash->equal_range(key);
+      for (auto iter = range.first; iter != range.second; ++iter) {
+        found += iter->second & 1;
+      }
+    } else {
+      sorted->for_each_in_range(key, key,
+                                [&](unsigned id) { found += id & 1; });
+    }
+    return found;
+  }
+
+  std::unique_ptr<HashMultimap> hash;
+  std::unique_ptr<SortedIndex> sorted;
+};
+
+// Builds the index over `state.range(0)` keys (compacting it, for
+// `kSortedCompacted`), reporting the heap it uses per row.
+//
+void BM_NumberIndexBuild(benchmark::State &state, NumberIndexKind kind) {
+  const std::vector<long> keys = random_keys(state.range(0), /*seed=*/1);
+  std::size_t heap_bytes = 0;
+  for (auto _ : state) {
+    const std::size_t heap_before = heap_bytes_in_use();
+    auto index = std::make_unique<NumberIndex>(kind, keys);
+    state.PauseTiming();
+    heap_bytes = heap_bytes_in_use() - heap_before;
+    index.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+  state.counters["heap_bytes/row"] = double(heap_bytes) / keys.size();
+}
+
+// Looks up random keys, visiting each matching row.
+//
+void BM_NumberIndexEqual(benchmark::State &state, NumberIndexKind kind) {
+  const NumberIndex index{kind, random_keys(state.range(0), /*seed=*/1)};
+  const std::vector<long> probes = random_keys(64 * 1024, /*seed=*/2);
+  std::size_t i = 0;
+  std::size_t found = 0;
+  for (auto _ : state) {
+    found += index.count_odd_equal(probes[i]);
+    i = (i + 1) % probes.size();
+  }
+  benchmark::DoNotOptimize(found);
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Counts the rows in random ranges of 101 keys (`SortedColumnIndex` only).
+//
+void BM_NumberIndexRange(benchmark::State &state, NumberIndexKind kind) {
+  const NumberIndex index{kind, random_keys(state.range(0), /*seed=*/1)};
+  const std::vector<long> probes = random_keys(64 * 1024, /*seed=*/2);
+  std::size_t i = 0;
+  std::size_t found = 0;
+  for (auto _ : state) {
+    found += index.sorted->count_in_range(probes[i], probes[i] + 100);
+    i = (i + 1) % probes.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["matches/query"] =
+      benchmark::Counter(found, benchmark::Counter::kAvgIterations);
+}
+
+// Column scans compared, over `state.range(0)` random dictionary words:
+// calling `std::string::find` on each value, as the baseline does, or
+// `for_each_row_containing` with each implementation this CPU supports.
+// Items are rows.
+//
+const std::vector<std::pair<const char *, std::optional<SubstringScanImpl>>>
+    kScanImpls = {
+        {"per-value-find", std::nullopt},
+        {"scalar", SubstringScanImpl::kScalar},
+        {"sse2", SubstringScanImpl::kSse2},
+        {"avx2", SubstringScanImpl::kAvx2},
+};
+
+bool is_supported(SubstringScanImpl impl) {
+  return impl == SubstringScanImpl::kScalar ||
+         (impl == SubstringScanImpl::kSse2 &&
+          substring_scan_impl() != SubstringScanImpl::kScalar) ||
+         substring_scan_impl() == impl;
+}
+
+void BM_ScanColumn(benchmark::State &state,
+                   std::optional<SubstringScanImpl> impl,
+                   const char *pattern) {
+  static const std::vector<std::string> words = load_words();
+  std::default_random_engine rng{/*seed=*/1};
+  std::uniform_int_distribution<std::size_t> pick_word(0, words.size() - 1);
+  std::vector<std::string> values;
+  StringColumn column;
+  for (int i = 0; i < state.range(0); ++i) {
+    values.emplace_back(words[pick_word(rng)]);
+    column.push_back(values.back());
+  }
+
+  std::size_t found = 0;
+  for (auto _ : state) {
+    if (impl) {
+      for_each_row_containing(*impl, column, pattern,
+                              [&](std::size_t) { ++found; });
+    } else {
+      for (const std::string &value : values) {
+        found += value.find(pattern) != std::string::npos;
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * values.size());
+  state.counters["matches/scan"] =
+      benchmark::Counter(found, benchmark::Counter::kAvgIterations);
+}
+
+// Whether a writer is inserting into a `ConcurrentQBRecordCollection` while
+// it is queried.
+//
+enum Writer { kIdle, kIngesting };
+
+const std::vector<std::pair<const char *, Writer>> kWriters = {
+    {"idle", kIdle},
+    {"ingesting", kIngesting},
+};
+
+record_type make_concurrent_record(unsigned id) {
+  return record_type{id, "name" + std::to_string(id), long(id % 100),
+                     id % 2 ? "odd" : "even"};
+}
+
+// Queries a collection of 10 thousand records from one thread, while a
+// writer inserts records and publishes them every 100 (if ingesting),
+// reporting the median and 99th percentile latency of each query.
+//
+void BM_QueryUnderIngestion(benchmark::State &state, Writer writer) {
+  using std::chrono::steady_clock;
+
+  constexpr unsigned kInitialRecords = 10 * 1000;
+  ConcurrentQBRecordCollection db;
+  for (unsigned id = 0; id < kInitialRecords; ++id) {
+    db.insert(make_concurrent_record(id));
+  }
+  db.publish();
+
+  std::atomic<bool> done{false};
+  std::thread writer_thread;
+  if (writer == kIngesting) {
+    writer_thread = std::thread{[&] {
+      for (unsigned id = kInitialRecords; !done; ++id) {
+        db.insert(make_concurrent_record(id));
+        if (id % 100 == 0) {
+          db.publish();
+        }
+      }
+    }};
+  }
+
+  std::vector<double> latencies;
+  unsigned i = 0;
+  for (auto _ : state) {
+    const auto start = steady_clock::now();
+    const auto snapshot = db.snapshot();
+    benchmark::DoNotOptimize(snapshot->find_matching_records(
+        "column1", std::to_string(i++ % 2000 * 7)));
+    latencies.emplace_back(elapsed_seconds(start) * 1e6);
+  }
+  done = true;
+  if (writer_thread.joinable()) {
+    writer_thread.join();
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+  state.SetItemsProcessed(state.iterations());
+  state.counters["p50_us"] = latencies[latencies.size() / 2];
+  state.counters["p99_us"] = latencies[latencies.size() * 99 / 100];
+}
+
+// Runs broad string queries against a `ShardedQBRecordCollection` of
+// `state.range(0)` records with `state.range(1)` shards, and a thread per
+// shard.
+//
+void BM_ShardedQuery(benchmark::State &state) {
+  const unsigned num_shards = state.range(1);
+  ShardedQBRecordCollection db{num_shards, num_shards};
+  db.bulk_insert(records_of_size(state.range(0)));
+
+  const std::vector<std::string> patterns = {"e", "a", "s", "in", "er"};
+  std::size_t i = 0;
+  std::size_t found = 0;
+  for (auto _ : state) {
+    found += db.find_matching_records("column1", patterns[i]).size();
+    i = (i + 1) % patterns.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["matches/query"] =
+      benchmark::Counter(found, benchmark::Counter::kAvgIterations);
+}
+
+// Registers `fn(state, args...)` as the benchmark `name`.
+//
+template <typename Fn, typename... Args>
+benchmark::internal::Benchmark *add(const std::string &name, Fn fn,
+                                    Args... args) {
+  return benchmark::RegisterBenchmark(name.c_str(), fn, args...);
+}
+
+// Registers `fn(state, args...)` as the benchmark `name`, for collections of
+// `kMinRecords` to `max_records` records.
+//
+template <typename Fn, typename... Args>
+benchmark::internal::Benchmark *add_sized(const std::string &name,
+                                          int max_records, Fn fn,
+                                          Args... args) {
+  return add(name, fn, args...)
+      ->ArgName("records")
+      ->RangeMultiplier(10)
+      ->Range(kMinRecords, max_records);
+}
+
+// Registers the pair `name<QBRecordCollection>/kind` and
+// `name<Baseline>/kind`.
+//
+template <typename Kind>
+void add_pair(const std::string &name, const char *kind_name, Kind kind,
+              void (*ours)(benchmark::State &, Kind),
+              void (*theirs)(benchmark::State &, Kind)) {
+  add_sized(name + "<QBRecordCollection>/" + kind_name, kMaxRecords, ours,
+            kind);
+  add_sized(name + "<Baseline>/" + kind_name, kMaxRecords, theirs, kind);
+}
+
+// Registers the build, query and teardown benchmarks of the substring index
+// `Index`, named `name`, on the keys `key_set`.
+//
+template <typename Index>
+void add_index_benchmarks(const std::string &name, KeySet key_set) {
+  const std::string suffix = "<" + name + ">/" + kKeySets[key_set].first;
+  add("BM_BuildIndex" + suffix, BM_BuildIndex<Index>, key_set)
+      ->Unit(benchmark::kMillisecond);
+  add("BM_QueryIndex" + suffix, BM_QueryIndex<Index>, key_set);
+  add("BM_TeardownIndex" + suffix, BM_TeardownIndex<Index>, key_set)
+      ->Iterations(10)
+      ->Unit(benchmark::kMillisecond);
+}
+
+void register_benchmarks() {
+  for (const auto &[name, outcome] : kOutcomes) {
+    add_pair("BM_FindId", name, outcome, BM_FindId<QBRecordCollection>,
+             BM_FindId<Baseline>);
+  }
+  for (const auto &[name, outcome] : kOutcomes) {
+    add_pair("BM_FindNumber", name, outcome,
+             BM_FindNumber<QBRecordCollection>, BM_FindNumber<Baseline>);
+  }
+  for (const auto &[name, selectivity] : kSelectivities) {
+    add_pair("BM_FindString", name, selectivity,
+             BM_FindString<QBRecordCollection>, BM_FindString<Baseline>);
+  }
+
+  // Every result of a batch is kept, so batches of common patterns over
+  // millions of records need gigabytes.
+  //
+  constexpr int kMaxBatchRecords = 100 * 1000;
+  for (const auto &[name, frequency] : kFrequencies) {
+    add_sized(std::string{"BM_FindStringEach/"} + name, kMaxBatchRecords,
+              BM_FindStringEach, frequency)
+        ->Unit(benchmark::kMillisecond);
+    add(std::string{"BM_FindStringBatch/"} + name, BM_FindStringBatch,
+        frequency)
+        ->ArgNames({"records", "threads"})
+        ->ArgsProduct({benchmark::CreateRange(kMinRecords, kMaxBatchRecords,
+                                              /*multi=*/10),
+                       {1, 4}})
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+  }
+
+  add_sized("BM_Insert", kMaxRecords, BM_Insert)
+      ->Unit(benchmark::kMillisecond);
+  add("BM_BulkInsert", BM_BulkInsert)
+      ->ArgNames({"records", "threads"})
+      ->ArgsProduct(
+          {benchmark::CreateRange(kMinRecords, kMaxRecords, /*multi=*/10),
+           {1, 2, 4, 8}})
+      ->Unit(benchmark::kMillisecond)
+      ->UseRealTime();
+  add_sized("BM_Teardown", kMaxRecords, BM_Teardown)
+      ->Unit(benchmark::kMillisecond);
+  add_sized("BM_Churn", 1000 * 1000, BM_Churn)
+      ->Unit(benchmark::kMillisecond);
+
+  for (const auto &[name, kind] : kVisitors) {
+    add(std::string{"BM_VisitMatches<StringTrie>/"} + name,
+        BM_VisitMatches<WordTrie>, kind)
+        ->Unit(benchmark::kMillisecond);
+    add(std::string{"BM_VisitMatches<QBColumnLookup>/"} + name,
+        BM_VisitMatches<WordLookup>, kind)
+        ->Unit(benchmark::kMillisecond);
+  }
+
+  for (const auto &[name, parser] : kParsers) {
+    add_sized(std::string{"BM_ParseRecords/"} + name, 1000 * 1000,
+              BM_ParseRecords, parser)
+        ->Unit(benchmark::kMillisecond);
+  }
+  for (const auto &[name, parser] : kParsers) {
+    add_sized(std::string{"BM_ImportRecords/"} + name, 1000 * 1000,
+              BM_ImportRecords, parser)
+        ->Unit(benchmark::kMillisecond);
+  }
+
+  for (const auto &[name, policy] : kLogPolicies) {
+    add(std::string{"BM_LoggedInsert/"} + name, BM_LoggedInsert, policy)
+        ->UseRealTime();
+  }
+  for (const auto &[name, policy] : kLogPolicies) {
+    if (policy) {
+      add(std::string{"BM_ConcurrentAppend/"} + name, BM_ConcurrentAppend,
+          *policy)
+          ->Threads(8)
+          ->UseRealTime();
+    }
+  }
+  add_sized("BM_Replay", 1000 * 1000, BM_Replay)
+      ->Unit(benchmark::kMillisecond);
+  add("BM_ReplayInterleaved", BM_ReplayInterleaved)
+      ->ArgNames({"records", "run"})
+      ->ArgsProduct({benchmark::CreateRange(kMinRecords, 1000 * 1000,
+                                            /*multi=*/10),
+                     {1, 100, 10 * 1000}})
+      ->Unit(benchmark::kMillisecond);
+
+  add_sized("BM_SaveSnapshot", 1000 * 1000, BM_SaveSnapshot)
+      ->Unit(benchmark::kMillisecond);
+  for (const auto &[name, start] : kSnapshotStarts) {
+    add_sized(std::string{"BM_OpenSnapshot/"} + name, 1000 * 1000,
+              BM_OpenSnapshot, start)
+        ->Unit(benchmark::kMillisecond);
+  }
+
+  add_index_benchmarks<StringTrie<int>>("StringTrie", kWords);
+  add_index_benchmarks<RadixTrie<int>>("RadixTrie", kWords);
+  add_index_benchmarks<SuffixArrayIndex<int>>("SuffixArrayIndex", kWords);
+  add_index_benchmarks<RadixTrie<int>>("RadixTrie", kLongValues);
+  add_index_benchmarks<SuffixArrayIndex<int>>("SuffixArrayIndex",
+                                              kLongValues);
+  add_index_benchmarks<TrigramIndex<int>>("TrigramIndex", kLongValues);
+
+  for (const auto &[name, layout] : kRecordLayouts) {
+    add_sized(std::string{"BM_ScanRecords/"} + name, 1000 * 1000,
+              BM_ScanRecords, layout);
+  }
+  add_sized("BM_IdMapInsert<unordered_map>", 1000 * 1000,
+            BM_IdMapInsert<HashIdMap>)
+      ->Unit(benchmark::kMillisecond);
+  add_sized("BM_IdMapInsert<DenseIdMap>", 1000 * 1000,
+            BM_IdMapInsert<DenseRowMap>)
+      ->Unit(benchmark::kMillisecond);
+  add_sized("BM_IdMapFind<unordered_map>", 1000 * 1000,
+            BM_IdMapFind<HashIdMap>);
+  add_sized("BM_IdMapFind<DenseIdMap>", 1000 * 1000, BM_IdMapFind<DenseRowMap>);
+
+  for (const auto &[name, kind] : kNumberIndexKinds) {
+    add_sized(std::string{"BM_NumberIndexBuild/"} + name, 1000 * 1000,
+              BM_NumberIndexBuild, kind)
+        ->Unit(benchmark::kMillisecond);
+    add_sized(std::string{"BM_NumberIndexEqual/"} + name, 1000 * 1000,
+              BM_NumberIndexEqual, kind);
+    if (kind != kHashMultimap) {
+      add_sized(std::string{"BM_NumberIndexRange/"} + name, 1000 * 1000,
+                BM_NumberIndexRange, kind);
+    }
+  }
+
+  for (const auto &[name, impl] : kScanImpls) {
+    if (impl && !is_supported(*impl)) {
+      continue;
+    }
+    for (const char *pattern : {"qz", "zyx", "tion", "e"}) {
+      add_sized(std::string{"BM_ScanColumn/"} + name + "/" + pattern,
+                1000 * 1000, BM_ScanColumn, impl, pattern);
+    }
+  }
+
+  for (const auto &[name, writer] : kWriters) {
+    add(std::string{"BM_QueryUnderIngestion/"} + name,
+        BM_QueryUnderIngestion, writer)
+        ->UseRealTime();
+  }
+  add("BM_ShardedQuery", BM_ShardedQuery)
+      ->ArgNames({"records", "shards"})
+      ->ArgsProduct({benchmark::CreateRange(kMinRecords, 1000 * 1000,
+                                            /*multi=*/10),
+                     {1, 2, 4, 8}})
+      ->UseRealTime();
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  register_benchmarks();
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -4,11 +4,18 @@
 #include "gtest/gtest.h"
 
 #include <algorithm>
+#include <functional>
 #include <limits>
+#include <map>
 #include <random>
+#include <set>
+
+#include <boost/optional/optional_io.hpp>
 
 #include "baseline.hpp"
-#include "timer.hpp"
+#include "heap_usage.hpp"
+#include "range_predicate.hpp"
+#include "string_trie.hpp"
 #include "words.hpp"
 
 namespace {
@@ -28,13 +35,29 @@ template <typename T> T make_copy(const T &val) { return val; }
 //  5. Multiple matches for:
 //     a. string field
 //     b. long field
-//  6. Stress test (large database, >10 million entries)
+//  6. Stress test (large database, up to 10 million entries; see
+//     qb_record_collection_benchmark.cpp)
 //     Repeatedly query for:
 //     a. no matches
 //     b. one match
 //     c. few matches
 //     d. many matches
 //     e. all of the above
+//  7. Paged and streaming queries:
+//     a. pages partition the full result set
+//     b. the callback can stop the search early
+//  8. Counting and existence queries agree with the full result set
+//  9. String queries agree with the baseline whether answered from the index
+//     (rare patterns) or by scanning the column (common patterns)
+// 10. The planner's choices are reported by `explain`
+// 11. Multi-column AND/OR queries agree with the baseline
+// 12. Bulk loads build the same collection as inserting one record at a time
+// 13. Batched queries agree with the same queries run one at a time
+// 14. Erasures and updates agree with the baseline, before and after
+//     compaction
+// 15. Memory usage reports account for the heap used by the collection
+// 16. Empty values are matched by the empty pattern, and only by it, whether
+//     the query is answered from the index or by scanning the column
 //
 class QBRecordCollectionTest : public ::testing::Test {
 protected:
@@ -66,6 +89,7 @@ protected:
           std::get<0>(record), std::get<1>(record), std::get<2>(record),
           std::get<3>(record),
       };
+      inserted_.emplace_back(record);
       db_.insert(std::move(record));
     }
   }
@@ -84,6 +108,10 @@ protected:
   // The baseline implementation.
   //
   baseline::QBRecordCollection base_;
+
+  // The records inserted into `db_`, in insertion order.
+  //
+  std::vector<QBRecord> inserted_;
 };
 
 //  1. Query empty database: no results
@@ -202,77 +230,732 @@ TEST_F(QBRecordCollectionTest, StringManyMatch) {
   EXPECT_GT(results.size(), 2u);
 }
 
+//  5. Multiple matches for:
+//     a. string field (pattern occurs more than once in one record)
+//
+TEST_F(QBRecordCollectionTest, StringRepeatedMatch) {
+  db_.insert(QBRecord{1, "eye", 10, "level"});
+  db_.insert(QBRecord{2, "see", 20, "never"});
+  db_.insert(QBRecord{3, "sky", 30, "dry"});
+
+  auto results = db_.find_matching_records("column3", "e");
+
+  ASSERT_THAT(results, ::testing::SizeIs(2));
+  EXPECT_EQ(std::get<0>(results[0]), 1u);
+  EXPECT_EQ(std::get<0>(results[1]), 2u);
+}
+
 //  5. Multiple matches for:
 //     b. long field
 //
-TEST_F(QBRecordCollectionTest, IntegerManyMatch) {}
-
-TEST_F(QBRecordCollectionTest, Perf) {
-  using std::chrono::steady_clock;
-
-  std::cerr << "RECORDS LOOP NEW_ID(q/s) BASE_ID(q/s) NEW_NUM(q/s) "
-               "BASE_NUM(q/s) NEW_STR(q/s) BASE_STR(q/s)"
-            << std::endl;
-
-  for (int count : {10, 100, 1000, 10 * 1000}) {
-    populateRecords(count);
-    for (int loop = 0; loop < 10; ++loop) {
-      std::cerr << count << " " << loop;
-
-      // Search for all ids.
-      //
-      {
-        auto start = steady_clock::now();
-        for (QBRecordCollection::unique_id_type id = 0; id < count; ++id) {
-          db_.find_matching_records("column0", std::to_string(id));
+TEST_F(QBRecordCollectionTest, IntegerManyMatch) {
+  populateRecords(1000);
+
+  for (bool compacted : {false, true}) {
+    if (compacted) {
+      db_.compact();
+    }
+    SCOPED_TRACE(compacted ? "compacted" : "not compacted");
+    for (const std::string pattern :
+         {"0", "17", "=-3", ">100", ">=100", "<-240", "<=-240",
+          "BETWEEN -10 AND 10", "between 5 and 5", "BETWEEN 10 AND -10",
+          ">9223372036854775807"}) {
+      const ValueRange<long> range = parse_range_predicate<long>(pattern);
+
+      std::vector<QBRecord> expected;
+      for (const baseline::QBRecord &rec : base_) {
+        if (range.lo <= rec.column2 && rec.column2 <= range.hi) {
+          expected.emplace_back(rec.column0, rec.column1, rec.column2,
+                                rec.column3);
         }
-        std::cerr << " " << count / elapsed_seconds(start);
       }
-      {
-        auto start = steady_clock::now();
-        for (QBRecordCollection::unique_id_type id = 0; id < count; ++id) {
-          QBFindMatchingRecords(base_, "column0", std::to_string(id));
-        }
-        std::cerr << " " << count / elapsed_seconds(start);
+
+      EXPECT_EQ(db_.find_matching_records("column2", pattern), expected)
+          << pattern;
+      EXPECT_EQ(db_.count_matching_records("column2", pattern),
+                expected.size())
+          << pattern;
+    }
+  }
+}
+
+// Record references agree with copied records for all column types.
+//
+TEST_F(QBRecordCollectionTest, RecordRefs) {
+  populateRecords(100);
+
+  for (const auto &[column, pattern] :
+       std::vector<std::pair<std::string, std::string>>{{"column0", "42"},
+                                                        {"column0", "100"},
+                                                        {"column1", "e"},
+                                                        {"column2", "3"},
+                                                        {"column3", "ab"},
+                                                        {"column3", "zzzz"}}) {
+    const auto records = db_.find_matching_records(column, pattern);
+    const auto refs = db_.find_matching_record_refs(column, pattern);
+
+    ASSERT_EQ(refs.size(), records.size());
+    for (std::size_t i = 0; i < refs.size(); ++i) {
+      EXPECT_EQ(refs[i].to_record(), records[i]);
+      EXPECT_EQ(refs[i].get<0>(), std::get<0>(records[i]));
+      EXPECT_EQ(refs[i].get<1>(), std::get<1>(records[i]));
+      EXPECT_EQ(refs[i].get<2>(), std::get<2>(records[i]));
+      EXPECT_EQ(refs[i].get<3>(), std::get<3>(records[i]));
+    }
+  }
+}
+
+//  7. Paged and streaming queries:
+//     a. pages partition the full result set
+//
+TEST_F(QBRecordCollectionTest, Pagination) {
+  populateRecords(1000);
+
+  for (const auto &[column, pattern] :
+       std::vector<std::pair<std::string, std::string>>{
+           {"column1", "e"}, {"column2", "3"}, {"column0", "7"}}) {
+    auto expected = db_.find_matching_records(column, pattern);
+    ASSERT_FALSE(expected.empty());
+
+    std::vector<QBRecord> actual;
+    for (std::size_t offset = 0;; offset += 7) {
+      const auto page = db_.find_matching_records(
+          column, pattern, QBRecordCollection::QueryLimits{offset, 7});
+      EXPECT_LE(page.size(), 7u);
+      actual.insert(actual.end(), page.begin(), page.end());
+      if (page.size() < 7) {
+        break;
       }
+    }
 
-      // Search for all nums.
-      //
-      {
-        auto start = steady_clock::now();
-        for (long num = -count / 4; num <= count / 4; ++num) {
-          db_.find_matching_records("column2", std::to_string(num));
-        }
-        std::cerr << " " << count / 2 / elapsed_seconds(start);
+    std::sort(actual.begin(), actual.end());
+    std::sort(expected.begin(), expected.end());
+    EXPECT_EQ(actual, expected);
+  }
+
+  EXPECT_THAT(db_.find_matching_records(
+                  "column1", "e", QBRecordCollection::QueryLimits{0, 0}),
+              ::testing::IsEmpty());
+}
+
+//  7. Paged and streaming queries:
+//     b. the callback can stop the search early
+//
+TEST_F(QBRecordCollectionTest, StreamingEarlyStop) {
+  populateRecords(1000);
+
+  std::vector<QBRecord> seen;
+  const std::size_t count = db_.for_each_matching_record(
+      "column3", "e", [&](const QBRecordCollection::RecordRef &ref) {
+        EXPECT_NE(ref.get<3>().find('e'), std::string_view::npos);
+        seen.emplace_back(ref.to_record());
+        return seen.size() == 5 ? VisitResult::kStop : VisitResult::kContinue;
+      });
+  EXPECT_EQ(count, 5u);
+  EXPECT_THAT(seen, ::testing::SizeIs(5));
+
+  // Without a stop, every match is streamed exactly once.
+  //
+  seen.clear();
+  db_.for_each_matching_record("column3", "e",
+                               [&](const QBRecordCollection::RecordRef &ref) {
+                                 seen.emplace_back(ref.to_record());
+                                 return VisitResult::kContinue;
+                               });
+  EXPECT_EQ(seen.size(), db_.find_matching_records("column3", "e").size());
+}
+
+//  8. Counting and existence queries agree with the full result set
+//
+TEST_F(QBRecordCollectionTest, CountAndAnyMatch) {
+  populateRecords(1000);
+
+  for (const auto &[column, pattern] :
+       std::vector<std::pair<std::string, std::string>>{{"column0", "42"},
+                                                        {"column0", "1000"},
+                                                        {"column1", "e"},
+                                                        {"column1", "ab"},
+                                                        {"column1", ""},
+                                                        {"column2", "3"},
+                                                        {"column2", "99999"},
+                                                        {"column3", "zzzz"},
+                                                        {"columnX", "1"}}) {
+    const std::size_t expected =
+        db_.find_matching_records(column, pattern).size();
+    EXPECT_EQ(db_.count_matching_records(column, pattern), expected)
+        << column << " " << pattern;
+    EXPECT_EQ(db_.any_match(column, pattern), expected != 0)
+        << column << " " << pattern;
+  }
+
+  // Whichever plan is chosen, with and without erased rows.
+  //
+  std::vector<std::string> patterns = {"", "zzzz"};
+  for (char c = 'a'; c <= 'z'; ++c) {
+    patterns.emplace_back(1, c);
+  }
+  for (std::size_t i = 0; i < words_.size(); i += 10) {
+    patterns.emplace_back(words_[i]);
+  }
+  std::set<QueryAccess> plans;
+  for (const char *stage : {"inserted", "erased"}) {
+    for (const std::string column : {"column1", "column3"}) {
+      for (const std::string &pattern : patterns) {
+        const std::size_t expected =
+            db_.find_matching_records(column, pattern).size();
+        EXPECT_EQ(db_.count_matching_records(column, pattern), expected)
+            << stage << " " << column << " " << pattern;
+        EXPECT_EQ(db_.any_match(column, pattern), expected != 0)
+            << stage << " " << column << " " << pattern;
+        plans.insert(db_.explain(column, pattern).access);
       }
-      {
-        auto start = steady_clock::now();
-        for (long num = -count / 4; num <= count / 4; ++num) {
-          QBFindMatchingRecords(base_, "column2", std::to_string(num));
-        }
-        std::cerr << " " << count / 2 / elapsed_seconds(start);
+    }
+    for (unsigned id = 0; id < 1000; id += 3) {
+      db_.erase(id);
+    }
+  }
+  EXPECT_THAT(plans, ::testing::UnorderedElementsAre(QueryAccess::kIndex,
+                                                     QueryAccess::kScan));
+}
+
+//  9. String queries agree with the baseline whether answered from the index
+//     (rare patterns) or by scanning the column (common patterns)
+//
+TEST_F(QBRecordCollectionTest, StringMatchesBaseline) {
+  populateRecords(1000);
+
+  for (const std::string column : {"column1", "column3"}) {
+    for (const std::string &pattern : std::vector<std::string>{
+             "", "e", "a", "ab", "the", "zzzz", words_[0], words_[7]}) {
+      std::vector<QBRecord> expected;
+      for (const baseline::QBRecord &rec :
+           QBFindMatchingRecords(base_, column, pattern)) {
+        expected.emplace_back(rec.column0, rec.column1, rec.column2,
+                              rec.column3);
       }
+      EXPECT_EQ(db_.find_matching_records(column, pattern), expected)
+          << column << " " << pattern;
+
+      std::size_t streamed = 0;
+      db_.for_each_matching_record(
+          column, pattern,
+          [&](const QBRecordCollection::RecordRef &) { ++streamed; });
+      EXPECT_EQ(streamed, expected.size()) << column << " " << pattern;
+    }
+  }
+}
+
+// 16. Empty values are matched by the empty pattern, and only by it, whether
+//     the query is answered from the index or by scanning the column
+//
+TEST_F(QBRecordCollectionTest, EmptyValues) {
+  populateRecords(1000);
+  // In id order, as the collection returns them.
+  //
+  std::vector<QBRecord> mixed = inserted_;
+  std::sort(mixed.begin(), mixed.end());
+  for (std::size_t i = 0; i < mixed.size(); i += 4) {
+    std::get<1>(mixed[i]).clear();
+  }
+  for (std::size_t i = 0; i < mixed.size(); i += 5) {
+    std::get<3>(mixed[i]).clear();
+  }
 
-      // Search for all words.
-      //
-      {
-        auto start = steady_clock::now();
-        for (const auto &w : words_) {
-          db_.find_matching_records("column1", w);
+  std::set<QueryAccess> plans;
+  // A small collection (where scans are cheap), one with only empty values,
+  // and a larger one.
+  //
+  for (const std::vector<QBRecord> &records :
+       std::vector<std::vector<QBRecord>>{
+           {{1, "", 0, ""}, {2, "abc", 0, "abc"}},
+           {{1, "", 0, ""}},
+           mixed,
+       }) {
+    QBRecordCollection db;
+    baseline::QBRecordCollection base;
+    for (const auto &[id, s1, n, s3] : records) {
+      db.insert(QBRecord{id, s1, n, s3});
+      base.push_back(baseline::QBRecord{id, s1, n, s3});
+    }
+    for (const std::string column : {"column1", "column3"}) {
+      for (const std::string &pattern :
+           std::vector<std::string>{"", "e", "abc", "zzzz", words_[0]}) {
+        std::vector<QBRecord> expected;
+        for (const baseline::QBRecord &rec :
+             QBFindMatchingRecords(base, column, pattern)) {
+          expected.emplace_back(rec.column0, rec.column1, rec.column2,
+                                rec.column3);
         }
-        std::cerr << " " << words_.size() / elapsed_seconds(start);
+        EXPECT_EQ(db.find_matching_records(column, pattern), expected)
+            << column << " " << pattern;
+        EXPECT_EQ(db.count_matching_records(column, pattern), expected.size())
+            << column << " " << pattern;
+        EXPECT_EQ(db.any_match(column, pattern), !expected.empty())
+            << column << " " << pattern;
+        plans.insert(db.explain(column, pattern).access);
       }
-      {
-        auto start = steady_clock::now();
-        for (const auto &w : words_) {
-          QBFindMatchingRecords(base_, "column1", w);
+    }
+  }
+  EXPECT_THAT(plans, ::testing::UnorderedElementsAre(QueryAccess::kIndex,
+                                                     QueryAccess::kScan));
+}
+
+// 10. The planner's choices are reported by `explain`
+//
+TEST_F(QBRecordCollectionTest, Explain) {
+  populateRecords(1000);
+
+  const QueryPlan common = db_.explain("column1", "e");
+  EXPECT_EQ(common.access, QueryAccess::kScan) << to_string(common);
+  EXPECT_EQ(common.column, 1);
+  EXPECT_EQ(common.records, 1000u);
+  EXPECT_EQ(common.estimated_matches,
+            db_.count_matching_records("column1", "e"));
+  EXPECT_LT(common.scan_cost, common.index_cost);
+  EXPECT_THAT(to_string(common), ::testing::StartsWith("scan column=1 "));
+
+  const QueryPlan rare = db_.explain("column3", "zzzz");
+  EXPECT_EQ(rare.access, QueryAccess::kIndex) << to_string(rare);
+  EXPECT_EQ(rare.estimated_matches, std::size_t{0});
+
+  const QueryPlan number = db_.explain("column2", "BETWEEN 1 AND 10");
+  EXPECT_EQ(number.access, QueryAccess::kIndex);
+  EXPECT_EQ(number.estimated_matches,
+            db_.count_matching_records("column2", "BETWEEN 1 AND 10"));
+
+  EXPECT_EQ(db_.explain("column0", "42").access, QueryAccess::kUniqueId);
+  EXPECT_EQ(db_.explain("column0", "42").estimated_matches, std::size_t{1});
+  EXPECT_EQ(db_.explain("columnX", "42").access, QueryAccess::kNone);
+  EXPECT_EQ(to_string(db_.explain("columnX", "42")), "none");
+
+  // Without an estimate, the index is always used.
+  //
+  EXPECT_EQ(plan_substring_query(1, 1000, boost::none).access,
+            QueryAccess::kIndex);
+  EXPECT_EQ(plan_substring_query(1, 1000, 1000u).access, QueryAccess::kScan);
+  EXPECT_EQ(plan_substring_query(1, 1000, 1u).access, QueryAccess::kIndex);
+}
+
+// 11. Multi-column AND/OR queries agree with the baseline
+//
+TEST_F(QBRecordCollectionTest, MultiPredicate) {
+  using Predicates = std::vector<ColumnPredicate>;
+
+  populateRecords(1000);
+
+  // Evaluates `predicates` against the baseline records.
+  //
+  const auto expected_records = [&](const Predicates &predicates,
+                                    PredicateOp op) {
+    std::vector<QBRecord> expected;
+    for (const baseline::QBRecord &rec : base_) {
+      const baseline::QBRecordCollection one{rec};
+      bool all = true, any = false;
+      for (const ColumnPredicate &p : predicates) {
+        bool match = false;
+        if (p.column == "column2") {
+          const ValueRange<long> range = parse_range_predicate<long>(p.match);
+          match = range.lo <= rec.column2 && rec.column2 <= range.hi;
+        } else {
+          match = !QBFindMatchingRecords(one, std::string{p.column},
+                                         std::string{p.match})
+                       .empty();
         }
-        std::cerr << " " << words_.size() / elapsed_seconds(start);
+        all = all && match;
+        any = any || match;
+      }
+      if (op == PredicateOp::kAnd ? all : any) {
+        expected.emplace_back(rec.column0, rec.column1, rec.column2,
+                              rec.column3);
+      }
+    }
+    return expected;
+  };
+
+  for (const Predicates &predicates : std::vector<Predicates>{
+           {},
+           {{"column1", "e"}},
+           {{"column1", "e"}, {"column2", ">0"}},
+           {{"column1", "e"}, {"column3", "a"}, {"column2", "<=10"}},
+           {{"column1", "the"}, {"column3", "e"}},
+           {{"column2", "BETWEEN -5 AND 5"}, {"column1", "a"}},
+           {{"column0", "42"}, {"column1", ""}},
+           {{"column0", "4242"}, {"column2", "BETWEEN -5 AND 5"}},
+           {{"column1", "zzzz"}, {"column3", "ab"}},
+       }) {
+    for (const PredicateOp op : {PredicateOp::kAnd, PredicateOp::kOr}) {
+      const auto expected = expected_records(predicates, op);
+      EXPECT_EQ(db_.find_matching_records(predicates, op), expected)
+          << predicates.size() << " predicates, op " << int(op);
+      EXPECT_EQ(db_.count_matching_records(predicates, op), expected.size());
+    }
+  }
+
+  // Predicates on unknown columns match nothing.
+  //
+  EXPECT_THAT(db_.find_matching_records(
+                  {{"column1", "e"}, {"columnX", "e"}}, PredicateOp::kAnd),
+              ::testing::IsEmpty());
+  EXPECT_EQ(db_.find_matching_records({{"column1", "e"}, {"columnX", "e"}},
+                                      PredicateOp::kOr),
+            db_.find_matching_records("column1", "e"));
+}
+
+// 12. Bulk loads build the same collection as inserting one record at a time
+//
+TEST_F(QBRecordCollectionTest, BulkInsert) {
+  populateRecords(5000);
+  db_.compact();
+
+  // Insert a few records one at a time first, and repeat some in the bulk
+  // load; only the first copy of each is kept.
+  //
+  QBRecordCollection bulk;
+  for (int i = 0; i < 100; ++i) {
+    bulk.insert(make_copy(inserted_[i]));
+  }
+  std::vector<QBRecord> rest(inserted_.begin() + 100, inserted_.end());
+  rest.emplace_back(inserted_[0]);
+  rest.emplace_back(inserted_[1000]);
+  std::get<1>(rest.back()) = "notinserted";
+  EXPECT_EQ(bulk.bulk_insert(rest, /*num_threads=*/4), inserted_.size() - 100);
+  EXPECT_EQ(bulk.bulk_insert(std::vector<QBRecord>{}, 4), 0u);
+
+  // Paged results come in index order, so also check that the indices hold
+  // the same rows in the same order.
+  //
+  const QueryLimits first_page{/*offset=*/0, /*limit=*/50};
+  for (const auto &[column, match] :
+       std::vector<std::pair<std::string, std::string>>{
+           {"column0", "17"},
+           {"column0", "5000"},
+           {"column1", "e"},
+           {"column1", "the"},
+           {"column1", "notinserted"},
+           {"column3", "ab"},
+           {"column3", ""},
+           {"column2", "BETWEEN -100 AND 100"},
+           {"column2", "<-1000"},
+       }) {
+    EXPECT_EQ(bulk.find_matching_records(column, match),
+              db_.find_matching_records(column, match))
+        << column << " " << match;
+    EXPECT_EQ(bulk.find_matching_records(column, match, first_page),
+              db_.find_matching_records(column, match, first_page))
+        << column << " " << match;
+    EXPECT_EQ(bulk.count_matching_records(column, match),
+              db_.count_matching_records(column, match))
+        << column << " " << match;
+  }
+}
+
+// 13. Batched queries agree with the same queries run one at a time
+//
+TEST_F(QBRecordCollectionTest, BatchQueries) {
+  populateRecords(2000);
+
+  const std::vector<std::pair<std::string, std::vector<std::string_view>>>
+      batches = {
+          {"column0", {"7", "1999", "2000", "7", "0"}},
+          {"column1", {"the", "th", "e", "zzz", "", "t", "the", "ab", "abc"}},
+          {"column3", {"a", "b", "ing", "in", "i"}},
+          {"column2", {"5", ">400", "BETWEEN -3 AND 3", "-7", "5"}},
+          {"column1", {}},
+      };
+  for (const auto &[column, patterns] : batches) {
+    for (const unsigned num_threads : {1, 3}) {
+      const auto results =
+          db_.find_matching_records_batch(column, patterns, num_threads);
+      ASSERT_EQ(results.size(), patterns.size());
+      for (std::size_t i = 0; i < patterns.size(); ++i) {
+        EXPECT_EQ(results[i], db_.find_matching_records(column, patterns[i]))
+            << column << " " << patterns[i];
       }
+    }
+  }
+
+  const auto results = db_.find_matching_records_batch("columnX", {"a", "b"});
+  EXPECT_THAT(results, ::testing::ElementsAre(::testing::IsEmpty(),
+                                              ::testing::IsEmpty()));
+}
+
+// Batches of many patterns, common (all three-letter words) or rare (pairs of
+// words), agree with the same queries run one at a time.
+//
+TEST_F(QBRecordCollectionTest, BatchQueryPatternSets) {
+  populateRecords(2000);
+  db_.compact();
+
+  std::vector<std::string> pairs;
+  for (std::size_t i = 0; i + 1 < words_.size(); i += 2) {
+    pairs.emplace_back(words_[i] + words_[i + 1]);
+  }
+  for (const std::vector<std::string> *strings : {&words_, &pairs}) {
+    const std::vector<std::string_view> patterns(strings->begin(),
+                                                 strings->end());
+    std::vector<std::vector<QBRecord>> expected;
+    for (const std::string_view pattern : patterns) {
+      expected.emplace_back(db_.find_matching_records("column1", pattern));
+    }
+    for (const unsigned num_threads : {1, 4}) {
+      EXPECT_EQ(
+          db_.find_matching_records_batch("column1", patterns, num_threads),
+          expected);
+    }
+  }
+}
+
+// 14. Erasures and updates agree with the baseline, before and after
+//     compaction
+//
+TEST_F(QBRecordCollectionTest, EraseAndUpdate) {
+  populateRecords(3000);
+
+  // The records expected in `db_`, by id.
+  //
+  std::map<unsigned, QBRecord> expected;
+  for (const QBRecord &record : inserted_) {
+    expected.emplace(std::get<0>(record), record);
+  }
+
+  const auto check = [&](const char *stage) {
+    baseline::QBRecordCollection base;
+    for (const auto &[id, record] : expected) {
+      base.push_back(baseline::QBRecord{id, std::get<1>(record),
+                                        std::get<2>(record),
+                                        std::get<3>(record)});
+    }
+    for (const auto &[column, pattern] :
+         std::vector<std::pair<std::string, std::string>>{
+             {"column0", "3"},
+             {"column0", "4"},
+             {"column1", ""},
+             {"column1", "e"},
+             {"column1", "upd"},
+             {"column1", words_[0]},
+             {"column3", "ab"},
+             {"column2", "-7"},
+             {"column2", "7"},
+         }) {
+      std::vector<QBRecord> matches;
+      for (const baseline::QBRecord &rec :
+           QBFindMatchingRecords(base, column, pattern)) {
+        matches.emplace_back(rec.column0, rec.column1, rec.column2,
+                             rec.column3);
+      }
+      EXPECT_EQ(db_.find_matching_records(column, pattern), matches)
+          << stage << " " << column << " " << pattern;
+      if (column != "column0") {
+        EXPECT_EQ(db_.count_matching_records(column, pattern), matches.size())
+            << stage << " " << column << " " << pattern;
+      }
+
+      std::size_t streamed = 0;
+      db_.for_each_matching_record(
+          column, pattern,
+          [&](const QBRecordCollection::RecordRef &) { ++streamed; });
+      EXPECT_EQ(streamed, matches.size())
+          << stage << " " << column << " " << pattern;
+    }
+    EXPECT_EQ(db_.count_matching_records({}, PredicateOp::kAnd),
+              expected.size())
+        << stage;
+  };
+
+  // Erase every third record, and update every fifth, changing some of its
+  // columns.
+  //
+  for (unsigned id = 0; id < 3000; id += 3) {
+    EXPECT_TRUE(db_.erase(id));
+    expected.erase(id);
+  }
+  EXPECT_FALSE(db_.erase(0));
+  EXPECT_FALSE(db_.erase(3000));
+  for (unsigned id = 0; id < 3000; id += 5) {
+    QBRecord record = expected.count(id) ? expected[id] : inserted_[0];
+    std::get<0>(record) = id;
+    std::get<1>(record) = "upd" + std::get<1>(record);
+    if (id % 2 == 0) {
+      std::get<2>(record) = -std::get<2>(record);
+    }
+    EXPECT_EQ(db_.update(make_copy(record)), expected.count(id) != 0);
+    if (expected.count(id)) {
+      expected[id] = record;
+      EXPECT_TRUE(db_.update(make_copy(record)));
+    }
+  }
+  check("erased");
+
+  db_.compact();
+  check("compacted");
+
+  // Erased ids can be inserted again.
+  //
+  for (unsigned id = 0; id < 300; id += 3) {
+    QBRecord record = inserted_[id];
+    std::get<0>(record) = id;
+    EXPECT_TRUE(db_.insert(make_copy(record)));
+    expected[id] = record;
+  }
+  check("reinserted");
+}
 
-      std::cerr << std::endl;
+// A churn of erasures, updates and insertions, then compaction, leaves the
+// same collection as rebuilding it from scratch.
+//
+TEST_F(QBRecordCollectionTest, ChurnMatchesRebuild) {
+  constexpr int kCount = 4000;
+  constexpr int kChurn = kCount / 10;
+  populateRecords(kCount);
+  db_.compact();
+
+  // Erase the first kChurn ids, update the next kChurn, and insert kChurn new
+  // records.
+  //
+  std::vector<QBRecord> by_id(kCount);
+  for (const QBRecord &record : inserted_) {
+    by_id[std::get<0>(record)] = record;
+  }
+  std::vector<QBRecord> after;
+  for (int id = kChurn; id < kCount; ++id) {
+    QBRecord record = by_id[id];
+    if (id < 2 * kChurn) {
+      std::get<1>(record) += "x";
     }
+    after.emplace_back(std::move(record));
+  }
+  for (int id = kCount; id < kCount + kChurn; ++id) {
+    QBRecord record = inserted_[id - kCount];
+    std::get<0>(record) = id;
+    after.emplace_back(std::move(record));
+  }
+
+  for (unsigned id = 0; id < kChurn; ++id) {
+    db_.erase(id);
+  }
+  for (int i = 0; i < kChurn; ++i) {
+    db_.update(make_copy(after[i]));
   }
+  for (std::size_t i = after.size() - kChurn; i < after.size(); ++i) {
+    db_.insert(make_copy(after[i]));
+  }
+  db_.compact();
+
+  QBRecordCollection rebuilt;
+  rebuilt.bulk_insert(after);
+
+  EXPECT_EQ(db_.find_matching_records("column1", "x"),
+            rebuilt.find_matching_records("column1", "x"));
+  EXPECT_EQ(db_.count_matching_records("column1", "x"),
+            rebuilt.count_matching_records("column1", "x"));
+}
+
+// 15. Memory usage reports account for the heap used by the collection
+//
+TEST_F(QBRecordCollectionTest, MemoryUsage) {
+  constexpr std::size_t kCount = 2000;
+  populateRecords(kCount);
+  std::size_t chars1 = 0, chars3 = 0;
+  for (const QBRecord &record : inserted_) {
+    chars1 += std::get<1>(record).size();
+    chars3 += std::get<3>(record).size();
+  }
+
+  // Build on the calling thread, so that every allocation comes from the
+  // heap arena that `heap_bytes_in_use` measures.
+  //
+  const std::size_t heap_before = heap_bytes_in_use();
+  QBRecordCollection db;
+  db.bulk_insert(inserted_, /*num_threads=*/1);
+  const std::size_t heap_bytes = heap_bytes_in_use() - heap_before;
+
+  const QBRecordCollection::MemoryReport report = db.memory_usage();
+  SCOPED_TRACE(::testing::Message() << "\n" << report);
+  EXPECT_EQ(report.records.num_entries, kCount);
+  EXPECT_EQ(report.columns[0].num_entries, kCount);
+  EXPECT_EQ(report.columns[2].num_entries, kCount);
+  EXPECT_EQ(report.columns[1].indexed_chars, chars1);
+  EXPECT_EQ(report.columns[3].indexed_chars, chars3);
+  for (const int i : {1, 3}) {
+    const MemoryUsage &usage = report.columns[i];
+    EXPECT_GT(usage.num_nodes, usage.num_inner_nodes);
+    EXPECT_GE(usage.average_fanout(), 1.0);
+    EXPECT_GT(usage.bytes_per_indexed_char(), 0.0);
+  }
+  if (heap_bytes != 0) {
+    // The report leaves out the heap's own overhead, but the heap may also
+    // have reused memory freed by earlier tests.
+    //
+    EXPECT_LE(report.total_bytes(), heap_bytes * 1.01);
+    EXPECT_GE(report.total_bytes(), heap_bytes * 0.9);
+  }
+
+  // Erased rows stay in the record store until compaction, but leave the
+  // indices straight away.
+  //
+  for (unsigned id = 0; id < kCount / 2; ++id) {
+    db.erase(id);
+  }
+  EXPECT_EQ(db.memory_usage().records.num_entries, kCount);
+  EXPECT_EQ(db.memory_usage().columns[0].num_entries, kCount / 2);
+  EXPECT_LT(db.memory_usage().columns[1].indexed_chars, chars1);
+  db.compact();
+  const QBRecordCollection::MemoryReport compacted = db.memory_usage();
+  EXPECT_EQ(compacted.records.num_entries, kCount / 2);
+  EXPECT_EQ(compacted.columns[2].num_entries, kCount / 2);
+  EXPECT_LT(compacted.records.bytes, report.records.bytes);
+}
+
+// Type-erasing a visitor behind `std::function` doesn't change what it
+// visits, whether it is passed to the trie or through `QBColumnLookup`.
+//
+TEST(QBColumnLookupTest, ErasedVisitor) {
+  const std::vector<std::string> words = load_words();
+  StringTrie<unsigned> trie;
+  QBColumnLookup<unsigned, std::string> lookup;
+  for (unsigned i = 0; i < words.size(); ++i) {
+    trie.insert_suffixes(words[i], i);
+    lookup.insert(i, words[i]);
+  }
+
+  const std::vector<std::string> patterns = {"e", "a", "s", "in", "er"};
+
+  // Captures enough state that `std::function` can not store it inline.
+  //
+  std::size_t matches = 0;
+  unsigned long checksum = 0;
+  unsigned max_id = 0;
+  const auto visitor = [&matches, &checksum, &max_id](unsigned id) {
+    ++matches;
+    checksum += id;
+    max_id = std::max(max_id, id);
+    return VisitResult::kContinue;
+  };
+  using ErasedVisitor = std::function<VisitResult(unsigned)>;
+
+  // Runs all patterns, returning the checksum of the ids visited.
+  //
+  const auto run = [&](const auto &query) {
+    matches = checksum = max_id = 0;
+    for (const std::string &pattern : patterns) {
+      query(pattern);
+    }
+    return checksum;
+  };
+
+  EXPECT_EQ(run([&](const std::string &pattern) {
+              trie.for_each_prefix_match(pattern, ErasedVisitor{visitor});
+            }),
+            run([&](const std::string &pattern) {
+              trie.for_each_prefix_match(pattern, visitor);
+            }));
+  EXPECT_EQ(run([&](const std::string &pattern) {
+              lookup.for_each_match(pattern, ErasedVisitor{visitor});
+            }),
+            run([&](const std::string &pattern) {
+              lookup.for_each_match(pattern, visitor);
+            }));
+  EXPECT_GT(matches, 0u);
 }
 
 } // namespace
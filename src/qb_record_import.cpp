@@ -0,0 +1,162 @@
+#include "qb_record_import.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "tuples.hpp"
+
+// Local helper functions.
+//
+namespace {
+
+constexpr std::size_t kNumColumns = std::tuple_size<QBRecordView>::value;
+
+[[noreturn]] void throw_error(const std::string &what,
+                              const std::string &path) {
+  throw std::runtime_error{what + ": " + path};
+}
+
+bool parse_field(std::string_view field, std::string_view &value) {
+  value = field;
+  return true;
+}
+
+template <typename T> bool parse_field(std::string_view field, T &value) {
+  static_assert(std::is_integral_v<T>, "numeric columns must be integers");
+  const char *end = field.data() + field.size();
+  const auto [ptr, ec] = std::from_chars(field.data(), end, value);
+  return ec == std::errc{} && ptr == end && !field.empty();
+}
+
+// Parses the line starting at offset `pos` of `text` into `record`, leaving
+// `pos` at the end of the line (its '\n', or the end of `text`) if it is well
+// formed.  Returns false if it isn't; see `parse_record`.
+//
+bool parse_line(std::string_view text, char delimiter, std::size_t &pos,
+                QBRecordView &record) {
+  bool ok = true;
+  for_each_upto<kNumColumns>([&](auto i) {
+    constexpr int I = decltype(i)::value;
+    constexpr bool kLast = I + 1 == kNumColumns;
+    if (!ok) {
+      return;
+    }
+    const std::size_t end = find_field_end(text, delimiter, pos);
+    const bool at_line_end = end == text.size() || text[end] == '\n';
+    std::string_view field = text.substr(pos, end - pos);
+    if (kLast && !field.empty() && field.back() == '\r') {
+      field.remove_suffix(1);
+    }
+    ok = at_line_end == kLast && parse_field(field, std::get<I>(record));
+    pos = kLast ? end : end + 1;
+  });
+  return ok;
+}
+
+} // namespace
+
+std::size_t find_field_end(std::string_view text, char delimiter,
+                           std::size_t from) {
+#if defined(__x86_64__)
+  // SSE2 is part of the x86-64 baseline, so this needs no runtime check.
+  //
+  const __m128i delimiters = _mm_set1_epi8(delimiter);
+  const __m128i newlines = _mm_set1_epi8('\n');
+  for (; from + 16 <= text.size(); from += 16) {
+    const __m128i block =
+        _mm_loadu_si128((const __m128i *)(text.data() + from));
+    const std::uint32_t mask = _mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(block, delimiters),
+                     _mm_cmpeq_epi8(block, newlines)));
+    if (mask != 0) {
+      return from + __builtin_ctz(mask);
+    }
+  }
+#endif
+  for (; from < text.size(); ++from) {
+    if (text[from] == delimiter || text[from] == '\n') {
+      return from;
+    }
+  }
+  return text.size();
+}
+
+bool parse_record(std::string_view line, char delimiter,
+                  QBRecordView &record) {
+  std::size_t pos = 0;
+  return parse_line(line, delimiter, pos, record) && pos == line.size();
+}
+
+RecordFileReader::RecordFileReader(const std::string &path,
+                                   const ImportOptions &options)
+    : path_{path}, options_{options} {
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw_error("can't open input file", path);
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    ::close(fd);
+    throw_error("can't stat input file", path);
+  }
+  size_ = st.st_size;
+  if (size_ > 0) {
+    map_ = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map_ == MAP_FAILED) {
+      map_ = nullptr;
+      ::close(fd);
+      throw_error("can't map input file", path);
+    }
+    // The file is read once, front to back.
+    //
+    ::madvise(map_, size_, MADV_SEQUENTIAL);
+    data_ = static_cast<const char *>(map_);
+  }
+  ::close(fd);
+
+  if (options_.skip_header) {
+    const std::string_view text{data_, size_};
+    pos_ = std::min(text.find('\n'), size_);
+  }
+}
+
+RecordFileReader::~RecordFileReader() noexcept {
+  if (map_) {
+    ::munmap(map_, size_);
+  }
+}
+
+bool RecordFileReader::next_chunk(std::vector<QBRecordView> &chunk) {
+  chunk.clear();
+  const std::string_view text{data_, size_};
+  while (pos_ < size_ && chunk.size() < options_.chunk_size) {
+    // `pos_` is at the start of a line, or at the newline ending the previous
+    // one.
+    //
+    if (text[pos_] == '\n') {
+      ++pos_;
+      ++line_;
+      continue;
+    }
+    if (text[pos_] == '\r' && (pos_ + 1 == size_ || text[pos_ + 1] == '\n')) {
+      ++pos_;
+      continue;
+    }
+    QBRecordView &record = chunk.emplace_back();
+    if (!parse_line(text, options_.delimiter, pos_, record)) {
+      throw_error("malformed record on line " + std::to_string(line_), path_);
+    }
+  }
+  return !chunk.empty();
+}
@@ -0,0 +1,127 @@
+// QBRecordImport - parsing records from delimited text files (CSV or TSV)
+// without copying them.
+//
+// An input file holds one record per line, with its columns in order
+// separated by a delimiter character.  There is no quoting or escaping, so
+// string values can't contain the delimiter or a newline.  Lines may end in
+// "\r\n", the last line needn't end in a newline, and empty lines are
+// skipped.  Numeric columns are decimal integers.
+//
+// `RecordFileReader` maps the file into memory and parses it into
+// `QBRecordView`s, in which each string column is a `std::string_view` into
+// the mapping; nothing is allocated per record, and each value is copied
+// once, straight into a collection's column store (see
+// `QBRecordCollection::import_records`).  Fields are split by
+// `find_field_end`, which looks for the delimiter and the newline 16
+// characters at a time with SSE2 (on x86-64), and numeric fields are
+// converted by `std::from_chars`, which, unlike `boost::lexical_cast`, neither
+// allocates, throws, nor consults the locale.
+//
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "qb_record.hpp"
+
+template <typename Record> struct RecordViewFor;
+
+template <typename... Ts> struct RecordViewFor<std::tuple<Ts...>> {
+  using type = std::tuple<std::conditional_t<
+      std::is_same_v<Ts, std::string>, std::string_view, Ts>...>;
+};
+
+// A record whose string columns refer to characters stored elsewhere.
+//
+using QBRecordView = RecordViewFor<QBRecord>::type;
+
+// How to read an input file.
+//
+struct ImportOptions {
+  // The character separating the columns of a line; ',' for CSV, '\t' for
+  // TSV.
+  //
+  char delimiter = ',';
+
+  // Whether the first line of the file is a header (column names) rather than
+  // a record.
+  //
+  bool skip_header = false;
+
+  // The maximum number of records parsed (and, on import, inserted) at a
+  // time.
+  //
+  std::size_t chunk_size = 64 * 1024;
+};
+
+// The outcome of importing a file.
+//
+struct ImportStats {
+  // The number of records read from the file.
+  //
+  std::size_t records = 0;
+
+  // The number of those inserted, i.e., whose id wasn't already present.
+  //
+  std::size_t inserted = 0;
+
+  // The size of the file, in bytes.
+  //
+  std::size_t bytes = 0;
+};
+
+// Returns the offset of the first `delimiter` or '\n' in `text` at or after
+// offset `from`, or `text.size()` if there is none.
+//
+std::size_t find_field_end(std::string_view text, char delimiter,
+                           std::size_t from = 0);
+
+// Parses the fields of `line` (without its newline) into `record`.  Returns
+// false if there are too few or too many fields, or a numeric field isn't a
+// number of the column's type.
+//
+bool parse_record(std::string_view line, char delimiter, QBRecordView &record);
+
+// Reads the records in an input file, a chunk at a time.
+//
+class RecordFileReader {
+public:
+  // Maps the file `path`, and skips its header if `options` say so.  Throws
+  // `std::runtime_error` if the file can't be opened or mapped.
+  //
+  RecordFileReader(const std::string &path, const ImportOptions &options);
+
+  RecordFileReader(const RecordFileReader &) = delete;
+  RecordFileReader &operator=(const RecordFileReader &) = delete;
+
+  ~RecordFileReader() noexcept;
+
+  // Returns the size of the file, in bytes.
+  //
+  std::size_t size() const { return size_; }
+
+  // Replaces the contents of `chunk` with the next (at most `chunk_size`)
+  // records of the file, which refer to the mapping and so are valid for the
+  // lifetime of the reader.  Returns false, leaving `chunk` empty, at the end
+  // of the file.  Throws `std::runtime_error`, naming the line, on a
+  // malformed record.
+  //
+  bool next_chunk(std::vector<QBRecordView> &chunk);
+
+private:
+  const std::string path_;
+  const ImportOptions options_;
+  void *map_ = nullptr;
+  const char *data_ = nullptr;
+  std::size_t size_ = 0;
+
+  // The offset in the file, and the (1-based) line number, of the next line to
+  // parse.
+  //
+  std::size_t pos_ = 0;
+  std::size_t line_ = 1;
+};
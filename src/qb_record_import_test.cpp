@@ -0,0 +1,248 @@
+#include "qb_record_import.hpp"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include "qb_record_collection.hpp"
+#include "words.hpp"
+
+namespace {
+
+using record_type = QBRecordCollection::record_type;
+
+// Returns `count` records with ids 0..count-1 and random strings made of
+// three-letter words.
+//
+std::vector<record_type> random_records(int count) {
+  const std::vector<std::string> words =
+      load_words([](std::string_view word) { return word.length() == 3; });
+  std::default_random_engine rng{/*seed=*/1};
+  std::uniform_int_distribution<int> pick_word_index(0, words.size() - 1);
+  std::uniform_int_distribution<int> pick_word_count(0, 3);
+  std::uniform_int_distribution<long> pick_long(-count / 4, count / 4);
+
+  const auto random_string = [&] {
+    std::string s;
+    for (int n = pick_word_count(rng); n > 0; --n) {
+      s += words[pick_word_index(rng)];
+    }
+    return s;
+  };
+
+  std::vector<record_type> records;
+  for (int id = 0; id < count; ++id) {
+    records.emplace_back(id, random_string(), pick_long(rng), random_string());
+  }
+  return records;
+}
+
+// An input file, removed when the test ends.
+//
+class InputFile {
+public:
+  InputFile(const std::string &name, const std::string &contents)
+      : path_{::testing::TempDir() + name + "." + std::to_string(::getpid())} {
+    std::ofstream{path_, std::ios::binary} << contents;
+  }
+  ~InputFile() { std::remove(path_.c_str()); }
+
+  const std::string &path() const { return path_; }
+
+private:
+  std::string path_;
+};
+
+// Returns `records` formatted as the lines of an input file.
+//
+std::string format_records(const std::vector<record_type> &records,
+                           char delimiter) {
+  std::ostringstream oss;
+  for (const auto &[id, s1, n, s3] : records) {
+    oss << id << delimiter << s1 << delimiter << n << delimiter << s3 << "\n";
+  }
+  return std::move(oss).str();
+}
+
+// Returns all the records in the input file `path`, as `record_type`s.
+//
+std::vector<record_type> read_all(const std::string &path,
+                                  const ImportOptions &options) {
+  RecordFileReader reader{path, options};
+  std::vector<record_type> records;
+  std::vector<QBRecordView> chunk;
+  while (reader.next_chunk(chunk)) {
+    EXPECT_LE(chunk.size(), options.chunk_size);
+    for (const auto &[id, s1, n, s3] : chunk) {
+      records.emplace_back(id, std::string{s1}, n, std::string{s3});
+    }
+  }
+  return records;
+}
+
+TEST(QBRecordImportTest, FindFieldEnd) {
+  std::default_random_engine rng{/*seed=*/1};
+  std::uniform_int_distribution<int> pick_char(0, 19);
+  for (int length = 0; length < 100; ++length) {
+    std::string text;
+    for (int i = 0; i < length; ++i) {
+      const int c = pick_char(rng);
+      text += c == 0 ? ',' : c == 1 ? '\n' : c == 2 ? '\t' : char('a' + c);
+    }
+    for (std::size_t from = 0; from <= text.size(); ++from) {
+      const std::size_t expected =
+          std::min(text.find_first_of(",\n", from), text.size());
+      EXPECT_EQ(find_field_end(text, ',', from), expected)
+          << text << " " << from;
+    }
+  }
+}
+
+TEST(QBRecordImportTest, ParseRecord) {
+  QBRecordView record;
+  EXPECT_TRUE(parse_record("7,abc,-12,", ',', record));
+  EXPECT_EQ(record, (QBRecordView{7, "abc", -12, ""}));
+  EXPECT_TRUE(parse_record("4294967295\t\t9223372036854775807\tx y\r", '\t',
+                           record));
+  EXPECT_EQ(record,
+            (QBRecordView{4294967295u, "", 9223372036854775807, "x y"}));
+
+  for (const char *line : {
+           "",
+           "7,abc,-12",
+           "7,abc,-12,x,y",
+           "7;abc;-12;x",
+           "x,abc,-12,x",
+           ",abc,-12,x",
+           "-7,abc,-12,x",
+           "4294967296,abc,-12,x",
+           "7,abc,12.5,x",
+           "7,abc, 12,x",
+           "7,abc,+12,x",
+       }) {
+    EXPECT_FALSE(parse_record(line, ',', record)) << line;
+  }
+}
+
+TEST(QBRecordImportTest, ReadInChunks) {
+  const std::vector<record_type> records = random_records(100);
+  for (const char delimiter : {',', '\t'}) {
+    const InputFile file{"read_in_chunks.csv",
+                         format_records(records, delimiter)};
+    for (const std::size_t chunk_size : {1, 7, 100, 1000}) {
+      ImportOptions options;
+      options.delimiter = delimiter;
+      options.chunk_size = chunk_size;
+      EXPECT_EQ(read_all(file.path(), options), records);
+    }
+  }
+}
+
+TEST(QBRecordImportTest, LineEndings) {
+  const InputFile file{"line_endings.csv", "column0,column1,column2,column3\n"
+                                           "1,a,10,b\r\n"
+                                           "\n"
+                                           "\r\n"
+                                           "2,,-20,\n"
+                                           "3,c,30,d"};
+  ImportOptions options;
+  options.skip_header = true;
+  EXPECT_THAT(read_all(file.path(), options),
+              ::testing::ElementsAre(record_type{1, "a", 10, "b"},
+                                     record_type{2, "", -20, ""},
+                                     record_type{3, "c", 30, "d"}));
+
+  const InputFile empty{"empty.csv", ""};
+  EXPECT_THAT(read_all(empty.path(), options), ::testing::IsEmpty());
+  const InputFile header_only{"header_only.csv", "a,b,c,d"};
+  EXPECT_THAT(read_all(header_only.path(), options), ::testing::IsEmpty());
+}
+
+TEST(QBRecordImportTest, Errors) {
+  EXPECT_THROW(RecordFileReader(::testing::TempDir() + "no_such_file.csv",
+                                ImportOptions{}),
+               std::runtime_error);
+
+  const InputFile file{"errors.csv", "1,a,10,b\n"
+                                     "\n"
+                                     "2,b,x,c\n"};
+  RecordFileReader reader{file.path(), ImportOptions{}};
+  std::vector<QBRecordView> chunk;
+  try {
+    reader.next_chunk(chunk);
+    FAIL() << "expected an exception";
+  } catch (const std::runtime_error &e) {
+    EXPECT_THAT(e.what(), ::testing::HasSubstr("line 3"));
+  }
+}
+
+TEST(QBRecordImportTest, CollectionImport) {
+  const std::vector<record_type> records = random_records(2000);
+  std::vector<record_type> with_duplicates = records;
+  with_duplicates.push_back(record_type{5, "duplicate", 0, ""});
+  const InputFile file{"collection_import.tsv",
+                       format_records(with_duplicates, '\t')};
+
+  QBRecordCollection imported;
+  EXPECT_TRUE(imported.insert(record_type{records[0]}));
+  ImportOptions options;
+  options.delimiter = '\t';
+  options.chunk_size = 300;
+  const ImportStats stats = imported.import_records(file.path(), options);
+  EXPECT_EQ(stats.records, records.size() + 1);
+  EXPECT_EQ(stats.inserted, records.size() - 1);
+
+  QBRecordCollection inserted;
+  inserted.bulk_insert(records);
+  for (const auto &[column, match] :
+       std::vector<std::pair<std::string, std::string>>{
+           {"column0", "5"},
+           {"column1", "e"},
+           {"column1", "duplicate"},
+           {"column3", "ab"},
+           {"column2", "BETWEEN -100 AND 100"},
+       }) {
+    EXPECT_EQ(imported.find_matching_records(column, match),
+              inserted.find_matching_records(column, match))
+        << column << " " << match;
+  }
+}
+
+// A CSV file imported with the default options (one chunk, no header).
+//
+TEST(QBRecordImportTest, DefaultOptions) {
+  constexpr std::size_t kCount = 5000;
+  const std::string text = format_records(random_records(kCount), ',');
+  const InputFile file{"default_options.csv", text};
+
+  std::size_t parsed = 0;
+  {
+    RecordFileReader reader{file.path(), ImportOptions{}};
+    EXPECT_EQ(reader.size(), text.size());
+    std::vector<QBRecordView> chunk;
+    while (reader.next_chunk(chunk)) {
+      parsed += chunk.size();
+    }
+  }
+  EXPECT_EQ(parsed, kCount);
+
+  QBRecordCollection db;
+  const ImportStats stats = db.import_records(file.path());
+  EXPECT_EQ(stats.records, kCount);
+  EXPECT_EQ(stats.inserted, kCount);
+  EXPECT_EQ(stats.bytes, text.size());
+}
+
+} // namespace
@@ -0,0 +1,397 @@
+#include "qb_record_snapshot.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/lexical_cast.hpp>
+
+#include "file_sync.hpp"
+#include "range_predicate.hpp"
+#include "suffix_array.hpp"
+#include "tuples.hpp"
+
+// Local helper functions.
+//
+namespace {
+
+using record_type = QBRecordSnapshot::record_type;
+
+constexpr char kMagic[8] = {'Q', 'B', 'S', 'N', 'A', 'P', '\r', '\n'};
+constexpr std::uint32_t kVersion = 1;
+constexpr std::size_t kSectionAlignment = 64;
+constexpr std::size_t kSectionsPerColumn = 3;
+constexpr std::size_t kNumColumns = std::tuple_size<record_type>::value;
+
+struct SnapshotHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t num_columns;
+  std::uint64_t num_records;
+  std::uint64_t file_size;
+};
+
+struct SnapshotSection {
+  std::uint64_t offset;
+  std::uint64_t size;
+};
+
+constexpr std::size_t kDataOffset =
+    sizeof(SnapshotHeader) +
+    kNumColumns * kSectionsPerColumn * sizeof(SnapshotSection);
+
+std::size_t align_section(std::size_t offset) {
+  return (offset + kSectionAlignment - 1) / kSectionAlignment *
+         kSectionAlignment;
+}
+
+[[noreturn]] void throw_error(const std::string &what,
+                              const std::string &path) {
+  throw std::runtime_error{what + ": " + path};
+}
+
+// Same as `throw_error`, adding the description of `errno`.
+//
+[[noreturn]] void throw_system_error(const std::string &what,
+                                     const std::string &path) {
+  throw_error(what + " (" + std::strerror(errno) + ")", path);
+}
+
+// The sections of a snapshot being written, in order.  Each section either
+// points into the `ColumnStore` being saved or owns a buffer built for it.
+//
+class SectionList {
+public:
+  template <typename T> void add(const T *data, std::size_t count) {
+    sections_.push_back(Section{data, count * sizeof(T)});
+  }
+
+  template <typename T> void add(std::vector<T> &&data) {
+    auto owned = std::make_shared<std::vector<T>>(std::move(data));
+    add(owned->data(), owned->size());
+    buffers_.emplace_back(std::move(owned));
+  }
+
+  // Writes the header, section table and sections to the file descriptor
+  // `fd`.  Returns false, with `errno` set, on failure.
+  //
+  bool write(int fd, std::size_t num_records) const {
+    std::vector<SnapshotSection> table;
+    std::size_t offset = kDataOffset;
+    for (const Section &section : sections_) {
+      offset = align_section(offset);
+      table.push_back(SnapshotSection{offset, section.size});
+      offset += section.size;
+    }
+
+    SnapshotHeader header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.num_columns = kNumColumns;
+    header.num_records = num_records;
+    header.file_size = offset;
+    if (!write_fully(fd, &header, sizeof(header)) ||
+        !write_fully(fd, table.data(),
+                     table.size() * sizeof(SnapshotSection))) {
+      return false;
+    }
+
+    std::size_t written = kDataOffset;
+    static const char kPadding[kSectionAlignment] = {};
+    for (std::size_t i = 0; i < sections_.size(); ++i) {
+      if (!write_fully(fd, kPadding, table[i].offset - written) ||
+          !write_fully(fd, sections_[i].data, sections_[i].size)) {
+        return false;
+      }
+      written = table[i].offset + sections_[i].size;
+    }
+    return true;
+  }
+
+private:
+  struct Section {
+    const void *data;
+    std::size_t size;
+  };
+
+  std::vector<Section> sections_;
+  std::vector<std::shared_ptr<const void>> buffers_;
+};
+
+} // namespace
+
+void write_snapshot(const ColumnStore<record_type> &records,
+                    const std::string &path) {
+  const std::size_t num_records = records.size();
+
+  SectionList sections;
+  for_each_upto<kNumColumns>([&](auto i) {
+    constexpr int I = decltype(i)::value;
+    using Value = std::tuple_element_t<I, record_type>;
+    const auto &column = records.column<I>();
+
+    if constexpr (std::is_same_v<Value, std::string>) {
+      const std::string_view chars = column.chars();
+      if (chars.size() >=
+          std::size_t(std::numeric_limits<std::int32_t>::max())) {
+        throw_error("string column too large for a snapshot", path);
+      }
+      std::vector<std::uint64_t> ends(num_records);
+      for (std::size_t row = 0; row < num_records; ++row) {
+        ends[row] = column.end_offset(row);
+      }
+      sections.add(chars.data(), chars.size());
+      sections.add(std::move(ends));
+      sections.add(build_suffix_array(chars));
+    } else {
+      std::vector<std::uint32_t> sorted_rows(num_records);
+      std::iota(sorted_rows.begin(), sorted_rows.end(), 0);
+      std::stable_sort(sorted_rows.begin(), sorted_rows.end(),
+                       [&](std::uint32_t a, std::uint32_t b) {
+                         return column[a] < column[b];
+                       });
+      std::vector<Value> sorted_values;
+      sorted_values.reserve(num_records);
+      for (const std::uint32_t row : sorted_rows) {
+        sorted_values.emplace_back(column[row]);
+      }
+      sections.add(column.data(), column.size());
+      sections.add(std::move(sorted_values));
+      sections.add(std::move(sorted_rows));
+    }
+  });
+
+  // The snapshot must be durable before it replaces the old one, and the
+  // rename must be durable before we return.
+  //
+  const std::string tmp_path = path + ".tmp";
+  const int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    throw_system_error("can't create snapshot", tmp_path);
+  }
+  const bool written = sections.write(fd, num_records) && ::fdatasync(fd) == 0;
+  const int saved_errno = errno;
+  if (::close(fd) != 0 || !written) {
+    if (!written) {
+      errno = saved_errno;
+    }
+    const std::string what = std::string{"can't write snapshot ("} +
+                             std::strerror(errno) + ")";
+    std::remove(tmp_path.c_str());
+    throw_error(what, tmp_path);
+  }
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    const std::string what = std::string{"can't rename snapshot ("} +
+                             std::strerror(errno) + ")";
+    std::remove(tmp_path.c_str());
+    throw_error(what, path);
+  }
+  if (!sync_parent_directory(path)) {
+    throw_system_error("can't sync directory of snapshot", path);
+  }
+}
+
+QBRecordSnapshot::QBRecordSnapshot(const std::string &path) {
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw_error(std::string{"can't open snapshot ("} + std::strerror(errno) +
+                    ")",
+                path);
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || std::size_t(st.st_size) < kDataOffset) {
+    ::close(fd);
+    throw_error("not a snapshot", path);
+  }
+  map_size_ = st.st_size;
+  map_ = ::mmap(nullptr, map_size_, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (map_ == MAP_FAILED) {
+    map_ = nullptr;
+    throw_error("can't map snapshot", path);
+  }
+
+  // Unmaps the file if validation fails.
+  //
+  const auto fail = [&](const std::string &what) {
+    ::munmap(map_, map_size_);
+    map_ = nullptr;
+    throw_error(what, path);
+  };
+
+  const char *base = static_cast<const char *>(map_);
+  SnapshotHeader header;
+  std::memcpy(&header, base, sizeof(header));
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+    fail("not a snapshot");
+  }
+  if (header.version != kVersion || header.num_columns != kNumColumns) {
+    fail("unsupported snapshot version or schema");
+  }
+  if (header.file_size != map_size_ ||
+      header.num_records > std::numeric_limits<row_type>::max()) {
+    fail("corrupt snapshot header");
+  }
+  size_ = header.num_records;
+
+  const auto *table =
+      reinterpret_cast<const SnapshotSection *>(base + sizeof(header));
+
+  // Returns the view of section `i` as an array of `T`.
+  //
+  const auto section = [&](std::size_t i, auto *type_tag) {
+    using T = std::remove_const_t<std::remove_pointer_t<decltype(type_tag)>>;
+    const SnapshotSection &s = table[i];
+    if (s.offset % kSectionAlignment != 0 || s.offset > map_size_ ||
+        s.size > map_size_ - s.offset || s.size % sizeof(T) != 0) {
+      fail("corrupt snapshot section table");
+    }
+    return MappedArray<T>{reinterpret_cast<const T *>(base + s.offset),
+                          s.size / sizeof(T)};
+  };
+
+  for_each_upto<kNumColumns>([&](auto i) {
+    constexpr int I = decltype(i)::value;
+    using Value = std::tuple_element_t<I, record_type>;
+    auto &column = std::get<I>(columns_);
+    const std::size_t first = I * kSectionsPerColumn;
+
+    if constexpr (std::is_same_v<Value, std::string>) {
+      column.chars = section(first, (char *)nullptr);
+      column.ends = section(first + 1, (std::uint64_t *)nullptr);
+      column.suffix_array = section(first + 2, (std::int32_t *)nullptr);
+      if (column.ends.size != size_ ||
+          (size_ > 0 && column.ends[size_ - 1] != column.chars.size) ||
+          column.suffix_array.size != column.chars.size) {
+        fail("corrupt snapshot string column");
+      }
+    } else {
+      column.values = section(first, (Value *)nullptr);
+      column.sorted_values = section(first + 1, (Value *)nullptr);
+      column.sorted_rows = section(first + 2, (std::uint32_t *)nullptr);
+      if (column.values.size != size_ || column.sorted_values.size != size_ ||
+          column.sorted_rows.size != size_) {
+        fail("corrupt snapshot numeric column");
+      }
+    }
+  });
+}
+
+QBRecordSnapshot::~QBRecordSnapshot() noexcept {
+  if (map_) {
+    ::munmap(map_, map_size_);
+  }
+}
+
+auto QBRecordSnapshot::find_matching_rows(std::string_view columnName,
+                                          std::string_view matchString) const
+    -> std::vector<row_type> {
+  std::vector<row_type> rows;
+  auto maybe_column_num = parse_column_name<QBRecordTraits>(columnName);
+  if (!maybe_column_num) {
+    return rows;
+  }
+  const int column_num = *maybe_column_num;
+
+  for_each_upto<kNumColumns>([&](auto i) {
+    constexpr int I = decltype(i)::value;
+    using Value = std::tuple_element_t<I, record_type>;
+    if (I != column_num) {
+      return;
+    }
+    const auto &column = std::get<I>(columns_);
+
+    if constexpr (std::is_same_v<Value, std::string>) {
+      if (matchString.empty()) {
+        rows.resize(size_);
+        std::iota(rows.begin(), rows.end(), 0);
+        return;
+      }
+      const std::string_view chars{column.chars.data, column.chars.size};
+      const auto compare = [&](std::int32_t pos) {
+        return chars.substr(pos, matchString.size()).compare(matchString);
+      };
+      const auto first = std::partition_point(
+          column.suffix_array.begin(), column.suffix_array.end(),
+          [&](std::int32_t pos) { return compare(pos) < 0; });
+      const auto last = std::partition_point(
+          first, column.suffix_array.end(),
+          [&](std::int32_t pos) { return compare(pos) == 0; });
+      for (auto iter = first; iter != last; ++iter) {
+        const std::size_t pos = *iter;
+        const row_type row =
+            std::upper_bound(column.ends.begin(), column.ends.end(), pos) -
+            column.ends.begin();
+        if (pos + matchString.size() <= column.ends[row]) {
+          rows.emplace_back(row);
+        }
+      }
+      std::sort(rows.begin(), rows.end());
+      rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+    } else {
+      ValueRange<Value> range;
+      if constexpr (I == QBRecordTraits::unique_id_column()) {
+        range.lo = range.hi = boost::lexical_cast<Value>(matchString);
+      } else {
+        range = parse_range_predicate<Value>(matchString);
+      }
+      const auto first =
+          std::lower_bound(column.sorted_values.begin(),
+                           column.sorted_values.end(), range.lo);
+      const auto last = std::upper_bound(first, column.sorted_values.end(),
+                                         range.hi);
+      rows.assign(column.sorted_rows.begin() +
+                      (first - column.sorted_values.begin()),
+                  column.sorted_rows.begin() +
+                      (last - column.sorted_values.begin()));
+    }
+  });
+
+  const auto &ids = std::get<QBRecordTraits::unique_id_column()>(columns_);
+  std::sort(rows.begin(), rows.end(), [&](row_type a, row_type b) {
+    return ids.values[a] < ids.values[b];
+  });
+  return rows;
+}
+
+auto QBRecordSnapshot::get_record(row_type row) const -> record_type {
+  record_type record;
+  for_each_upto<kNumColumns>([&](auto i) {
+    constexpr int I = decltype(i)::value;
+    using Value = std::tuple_element_t<I, record_type>;
+    if constexpr (std::is_same_v<Value, std::string>) {
+      std::get<I>(record) = Value{std::get<I>(columns_)[row]};
+    } else {
+      std::get<I>(record) = std::get<I>(columns_).values[row];
+    }
+  });
+  return record;
+}
+
+auto QBRecordSnapshot::find_matching_records(
+    std::string_view columnName, std::string_view matchString) const
+    -> std::vector<record_type> {
+  std::vector<record_type> results;
+  for (const row_type row : find_matching_rows(columnName, matchString)) {
+    results.emplace_back(get_record(row));
+  }
+  return results;
+}
+
+std::size_t
+QBRecordSnapshot::count_matching_records(std::string_view columnName,
+                                         std::string_view matchString) const {
+  return find_matching_rows(columnName, matchString).size();
+}
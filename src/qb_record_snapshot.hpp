@@ -0,0 +1,140 @@
+// QBRecordSnapshot - a read-only record collection that is memory-mapped from
+// a snapshot file instead of being rebuilt by inserting every record.
+//
+// A snapshot file holds the records column by column, together with indices
+// that, unlike the tries behind a `QBRecordCollection`, are plain arrays
+// addressed by offset rather than pointer.  Opening a snapshot therefore only
+// maps the file and checks its header; pages are faulted in lazily by the
+// queries that touch them, and are shared by all processes mapping the file.
+//
+// File layout (all integers in host byte order; sections 64-byte aligned):
+//
+//  - `SnapshotHeader`: magic, format version, record and column counts.
+//
+//  - A table of `SnapshotSection`s (offset and size in bytes), three per
+//    column, in column order:
+//
+//     - Numeric columns: the values in row order, the same values sorted
+//       (stably), and the rows in that sorted order.  Equality and range
+//       queries binary search the sorted values.
+//
+//     - String columns: the characters of all values, concatenated (as in a
+//       `StringColumn`), the offset of the end of each row's value, and the
+//       suffix array of the characters (see suffix_array.hpp).  All the
+//       occurrences of a pattern are a contiguous range of the suffix array,
+//       found by binary search; those that straddle two values are skipped.
+//
+//  - The sections' data.
+//
+// The characters of each string column must total less than 2 GiB.
+// Snapshots are written by `QBRecordCollection::save_snapshot`, and are
+// trusted: only the header and section sizes are checked when opening one.
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "column_store.hpp"
+#include "qb_record.hpp"
+
+// A read-only view of a contiguous array of `T` inside a mapped file.
+//
+template <typename T> struct MappedArray {
+  const T *data = nullptr;
+  std::size_t size = 0;
+
+  const T &operator[](std::size_t i) const { return data[i]; }
+  const T *begin() const { return data; }
+  const T *end() const { return data + size; }
+};
+
+// The sections of one column of a snapshot; see the file layout above.
+//
+template <typename T> struct SnapshotColumn {
+  MappedArray<T> values;
+  MappedArray<T> sorted_values;
+  MappedArray<std::uint32_t> sorted_rows;
+};
+
+template <> struct SnapshotColumn<std::string> {
+  MappedArray<char> chars;
+  MappedArray<std::uint64_t> ends;
+  MappedArray<std::int32_t> suffix_array;
+
+  // Returns the value in row `row`.
+  //
+  std::string_view operator[](std::size_t row) const {
+    const std::size_t begin = row == 0 ? 0 : ends[row - 1];
+    return std::string_view{chars.data + begin, ends[row] - begin};
+  }
+};
+
+template <typename Record> struct SnapshotColumnsFor;
+
+template <typename... Ts> struct SnapshotColumnsFor<std::tuple<Ts...>> {
+  using type = std::tuple<SnapshotColumn<Ts>...>;
+};
+
+// Writes a snapshot of `records` to the file `path`, replacing it atomically
+// and durably: the snapshot is written to a temporary file and synced, then
+// renamed over `path`, and the directory synced.  Throws `std::runtime_error`
+// on failure, leaving any previous snapshot at `path` in place.
+//
+void write_snapshot(const ColumnStore<QBRecordTraits::columns_type> &records,
+                    const std::string &path);
+
+class QBRecordSnapshot {
+public:
+  using traits_type = QBRecordTraits;
+  using record_type = traits_type::columns_type;
+  using unique_id_type = traits_type::unique_id_type;
+
+  // Maps the snapshot file `path`.  Throws `std::runtime_error` if it can't be
+  // opened or is not a valid snapshot.
+  //
+  explicit QBRecordSnapshot(const std::string &path);
+
+  QBRecordSnapshot(const QBRecordSnapshot &) = delete;
+  QBRecordSnapshot &operator=(const QBRecordSnapshot &) = delete;
+
+  ~QBRecordSnapshot() noexcept;
+
+  // Returns the number of records.
+  //
+  std::size_t size() const { return size_; }
+
+  // Same as the `QBRecordCollection` members of the same names.
+  //
+  std::vector<record_type>
+  find_matching_records(std::string_view columnName,
+                        std::string_view matchString) const;
+
+  std::size_t count_matching_records(std::string_view columnName,
+                                     std::string_view matchString) const;
+
+private:
+  using row_type = std::uint32_t;
+
+  // Returns the distinct rows of the records whose column `columnName`
+  // matches `matchString`, in ascending id order.
+  //
+  std::vector<row_type> find_matching_rows(std::string_view columnName,
+                                           std::string_view matchString) const;
+
+  // Returns a copy of the record in row `row`.
+  //
+  record_type get_record(row_type row) const;
+
+  // The mapped file.
+  //
+  void *map_ = nullptr;
+  std::size_t map_size_ = 0;
+
+  std::size_t size_ = 0;
+  SnapshotColumnsFor<record_type>::type columns_;
+};
@@ -0,0 +1,238 @@
+#include "qb_record_snapshot.hpp"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "qb_record_collection.hpp"
+#include "words.hpp"
+
+namespace {
+
+using record_type = QBRecordSnapshot::record_type;
+
+// Returns `count` records with ids 0..count-1 in a random order, and random
+// strings made of three-letter words.
+//
+std::vector<record_type> random_records(int count) {
+  const std::vector<std::string> words =
+      load_words([](std::string_view word) { return word.length() == 3; });
+  std::default_random_engine rng{/*seed=*/1};
+  std::uniform_int_distribution<int> pick_word_index(0, words.size() - 1);
+  std::uniform_int_distribution<int> pick_word_count(0, 3);
+  std::uniform_int_distribution<long> pick_long(-count / 4, count / 4);
+
+  const auto random_string = [&] {
+    std::string s;
+    for (int n = pick_word_count(rng); n > 0; --n) {
+      s += words[pick_word_index(rng)];
+    }
+    return s;
+  };
+
+  std::vector<unsigned> ids(count);
+  std::iota(ids.begin(), ids.end(), 0);
+  std::shuffle(ids.begin(), ids.end(), rng);
+
+  std::vector<record_type> records;
+  for (const unsigned id : ids) {
+    records.emplace_back(id, random_string(), pick_long(rng), random_string());
+  }
+  return records;
+}
+
+// A snapshot file path, removed when the test ends.
+//
+class SnapshotFile {
+public:
+  explicit SnapshotFile(const std::string &name)
+      : path_{::testing::TempDir() + name + "." + std::to_string(::getpid())} {
+  }
+  ~SnapshotFile() { std::remove(path_.c_str()); }
+
+  const std::string &path() const { return path_; }
+
+private:
+  std::string path_;
+};
+
+TEST(QBRecordSnapshotTest, MatchesCollection) {
+  QBRecordCollection db;
+  for (record_type &record : random_records(3000)) {
+    db.insert(std::move(record));
+  }
+  const SnapshotFile file{"matches_collection.qbsnap"};
+  db.save_snapshot(file.path());
+
+  const QBRecordSnapshot snapshot{file.path()};
+  EXPECT_EQ(snapshot.size(), 3000u);
+
+  for (const auto &[column, match] :
+       std::vector<std::pair<std::string, std::string>>{
+           {"column0", "0"},
+           {"column0", "2999"},
+           {"column0", "3000"},
+           {"column1", ""},
+           {"column1", "e"},
+           {"column1", "the"},
+           {"column1", "zzzzz"},
+           {"column3", "ab"},
+           {"column3", "ing"},
+           {"column2", "7"},
+           {"column2", ">700"},
+           {"column2", "BETWEEN -9 AND 9"},
+           {"columnX", "a"},
+       }) {
+    const std::vector<record_type> expected =
+        db.find_matching_records(column, match);
+    EXPECT_EQ(snapshot.find_matching_records(column, match), expected)
+        << column << " " << match;
+    EXPECT_EQ(snapshot.count_matching_records(column, match), expected.size())
+        << column << " " << match;
+  }
+}
+
+TEST(QBRecordSnapshotTest, MatchesDoNotStraddleValues) {
+  QBRecordCollection db;
+  db.insert({7, "ab", 1, ""});
+  db.insert({3, "", 2, "x"});
+  db.insert({5, "cd", 3, "abcd"});
+  const SnapshotFile file{"straddle.qbsnap"};
+  db.save_snapshot(file.path());
+
+  const QBRecordSnapshot snapshot{file.path()};
+  EXPECT_THAT(snapshot.find_matching_records("column1", "bc"),
+              ::testing::IsEmpty());
+  EXPECT_THAT(snapshot.find_matching_records("column1", "b"),
+              ::testing::ElementsAre(record_type{7, "ab", 1, ""}));
+  EXPECT_THAT(snapshot.find_matching_records("column3", "bc"),
+              ::testing::ElementsAre(record_type{5, "cd", 3, "abcd"}));
+  EXPECT_EQ(snapshot.count_matching_records("column1", ""), 3u);
+}
+
+TEST(QBRecordSnapshotTest, ErasedAndUpdatedRecords) {
+  QBRecordCollection db;
+  db.insert({7, "ab", 1, ""});
+  db.insert({3, "cd", 2, "x"});
+  db.insert({5, "ef", 3, "abcd"});
+  db.erase(3);
+  db.update({5, "gh", 4, "abcd"});
+  const SnapshotFile file{"erased.qbsnap"};
+  db.save_snapshot(file.path());
+
+  const QBRecordSnapshot snapshot{file.path()};
+  EXPECT_EQ(snapshot.size(), 2u);
+  EXPECT_THAT(snapshot.find_matching_records("column1", ""),
+              ::testing::ElementsAre(record_type{5, "gh", 4, "abcd"},
+                                     record_type{7, "ab", 1, ""}));
+}
+
+TEST(QBRecordSnapshotTest, EmptyCollection) {
+  const SnapshotFile file{"empty.qbsnap"};
+  QBRecordCollection{}.save_snapshot(file.path());
+
+  const QBRecordSnapshot snapshot{file.path()};
+  EXPECT_EQ(snapshot.size(), 0u);
+  EXPECT_THAT(snapshot.find_matching_records("column1", ""),
+              ::testing::IsEmpty());
+  EXPECT_THAT(snapshot.find_matching_records("column2", ">0"),
+              ::testing::IsEmpty());
+}
+
+TEST(QBRecordSnapshotTest, InvalidFiles) {
+  const SnapshotFile file{"invalid.qbsnap"};
+  EXPECT_THROW(QBRecordSnapshot{file.path()}, std::runtime_error);
+
+  std::ofstream{file.path()} << "not a snapshot";
+  EXPECT_THROW(QBRecordSnapshot{file.path()}, std::runtime_error);
+
+  // A truncated snapshot.
+  //
+  QBRecordCollection db;
+  for (record_type &record : random_records(100)) {
+    db.insert(std::move(record));
+  }
+  db.save_snapshot(file.path());
+  EXPECT_EQ(QBRecordSnapshot{file.path()}.size(), 100u);
+  ASSERT_EQ(::truncate(file.path().c_str(), 1000), 0);
+  EXPECT_THROW(QBRecordSnapshot{file.path()}, std::runtime_error);
+}
+
+// A snapshot that can't be written, whether its temporary file can't be
+// created or a write fails part way, leaves the previous snapshot in place.
+//
+TEST(QBRecordSnapshotTest, FailedWriteKeepsOldSnapshot) {
+  const SnapshotFile file{"failed_write.qbsnap"};
+  QBRecordCollection db;
+  db.insert({5000, "old", 1, ""});
+  db.save_snapshot(file.path());
+  for (record_type &record : random_records(1000)) {
+    db.insert(std::move(record));
+  }
+  const std::string tmp_path = file.path() + ".tmp";
+  const auto expect_old_snapshot = [&] {
+    const QBRecordSnapshot snapshot{file.path()};
+    EXPECT_EQ(snapshot.size(), 1u);
+    EXPECT_THAT(snapshot.find_matching_records("column1", "old"),
+                ::testing::ElementsAre(record_type{5000, "old", 1, ""}));
+  };
+
+  ASSERT_EQ(::mkdir(tmp_path.c_str(), 0755), 0);
+  EXPECT_THROW(db.save_snapshot(file.path()), std::runtime_error);
+  ASSERT_EQ(::rmdir(tmp_path.c_str()), 0);
+  expect_old_snapshot();
+
+  // Limit the size of files this process may write, so that writing the
+  // snapshot fails with EFBIG (rather than SIGXFSZ, which is ignored).
+  //
+  struct rlimit old_limit;
+  ASSERT_EQ(::getrlimit(RLIMIT_FSIZE, &old_limit), 0);
+  struct rlimit limit = old_limit;
+  limit.rlim_cur = 4096;
+  const auto old_handler = std::signal(SIGXFSZ, SIG_IGN);
+  ASSERT_EQ(::setrlimit(RLIMIT_FSIZE, &limit), 0);
+  EXPECT_THROW(db.save_snapshot(file.path()), std::runtime_error);
+  ASSERT_EQ(::setrlimit(RLIMIT_FSIZE, &old_limit), 0);
+  std::signal(SIGXFSZ, old_handler);
+  expect_old_snapshot();
+  EXPECT_NE(::access(tmp_path.c_str(), F_OK), 0);
+
+  db.save_snapshot(file.path());
+  EXPECT_EQ(QBRecordSnapshot{file.path()}.size(), 1001u);
+}
+
+// The first query on a freshly opened snapshot (see
+// `BM_OpenSnapshot` in qb_record_collection_benchmark.cpp for its cost)
+// answers as the collection it was saved from does.
+//
+TEST(QBRecordSnapshotTest, FirstQueryAfterOpen) {
+  QBRecordCollection db;
+  for (record_type &record : random_records(1000)) {
+    db.insert(std::move(record));
+  }
+  const SnapshotFile file{"first_query_after_open.qbsnap"};
+  db.save_snapshot(file.path());
+
+  const QBRecordSnapshot snapshot{file.path()};
+  const std::vector<record_type> expected =
+      db.find_matching_records("column1", "e");
+  EXPECT_THAT(expected, ::testing::Not(::testing::IsEmpty()));
+  EXPECT_EQ(snapshot.find_matching_records("column1", "e"), expected);
+}
+
+} // namespace
@@ -0,0 +1,121 @@
+// Query planning for QBRecordCollection: choosing between walking a column's
+// index and scanning the column itself.
+//
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <utility>
+
+#include <boost/optional/optional.hpp>
+
+// How a single-column query is answered.
+//
+enum struct QueryAccess {
+  kNone,     // The column does not exist; there are no matches.
+  kUniqueId, // Primary key lookup.
+  kIndex,    // Walk the column's index.
+  kScan,     // Scan the column's values (string columns only).
+};
+
+inline const char *to_string(QueryAccess access) {
+  switch (access) {
+  case QueryAccess::kNone:
+    return "none";
+  case QueryAccess::kUniqueId:
+    return "unique-id";
+  case QueryAccess::kIndex:
+    return "index";
+  case QueryAccess::kScan:
+    return "scan";
+  }
+  return "?";
+}
+
+// Estimated costs, in nanoseconds, of the two ways of answering a substring
+// query, not counting the cost of materializing the matching records (which is
+// the same for both).  Calibrated against `StringTrie` on 4K-64K records of
+// short strings: walking the trie costs about 64ns per matching record (more
+// on larger collections, as the trie outgrows the cache), while the
+// vectorized scan (see substring_scan.hpp) costs about 1ns per record.
+//
+constexpr double kIndexCostPerMatch = 64;
+constexpr double kScanCostPerRecord = 1;
+
+// The plan for a single-column query, as chosen by `plan_substring_query` (or
+// trivially, for other column types) and reported by
+// `QBRecordCollection::explain`.
+//
+struct QueryPlan {
+  QueryAccess access = QueryAccess::kNone;
+
+  // The queried column, or -1 if it does not exist.
+  //
+  int column = -1;
+
+  // The number of records in the collection when the plan was made.
+  //
+  std::size_t records = 0;
+
+  // The number of matching records estimated by the column's index; none if
+  // the index can't estimate matches without finding them.
+  //
+  boost::optional<std::size_t> estimated_matches;
+
+  // The estimated costs (see above) of walking the index and of scanning the
+  // column; zero unless both were considered.
+  //
+  double index_cost = 0;
+  double scan_cost = 0;
+};
+
+// Returns the plan for a substring query on string column `column` of a
+// collection of `records` records, given the index's estimate of the number
+// of matches: scan the column iff that is estimated to be cheaper.  Without
+// an estimate, the index is always used.
+//
+inline QueryPlan
+plan_substring_query(int column, std::size_t records,
+                     boost::optional<std::size_t> estimated_matches) {
+  QueryPlan plan;
+  plan.access = QueryAccess::kIndex;
+  plan.column = column;
+  plan.records = records;
+  plan.estimated_matches = estimated_matches;
+  if (estimated_matches) {
+    plan.index_cost = double(*estimated_matches) * kIndexCostPerMatch;
+    plan.scan_cost = double(records) * kScanCostPerRecord;
+    if (plan.scan_cost < plan.index_cost) {
+      plan.access = QueryAccess::kScan;
+    }
+  }
+  return plan;
+}
+
+inline std::ostream &operator<<(std::ostream &out, const QueryPlan &plan) {
+  out << to_string(plan.access);
+  if (plan.access == QueryAccess::kNone) {
+    return out;
+  }
+  out << " column=" << plan.column << " records=" << plan.records;
+  if (plan.estimated_matches) {
+    out << " estimated_matches=" << *plan.estimated_matches;
+  }
+  if (plan.index_cost != 0 || plan.scan_cost != 0) {
+    out << " index_cost=" << plan.index_cost << "ns"
+        << " scan_cost=" << plan.scan_cost << "ns";
+  }
+  return out;
+}
+
+// Returns a one-line description of `plan`, e.g.
+// "scan column=1 records=1000 estimated_matches=312 index_cost=19968ns
+// scan_cost=1000ns".
+//
+inline std::string to_string(const QueryPlan &plan) {
+  std::ostringstream oss;
+  oss << plan;
+  return std::move(oss).str();
+}
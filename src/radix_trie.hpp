@@ -0,0 +1,620 @@
+// Implementation of RadixTrie, a space-efficient alternative to StringTrie.
+//
+// A RadixTrie<T> has the same multimap-like interface as StringTrie<T> (and
+// can therefore be used as the index behind a string QBColumnLookup), but
+// addresses the two main sources of space overhead noted in string_trie.hpp:
+//
+//  1. Path compression: chains of nodes with a single child and no values are
+//     collapsed into one edge.  Edge labels are not copied into nodes; each
+//     node refers to its label as an (offset, length) slice of a per-trie
+//     character pool, into which every inserted key is appended exactly once.
+//     Splitting an edge therefore never allocates label memory, and
+//     `insert_suffixes` creates at most two nodes per suffix instead of one
+//     node per character.
+//
+//  2. Adaptive fan-out: instead of a fixed 256-way pointer array, each node
+//     uses the smallest of four child representations that fits its branching
+//     factor, growing in place as children are added (cf. Leis, Kemper and
+//     Neumann, "The Adaptive Radix Tree", ICDE 2013):
+//
+//       - Node4:   up to 4 children; sorted key and pointer arrays
+//       - Node16:  up to 16 children; sorted arrays, SSE2 key search
+//       - Node48:  up to 48 children; 256-byte key -> slot index
+//       - Node256: up to 256 children; direct-mapped pointer array
+//
+// Children are always enumerated in ascending key order, so traversal order
+// is the same as for StringTrie.
+//
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#include <vector>
+
+#include "memory_usage.hpp"
+#include "visitor.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+//------------------------------------------------------------------------------
+
+// Path-compressed adaptive radix trie mapping 8-bit char strings to values of
+// type `T`.
+//
+template <typename T> class RadixTrie {
+private:
+  enum struct NodeKind : std::uint8_t { kNode4, kNode16, kNode48, kNode256 };
+
+  // The header shared by all node kinds.
+  //
+  struct Node {
+    explicit Node(NodeKind k) : kind{k} {}
+
+    // Disable copying so we enforce unique ownership of child nodes.
+    //
+    Node(const Node &) = delete;
+    Node &operator=(const Node &) = delete;
+
+    // Which of the concrete node types below `this` is.
+    //
+    NodeKind kind;
+
+    // The number of non-null child branches.
+    //
+    std::uint16_t num_children = 0;
+
+    // The compressed path leading into this node, not including the branch
+    // key byte by which the parent refers to it; a slice of
+    // `RadixTrie::labels_`.
+    //
+    std::uint32_t label_offset = 0;
+    std::uint32_t label_length = 0;
+
+    // The number of distinct insertions that stored a value at or below this
+    // node, and the stamp of the most recent one; see
+    // `StringTrie::Node::subtree_count`.
+    //
+    std::uint32_t subtree_count = 0;
+    std::uint32_t last_stamp = 0;
+
+    // The values associated with the string whose path from the root of the
+    // trie leads to `this`.
+    //
+    std::vector<T> values;
+  };
+
+  // Node with up to `N` children, stored as parallel arrays sorted by key.
+  //
+  template <int N, NodeKind K> struct SortedNode : Node {
+    SortedNode() : Node{K} { keys.fill(0); }
+
+    std::array<std::uint8_t, N> keys;
+    std::array<Node *, N> children;
+  };
+
+  using Node4 = SortedNode<4, NodeKind::kNode4>;
+  using Node16 = SortedNode<16, NodeKind::kNode16>;
+
+  // Node with up to 48 children; `child_index` maps a key byte to one plus
+  // its slot in `children`, or zero if there is no such branch.
+  //
+  struct Node48 : Node {
+    Node48() : Node{NodeKind::kNode48} { child_index.fill(0); }
+
+    std::array<std::uint8_t, 256> child_index;
+    std::array<Node *, 48> children;
+  };
+
+  // Node with a direct-mapped child array; same layout as StringTrie::Node,
+  // but only used when the branching factor justifies it.
+  //
+  struct Node256 : Node {
+    Node256() : Node{NodeKind::kNode256} { children.fill(nullptr); }
+
+    std::array<Node *, 256> children;
+  };
+
+  // -- Node helpers -----------------------------------------------------------
+
+  template <typename SortedNodeT>
+  static Node *const *find_sorted(const SortedNodeT *node, std::uint8_t key) {
+    for (int i = 0; i < node->num_children; ++i) {
+      if (node->keys[i] == key) {
+        return &node->children[i];
+      }
+      if (node->keys[i] > key) {
+        break;
+      }
+    }
+    return nullptr;
+  }
+
+  // Returns a pointer to the child pointer for branch `key`, or nullptr if
+  // there is no such branch.
+  //
+  static Node *const *find_child(const Node *node, std::uint8_t key) {
+    switch (node->kind) {
+    case NodeKind::kNode4:
+      return find_sorted(static_cast<const Node4 *>(node), key);
+
+    case NodeKind::kNode16: {
+      const auto *n = static_cast<const Node16 *>(node);
+#if defined(__SSE2__)
+      const __m128i matches = _mm_cmpeq_epi8(
+          _mm_set1_epi8((char)key),
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(n->keys.data())));
+      const int mask =
+          _mm_movemask_epi8(matches) & ((1 << n->num_children) - 1);
+      return mask ? &n->children[__builtin_ctz(mask)] : nullptr;
+#else
+      return find_sorted(n, key);
+#endif
+    }
+
+    case NodeKind::kNode48: {
+      const auto *n = static_cast<const Node48 *>(node);
+      const int slot = n->child_index[key];
+      return slot ? &n->children[slot - 1] : nullptr;
+    }
+
+    case NodeKind::kNode256: {
+      const auto *n = static_cast<const Node256 *>(node);
+      return n->children[key] ? &n->children[key] : nullptr;
+    }
+    }
+    return nullptr;
+  }
+
+  static Node **find_child(Node *node, std::uint8_t key) {
+    return const_cast<Node **>(
+        find_child(static_cast<const Node *>(node), key));
+  }
+
+  // Invokes the visitor `fn` (see visitor.hpp) with the key byte and child
+  // pointer of each branch of `node`, in ascending key order.  Returns false
+  // iff `fn` stopped the iteration early.
+  //
+  template <typename Fn /* void(std::uint8_t key, Node *child) */>
+  static bool for_each_child(const Node *node, Fn &&fn) {
+    switch (node->kind) {
+    case NodeKind::kNode4:
+      return for_each_sorted(static_cast<const Node4 *>(node), fn);
+
+    case NodeKind::kNode16:
+      return for_each_sorted(static_cast<const Node16 *>(node), fn);
+
+    case NodeKind::kNode48: {
+      const auto *n = static_cast<const Node48 *>(node);
+      for (int key = 0; key < 256; ++key) {
+        if (n->child_index[key] &&
+            !invoke_visitor(fn, std::uint8_t(key),
+                            n->children[n->child_index[key] - 1])) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    case NodeKind::kNode256: {
+      const auto *n = static_cast<const Node256 *>(node);
+      for (int key = 0; key < 256; ++key) {
+        if (n->children[key] &&
+            !invoke_visitor(fn, std::uint8_t(key), n->children[key])) {
+          return false;
+        }
+      }
+      return true;
+    }
+    }
+    return true;
+  }
+
+  template <typename SortedNodeT, typename Fn>
+  static bool for_each_sorted(const SortedNodeT *node, Fn &&fn) {
+    for (int i = 0; i < node->num_children; ++i) {
+      if (!invoke_visitor(fn, node->keys[i], node->children[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static bool is_full(const Node *node) {
+    switch (node->kind) {
+    case NodeKind::kNode4:
+      return node->num_children == 4;
+    case NodeKind::kNode16:
+      return node->num_children == 16;
+    case NodeKind::kNode48:
+      return node->num_children == 48;
+    case NodeKind::kNode256:
+      return false;
+    }
+    return false;
+  }
+
+  // Moves the common header fields from `from` to `to`.
+  //
+  static void move_header(Node *from, Node *to) {
+    to->num_children = from->num_children;
+    to->label_offset = from->label_offset;
+    to->label_length = from->label_length;
+    to->subtree_count = from->subtree_count;
+    to->last_stamp = from->last_stamp;
+    to->values = std::move(from->values);
+  }
+
+  // Replaces a full `node` with the next larger node kind, returning the new
+  // node; `node` is deleted.
+  //
+  static Node *grow(Node *node) {
+    switch (node->kind) {
+    case NodeKind::kNode4: {
+      auto *from = static_cast<Node4 *>(node);
+      auto *to = new Node16;
+      move_header(from, to);
+      std::copy_n(from->keys.begin(), from->num_children, to->keys.begin());
+      std::copy_n(from->children.begin(), from->num_children,
+                  to->children.begin());
+      delete from;
+      return to;
+    }
+
+    case NodeKind::kNode16: {
+      auto *from = static_cast<Node16 *>(node);
+      auto *to = new Node48;
+      move_header(from, to);
+      for (int i = 0; i < from->num_children; ++i) {
+        to->children[i] = from->children[i];
+        to->child_index[from->keys[i]] = i + 1;
+      }
+      delete from;
+      return to;
+    }
+
+    case NodeKind::kNode48: {
+      auto *from = static_cast<Node48 *>(node);
+      auto *to = new Node256;
+      move_header(from, to);
+      for (int key = 0; key < 256; ++key) {
+        if (from->child_index[key]) {
+          to->children[key] = from->children[from->child_index[key] - 1];
+        }
+      }
+      delete from;
+      return to;
+    }
+
+    case NodeKind::kNode256:
+      break;
+    }
+    assert(!"Node256 can not grow");
+    return node;
+  }
+
+  template <typename SortedNodeT>
+  static void insert_sorted(SortedNodeT *node, std::uint8_t key, Node *child) {
+    int i = node->num_children;
+    for (; i > 0 && node->keys[i - 1] > key; --i) {
+      node->keys[i] = node->keys[i - 1];
+      node->children[i] = node->children[i - 1];
+    }
+    node->keys[i] = key;
+    node->children[i] = child;
+    ++node->num_children;
+  }
+
+  // Adds `child` as branch `key` of the node pointed to by `slot`, which must
+  // not already have such a branch.  If the node is full, it is replaced (by
+  // updating `*slot`) with a larger node kind first.
+  //
+  static void add_child(Node **slot, std::uint8_t key, Node *child) {
+    if (is_full(*slot)) {
+      *slot = grow(*slot);
+    }
+    Node *node = *slot;
+    switch (node->kind) {
+    case NodeKind::kNode4:
+      insert_sorted(static_cast<Node4 *>(node), key, child);
+      break;
+
+    case NodeKind::kNode16:
+      insert_sorted(static_cast<Node16 *>(node), key, child);
+      break;
+
+    case NodeKind::kNode48: {
+      auto *n = static_cast<Node48 *>(node);
+      n->children[n->num_children] = child;
+      n->child_index[key] = ++n->num_children;
+      break;
+    }
+
+    case NodeKind::kNode256: {
+      auto *n = static_cast<Node256 *>(node);
+      n->children[key] = child;
+      ++n->num_children;
+      break;
+    }
+    }
+  }
+
+  // Returns the size of the concrete node type of `node`.
+  //
+  static std::size_t node_size(const Node *node) {
+    switch (node->kind) {
+    case NodeKind::kNode4:
+      return sizeof(Node4);
+    case NodeKind::kNode16:
+      return sizeof(Node16);
+    case NodeKind::kNode48:
+      return sizeof(Node48);
+    case NodeKind::kNode256:
+      return sizeof(Node256);
+    }
+    return sizeof(Node);
+  }
+
+  // Recursively deletes `node` and all its descendants.
+  //
+  static void destroy(Node *node) noexcept {
+    for_each_child(node, [](std::uint8_t, Node *child) { destroy(child); });
+    switch (node->kind) {
+    case NodeKind::kNode4:
+      delete static_cast<Node4 *>(node);
+      break;
+    case NodeKind::kNode16:
+      delete static_cast<Node16 *>(node);
+      break;
+    case NodeKind::kNode48:
+      delete static_cast<Node48 *>(node);
+      break;
+    case NodeKind::kNode256:
+      delete static_cast<Node256 *>(node);
+      break;
+    }
+  }
+
+  template <typename Fn /* void(const T &) */>
+  static bool visit_values(const Node *node, Fn &&fn) {
+    for (const T &v : node->values) {
+      if (!invoke_visitor(fn, v)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  template <typename Fn /* void(const T &) */>
+  static bool visit_recursive(const Node *node, Fn &&fn) {
+    if (!visit_values(node, fn)) {
+      return false;
+    }
+    return for_each_child(node, [&](std::uint8_t, const Node *child) {
+      return visit_recursive(child, fn) ? VisitResult::kContinue
+                                        : VisitResult::kStop;
+    });
+  }
+
+  // -- Trie helpers -----------------------------------------------------------
+
+  std::string_view label(const Node *node) const {
+    return std::string_view{labels_.data() + node->label_offset,
+                            node->label_length};
+  }
+
+  // Appends `key` to the label pool, returning its offset.
+  //
+  std::uint32_t append_label(std::string_view key) {
+    assert(labels_.size() + key.size() <=
+           std::numeric_limits<std::uint32_t>::max());
+    const auto offset = std::uint32_t(labels_.size());
+    labels_.insert(labels_.end(), key.begin(), key.end());
+    return offset;
+  }
+
+  static void count_insertion(Node *node, std::uint32_t stamp) {
+    if (node->last_stamp != stamp) {
+      node->last_stamp = stamp;
+      ++node->subtree_count;
+    }
+  }
+
+  std::uint32_t next_stamp() {
+    assert(stamp_ < std::numeric_limits<std::uint32_t>::max());
+    return ++stamp_;
+  }
+
+  // Inserts `value` under `key`, which must already be present in the label
+  // pool at `key_offset` (so that new leaves can refer to it), as part of the
+  // insertion with the given `stamp`.
+  //
+  void insert_at(std::string_view key, std::uint32_t key_offset,
+                 const T &value, std::uint32_t stamp) {
+    Node **slot = &root_;
+    for (;;) {
+      Node *node = *slot;
+      count_insertion(node, stamp);
+      if (key.empty()) {
+        node->values.emplace_back(value);
+        return;
+      }
+
+      const auto ch = (std::uint8_t)key.front();
+      Node **child_slot = find_child(node, ch);
+      if (!child_slot) {
+        auto *leaf = new Node4;
+        leaf->label_offset = key_offset + 1;
+        leaf->label_length = key.size() - 1;
+        leaf->values.emplace_back(value);
+        count_insertion(leaf, stamp);
+        add_child(slot, ch, leaf);
+        return;
+      }
+      key.remove_prefix(1);
+      ++key_offset;
+
+      Node *child = *child_slot;
+      const std::string_view child_label = label(child);
+      const std::size_t common =
+          std::mismatch(child_label.begin(), child_label.end(), key.begin(),
+                        key.end())
+              .first -
+          child_label.begin();
+
+      if (common < child_label.size()) {
+        // `key` diverges from (or ends within) the child's label; split the
+        // edge by inserting a new node after the common prefix.
+        //
+        auto *middle = new Node4;
+        middle->label_offset = child->label_offset;
+        middle->label_length = common;
+        middle->subtree_count = child->subtree_count;
+        middle->last_stamp = child->last_stamp;
+        insert_sorted(middle, (std::uint8_t)child_label[common], child);
+        child->label_offset += common + 1;
+        child->label_length -= common + 1;
+        *child_slot = middle;
+      }
+      key.remove_prefix(common);
+      key_offset += common;
+      slot = child_slot;
+    }
+  }
+
+  // Searches from the root of the trie for `key`.  If `exact` is true, returns
+  // the node whose path is exactly `key`; otherwise returns the shallowest node
+  // whose path starts with `key` (i.e., the root of the subtree containing all
+  // keys with that prefix).  Returns nullptr if there is no such node.
+  //
+  const Node *find_node(std::string_view key, bool exact) const {
+    const Node *node = root_;
+    while (!key.empty()) {
+      Node *const *child_slot = find_child(node, (std::uint8_t)key.front());
+      if (!child_slot) {
+        return nullptr;
+      }
+      key.remove_prefix(1);
+      node = *child_slot;
+
+      const std::string_view node_label = label(node);
+      if (key.size() < node_label.size()) {
+        if (exact || node_label.substr(0, key.size()) != key) {
+          return nullptr;
+        }
+        return node;
+      }
+      if (key.substr(0, node_label.size()) != node_label) {
+        return nullptr;
+      }
+      key.remove_prefix(node_label.size());
+    }
+    return node;
+  }
+
+  // The root of the trie; always has an empty label.  Values (`T`) stored here
+  // are associated with the empty string.
+  //
+  Node *root_ = new Node4;
+
+  // Character pool holding all node labels.
+  //
+  std::vector<char> labels_;
+
+  // The stamp of the most recent insertion.
+  //
+  std::uint32_t stamp_ = 0;
+
+  //============================================================================
+public:
+  RadixTrie() = default;
+  RadixTrie(const RadixTrie &) = delete;
+  RadixTrie &operator=(const RadixTrie &) = delete;
+
+  ~RadixTrie() noexcept { destroy(root_); }
+
+  //================================
+
+  // Inserts `value` under the given `key`.  This operation always creates a new
+  // mapping in the trie (because this container has multimap-like semantics).
+  //
+  // Complexity: O(key.length())
+  //
+  void insert(std::string_view key, const T &value) {
+    insert_at(key, append_label(key), value, next_stamp());
+  }
+
+  // Inserts `value` under all the suffixes of key (including key itself).  The
+  // key is only added to the label pool once, and shared by all suffixes.
+  //
+  void insert_suffixes(std::string_view key, const T &value) {
+    const std::uint32_t key_offset = append_label(key);
+    const std::uint32_t stamp = next_stamp();
+    for (std::uint32_t i = 0; i < key.size(); ++i) {
+      insert_at(key.substr(i), key_offset + i, value, stamp);
+    }
+  }
+
+  // Invokes the visitor `fn` (see visitor.hpp) for each mapped value whose key
+  // matches `key` exactly.  Returns false iff `fn` stopped the iteration early.
+  //
+  template <typename Fn /* void(const T &) */>
+  bool for_each_exact_match(std::string_view key, Fn &&fn) const {
+    const Node *node = find_node(key, /*exact=*/true);
+    if (!node) {
+      return true;
+    }
+    return visit_values(node, fn);
+  }
+
+  // Invokes the visitor `fn` (see visitor.hpp) for each mapped value whose key
+  // starts with `key_prefix`.  Returns false iff `fn` stopped the iteration
+  // early.
+  //
+  template <typename Fn /* void(const T &) */>
+  bool for_each_prefix_match(std::string_view key_prefix, Fn &&fn) const {
+    const Node *node = find_node(key_prefix, /*exact=*/false);
+    if (!node) {
+      return true;
+    }
+    return visit_recursive(node, fn);
+  }
+  // Returns the number of calls to `insert` or `insert_suffixes` that stored a
+  // value under some key starting with `key_prefix`; see
+  // `StringTrie::count_prefix_matches`.
+  //
+  // Complexity: O(key_prefix.length())
+  //
+  std::size_t count_prefix_matches(std::string_view key_prefix) const {
+    const Node *node = find_node(key_prefix, /*exact=*/false);
+    return node ? node->subtree_count : 0;
+  }
+
+  // Returns the memory used by the trie (its nodes, their value arrays and
+  // the label pool), with counts of its nodes and values.
+  //
+  // Complexity: O(number of nodes)
+  //
+  MemoryUsage memory_usage() const {
+    MemoryUsage usage;
+    usage.bytes = heap_bytes(labels_);
+    std::vector<const Node *> stack = {root_};
+    while (!stack.empty()) {
+      const Node *node = stack.back();
+      stack.pop_back();
+      ++usage.num_nodes;
+      usage.num_inner_nodes += node->num_children != 0;
+      usage.num_entries += node->values.size();
+      usage.bytes += node_size(node) + heap_bytes(node->values);
+      for_each_child(node, [&](std::uint8_t, const Node *child) {
+        stack.push_back(child);
+      });
+    }
+    return usage;
+  }
+};
@@ -0,0 +1,159 @@
+#include "radix_trie.hpp"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include <set>
+#include <string>
+
+#include "qb_column_lookup.hpp"
+#include "string_trie.hpp"
+#include "words.hpp"
+
+namespace {
+
+template <typename Trie>
+std::set<int> prefix_matches(const Trie &trie, std::string_view prefix) {
+  std::set<int> actual;
+  trie.for_each_prefix_match(prefix, [&](int i) { actual.insert(i); });
+  return actual;
+}
+
+template <typename Trie>
+std::multiset<int> exact_matches(const Trie &trie, std::string_view key) {
+  std::multiset<int> actual;
+  trie.for_each_exact_match(key, [&](int i) { actual.insert(i); });
+  return actual;
+}
+
+TEST(RadixTrieTest, EdgeSplitting) {
+  using ::testing::ElementsAre;
+  using ::testing::IsEmpty;
+
+  RadixTrie<int> trie;
+  trie.insert("romane", 1);
+  trie.insert("romanus", 2);
+  trie.insert("romulus", 3);
+  trie.insert("rubens", 4);
+  trie.insert("ruber", 5);
+  trie.insert("rubicon", 6);
+  trie.insert("rubicundus", 7);
+  trie.insert("rom", 8);
+  trie.insert("rom", 9);
+
+  EXPECT_THAT(exact_matches(trie, "romane"), ElementsAre(1));
+  EXPECT_THAT(exact_matches(trie, "rom"), ElementsAre(8, 9));
+  EXPECT_THAT(exact_matches(trie, "roma"), IsEmpty());
+  EXPECT_THAT(exact_matches(trie, "romanes"), IsEmpty());
+  EXPECT_THAT(exact_matches(trie, ""), IsEmpty());
+
+  EXPECT_THAT(prefix_matches(trie, ""),
+              ElementsAre(1, 2, 3, 4, 5, 6, 7, 8, 9));
+  EXPECT_THAT(prefix_matches(trie, "r"),
+              ElementsAre(1, 2, 3, 4, 5, 6, 7, 8, 9));
+  EXPECT_THAT(prefix_matches(trie, "rom"), ElementsAre(1, 2, 3, 8, 9));
+  EXPECT_THAT(prefix_matches(trie, "roman"), ElementsAre(1, 2));
+  EXPECT_THAT(prefix_matches(trie, "rubi"), ElementsAre(6, 7));
+  EXPECT_THAT(prefix_matches(trie, "rubicu"), ElementsAre(7));
+  EXPECT_THAT(prefix_matches(trie, "rubicx"), IsEmpty());
+  EXPECT_THAT(prefix_matches(trie, "x"), IsEmpty());
+}
+
+TEST(RadixTrieTest, NodeGrowth) {
+  // Give the root (and one inner node) every possible branching factor so
+  // that all node kinds are exercised.
+  //
+  RadixTrie<int> trie;
+  for (int ch = 255; ch >= 0; --ch) {
+    const char key[] = {'a', char(ch), 'z'};
+    trie.insert(std::string_view{key, sizeof(key)}, ch);
+    trie.insert(std::string_view{key + 1, 1}, ch);
+
+    for (int other = ch; other < 256; other += 17) {
+      const char other_key[] = {'a', char(other), 'z'};
+      ASSERT_THAT(exact_matches(trie, std::string_view{other_key, 3}),
+                  ::testing::ElementsAre(other));
+      ASSERT_THAT(exact_matches(trie, std::string_view{other_key + 1, 1}),
+                  ::testing::ElementsAre(other));
+    }
+  }
+  EXPECT_EQ(prefix_matches(trie, "a").size(), 256u);
+  EXPECT_EQ(prefix_matches(trie, "").size(), 256u);
+}
+
+// Subtree counts must survive edge splits and node growth, and count each
+// `insert_suffixes` call once no matter how many of its suffixes match.
+//
+TEST(RadixTrieTest, CountPrefixMatches) {
+  const std::vector<std::string> words = load_words();
+
+  StringTrie<int> string_trie;
+  RadixTrie<int> radix_trie;
+  for (int i = 0; i < int(words.size()); i += 7) {
+    string_trie.insert_suffixes(words[i], i);
+    radix_trie.insert_suffixes(words[i], i);
+  }
+
+  for (const char *pattern :
+       {"", "a", "e", "ss", "ing", "ill", "uniquely", "notawordXYZ", "q"}) {
+    const std::size_t expected = prefix_matches(radix_trie, pattern).size();
+    EXPECT_EQ(radix_trie.count_prefix_matches(pattern), expected) << pattern;
+    EXPECT_EQ(string_trie.count_prefix_matches(pattern), expected) << pattern;
+  }
+
+  RadixTrie<int> trie;
+  trie.insert("rom", 1);
+  trie.insert("rom", 1);
+  trie.insert("romane", 2);
+  EXPECT_EQ(trie.count_prefix_matches("ro"), 3u);
+  EXPECT_EQ(trie.count_prefix_matches("roma"), 1u);
+  EXPECT_EQ(trie.count_prefix_matches("romx"), 0u);
+}
+
+TEST(RadixTrieTest, ColumnLookupBackend) {
+  QBColumnLookup<unsigned, std::string, RadixTrie<unsigned>> lookup;
+  lookup.insert(1, "banana");
+  lookup.insert(2, "bandana");
+  lookup.insert(3, "cabana");
+
+  std::multiset<unsigned> actual;
+  lookup.for_each_match("ana", [&](unsigned id) {
+    actual.insert(id);
+    return VisitResult::kContinue;
+  });
+
+  EXPECT_THAT(actual, ::testing::ElementsAre(1, 2, 3));
+}
+
+// Builds a StringTrie and a RadixTrie over the same corpus and checks that
+// they agree with a brute force search.  (BM_BuildIndex and BM_QueryIndex in
+// qb_record_collection_benchmark.cpp compare their memory and speed.)
+//
+TEST(RadixTrieTest, MatchesStringTrie) {
+  const std::vector<std::string> words = load_words();
+
+  StringTrie<int> old_trie;
+  RadixTrie<int> new_trie;
+  for (std::size_t i = 0; i < words.size(); ++i) {
+    old_trie.insert_suffixes(words[i], i);
+    new_trie.insert_suffixes(words[i], i);
+  }
+
+  for (const char *pattern : {"x", "ill", "zing", "uniquely", "notawordXYZ",
+                              "bob", "aa", "niqu", "ly", "are", "ss", "ZZG",
+                              "raft", "th", "lo", "term", "expect", "lease"}) {
+    std::set<int> expected;
+    for (std::size_t i = 0; i < words.size(); ++i) {
+      if (words[i].find(pattern) != std::string::npos) {
+        expected.insert(i);
+      }
+    }
+
+    EXPECT_THAT(prefix_matches(old_trie, pattern),
+                ::testing::ContainerEq(expected));
+    EXPECT_THAT(prefix_matches(new_trie, pattern),
+                ::testing::ContainerEq(expected));
+  }
+}
+
+} // namespace
@@ -0,0 +1,130 @@
+// Parsing of comparison/range predicates for numeric column queries.
+//
+#pragma once
+
+#include <cctype>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include <boost/lexical_cast.hpp>
+
+// Closed range [lo, hi] of values of type `T`; empty if `hi < lo`.
+//
+template <typename T> struct ValueRange {
+  T lo;
+  T hi;
+
+  bool empty() const { return hi < lo; }
+};
+
+namespace detail {
+
+inline std::string_view trim(std::string_view s) {
+  while (!s.empty() && std::isspace((unsigned char)s.front())) {
+    s.remove_prefix(1);
+  }
+  while (!s.empty() && std::isspace((unsigned char)s.back())) {
+    s.remove_suffix(1);
+  }
+  return s;
+}
+
+// Returns true (and removes it from `s`) iff `s` starts with the keyword
+// `word` (compared case-insensitively) followed by whitespace.
+//
+inline bool consume_keyword(std::string_view &s, std::string_view word) {
+  if (s.size() <= word.size() || !std::isspace((unsigned char)s[word.size()])) {
+    return false;
+  }
+  for (std::size_t i = 0; i < word.size(); ++i) {
+    if (std::toupper((unsigned char)s[i]) != word[i]) {
+      return false;
+    }
+  }
+  s = trim(s.substr(word.size()));
+  return true;
+}
+
+// Returns the offset of the keyword `word` (upper case), surrounded by
+// whitespace, in `s`; or `npos`.
+//
+inline std::size_t find_keyword(std::string_view s, std::string_view word) {
+  for (std::size_t i = 1; i + word.size() < s.size(); ++i) {
+    if (!std::isspace((unsigned char)s[i - 1]) ||
+        !std::isspace((unsigned char)s[i + word.size()])) {
+      continue;
+    }
+    std::size_t j = 0;
+    while (j < word.size() &&
+           std::toupper((unsigned char)s[i + j]) == word[j]) {
+      ++j;
+    }
+    if (j == word.size()) {
+      return i;
+    }
+  }
+  return std::string_view::npos;
+}
+
+template <typename T> T parse_number(std::string_view s) {
+  return boost::lexical_cast<T>(trim(s));
+}
+
+} // namespace detail
+
+// Parses a match string for a numeric column into the range of values it
+// matches.  Accepted forms (keywords are case-insensitive, and whitespace
+// around operators and operands is ignored):
+//
+//   "42", "=42"           values equal to 42
+//   ">42", ">=42"         values greater than (or equal to) 42
+//   "<42", "<=42"         values less than (or equal to) 42
+//   "BETWEEN 1 AND 10"    values from 1 to 10, inclusive
+//
+// Throws `boost::bad_lexical_cast` if an operand is not a valid `T`, and
+// `std::invalid_argument` if a BETWEEN predicate is missing its AND.
+//
+template <typename T> ValueRange<T> parse_range_predicate(std::string_view s) {
+  static_assert(std::is_integral_v<T>, "range predicates require integers");
+  using limits = std::numeric_limits<T>;
+
+  s = detail::trim(s);
+
+  if (detail::consume_keyword(s, "BETWEEN")) {
+    const std::size_t and_pos = detail::find_keyword(s, "AND");
+    if (and_pos == std::string_view::npos) {
+      throw std::invalid_argument{"BETWEEN without AND: " + std::string{s}};
+    }
+    return {detail::parse_number<T>(s.substr(0, and_pos)),
+            detail::parse_number<T>(s.substr(and_pos + 3))};
+  }
+
+  if (s.substr(0, 2) == ">=") {
+    return {detail::parse_number<T>(s.substr(2)), limits::max()};
+  }
+  if (s.substr(0, 2) == "<=") {
+    return {limits::lowest(), detail::parse_number<T>(s.substr(2))};
+  }
+  if (s.substr(0, 1) == ">") {
+    const T value = detail::parse_number<T>(s.substr(1));
+    if (value == limits::max()) {
+      return {limits::max(), limits::lowest()};
+    }
+    return {T(value + 1), limits::max()};
+  }
+  if (s.substr(0, 1) == "<") {
+    const T value = detail::parse_number<T>(s.substr(1));
+    if (value == limits::lowest()) {
+      return {limits::max(), limits::lowest()};
+    }
+    return {limits::lowest(), T(value - 1)};
+  }
+  if (s.substr(0, 1) == "=") {
+    s.remove_prefix(1);
+  }
+  const T value = detail::parse_number<T>(s);
+  return {value, value};
+}
@@ -0,0 +1,145 @@
+#include "sharded_qb_record_collection.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include <boost/lexical_cast.hpp>
+
+ShardedQBRecordCollection::ShardedQBRecordCollection(unsigned num_shards,
+                                                     unsigned num_threads)
+    : pool_{num_threads} {
+  num_shards = std::max(num_shards, 1u);
+  shards_.reserve(num_shards);
+  for (unsigned i = 0; i < num_shards; ++i) {
+    shards_.emplace_back(/*id_stride=*/num_shards, /*id_residue=*/i);
+  }
+}
+
+std::size_t ShardedQBRecordCollection::shard_of(unique_id_type id) const {
+  return id % shards_.size();
+}
+
+void ShardedQBRecordCollection::for_each_shard(
+    const std::function<void(QBRecordCollection &, std::size_t)> &fn) {
+  std::vector<std::function<void()>> tasks;
+  for (std::size_t i = 0; i < shards_.size(); ++i) {
+    tasks.emplace_back([&, i] { fn(shards_[i], i); });
+  }
+  pool_.run(tasks);
+}
+
+void ShardedQBRecordCollection::for_each_shard(
+    const std::function<void(const QBRecordCollection &, std::size_t)> &fn)
+    const {
+  std::vector<std::function<void()>> tasks;
+  for (std::size_t i = 0; i < shards_.size(); ++i) {
+    tasks.emplace_back([&, i] { fn(shards_[i], i); });
+  }
+  pool_.run(tasks);
+}
+
+auto ShardedQBRecordCollection::merge_results(
+    std::vector<std::vector<record_type>> &&results)
+    -> std::vector<record_type> {
+  if (results.size() == 1) {
+    return std::move(results.front());
+  }
+  std::size_t total = 0;
+  for (const std::vector<record_type> &result : results) {
+    total += result.size();
+  }
+  std::vector<record_type> merged;
+  merged.reserve(total);
+
+  // There are only as many results as shards, so pick the one with the
+  // smallest next id by linear search.
+  //
+  std::vector<std::size_t> next(results.size(), 0);
+  while (merged.size() < total) {
+    std::size_t min = results.size();
+    for (std::size_t i = 0; i < results.size(); ++i) {
+      if (next[i] < results[i].size() &&
+          (min == results.size() ||
+           std::get<0>(results[i][next[i]]) <
+               std::get<0>(results[min][next[min]]))) {
+        min = i;
+      }
+    }
+    merged.emplace_back(std::move(results[min][next[min]++]));
+  }
+  return merged;
+}
+
+const QBRecordCollection *
+ShardedQBRecordCollection::id_query_shard(std::string_view columnName,
+                                          std::string_view matchString) const {
+  const auto column_num = parse_column_name<QBRecordTraits>(columnName);
+  if (!column_num || *column_num != QBRecordTraits::unique_id_column()) {
+    return nullptr;
+  }
+  return &shards_[shard_of(boost::lexical_cast<unique_id_type>(matchString))];
+}
+
+bool ShardedQBRecordCollection::insert(record_type &&record) {
+  return shards_[shard_of(std::get<0>(record))].insert(std::move(record));
+}
+
+void ShardedQBRecordCollection::compact() {
+  for_each_shard([](QBRecordCollection &shard, std::size_t) {
+    shard.compact();
+  });
+}
+
+auto ShardedQBRecordCollection::find_matching_records(
+    std::string_view columnName, std::string_view matchString) const
+    -> std::vector<record_type> {
+  if (const QBRecordCollection *shard =
+          id_query_shard(columnName, matchString)) {
+    return shard->find_matching_records(columnName, matchString);
+  }
+  std::vector<std::vector<record_type>> results(shards_.size());
+  for_each_shard([&](const QBRecordCollection &shard, std::size_t i) {
+    results[i] = shard.find_matching_records(columnName, matchString);
+  });
+  return merge_results(std::move(results));
+}
+
+auto ShardedQBRecordCollection::find_matching_records(
+    const std::vector<ColumnPredicate> &predicates, PredicateOp op) const
+    -> std::vector<record_type> {
+  std::vector<std::vector<record_type>> results(shards_.size());
+  for_each_shard([&](const QBRecordCollection &shard, std::size_t i) {
+    results[i] = shard.find_matching_records(predicates, op);
+  });
+  return merge_results(std::move(results));
+}
+
+std::size_t ShardedQBRecordCollection::count_matching_records(
+    std::string_view columnName, std::string_view matchString) const {
+  if (const QBRecordCollection *shard =
+          id_query_shard(columnName, matchString)) {
+    return shard->count_matching_records(columnName, matchString);
+  }
+  std::vector<std::size_t> counts(shards_.size());
+  for_each_shard([&](const QBRecordCollection &shard, std::size_t i) {
+    counts[i] = shard.count_matching_records(columnName, matchString);
+  });
+  std::size_t total = 0;
+  for (const std::size_t count : counts) {
+    total += count;
+  }
+  return total;
+}
+
+std::size_t ShardedQBRecordCollection::count_matching_records(
+    const std::vector<ColumnPredicate> &predicates, PredicateOp op) const {
+  std::vector<std::size_t> counts(shards_.size());
+  for_each_shard([&](const QBRecordCollection &shard, std::size_t i) {
+    counts[i] = shard.count_matching_records(predicates, op);
+  });
+  std::size_t total = 0;
+  for (const std::size_t count : counts) {
+    total += count;
+  }
+  return total;
+}
@@ -0,0 +1,123 @@
+// ShardedQBRecordCollection - a record collection partitioned by unique id
+// into independent QBRecordCollections, so that queries can use many cores.
+//
+// Each record lives in shard `id % N` of the N shards, and each shard has its
+// own column indices.  Inserts and unique id queries go to
+// a single shard; all other queries run on every shard at once, on a shared
+// `ThreadPool`, and the per-shard results (each sorted by id) are merged.  A
+// broad query thus walks N tries a fraction of the size on N cores, instead
+// of one large trie on one core.
+//
+// Each shard keys its id map by `id / N` (see `StridedIdMap`), so ids that
+// are dense overall stay dense within every shard.  Ids that share a common
+// factor with N (e.g. all even, with an even N) fill only some of the shards.
+//
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+#include "parallel.hpp"
+#include "qb_record_collection.hpp"
+
+class ShardedQBRecordCollection {
+public:
+  using record_type = QBRecordCollection::record_type;
+  using unique_id_type = QBRecordCollection::unique_id_type;
+
+  // Creates an empty collection of `num_shards` shards, queried by
+  // `num_threads` threads (the caller and `num_threads - 1` pool workers).
+  //
+  explicit ShardedQBRecordCollection(
+      unsigned num_shards = default_thread_count(),
+      unsigned num_threads = default_thread_count());
+
+  ShardedQBRecordCollection(const ShardedQBRecordCollection &) = delete;
+  ShardedQBRecordCollection &
+  operator=(const ShardedQBRecordCollection &) = delete;
+
+  // Returns the number of shards.
+  //
+  std::size_t num_shards() const { return shards_.size(); }
+
+  // Inserts a new record into its shard; see `QBRecordCollection::insert`.
+  //
+  bool insert(record_type &&record);
+
+  // Inserts each of `records` (any range of `record_type`), as if by
+  // `insert`, loading all shards in parallel.  Returns the number of records
+  // inserted.
+  //
+  template <typename Range> std::size_t bulk_insert(const Range &records);
+
+  // Compacts all shards, in parallel; see `QBRecordCollection::compact`.
+  //
+  void compact();
+
+  // Same as the `QBRecordCollection` members of the same names.  Results are
+  // sorted by id.
+  //
+  std::vector<record_type>
+  find_matching_records(std::string_view columnName,
+                        std::string_view matchString) const;
+
+  std::vector<record_type>
+  find_matching_records(const std::vector<ColumnPredicate> &predicates,
+                        PredicateOp op) const;
+
+  std::size_t count_matching_records(std::string_view columnName,
+                                     std::string_view matchString) const;
+
+  std::size_t
+  count_matching_records(const std::vector<ColumnPredicate> &predicates,
+                         PredicateOp op) const;
+
+private:
+  // Returns the shard for records with the given id.
+  //
+  std::size_t shard_of(unique_id_type id) const;
+
+  // Runs `fn(shard, i)` for each shard `i`, in parallel.
+  //
+  void for_each_shard(
+      const std::function<void(QBRecordCollection &, std::size_t)> &fn);
+  void for_each_shard(
+      const std::function<void(const QBRecordCollection &, std::size_t)> &fn)
+      const;
+
+  // Merges the per-shard results of a query, each sorted by id, into one
+  // vector sorted by id.
+  //
+  static std::vector<record_type>
+  merge_results(std::vector<std::vector<record_type>> &&results);
+
+  // Returns the only shard that can match if `columnName` is the unique id
+  // column, and nullptr otherwise.
+  //
+  const QBRecordCollection *id_query_shard(std::string_view columnName,
+                                           std::string_view matchString) const;
+
+  std::vector<QBRecordCollection> shards_;
+  mutable ThreadPool pool_;
+};
+
+template <typename Range>
+std::size_t ShardedQBRecordCollection::bulk_insert(const Range &records) {
+  std::vector<std::vector<record_type>> parts(shards_.size());
+  for (const record_type &record : records) {
+    parts[shard_of(std::get<0>(record))].emplace_back(record);
+  }
+
+  std::vector<std::size_t> inserted(shards_.size());
+  for_each_shard([&](QBRecordCollection &shard, std::size_t i) {
+    inserted[i] = shard.bulk_insert(parts[i], /*num_threads=*/1);
+  });
+
+  std::size_t total = 0;
+  for (const std::size_t n : inserted) {
+    total += n;
+  }
+  return total;
+}
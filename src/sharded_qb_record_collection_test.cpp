@@ -0,0 +1,116 @@
+#include "sharded_qb_record_collection.hpp"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "words.hpp"
+
+namespace {
+
+using record_type = ShardedQBRecordCollection::record_type;
+
+// Returns `count` records with ids 0..count-1 and random strings made of
+// three-letter words.
+//
+std::vector<record_type> random_records(int count) {
+  const std::vector<std::string> words =
+      load_words([](std::string_view word) { return word.length() == 3; });
+  std::default_random_engine rng{/*seed=*/1};
+  std::uniform_int_distribution<int> pick_word_index(0, words.size() - 1);
+  std::uniform_int_distribution<int> pick_word_count(1, 3);
+  std::uniform_int_distribution<long> pick_long(-count / 4, count / 4);
+
+  const auto random_string = [&] {
+    std::string s;
+    for (int n = pick_word_count(rng); n > 0; --n) {
+      s += words[pick_word_index(rng)];
+    }
+    return s;
+  };
+
+  std::vector<record_type> records;
+  for (int id = 0; id < count; ++id) {
+    records.emplace_back(id, random_string(), pick_long(rng), random_string());
+  }
+  return records;
+}
+
+TEST(ShardedQBRecordCollectionTest, MatchesSingleCollection) {
+  const std::vector<record_type> records = random_records(3000);
+
+  QBRecordCollection single;
+  for (const record_type &record : records) {
+    single.insert(record_type{record});
+  }
+
+  // Load half the records one at a time and half in bulk, repeating some.
+  //
+  ShardedQBRecordCollection sharded{/*num_shards=*/5, /*num_threads=*/3};
+  ASSERT_EQ(sharded.num_shards(), 5u);
+  for (std::size_t i = 0; i < records.size() / 2; ++i) {
+    EXPECT_TRUE(sharded.insert(record_type{records[i]}));
+  }
+  EXPECT_FALSE(sharded.insert(record_type{records[0]}));
+  EXPECT_EQ(sharded.bulk_insert(std::vector<record_type>(
+                records.begin() + 100, records.end())),
+            records.size() - records.size() / 2);
+  sharded.compact();
+
+  for (const auto &[column, match] :
+       std::vector<std::pair<std::string, std::string>>{
+           {"column0", "17"},
+           {"column0", "3000"},
+           {"column1", "e"},
+           {"column1", "the"},
+           {"column3", "ab"},
+           {"column3", ""},
+           {"column2", "BETWEEN -100 AND 100"},
+           {"column2", ">700"},
+           {"columnX", "a"},
+       }) {
+    EXPECT_EQ(sharded.find_matching_records(column, match),
+              single.find_matching_records(column, match))
+        << column << " " << match;
+    EXPECT_EQ(sharded.count_matching_records(column, match),
+              single.count_matching_records(column, match))
+        << column << " " << match;
+  }
+
+  for (const PredicateOp op : {PredicateOp::kAnd, PredicateOp::kOr}) {
+    const std::vector<ColumnPredicate> predicates = {{"column1", "a"},
+                                                     {"column2", ">0"}};
+    EXPECT_EQ(sharded.find_matching_records(predicates, op),
+              single.find_matching_records(predicates, op));
+    EXPECT_EQ(sharded.count_matching_records(predicates, op),
+              single.count_matching_records(predicates, op));
+  }
+}
+
+// Checks that broad string queries find the same records whatever the number
+// of shards and threads.  (BM_ShardedQuery in
+// qb_record_collection_benchmark.cpp measures their throughput.)
+//
+TEST(ShardedQBRecordCollectionTest, ShardCountsAgree) {
+  const std::vector<record_type> records = random_records(2000);
+  const std::vector<std::string> patterns = {"e", "a", "s", "in", "er"};
+
+  ShardedQBRecordCollection single{1, 1};
+  single.bulk_insert(records);
+  for (const unsigned num_shards : {2, 4, 8}) {
+    ShardedQBRecordCollection db{num_shards, num_shards};
+    db.bulk_insert(records);
+    for (const std::string &pattern : patterns) {
+      EXPECT_EQ(db.find_matching_records("column1", pattern),
+                single.find_matching_records("column1", pattern))
+          << num_shards << " shards, pattern=" << pattern;
+    }
+  }
+}
+
+} // namespace
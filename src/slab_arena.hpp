@@ -0,0 +1,102 @@
+// Implementation of SlabArena, an append-only object pool addressed by 32-bit
+// indices.
+//
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+//------------------------------------------------------------------------------
+
+// Pool of objects of type `T`, allocated in order from a small number of
+// geometrically growing slabs and identified by dense 32-bit indices.
+//
+// Slab `k` holds `kFirstSlabSize << k` objects, so an arena of `n` objects
+// uses O(log n) slabs, and objects are never moved once allocated (references
+// stay valid until the arena is destroyed).  Individual objects can not be
+// freed; since `T` must be trivially destructible, destroying the arena just
+// frees its slabs, regardless of how many objects it holds.
+//
+template <typename T, std::size_t kFirstSlabSize = 1024> class SlabArena {
+  static_assert(std::is_trivially_destructible_v<T>,
+                "SlabArena never runs destructors");
+  static_assert((kFirstSlabSize & (kFirstSlabSize - 1)) == 0,
+                "kFirstSlabSize must be a power of 2");
+
+public:
+  using index_type = std::uint32_t;
+
+  SlabArena() = default;
+  SlabArena(const SlabArena &) = delete;
+  SlabArena &operator=(const SlabArena &) = delete;
+
+  ~SlabArena() noexcept {
+    for (T *slab : slabs_) {
+      std::free(slab);
+    }
+  }
+
+  // Allocates a new value-initialized `T`, returning its index.
+  //
+  index_type allocate() {
+    if (size_ == capacity_) {
+      add_slab();
+    }
+    const index_type index = size_++;
+    new (&(*this)[index]) T{};
+    return index;
+  }
+
+  T &operator[](index_type index) {
+    assert(index < size_);
+    const int slab = slab_of(index);
+    return slabs_[slab][index - slab_begin(slab)];
+  }
+
+  const T &operator[](index_type index) const {
+    return const_cast<SlabArena &>(*this)[index];
+  }
+
+  // Returns the number of objects allocated so far.
+  //
+  std::size_t size() const { return size_; }
+
+  // Returns the total size in bytes of all slabs.
+  //
+  std::size_t byte_size() const { return capacity_ * sizeof(T); }
+
+private:
+  // Returns the index of the first object in slab `k`.
+  //
+  static std::size_t slab_begin(int k) {
+    return kFirstSlabSize * ((std::size_t{1} << k) - 1);
+  }
+
+  // Returns which slab holds the object at `index`.
+  //
+  static int slab_of(index_type index) {
+    const std::uint64_t q = index / kFirstSlabSize + 1;
+    return 63 - __builtin_clzll(q);
+  }
+
+  void add_slab() {
+    const std::size_t slab_size = kFirstSlabSize << slabs_.size();
+    assert(capacity_ + slab_size <=
+           std::size_t(std::numeric_limits<index_type>::max()) + 1);
+    T *slab = static_cast<T *>(std::malloc(slab_size * sizeof(T)));
+    if (!slab) {
+      throw std::bad_alloc{};
+    }
+    slabs_.emplace_back(slab);
+    capacity_ += slab_size;
+  }
+
+  std::vector<T *> slabs_;
+  std::size_t size_ = 0;
+  std::size_t capacity_ = 0;
+};
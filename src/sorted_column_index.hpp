@@ -0,0 +1,402 @@
+// Implementation of SortedColumnIndex, a contiguous ordered index for numeric
+// columns.
+//
+// A SortedColumnIndex<Key, Id> maps numeric keys onto row ids, like an
+// `std::multimap<Key, Id>`, but stores its entries as sorted parallel arrays
+// of keys and ids (structure of arrays) rather than as one heap node per
+// entry.  Searches therefore touch only the key array, and the ids for a
+// matching range of keys are read off a single contiguous slice.
+//
+// Keeping one big array sorted would make every insert O(n), so entries are
+// kept in a small number of sorted runs instead (the "logarithmic method" of
+// Bentley and Saxe, as used by LSM trees):
+//
+//  - New entries are appended to an unsorted insert buffer of at most
+//    `kBufferSize` entries, which queries scan linearly.
+//
+//  - When the buffer fills up, it is sorted into a new run.  Whenever the
+//    newest run has grown to at least 1/`kMergeRatio` of the size of the one
+//    before it, the two are merged; run sizes thus decrease geometrically, so
+//    there are O(log n) runs, and each entry is merged O(log n) times.
+//
+// Queries search each run with interpolation search (falling back to binary
+// search when the keys turn out not to be evenly distributed), so equality
+// and range queries cost O(log^2 n) in the worst case and about
+// O(log n log log n) for uniformly distributed keys, plus the size of the
+// result.  Since every run is searched, `compact()` (which merges everything
+// into a single run) should be called after a bulk load; a compacted index
+// answers equality queries in about twice the time of a hash table, in about a
+// quarter of the space.
+//
+// Erased entries are marked in a bitmap per run rather than removed, which
+// would move the rest of the run; queries skip them, and they are dropped
+// when their run is next merged (or rewritten, once most of its entries are
+// erased).
+//
+// Queries never modify the index, so a fully built index can be shared
+// between reader threads.
+//
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <type_traits>
+#include <vector>
+
+#include "memory_usage.hpp"
+#include "visitor.hpp"
+
+//------------------------------------------------------------------------------
+
+// Ordered multimap from numeric keys of type `Key` to ids of type `Id`.
+//
+template <typename Key, typename Id> class SortedColumnIndex {
+  static_assert(std::is_arithmetic_v<Key>,
+                "SortedColumnIndex keys must be numeric");
+
+public:
+  // The maximum number of entries in the unsorted insert buffer.
+  //
+  static constexpr std::size_t kBufferSize = 256;
+
+private:
+  // A sorted run of entries, stored as parallel arrays.  Entries with equal
+  // keys are in insertion order.
+  //
+  struct Run {
+    std::vector<Key> keys;
+    std::vector<Id> ids;
+
+    // One bit per entry, set iff the entry is erased; empty if none is.
+    //
+    std::vector<std::uint64_t> erased;
+    std::size_t num_erased = 0;
+
+    // Returns the number of entries, including erased ones.
+    //
+    std::size_t size() const { return keys.size(); }
+
+    // Returns the bytes allocated by the run.
+    //
+    std::size_t byte_size() const {
+      return heap_bytes(keys) + heap_bytes(ids) + heap_bytes(erased);
+    }
+
+    bool is_erased(std::size_t i) const {
+      return num_erased != 0 && ((erased[i / 64] >> (i % 64)) & 1);
+    }
+
+    void set_erased(std::size_t i) {
+      if (erased.empty()) {
+        erased.resize((size() + 63) / 64);
+      }
+      erased[i / 64] |= std::uint64_t{1} << (i % 64);
+      ++num_erased;
+    }
+
+    // Returns the number of erased entries in [`begin`, `end`).
+    //
+    std::size_t count_erased(std::size_t begin, std::size_t end) const {
+      if (num_erased == 0) {
+        return 0;
+      }
+      std::size_t count = 0;
+      for (std::size_t i = begin; i < end && i % 64 != 0; ++i) {
+        count += is_erased(i);
+      }
+      std::size_t i = std::min(end, (begin + 63) / 64 * 64);
+      for (; i + 64 <= end; i += 64) {
+        count += __builtin_popcountll(erased[i / 64]);
+      }
+      for (; i < end; ++i) {
+        count += is_erased(i);
+      }
+      return count;
+    }
+  };
+
+  // Runs are merged when the newer is at least 1/kMergeRatio the size of the
+  // older.
+  //
+  static constexpr std::size_t kMergeRatio = 8;
+
+  // Below this many candidates, `lower_bound` switches to binary search.
+  //
+  static constexpr std::size_t kBinarySearchCutoff = 64;
+
+  // The maximum number of interpolation probes before `lower_bound` falls
+  // back to binary search; bounds the cost for skewed key distributions.
+  //
+  static constexpr int kMaxInterpolationProbes = 8;
+
+  // Returns the index of the first key in `run` that is not less than `key`.
+  //
+  static std::size_t lower_bound(const Run &run, Key key) {
+    const std::vector<Key> &keys = run.keys;
+
+    // Invariant: keys[i] < key for i < lo, and keys[i] >= key for i >= hi.
+    //
+    std::size_t lo = 0;
+    std::size_t hi = keys.size();
+    for (int probe = 0;
+         probe < kMaxInterpolationProbes && hi - lo > kBinarySearchCutoff;
+         ++probe) {
+      const Key first = keys[lo];
+      const Key last = keys[hi - 1];
+      if (!(first < key)) {
+        return lo;
+      }
+      if (last < key) {
+        return hi;
+      }
+      // Estimate the position of `key` assuming the keys in [lo, hi) are
+      // evenly distributed; first < key <= last, so this is in [lo, hi).
+      //
+      const double fraction =
+          (double(key) - double(first)) / (double(last) - double(first));
+      const std::size_t mid =
+          std::min(lo + std::size_t(fraction * double(hi - 1 - lo)), hi - 1);
+      if (keys[mid] < key) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return std::lower_bound(keys.begin() + lo, keys.begin() + hi, key) -
+           keys.begin();
+  }
+
+  // Returns the index of the first key in `run` that is greater than `key`.
+  //
+  static std::size_t upper_bound(const Run &run, Key key) {
+    if constexpr (std::is_integral_v<Key>) {
+      if (key == std::numeric_limits<Key>::max()) {
+        return run.size();
+      }
+      return lower_bound(run, key + 1);
+    } else {
+      return std::upper_bound(run.keys.begin(), run.keys.end(), key) -
+             run.keys.begin();
+    }
+  }
+
+  // Returns the entries of `older` and `newer` merged into one run, without
+  // the erased ones; for equal keys, entries from `older` come first.
+  //
+  static Run merge(const Run &older, const Run &newer) {
+    const std::size_t size = older.size() - older.num_erased + newer.size() -
+                             newer.num_erased;
+    Run merged;
+    merged.keys.reserve(size);
+    merged.ids.reserve(size);
+
+    // Appends entries [`i`, `end`) of `run` that aren't erased.
+    //
+    const auto append = [&](const Run &run, std::size_t i, std::size_t end) {
+      if (run.num_erased == 0) {
+        merged.keys.insert(merged.keys.end(), run.keys.begin() + i,
+                           run.keys.begin() + end);
+        merged.ids.insert(merged.ids.end(), run.ids.begin() + i,
+                          run.ids.begin() + end);
+        return;
+      }
+      for (; i < end; ++i) {
+        if (!run.is_erased(i)) {
+          merged.keys.emplace_back(run.keys[i]);
+          merged.ids.emplace_back(run.ids[i]);
+        }
+      }
+    };
+
+    std::size_t i = 0, j = 0;
+    while (i < older.size() && j < newer.size()) {
+      if (newer.keys[j] < older.keys[i]) {
+        append(newer, j, j + 1);
+        ++j;
+      } else {
+        append(older, i, i + 1);
+        ++i;
+      }
+    }
+    append(older, i, older.size());
+    append(newer, j, newer.size());
+    return merged;
+  }
+
+  // Sorts the insert buffer into a new run, then restores the run size
+  // invariant by merging.
+  //
+  void flush_buffer() {
+    if (buffer_.size() == 0) {
+      return;
+    }
+
+    std::vector<std::uint32_t> order(buffer_.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](std::uint32_t a, std::uint32_t b) {
+                       return buffer_.keys[a] < buffer_.keys[b];
+                     });
+
+    Run run;
+    run.keys.reserve(order.size());
+    run.ids.reserve(order.size());
+    for (std::uint32_t i : order) {
+      run.keys.emplace_back(buffer_.keys[i]);
+      run.ids.emplace_back(buffer_.ids[i]);
+    }
+    buffer_.keys.clear();
+    buffer_.ids.clear();
+
+    runs_.emplace_back(std::move(run));
+    while (runs_.size() >= 2 &&
+           runs_.back().size() * kMergeRatio >=
+               runs_[runs_.size() - 2].size()) {
+      Run merged = merge(runs_[runs_.size() - 2], runs_.back());
+      runs_.pop_back();
+      runs_.back() = std::move(merged);
+    }
+  }
+
+  // Sorted runs, oldest (and largest) first.
+  //
+  std::vector<Run> runs_;
+
+  // Recently inserted entries, in insertion order.
+  //
+  Run buffer_;
+
+  //============================================================================
+public:
+  // Adds an entry mapping `key` to `id`.
+  //
+  // Complexity: amortized O(log n)
+  //
+  void insert(Key key, Id id) {
+    buffer_.keys.emplace_back(key);
+    buffer_.ids.emplace_back(id);
+    if (buffer_.size() >= kBufferSize) {
+      flush_buffer();
+    }
+  }
+
+  // Removes one entry mapping `key` to `id`.  Returns false if there is none.
+  //
+  // Complexity: O(log^2 n + the number of entries with key `key`), plus
+  // amortized O(1) for rewriting runs
+  //
+  bool erase(Key key, Id id) {
+    for (std::size_t i = 0; i < buffer_.size(); ++i) {
+      if (buffer_.ids[i] == id && buffer_.keys[i] == key) {
+        buffer_.keys.erase(buffer_.keys.begin() + i);
+        buffer_.ids.erase(buffer_.ids.begin() + i);
+        return true;
+      }
+    }
+    for (Run &run : runs_) {
+      for (std::size_t i = lower_bound(run, key);
+           i < run.size() && !(key < run.keys[i]); ++i) {
+        if (run.ids[i] != id || run.is_erased(i)) {
+          continue;
+        }
+        run.set_erased(i);
+        if (run.num_erased * 2 > run.size()) {
+          // Rewrite the run without its erased entries, so that they never
+          // take up more than half of it.
+          //
+          run = merge(run, Run{});
+        }
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Merges all entries into a single sorted run, without erased entries, so
+  // that subsequent queries need only one search.
+  //
+  void compact() {
+    flush_buffer();
+    while (runs_.size() >= 2) {
+      Run merged = merge(runs_[runs_.size() - 2], runs_.back());
+      runs_.pop_back();
+      runs_.back() = std::move(merged);
+    }
+    if (!runs_.empty() && runs_.back().num_erased != 0) {
+      runs_.back() = merge(runs_.back(), Run{});
+    }
+  }
+
+  // Returns the total number of entries, not counting erased ones.
+  //
+  std::size_t size() const {
+    std::size_t total = buffer_.size();
+    for (const Run &run : runs_) {
+      total += run.size() - run.num_erased;
+    }
+    return total;
+  }
+
+  // Invokes the visitor `fn` (see visitor.hpp) on the id of each entry with a
+  // key in the closed range [`lo`, `hi`].  Ids are visited in key order within
+  // each run, then in insertion order for the insert buffer.  Returns false
+  // iff `fn` stopped the iteration early.
+  //
+  template <typename Fn /* void(Id) */>
+  bool for_each_in_range(Key lo, Key hi, Fn &&fn) const {
+    if (hi < lo) {
+      return true;
+    }
+    for (const Run &run : runs_) {
+      for (std::size_t i = lower_bound(run, lo);
+           i < run.size() && !(hi < run.keys[i]); ++i) {
+        if (!run.is_erased(i) && !invoke_visitor(fn, run.ids[i])) {
+          return false;
+        }
+      }
+    }
+    for (std::size_t i = 0; i < buffer_.size(); ++i) {
+      if (!(buffer_.keys[i] < lo) && !(hi < buffer_.keys[i]) &&
+          !invoke_visitor(fn, buffer_.ids[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Returns the number of entries with a key in the closed range [`lo`, `hi`],
+  // without visiting them (though runs with erased entries count those in the
+  // range by scanning their bitmap).
+  //
+  std::size_t count_in_range(Key lo, Key hi) const {
+    if (hi < lo) {
+      return 0;
+    }
+    std::size_t count = 0;
+    for (const Run &run : runs_) {
+      const std::size_t begin = lower_bound(run, lo);
+      const std::size_t end = upper_bound(run, hi);
+      count += end - begin - run.count_erased(begin, end);
+    }
+    for (Key key : buffer_.keys) {
+      count += !(key < lo) && !(hi < key);
+    }
+    return count;
+  }
+
+  // Returns the memory used by the index; its entries include erased ones
+  // not yet merged away.
+  //
+  MemoryUsage memory_usage() const {
+    MemoryUsage usage;
+    usage.bytes = heap_bytes(runs_) + buffer_.byte_size();
+    usage.num_entries = buffer_.size();
+    for (const Run &run : runs_) {
+      usage.bytes += run.byte_size();
+      usage.num_entries += run.size();
+    }
+    return usage;
+  }
+};
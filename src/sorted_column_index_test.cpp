@@ -0,0 +1,261 @@
+#include "sorted_column_index.hpp"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include <functional>
+#include <limits>
+#include <map>
+#include <random>
+#include <set>
+#include <unordered_map>
+
+#include "range_predicate.hpp"
+
+namespace {
+
+template <typename Index>
+std::multiset<unsigned> in_range(const Index &index, long lo, long hi) {
+  std::multiset<unsigned> actual;
+  index.for_each_in_range(lo, hi, [&](unsigned id) { actual.insert(id); });
+  return actual;
+}
+
+std::multiset<unsigned> in_range(const std::multimap<long, unsigned> &expected,
+                                 long lo, long hi) {
+  std::multiset<unsigned> result;
+  if (hi < lo) {
+    return result;
+  }
+  for (auto iter = expected.lower_bound(lo);
+       iter != expected.end() && iter->first <= hi; ++iter) {
+    result.insert(iter->second);
+  }
+  return result;
+}
+
+TEST(RangePredicateTest, Parse) {
+  using Range = ValueRange<long>;
+  constexpr long kMin = std::numeric_limits<long>::lowest();
+  constexpr long kMax = std::numeric_limits<long>::max();
+
+  const auto parse = [](std::string_view s) {
+    const Range r = parse_range_predicate<long>(s);
+    return std::make_pair(r.lo, r.hi);
+  };
+
+  EXPECT_EQ(parse("42"), std::make_pair(42L, 42L));
+  EXPECT_EQ(parse("-7"), std::make_pair(-7L, -7L));
+  EXPECT_EQ(parse("= 42"), std::make_pair(42L, 42L));
+  EXPECT_EQ(parse(">100"), std::make_pair(101L, kMax));
+  EXPECT_EQ(parse(" >= 100 "), std::make_pair(100L, kMax));
+  EXPECT_EQ(parse("<-3"), std::make_pair(kMin, -4L));
+  EXPECT_EQ(parse("<=0"), std::make_pair(kMin, 0L));
+  EXPECT_EQ(parse("BETWEEN 1 AND 10"), std::make_pair(1L, 10L));
+  EXPECT_EQ(parse("between -5 and -2"), std::make_pair(-5L, -2L));
+
+  EXPECT_TRUE(parse_range_predicate<long>("> 9223372036854775807").empty());
+  EXPECT_TRUE(parse_range_predicate<long>("<-9223372036854775808").empty());
+  EXPECT_TRUE(parse_range_predicate<long>("BETWEEN 3 AND 2").empty());
+
+  EXPECT_THROW(parse("abc"), boost::bad_lexical_cast);
+  EXPECT_THROW(parse(">"), boost::bad_lexical_cast);
+  EXPECT_THROW(parse("BETWEEN 1 AND"), std::invalid_argument);
+  EXPECT_THROW(parse("BETWEEN x AND 1"), boost::bad_lexical_cast);
+  EXPECT_THROW(parse("BETWEEN 1 10"), std::invalid_argument);
+}
+
+TEST(SortedColumnIndexTest, RandomVsMultimap) {
+  std::default_random_engine rng{/*seed=*/1};
+
+  // Uniform, clustered (many duplicates) and skewed key distributions, so
+  // that both interpolation and binary search paths are exercised.
+  //
+  std::uniform_int_distribution<long> uniform(-1000000, 1000000);
+  std::uniform_int_distribution<long> clustered(-20, 20);
+  std::exponential_distribution<double> skewed(1e-4);
+  const std::vector<std::function<long()>> distributions = {
+      [&] { return uniform(rng); }, [&] { return clustered(rng); },
+      [&] { return long(skewed(rng)); }};
+
+  for (const auto &pick_key : distributions) {
+    SortedColumnIndex<long, unsigned> index;
+    std::multimap<long, unsigned> expected;
+
+    for (unsigned id = 0; id < 20000; ++id) {
+      const long key = pick_key();
+      index.insert(key, id);
+      expected.emplace(key, id);
+
+      // Check at various run/buffer states, including just after a flush.
+      //
+      if (id % 997 == 0 ||
+          id % SortedColumnIndex<long, unsigned>::kBufferSize == 0) {
+        const long lo = pick_key();
+        const long hi = lo + std::abs(pick_key() - pick_key());
+        ASSERT_EQ(in_range(index, lo, hi), in_range(expected, lo, hi));
+        ASSERT_EQ(in_range(index, lo, lo), in_range(expected, lo, lo));
+        ASSERT_EQ(index.count_in_range(lo, hi),
+                  in_range(expected, lo, hi).size());
+      }
+    }
+    EXPECT_EQ(index.size(), expected.size());
+
+    for (bool compacted : {false, true}) {
+      if (compacted) {
+        index.compact();
+        EXPECT_EQ(index.size(), expected.size());
+      }
+      for (int i = 0; i < 200; ++i) {
+        const long a = pick_key();
+        const long b = pick_key();
+        EXPECT_EQ(in_range(index, a, b), in_range(expected, a, b));
+        EXPECT_EQ(index.count_in_range(a, b),
+                  in_range(expected, a, b).size());
+      }
+      constexpr long kMin = std::numeric_limits<long>::lowest();
+      constexpr long kMax = std::numeric_limits<long>::max();
+      EXPECT_EQ(index.count_in_range(kMin, kMax), expected.size());
+      EXPECT_EQ(index.count_in_range(kMax, kMax), expected.count(kMax));
+    }
+  }
+}
+
+TEST(SortedColumnIndexTest, EraseVsMultimap) {
+  std::default_random_engine rng{/*seed=*/1};
+  std::uniform_int_distribution<long> pick_key(-50, 50);
+  constexpr long kMin = std::numeric_limits<long>::lowest();
+  constexpr long kMax = std::numeric_limits<long>::max();
+
+  SortedColumnIndex<long, unsigned> index;
+  std::multimap<long, unsigned> expected;
+
+  // Removes the entry for `id` from `expected`, returning its key.
+  //
+  const auto erase_expected = [&](unsigned id) {
+    for (auto iter = expected.begin(); iter != expected.end(); ++iter) {
+      if (iter->second == id) {
+        const long key = iter->first;
+        expected.erase(iter);
+        return key;
+      }
+    }
+    return kMax;
+  };
+
+  // Interleave inserts with erasures of random earlier entries (from runs
+  // and from the insert buffer), checking along the way.
+  //
+  unsigned next_id = 0;
+  for (int round = 0; round < 20000; ++round) {
+    if (expected.empty() || round % 3 != 0) {
+      const long key = pick_key(rng);
+      index.insert(key, next_id);
+      expected.emplace(key, next_id);
+      ++next_id;
+    } else {
+      const unsigned id =
+          std::uniform_int_distribution<unsigned>(0, next_id - 1)(rng);
+      const long key = erase_expected(id);
+      EXPECT_EQ(index.erase(key == kMax ? pick_key(rng) : key, id),
+                key != kMax);
+    }
+
+    if (round % 997 == 0) {
+      const long lo = pick_key(rng);
+      const long hi = lo + std::abs(pick_key(rng));
+      ASSERT_EQ(in_range(index, lo, hi), in_range(expected, lo, hi));
+      ASSERT_EQ(index.count_in_range(lo, hi),
+                in_range(expected, lo, hi).size());
+    }
+  }
+  EXPECT_FALSE(index.erase(1000, 0));
+
+  for (bool compacted : {false, true}) {
+    if (compacted) {
+      index.compact();
+    }
+    EXPECT_EQ(index.size(), expected.size());
+    EXPECT_EQ(index.count_in_range(kMin, kMax), expected.size());
+    for (long lo = -51; lo <= 51; lo += 3) {
+      EXPECT_EQ(in_range(index, lo, lo + 7), in_range(expected, lo, lo + 7));
+      EXPECT_EQ(index.count_in_range(lo, lo + 7),
+                in_range(expected, lo, lo + 7).size());
+    }
+  }
+}
+
+TEST(SortedColumnIndexTest, EarlyStop) {
+  SortedColumnIndex<long, unsigned> index;
+  for (unsigned id = 0; id < 1000; ++id) {
+    index.insert(id % 10, id);
+  }
+
+  int visited = 0;
+  EXPECT_FALSE(index.for_each_in_range(3, 5, [&](unsigned) {
+    return ++visited == 150 ? VisitResult::kStop : VisitResult::kContinue;
+  }));
+  EXPECT_EQ(visited, 150);
+  EXPECT_EQ(index.count_in_range(3, 5), 300u);
+}
+
+// Checks equality queries against the hash multimap previously used for
+// numeric columns, before and after compaction.  (BM_NumberIndexBuild,
+// BM_NumberIndexEqual and BM_NumberIndexRange in
+// qb_record_collection_benchmark.cpp compare their footprint and speed.)
+//
+TEST(SortedColumnIndexTest, MatchesHashMultimap) {
+  constexpr unsigned kCount = 10 * 1000;
+  constexpr int kQueries = 1000;
+
+  std::default_random_engine rng{/*seed=*/1};
+  std::uniform_int_distribution<long> pick_key(-long(kCount) / 4,
+                                               long(kCount) / 4);
+  std::vector<long> keys(kCount);
+  for (long &key : keys) {
+    key = pick_key(rng);
+  }
+  std::vector<long> probes(kQueries);
+  for (long &probe : probes) {
+    probe = pick_key(rng);
+  }
+
+  std::unordered_multimap<long, unsigned> hash_index;
+  SortedColumnIndex<long, unsigned> index;
+  for (unsigned id = 0; id < kCount; ++id) {
+    hash_index.emplace(keys[id], id);
+    index.insert(keys[id], id);
+  }
+
+  std::size_t hash_found = 0;
+  for (long probe : probes) {
+    const auto found = hash_index.equal_range(probe);
+    for (auto iter = found.first; iter != found.second; ++iter) {
+      hash_found += iter->second & 1;
+    }
+  }
+
+  // Queries run before and after compaction.
+  //
+  const auto run_queries = [&](std::size_t &found,
+                               std::size_t &range_found) {
+    for (long probe : probes) {
+      index.for_each_in_range(probe, probe,
+                              [&](unsigned id) { found += id & 1; });
+      range_found += index.count_in_range(probe, probe + 100);
+    }
+  };
+
+  std::size_t sorted_found = 0, sorted_range_found = 0;
+  run_queries(sorted_found, sorted_range_found);
+  index.compact();
+  std::size_t compacted_found = 0, compacted_range_found = 0;
+  run_queries(compacted_found, compacted_range_found);
+
+  EXPECT_EQ(hash_found, sorted_found);
+  EXPECT_EQ(hash_found, compacted_found);
+  EXPECT_GT(sorted_range_found, 0u);
+  EXPECT_EQ(sorted_range_found, compacted_range_found);
+}
+
+} // namespace
@@ -23,6 +23,10 @@
 // substrings that are relatively infrequent, suggesting that even in
 // its suboptimal form, this design shows promise.
 //
+// RadixTrie (see radix_trie.hpp) addresses these shortcomings with
+// path compression and adaptive node sizes, and can be used in place of
+// StringTrie as the index for a string QBColumnLookup.
+//
 // There are well-known algorithms
 // (cf. https://web.stanford.edu/~mjkay/gusfield.pdf) for doing suffix
 // trie construction in time linear to the size of all input strings,
@@ -35,11 +39,18 @@
 #pragma once
 
 #include <array>
+#include <cassert>
 #include <cstdint>
 #include <iostream>
+#include <limits>
 #include <string_view>
+#include <type_traits>
 #include <vector>
 
+#include "memory_usage.hpp"
+#include "slab_arena.hpp"
+#include "visitor.hpp"
+
 //------------------------------------------------------------------------------
 
 // Represents the set of non-null child branches for a trie node.  The branching
@@ -69,20 +80,23 @@ public:
   //
   bool test(int pos) const { return (bits_[pos / 64] & mask(pos)) != 0ull; }
 
-  // Given a callable `fn` of type `Fn`, which takes an `int` as its only arg
-  // (return value is ignored), invokes `fn` on the indices of all bits set to
-  // 1.
+  // Given a visitor `fn` of type `Fn`, which takes an `int` as its only arg
+  // (see visitor.hpp), invokes `fn` on the indices of all bits set to 1.
+  // Returns false iff `fn` stopped the iteration early.
   //
-  template <typename Fn /* void(int index) */> void for_each(Fn &&fn) {
+  template <typename Fn /* void(int index) */> bool for_each(Fn &&fn) const {
     for (int i = 0; i < 4; ++i) {
       const int base = i * 64;
       std::uint64_t chunk = bits_[i];
       while (chunk != 0) {
         int next = __builtin_ctzll(chunk);
-        fn(next + base);
+        if (!invoke_visitor(fn, next + base)) {
+          return false;
+        }
         chunk &= ~(1ull << next);
       }
     }
+    return true;
   }
 };
 
@@ -90,100 +104,369 @@ public:
 
 // Trie mapping 8-bit char strings to values of type `T`.
 //
+// All nodes and values are allocated from `SlabArena`s owned by the trie and
+// refer to each other by 32-bit index rather than pointer, which halves the
+// size of the branch array, keeps inserts free of per-node heap allocations,
+// places nodes in the order they were created (so that a freshly built
+// subtree is mostly contiguous in memory), and lets the whole trie be
+// destroyed with a few calls to `free` instead of a recursive walk.
+//
 template <typename T> class StringTrie {
+  static_assert(std::is_trivially_copyable_v<T> &&
+                    std::is_trivially_destructible_v<T>,
+                "StringTrie values must be trivially copyable/destructible");
+
 private:
+  // Index of a node in `nodes_`.  The root is node 0, which is never the child
+  // of another node, so 0 also serves as the null node id.
+  //
+  using NodeId = std::uint32_t;
+
+  // Index of a value entry in `values_`; 0 is reserved as the null value id.
+  //
+  using ValueId = std::uint32_t;
+
   struct Node {
     // The set of all non-null child branches.
     //
     BranchSet active;
 
-    // The actual child node pointers, including nulls; the array index is the
-    // char value of the next character in the string stored by the child node.
+    // The actual child node ids; the array index is the char value of the next
+    // character in the string stored by the child node.  Only the entries in
+    // `active` are meaningful.
     //
-    std::array<Node *, 256> branch; // Originally used std::unique_ptr here but
-                                    // because most branches are null,
-                                    // destructing a trie was very slow!
+    std::array<NodeId, 256> branch;
 
-    // The values stored at this node; i.e., the values assoicated with the
-    // string whose path from the root of the trie leads to `this`.
+    // The values stored at this node; i.e., the values associated with the
+    // string whose path from the root of the trie leads to `this`.  Stored as
+    // a singly linked list (in insertion order) of entries in `values_`.
     //
-    std::vector<T> values;
+    ValueId first_value;
+    ValueId last_value;
 
-    // Disable copying so we enforce unique ownership of child nodes.
+    // The number of distinct insertions (calls to `insert` or
+    // `insert_suffixes`, less those undone by `erase_suffixes`) that stored a
+    // value at or below this node, and the stamp (see `stamp_`) of the most
+    // recent insertion or erasure to count it.  Lets prefix match counts be
+    // read off a single node instead of walking its whole subtree.
     //
-    Node() = default;
-    Node(const Node &) = delete;
-    Node &operator=(const Node &) = delete;
-
-    // Custom dtor to only iterate over branches we actually have to recursively
-    // delete.
-    //
-    ~Node() noexcept {
-      active.for_each([&](int i) {
-        assert(branch[i] != nullptr);
-        delete branch[i];
-      });
-    }
+    std::uint32_t subtree_count;
+    std::uint32_t last_stamp;
 
     // Returns true iff this node has a child corresponding to the given char
     // value.
     //
-    bool has_branch(int ch) { return active.test(ch); }
+    bool has_branch(int ch) const { return active.test(ch); }
+  };
 
-    // Invokes `fn` for each value stored at this node.
-    //
-    template <typename Fn /* void(const T &) */> void visit_values(Fn &&fn) {
-      for (const T &v : values) {
-        fn(v);
+  struct ValueEntry {
+    T value;
+    ValueId next;
+  };
+
+  // Invokes `fn` for each value stored at `node`.  Returns false iff `fn`
+  // stopped the iteration early.
+  //
+  template <typename Fn /* void(const T &) */>
+  bool visit_values(const Node &node, Fn &&fn) const {
+    for (ValueId v = node.first_value; v != 0; v = values_[v].next) {
+      if (!invoke_visitor(fn, values_[v].value)) {
+        return false;
       }
     }
+    return true;
+  }
 
-    // Invokes `fn` for each value stored at this node and all child nodes; used
-    // for substring/prefix matching.
-    //
-    template <typename Fn /* void(const T &) */> void visit_recursive(Fn &&fn) {
-      visit_values(fn);
-      active.for_each([&](int i) {
-        assert(branch[i] != nullptr);
-        branch[i]->visit_recursive(fn);
-      });
+  // Invokes `fn` for each value stored at `node` and all its descendants; used
+  // for substring/prefix matching.  Returns false iff `fn` stopped the
+  // iteration early, in which case no further nodes are visited.
+  //
+  template <typename Fn /* void(const T &) */>
+  bool visit_recursive(const Node &node, Fn &&fn) const {
+    if (!visit_values(node, fn)) {
+      return false;
     }
-  };
+    return node.active.for_each([&](int i) {
+      assert(node.branch[i] != 0);
+      return visit_recursive(nodes_[node.branch[i]], fn)
+                 ? VisitResult::kContinue
+                 : VisitResult::kStop;
+    });
+  }
 
-  // Searches from the root of the trie for a match to `key`.  If no such key is
-  // found, behavior depends on the value of `create`:
+  // Counts the insertion with the given `stamp` in the `subtree_count` of
+  // `node`, unless it has already been counted there.
   //
-  //  - create=true: a new path is created for the missing portion of `key`
-  //  - create=false: nullptr is returned
+  static void count_insertion(Node &node, std::uint32_t stamp) {
+    if (node.last_stamp != stamp) {
+      node.last_stamp = stamp;
+      ++node.subtree_count;
+    }
+  }
+
+  // Returns a fresh stamp identifying one call to `insert` or
+  // `insert_suffixes`.
+  //
+  std::uint32_t next_stamp() {
+    assert(stamp_ < std::numeric_limits<std::uint32_t>::max());
+    return ++stamp_;
+  }
+
+  // Inserts `value` under `key` as part of the insertion with the given
+  // `stamp`, creating the path to `key` as needed.
   //
-  Node *find_node(std::string_view key, bool create) {
-    Node *node = &root_;
+  void insert_one(std::string_view key, const T &value, std::uint32_t stamp) {
+    NodeId id = 0;
+    count_insertion(nodes_[id], stamp);
     while (!key.empty()) {
       const int ch = (unsigned char)key.front();
-      if (!node->has_branch(ch)) {
-        if (!create) {
-          return nullptr;
-        }
-        node->active.set(ch, true);
-        node->branch[ch] = new Node();
+      if (!nodes_[id].has_branch(ch)) {
+        const NodeId child = allocate_node();
+        Node &node = nodes_[id];
+        node.active.set(ch, true);
+        node.branch[ch] = child;
+      }
+      id = nodes_[id].branch[ch];
+      count_insertion(nodes_[id], stamp);
+      key.remove_prefix(1);
+    }
+
+    Node &node = nodes_[id];
+    const ValueId v = allocate_value();
+    values_[v].value = value;
+    if (node.last_value) {
+      values_[node.last_value].next = v;
+    } else {
+      node.first_value = v;
+    }
+    node.last_value = v;
+  }
+
+  // Removes one entry of `value` from the values stored at `node`.  Returns
+  // false if there is none.
+  //
+  bool remove_value(Node &node, const T &value) {
+    ValueId prev = 0;
+    for (ValueId v = node.first_value; v != 0; prev = v, v = values_[v].next) {
+      if (!(values_[v].value == value)) {
+        continue;
+      }
+      const ValueId next = values_[v].next;
+      if (prev) {
+        values_[prev].next = next;
+      } else {
+        node.first_value = next;
+      }
+      if (node.last_value == v) {
+        node.last_value = prev;
+      }
+      values_[v].next = free_values_;
+      free_values_ = v;
+      return true;
+    }
+    return false;
+  }
+
+  // Removes one entry of `value` under `key` as part of the erasure with the
+  // given `stamp`, uncounting the insertion it undoes from the nodes on the
+  // path to `key` (at most once per node per erasure).  Nodes left empty are
+  // not freed; see `prune`.
+  //
+  void erase_one(std::string_view key, const T &value, std::uint32_t stamp) {
+    NodeId id = 0;
+    uncount_insertion(nodes_[id], stamp);
+    while (!key.empty()) {
+      const int ch = (unsigned char)key.front();
+      assert(nodes_[id].has_branch(ch));
+      id = nodes_[id].branch[ch];
+      uncount_insertion(nodes_[id], stamp);
+      key.remove_prefix(1);
+    }
+    const bool removed = remove_value(nodes_[id], value);
+    assert(removed);
+    (void)removed;
+  }
+
+  // Undoes `count_insertion` for the insertion being erased with `stamp`.
+  //
+  static void uncount_insertion(Node &node, std::uint32_t stamp) {
+    if (node.last_stamp != stamp) {
+      node.last_stamp = stamp;
+      assert(node.subtree_count > 0);
+      --node.subtree_count;
+    }
+  }
+
+  // Unlinks and frees the first subtree on the path to `key` in which no
+  // insertion is counted any more (so which holds no values).
+  //
+  void prune(std::string_view key) {
+    NodeId id = 0;
+    while (!key.empty()) {
+      const int ch = (unsigned char)key.front();
+      if (!nodes_[id].has_branch(ch)) {
+        return;
+      }
+      const NodeId child = nodes_[id].branch[ch];
+      if (nodes_[child].subtree_count == 0) {
+        nodes_[id].active.set(ch, false);
+        free_subtree(child);
+        return;
+      }
+      id = child;
+      key.remove_prefix(1);
+    }
+  }
+
+  // Returns node `id` and all its descendants, which must hold no values, to
+  // the free list.
+  //
+  void free_subtree(NodeId id) {
+    assert(nodes_[id].first_value == 0);
+    nodes_[id].active.for_each([&](int ch) {
+      free_subtree(nodes_[id].branch[ch]);
+    });
+    nodes_[id].first_value = free_nodes_;
+    free_nodes_ = id;
+  }
+
+  // Returns a new empty node, reusing a freed one if there is any.
+  //
+  NodeId allocate_node() {
+    if (free_nodes_ == 0) {
+      return nodes_.allocate();
+    }
+    const NodeId id = free_nodes_;
+    free_nodes_ = nodes_[id].first_value;
+    nodes_[id] = Node{};
+    return id;
+  }
+
+  // Returns a new value entry, reusing a freed one if there is any.
+  //
+  ValueId allocate_value() {
+    if (free_values_ == 0) {
+      return values_.allocate();
+    }
+    const ValueId v = free_values_;
+    free_values_ = values_[v].next;
+    values_[v] = ValueEntry{};
+    return v;
+  }
+
+  // Adds the values and descendants of `from`, a node of `other`, to node `id`
+  // of this trie; see `merge`.
+  //
+  void merge_node(NodeId id, const StringTrie &other, const Node &from) {
+    for (ValueId v = from.first_value; v != 0; v = other.values_[v].next) {
+      const ValueId copy = allocate_value();
+      values_[copy].value = other.values_[v].value;
+      Node &node = nodes_[id];
+      if (node.last_value) {
+        values_[node.last_value].next = copy;
+      } else {
+        node.first_value = copy;
+      }
+      node.last_value = copy;
+    }
+    // The insertions counted by the two nodes are distinct, so their counts
+    // add up.
+    //
+    nodes_[id].subtree_count += from.subtree_count;
+
+    from.active.for_each([&](int ch) {
+      if (!nodes_[id].has_branch(ch)) {
+        const NodeId child = allocate_node();
+        Node &node = nodes_[id];
+        node.active.set(ch, true);
+        node.branch[ch] = child;
+      }
+      merge_node(nodes_[id].branch[ch], other, other.nodes_[from.branch[ch]]);
+    });
+  }
+
+  // Searches from the root of the trie for a match to `key`.  Returns nullptr
+  // if there is no such key.
+  //
+  const Node *find_node(std::string_view key) const {
+    NodeId id = 0;
+    while (!key.empty()) {
+      const int ch = (unsigned char)key.front();
+      if (!nodes_[id].has_branch(ch)) {
+        return nullptr;
       }
-      node = node->branch[ch];
+      id = nodes_[id].branch[ch];
       key.remove_prefix(1);
     }
-    return node;
+    return &nodes_[id];
   }
 
-  // The root of the trie.  Values (`T`) stored here are associated with the
-  // empty string.
+  // Invokes `fn(i, node)` with the node for each of `keys[i]` that is in the
+  // trie, in order.  Each descent from the root resumes from the deepest node
+  // reached by the previous one for their common prefix.
+  //
+  template <typename Fn /* void(std::size_t i, const Node &) */>
+  void find_nodes_batch(const std::vector<std::string_view> &keys,
+                        Fn &&fn) const {
+    // The nodes on the path to the previous key (as far as it exists in the
+    // trie); `path[d]` is the node reached after `d` characters.
+    //
+    std::vector<NodeId> path = {0};
+    std::string_view previous;
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+      const std::string_view key = keys[i];
+      std::size_t depth = 0;
+      while (depth + 1 < path.size() && depth < key.size() &&
+             key[depth] == previous[depth]) {
+        ++depth;
+      }
+      path.resize(depth + 1);
+      previous = key;
+
+      for (; depth < key.size(); ++depth) {
+        const Node &node = nodes_[path.back()];
+        const int ch = (unsigned char)key[depth];
+        if (!node.has_branch(ch)) {
+          break;
+        }
+        path.emplace_back(node.branch[ch]);
+      }
+      if (depth == key.size()) {
+        fn(i, nodes_[path.back()]);
+      }
+    }
+  }
+
+  // All nodes in the trie; the root is `nodes_[0]`.  Values (`T`) stored at the
+  // root are associated with the empty string.
+  //
+  SlabArena<Node> nodes_;
+
+  // All value entries, for all nodes; `values_[0]` is unused.
   //
-  Node root_;
+  SlabArena<ValueEntry> values_;
+
+  // The heads of the lists of nodes and value entries freed by erasures, or 0
+  // if there are none.  The lists are linked through `Node::first_value` and
+  // `ValueEntry::next` respectively.
+  //
+  NodeId free_nodes_ = 0;
+  ValueId free_values_ = 0;
+
+  // The stamp of the most recent insertion or erasure; see
+  // `Node::subtree_count`.
+  //
+  std::uint32_t stamp_ = 0;
 
   //============================================================================
 public:
   // TODO - to same coding time for this exercise, STL-container style copy
   // semantics are disabled; we could implement these.
 
-  StringTrie() = default;
+  StringTrie() {
+    nodes_.allocate();
+    values_.allocate();
+  }
   StringTrie(const StringTrie &) = delete;
   StringTrie &operator=(const StringTrie &) = delete;
 
@@ -195,38 +478,149 @@ public:
   // Complexity: O(key.length())
   //
   void insert(std::string_view key, const T &value) {
-    Node *node = find_node(key, /*create=*/true);
-    node->values.emplace_back(value);
+    insert_one(key, value, next_stamp());
   }
 
   // Inserts `value` under all the suffixes of key (including key itself).
   //
   void insert_suffixes(std::string_view key, const T &value) {
+    const std::uint32_t stamp = next_stamp();
     while (!key.empty()) {
-      insert(key, value);
+      insert_one(key, value, stamp);
       key.remove_prefix(1);
     }
   }
 
-  // Invokes `fn` for each mapped value whose key matches `key` exactly.
+  // Undoes `insert_suffixes(key, value)`, which must have been called and not
+  // yet undone: removes one entry of `value` under each suffix of `key`, and
+  // frees the nodes left without values under them (for reuse by later
+  // insertions).
+  //
+  // Complexity: O(key.length()^2 + the number of values under the suffixes)
+  //
+  void erase_suffixes(std::string_view key, const T &value) {
+    const std::uint32_t stamp = next_stamp();
+    for (std::string_view suffix = key; !suffix.empty();
+         suffix.remove_prefix(1)) {
+      erase_one(suffix, value, stamp);
+    }
+    // Only prune once all the suffixes are erased: a node uncounted by the
+    // first of them may still hold the values of later ones.
+    //
+    for (std::string_view suffix = key; !suffix.empty();
+         suffix.remove_prefix(1)) {
+      prune(suffix);
+    }
+  }
+
+  // Adds all the mappings of `other` to this trie, as if each call to `insert`
+  // or `insert_suffixes` made on `other` had been made on this trie instead,
+  // in the same order, after all of those already made on it.  Tries built
+  // separately (e.g., on different threads) from consecutive slices of a
+  // sequence of keys can thus be merged, in order, into the same trie as
+  // inserting the whole sequence into one.
+  //
+  // Complexity: O(size of other)
+  //
+  void merge(const StringTrie &other) {
+    assert(std::uint64_t{stamp_} + other.stamp_ <=
+           std::numeric_limits<std::uint32_t>::max());
+    // Stamps only need to be distinct from those of later insertions, which
+    // will be above the new `stamp_`.
+    //
+    stamp_ += other.stamp_;
+    merge_node(0, other, other.nodes_[0]);
+  }
+
+  // Invokes the visitor `fn` (see visitor.hpp) for each mapped value whose key
+  // matches `key` exactly.  Returns false iff `fn` stopped the iteration early.
   //
   template <typename Fn /* void(const T &) */>
-  void for_each_exact_match(std::string_view key, Fn &&fn) {
-    Node *node = find_node(key, /*create=*/false);
+  bool for_each_exact_match(std::string_view key, Fn &&fn) const {
+    const Node *node = find_node(key);
     if (!node) {
-      return;
+      return true;
     }
-    node->visit_values(fn);
+    return visit_values(*node, fn);
   }
 
-  // Invokes `fn` for each mapped value whose key starts with `key_prefix`.
+  // Invokes the visitor `fn` (see visitor.hpp) for each mapped value whose key
+  // starts with `key_prefix`.  Returns false iff `fn` stopped the iteration
+  // early.
   //
   template <typename Fn /* void(const T &) */>
-  void for_each_prefix_match(std::string_view key_prefix, Fn &&fn) {
-    Node *node = find_node(key_prefix, /*create=*/false);
+  bool for_each_prefix_match(std::string_view key_prefix, Fn &&fn) const {
+    const Node *node = find_node(key_prefix);
     if (!node) {
-      return;
+      return true;
+    }
+    return visit_recursive(*node, fn);
+  }
+
+  // Same as calling `for_each_prefix_match(key_prefixes[i], ...)` for each `i`
+  // in turn, with a visitor that passes `i` and each value on to `fn`, but
+  // each descent from the root resumes from the deepest node reached by the
+  // previous one for their common prefix.  With the prefixes sorted, each
+  // node on the way to any of them is thus reached only once.
+  //
+  template <typename Fn /* void(std::size_t i, const T &) */>
+  void for_each_prefix_match_batch(
+      const std::vector<std::string_view> &key_prefixes, Fn &&fn) const {
+    find_nodes_batch(key_prefixes, [&](std::size_t i, const Node &node) {
+      visit_recursive(node, [&](const T &value) { fn(i, value); });
+    });
+  }
+
+  // Returns `count_prefix_matches(key_prefixes[i])` for each `i`, sharing
+  // descents as `for_each_prefix_match_batch` does.
+  //
+  std::vector<std::size_t>
+  count_prefix_matches_batch(
+      const std::vector<std::string_view> &key_prefixes) const {
+    std::vector<std::size_t> counts(key_prefixes.size(), 0);
+    find_nodes_batch(key_prefixes, [&](std::size_t i, const Node &node) {
+      counts[i] = node.subtree_count;
+    });
+    return counts;
+  }
+
+  // Returns the number of calls to `insert` or `insert_suffixes` that stored a
+  // value under some key starting with `key_prefix`.  When each value is
+  // inserted by a single call (as for QBColumnLookup, where values are row
+  // ids), this is the number of distinct values `for_each_prefix_match` would
+  // visit.
+  //
+  // Complexity: O(key_prefix.length())
+  //
+  std::size_t count_prefix_matches(std::string_view key_prefix) const {
+    const Node *node = find_node(key_prefix);
+    return node ? node->subtree_count : 0;
+  }
+
+  // Returns the memory used by the trie (all of its slabs, including free
+  // nodes and value entries), with counts of the nodes and value entries in
+  // use.
+  //
+  // Complexity: O(number of nodes + number of values)
+  //
+  MemoryUsage memory_usage() const {
+    MemoryUsage usage;
+    usage.bytes = nodes_.byte_size() + values_.byte_size();
+    std::vector<NodeId> stack = {0};
+    while (!stack.empty()) {
+      const Node &node = nodes_[stack.back()];
+      stack.pop_back();
+      ++usage.num_nodes;
+      for (ValueId v = node.first_value; v != 0; v = values_[v].next) {
+        ++usage.num_entries;
+      }
+      bool inner = false;
+      node.active.for_each([&](int ch) {
+        inner = true;
+        stack.push_back(node.branch[ch]);
+      });
+      usage.num_inner_nodes += inner;
     }
-    node->visit_recursive(fn);
+    return usage;
   }
 };
@@ -3,7 +3,14 @@
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
+#include <algorithm>
+#include <cstring>
 #include <functional>
+#include <memory>
+#include <set>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 #include "timer.hpp"
 #include "words.hpp"
@@ -45,6 +52,190 @@ TEST(BranchSetTest, Smoke) {
   }
 }
 
+TEST(SlabArenaTest, StableIndices) {
+  SlabArena<std::uint64_t, 4> arena;
+  std::vector<const std::uint64_t *> addresses;
+  for (std::uint64_t i = 0; i < 1000; ++i) {
+    const auto index = arena.allocate();
+    ASSERT_EQ(index, i);
+    EXPECT_EQ(arena[index], 0u);
+    arena[index] = i * i;
+    addresses.emplace_back(&arena[index]);
+  }
+  EXPECT_EQ(arena.size(), 1000u);
+  for (std::uint64_t i = 0; i < 1000; ++i) {
+    EXPECT_EQ(arena[i], i * i);
+    EXPECT_EQ(&arena[i], addresses[i]);
+  }
+}
+
+TEST(TrieTest, EarlyStop) {
+  StringTrie<int> index;
+  for (int i = 0; i < 10; ++i) {
+    index.insert_suffixes("abc", i);
+  }
+
+  int visited = 0;
+  EXPECT_FALSE(index.for_each_prefix_match("", [&](int) {
+    return ++visited == 3 ? VisitResult::kStop : VisitResult::kContinue;
+  }));
+  EXPECT_EQ(visited, 3);
+
+  visited = 0;
+  EXPECT_TRUE(index.for_each_prefix_match("bc", [&](int) { ++visited; }));
+  EXPECT_EQ(visited, 10);
+
+  EXPECT_FALSE(index.for_each_exact_match(
+      "c", [&](int) { return VisitResult::kStop; }));
+}
+
+TEST(TrieTest, CountPrefixMatches) {
+  StringTrie<int> index;
+  index.insert_suffixes("banana", 1);
+  index.insert_suffixes("bandana", 2);
+  index.insert_suffixes("cabana", 3);
+  index.insert("nab", 4);
+  index.insert("nab", 4);
+
+  EXPECT_EQ(index.count_prefix_matches(""), 5u);
+  EXPECT_EQ(index.count_prefix_matches("ana"), 3u);
+  EXPECT_EQ(index.count_prefix_matches("an"), 3u);
+  EXPECT_EQ(index.count_prefix_matches("na"), 5u);
+  EXPECT_EQ(index.count_prefix_matches("nab"), 2u);
+  EXPECT_EQ(index.count_prefix_matches("band"), 1u);
+  EXPECT_EQ(index.count_prefix_matches("bandanas"), 0u);
+  EXPECT_EQ(index.count_prefix_matches("x"), 0u);
+}
+
+TEST(TrieTest, Merge) {
+  const std::vector<std::string> words = load_words();
+  const int count = std::min<int>(words.size(), 20000);
+
+  // Build one trie serially, and the same one by merging tries built from
+  // slices of the words, in order.
+  //
+  auto whole = std::make_unique<StringTrie<int>>();
+  auto merged = std::make_unique<StringTrie<int>>();
+  whole->insert("ing", -1);
+  merged->insert("ing", -1);
+  for (int i = 0; i < count; ++i) {
+    whole->insert_suffixes(words[i], i);
+  }
+  for (const auto &[begin, end] : {std::pair<int, int>{0, count / 3},
+                                   {count / 3, count / 2},
+                                   {count / 2, count / 2},
+                                   {count / 2, count}}) {
+    auto slice = std::make_unique<StringTrie<int>>();
+    for (int i = begin; i < end; ++i) {
+      slice->insert_suffixes(words[i], i);
+    }
+    merged->merge(*slice);
+  }
+
+  // Later insertions are counted as usual.
+  //
+  whole->insert_suffixes("zinging", count);
+  merged->insert_suffixes("zinging", count);
+
+  for (const char *pattern :
+       {"", "a", "ing", "zing", "ll", "uniquely", "notawordXYZ"}) {
+    std::vector<int> expected, actual;
+    whole->for_each_prefix_match(pattern,
+                                 [&](int i) { expected.emplace_back(i); });
+    merged->for_each_prefix_match(pattern,
+                                  [&](int i) { actual.emplace_back(i); });
+    EXPECT_EQ(actual, expected) << pattern;
+    EXPECT_EQ(merged->count_prefix_matches(pattern),
+              whole->count_prefix_matches(pattern))
+        << pattern;
+  }
+}
+
+TEST(TrieTest, PrefixMatchBatch) {
+  StringTrie<int> index;
+  index.insert_suffixes("banana", 1);
+  index.insert_suffixes("bandana", 2);
+  index.insert_suffixes("cabana", 3);
+
+  // Sorted and unsorted, with repeats and misses.
+  //
+  for (const std::vector<std::string_view> &prefixes :
+       std::vector<std::vector<std::string_view>>{
+           {"", "a", "an", "ana", "anas", "b", "ba", "ban", "band", "c", "x"},
+           {"band", "ban", "ana", "x", "", "ana", "bandanas", "nd"},
+           {}}) {
+    std::vector<std::vector<int>> expected(prefixes.size());
+    for (std::size_t i = 0; i < prefixes.size(); ++i) {
+      index.for_each_prefix_match(
+          prefixes[i], [&](int value) { expected[i].emplace_back(value); });
+    }
+    std::vector<std::vector<int>> actual(prefixes.size());
+    index.for_each_prefix_match_batch(prefixes, [&](std::size_t i, int value) {
+      actual[i].emplace_back(value);
+    });
+    EXPECT_EQ(actual, expected);
+  }
+}
+
+TEST(TrieTest, EraseSuffixes) {
+  const std::vector<std::string> words = load_words();
+  const int count = std::min<int>(words.size(), 20000);
+  const std::vector<const char *> patterns = {"",   "a",        "ing", "zing",
+                                              "ll", "uniquely", "notawordXYZ"};
+
+  // Erasing the odd words leaves the same trie as only inserting the even
+  // ones.
+  //
+  auto erased = std::make_unique<StringTrie<int>>();
+  auto even = std::make_unique<StringTrie<int>>();
+  for (int i = 0; i < count; ++i) {
+    erased->insert_suffixes(words[i], i);
+    if (i % 2 == 0) {
+      even->insert_suffixes(words[i], i);
+    }
+  }
+  for (int i = 1; i < count; i += 2) {
+    erased->erase_suffixes(words[i], i);
+  }
+
+  const auto expect_same = [&](const StringTrie<int> &expected_trie,
+                               const StringTrie<int> &actual_trie) {
+    for (const char *pattern : patterns) {
+      std::vector<int> expected, actual;
+      expected_trie.for_each_prefix_match(
+          pattern, [&](int i) { expected.emplace_back(i); });
+      actual_trie.for_each_prefix_match(
+          pattern, [&](int i) { actual.emplace_back(i); });
+      std::sort(expected.begin(), expected.end());
+      std::sort(actual.begin(), actual.end());
+      EXPECT_EQ(actual, expected) << pattern;
+      EXPECT_EQ(actual_trie.count_prefix_matches(pattern),
+                expected_trie.count_prefix_matches(pattern))
+          << pattern;
+    }
+  };
+  expect_same(*even, *erased);
+
+  // Insertions after erasures (which reuse the nodes and values they freed)
+  // work as usual.
+  //
+  for (int i = 1; i < count; i += 2) {
+    erased->insert_suffixes(words[i], i);
+    even->insert_suffixes(words[i], i);
+  }
+  expect_same(*even, *erased);
+
+  // Erasing everything leaves an empty trie.
+  //
+  for (int i = 0; i < count; ++i) {
+    erased->erase_suffixes(words[i], i);
+  }
+  for (const char *pattern : patterns) {
+    EXPECT_EQ(erased->count_prefix_matches(pattern), 0u) << pattern;
+    erased->for_each_prefix_match(pattern, [](int i) { ADD_FAILURE() << i; });
+  }
+}
+
 TEST(TrieTest, SubstringSearch) {
   using std::chrono::steady_clock;
 
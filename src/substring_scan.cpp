@@ -0,0 +1,146 @@
+#include "substring_scan.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// Local helper functions.
+//
+namespace {
+
+std::size_t find_substring_scalar(std::string_view text,
+                                  std::string_view pattern, std::size_t from) {
+  return text.find(pattern, from);
+}
+
+#if defined(__x86_64__)
+
+// Checks the candidate positions `i + k` for each set bit `k` of `mask`,
+// returning the first at which `pattern` occurs in `text`, or npos.  The
+// first and last characters are already known to match.
+//
+inline std::size_t check_candidates(std::uint32_t mask, std::size_t i,
+                                    std::string_view text,
+                                    std::string_view pattern) {
+  while (mask != 0) {
+    const std::size_t pos = i + __builtin_ctz(mask);
+    if (pattern.size() <= 2 ||
+        std::memcmp(text.data() + pos + 1, pattern.data() + 1,
+                    pattern.size() - 2) == 0) {
+      return pos;
+    }
+    mask &= mask - 1;
+  }
+  return std::string_view::npos;
+}
+
+// SSE2 is part of the x86-64 baseline, so this needs no target attribute.
+//
+std::size_t find_substring_sse2(std::string_view text, std::string_view pattern,
+                                std::size_t from) {
+  const std::size_t m = pattern.size();
+  if (m == 0 || from + m > text.size()) {
+    return find_substring_scalar(text, pattern, from);
+  }
+  const __m128i first = _mm_set1_epi8(pattern.front());
+  const __m128i last = _mm_set1_epi8(pattern.back());
+
+  std::size_t i = from;
+  for (; i + m - 1 + 16 <= text.size(); i += 16) {
+    const __m128i block_first =
+        _mm_loadu_si128((const __m128i *)(text.data() + i));
+    const __m128i block_last =
+        _mm_loadu_si128((const __m128i *)(text.data() + i + m - 1));
+    const std::uint32_t mask = _mm_movemask_epi8(_mm_and_si128(
+        _mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last)));
+    const std::size_t found = check_candidates(mask, i, text, pattern);
+    if (found != std::string_view::npos) {
+      return found;
+    }
+  }
+  return find_substring_scalar(text, pattern, i);
+}
+
+__attribute__((target("avx2"))) std::size_t
+find_substring_avx2(std::string_view text, std::string_view pattern,
+                    std::size_t from) {
+  const std::size_t m = pattern.size();
+  if (m == 0 || from + m > text.size()) {
+    return find_substring_scalar(text, pattern, from);
+  }
+  const __m256i first = _mm256_set1_epi8(pattern.front());
+  const __m256i last = _mm256_set1_epi8(pattern.back());
+
+  std::size_t i = from;
+  for (; i + m - 1 + 32 <= text.size(); i += 32) {
+    const __m256i block_first =
+        _mm256_loadu_si256((const __m256i *)(text.data() + i));
+    const __m256i block_last =
+        _mm256_loadu_si256((const __m256i *)(text.data() + i + m - 1));
+    const std::uint32_t mask = _mm256_movemask_epi8(
+        _mm256_and_si256(_mm256_cmpeq_epi8(first, block_first),
+                         _mm256_cmpeq_epi8(last, block_last)));
+    const std::size_t found = check_candidates(mask, i, text, pattern);
+    if (found != std::string_view::npos) {
+      return found;
+    }
+  }
+  return find_substring_sse2(text, pattern, i);
+}
+
+#endif // defined(__x86_64__)
+
+SubstringScanImpl select_impl() {
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return SubstringScanImpl::kAvx2;
+  }
+  return SubstringScanImpl::kSse2;
+#else
+  return SubstringScanImpl::kScalar;
+#endif
+}
+
+using FindFn = std::size_t (*)(std::string_view, std::string_view,
+                               std::size_t);
+
+FindFn impl_fn(SubstringScanImpl impl) {
+  switch (impl) {
+#if defined(__x86_64__)
+  case SubstringScanImpl::kAvx2:
+    return &find_substring_avx2;
+  case SubstringScanImpl::kSse2:
+    return &find_substring_sse2;
+#endif
+  default:
+    return &find_substring_scalar;
+  }
+}
+
+// The implementation for this CPU, selected once on first use.
+//
+FindFn selected_fn() {
+  static const FindFn fn = impl_fn(substring_scan_impl());
+  return fn;
+}
+
+} // namespace
+
+SubstringScanImpl substring_scan_impl() {
+  static const SubstringScanImpl impl = select_impl();
+  return impl;
+}
+
+std::size_t find_substring(std::string_view text, std::string_view pattern,
+                           std::size_t from) {
+  return selected_fn()(text, pattern, from);
+}
+
+std::size_t find_substring(SubstringScanImpl impl, std::string_view text,
+                           std::string_view pattern, std::size_t from) {
+  return impl_fn(impl)(text, pattern, from);
+}
@@ -0,0 +1,103 @@
+// Vectorized brute-force substring search, for scanning string columns
+// without an index.
+//
+// `find_substring` uses the "generic SIMD" algorithm of Wojciech Mula
+// (http://0x80.pl/articles/simd-strfind.html): the first and last characters
+// of the pattern are broadcast into vector registers and compared against
+// two overlapping blocks of the text, 16 (SSE2) or 32 (AVX2) positions at a
+// time, so that only positions where both characters match are checked
+// with a full comparison.  The widest implementation supported by the CPU is
+// selected at runtime, so the same binary runs on any x86-64 machine; other
+// architectures use a portable scalar implementation.
+//
+// `for_each_row_containing` applies it to all the values of a `StringColumn`
+// at once, searching the column's character arena rather than each value in
+// turn.  Its results are the same as calling `std::string::find` on each row
+// (as `baseline::QBFindMatchingRecords` does), at a cost linear in the size
+// of the column; compared with a suffix index that is slow for rare
+// patterns, but competitive on small columns or for patterns that match a
+// large fraction of the rows.
+//
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+#include <utility>
+
+#include "column_store.hpp"
+#include "visitor.hpp"
+
+// The implementations of `find_substring`.
+//
+enum struct SubstringScanImpl { kScalar, kSse2, kAvx2 };
+
+// Returns the implementation selected for this CPU.
+//
+SubstringScanImpl substring_scan_impl();
+
+// Returns the offset of the first occurrence of `pattern` in `text` at or
+// after offset `from`, or `std::string_view::npos` if there is none; i.e.,
+// `text.find(pattern, from)`.
+//
+std::size_t find_substring(std::string_view text, std::string_view pattern,
+                           std::size_t from = 0);
+
+// Same as `find_substring`, using implementation `impl`, which must be
+// supported by the CPU (for testing and benchmarks).
+//
+std::size_t find_substring(SubstringScanImpl impl, std::string_view text,
+                           std::string_view pattern, std::size_t from = 0);
+
+// Invokes the visitor `fn` (see visitor.hpp) on the row ordinal of each row of
+// `column` whose value contains `pattern`, in row order, using implementation
+// `impl` to search.  Returns false iff `fn` stopped the scan early.
+//
+template <typename Fn /* VisitResult(std::size_t) */>
+bool for_each_row_containing(SubstringScanImpl impl, const StringColumn &column,
+                             std::string_view pattern, Fn &&fn) {
+  if (pattern.empty()) {
+    // Every value contains the empty string.
+    //
+    for (std::size_t row = 0; row < column.size(); ++row) {
+      if (!invoke_visitor(fn, row)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  const std::string_view text = column.chars();
+  std::size_t row = 0;
+  std::size_t from = 0;
+  for (;;) {
+    const std::size_t found = find_substring(impl, text, pattern, from);
+    if (found == std::string_view::npos) {
+      return true;
+    }
+    while (column.end_offset(row) <= found) {
+      ++row;
+    }
+    if (found + pattern.size() > column.end_offset(row)) {
+      // The occurrence straddles the end of the value.
+      //
+      from = found + 1;
+      continue;
+    }
+    if (!invoke_visitor(fn, row)) {
+      return false;
+    }
+    // Each row is reported once, so resume the search at the next row.
+    //
+    from = column.end_offset(row);
+    ++row;
+  }
+}
+
+// Same as above, using the implementation selected for this CPU.
+//
+template <typename Fn /* VisitResult(std::size_t) */>
+bool for_each_row_containing(const StringColumn &column,
+                             std::string_view pattern, Fn &&fn) {
+  return for_each_row_containing(substring_scan_impl(), column, pattern,
+                                 std::forward<Fn>(fn));
+}
@@ -0,0 +1,162 @@
+#include "substring_scan.hpp"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "words.hpp"
+
+namespace {
+
+// The implementations this CPU can run.
+//
+std::vector<SubstringScanImpl> supported_impls() {
+  std::vector<SubstringScanImpl> impls = {SubstringScanImpl::kScalar};
+  if (substring_scan_impl() != SubstringScanImpl::kScalar) {
+    impls.emplace_back(SubstringScanImpl::kSse2);
+  }
+  if (substring_scan_impl() == SubstringScanImpl::kAvx2) {
+    impls.emplace_back(SubstringScanImpl::kAvx2);
+  }
+  return impls;
+}
+
+const char *impl_name(SubstringScanImpl impl) {
+  switch (impl) {
+  case SubstringScanImpl::kScalar:
+    return "scalar";
+  case SubstringScanImpl::kSse2:
+    return "sse2";
+  case SubstringScanImpl::kAvx2:
+    return "avx2";
+  }
+  return "?";
+}
+
+std::string random_string(std::default_random_engine &rng, int max_length,
+                          char max_char) {
+  std::uniform_int_distribution<int> pick_length(0, max_length);
+  std::uniform_int_distribution<int> pick_char('a', max_char);
+  std::string s(pick_length(rng), ' ');
+  for (char &ch : s) {
+    ch = char(pick_char(rng));
+  }
+  return s;
+}
+
+TEST(FindSubstringTest, RandomVsStringFind) {
+  std::default_random_engine rng{/*seed=*/1};
+
+  for (const SubstringScanImpl impl : supported_impls()) {
+    SCOPED_TRACE(impl_name(impl));
+    // Small alphabets, so that there are many partial matches.
+    //
+    for (const char max_char : {'b', 'd', 'z'}) {
+      for (int i = 0; i < 2000; ++i) {
+        const std::string text = random_string(rng, 200, max_char);
+        const std::string pattern = random_string(rng, 6, max_char);
+        std::uniform_int_distribution<std::size_t> pick_from(0,
+                                                             text.size() + 1);
+        const std::size_t from = i % 2 ? pick_from(rng) : 0;
+        ASSERT_EQ(find_substring(impl, text, pattern, from),
+                  text.find(pattern, from))
+            << text << " " << pattern << " " << from;
+      }
+    }
+    // Long patterns, and matches in the last block.
+    //
+    const std::string text =
+        std::string(100, 'a') + "xyz" + std::string(37, 'b');
+    EXPECT_EQ(find_substring(impl, text, text.substr(50)), 50u);
+    EXPECT_EQ(find_substring(impl, text, text), 0u);
+    EXPECT_EQ(find_substring(impl, text, text + "b"), std::string::npos);
+    EXPECT_EQ(find_substring(impl, text, "bbb", 130), 130u);
+    EXPECT_EQ(find_substring(impl, text, "xyz"), 100u);
+    EXPECT_EQ(find_substring(impl, text, "xyz", 101), std::string::npos);
+  }
+}
+
+TEST(SubstringScanTest, ForEachRowContaining) {
+  std::default_random_engine rng{/*seed=*/1};
+
+  StringColumn column;
+  std::vector<std::string> values;
+  for (int i = 0; i < 5000; ++i) {
+    values.emplace_back(random_string(rng, 12, 'e'));
+    column.push_back(values.back());
+  }
+
+  for (int i = 0; i < 200; ++i) {
+    const std::string pattern = random_string(rng, 4, 'e');
+    std::vector<std::size_t> expected;
+    for (std::size_t row = 0; row < values.size(); ++row) {
+      if (values[row].find(pattern) != std::string::npos) {
+        expected.emplace_back(row);
+      }
+    }
+    std::vector<std::size_t> actual;
+    EXPECT_TRUE(for_each_row_containing(
+        column, pattern, [&](std::size_t row) { actual.emplace_back(row); }));
+    ASSERT_EQ(actual, expected) << pattern;
+  }
+
+  // Matches must not straddle values.
+  //
+  StringColumn pairs;
+  pairs.push_back("ab");
+  pairs.push_back("");
+  pairs.push_back("cd");
+  int count = 0;
+  for_each_row_containing(pairs, "bc", [&](std::size_t) { ++count; });
+  EXPECT_EQ(count, 0);
+
+  // The visitor can stop the scan.
+  //
+  count = 0;
+  EXPECT_FALSE(for_each_row_containing(column, "a", [&](std::size_t) {
+    return ++count == 3 ? VisitResult::kStop : VisitResult::kContinue;
+  }));
+  EXPECT_EQ(count, 3);
+}
+
+// Checks scanning a column of dictionary words with each implementation
+// against calling `std::string::find` on each value, as the baseline does,
+// for rare and common patterns.  (BM_ScanColumn in
+// qb_record_collection_benchmark.cpp compares their speed.)
+//
+TEST(SubstringScanTest, MatchesPerValueFind) {
+  constexpr int kRows = 10 * 1000;
+
+  const std::vector<std::string> words = load_words();
+  std::default_random_engine rng{/*seed=*/1};
+  std::uniform_int_distribution<std::size_t> pick_word(0, words.size() - 1);
+
+  std::vector<std::string> values;
+  StringColumn column;
+  for (int i = 0; i < kRows; ++i) {
+    values.emplace_back(words[pick_word(rng)]);
+    column.push_back(values.back());
+  }
+
+  for (const std::string pattern : {"qz", "zyx", "tion", "e"}) {
+    std::vector<std::size_t> expected;
+    for (std::size_t row = 0; row < values.size(); ++row) {
+      if (values[row].find(pattern) != std::string::npos) {
+        expected.emplace_back(row);
+      }
+    }
+
+    for (const SubstringScanImpl impl : supported_impls()) {
+      std::vector<std::size_t> actual;
+      for_each_row_containing(impl, column, pattern,
+                              [&](std::size_t row) { actual.push_back(row); });
+      EXPECT_EQ(actual, expected)
+          << impl_name(impl) << " pattern=" << pattern;
+    }
+  }
+}
+
+} // namespace
@@ -0,0 +1,438 @@
+// Implementation of SuffixArrayIndex: a bulk-built generalized suffix array
+// alternative to StringTrie.
+//
+// SuffixArrayIndex<T> has the same `insert_suffixes` / `for_each_prefix_match`
+// interface as StringTrie<T>, so it can be used as the index behind a string
+// QBColumnLookup, but stores no per-node pointers at all.  Instead:
+//
+//  - All inserted keys are appended, each followed by a NUL separator, to a
+//    single contiguous text buffer; a parallel array of start offsets maps a
+//    text position back to the value for its key.
+//
+//  - The suffix array (the start positions of all suffixes of the text, in
+//    lexicographic order) is built in O(|text|) time using the SA-IS algorithm
+//    (Nong, Zhang and Chan, "Two Efficient Algorithms for Linear Time Suffix
+//    Array Construction", IEEE Trans. Computers, 2011).
+//
+//  - An LCP array (length of the longest common prefix of each suffix and its
+//    predecessor) is built with Kasai's algorithm.  LCP values are stored in a
+//    single byte, saturating at 255.
+//
+// All suffixes that start with a given pattern form a contiguous range of the
+// suffix array; a query binary searches for the start of that range and then
+// extends it using the LCP array, without any further string comparisons.
+//
+// Space is 1 (text) + 4 (suffix array) + 1 (LCP) bytes per indexed character,
+// plus `sizeof(T) + 4` bytes per key.
+//
+// The index is built in bulk: `insert_suffixes` appends to the text buffer,
+// and the arrays are (re)built by `build()`.  Keys inserted since the last
+// build are searched by scanning them, so queries never modify the index and
+// may run concurrently.  To bound that scan, `insert_suffixes` rebuilds the
+// arrays itself once the unbuilt keys outgrow a quarter of the built text
+// (and `kMinRebuildSize`), which amortizes the cost of rebuilding to a
+// constant per inserted character.  Call `build()` after a bulk load (as
+// `QBColumnLookup::compact` does) so that no keys are left to scan.
+//
+// Keys may contain any byte, but NUL bytes are not searchable: patterns
+// containing NUL never match.
+//
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "memory_usage.hpp"
+#include "visitor.hpp"
+
+//------------------------------------------------------------------------------
+// Helpers and implementation detail for `build_suffix_array`.
+//
+namespace detail {
+
+// Returns the start (`end=false`) or one-past-the-end (`end=true`) index of
+// each character's bucket in the suffix array.
+//
+inline void sais_buckets(const std::int32_t *s, int n, int k,
+                         std::vector<std::int32_t> &bkt, bool end) {
+  std::fill(bkt.begin(), bkt.end(), 0);
+  for (int i = 0; i < n; ++i) {
+    ++bkt[s[i]];
+  }
+  int sum = 0;
+  for (int c = 0; c < k; ++c) {
+    sum += bkt[c];
+    bkt[c] = end ? sum : sum - bkt[c];
+  }
+}
+
+// SA-IS: computes the suffix array `sa` of `s`, a string of length `n` over
+// the integer alphabet [0, k) whose last character is a unique 0 sentinel.
+//
+inline void sais(const std::int32_t *s, std::int32_t *sa, int n, int k) {
+  // Classify each suffix as S-type (true) or L-type (false).
+  //
+  std::vector<bool> stype(n);
+  stype[n - 1] = true;
+  for (int i = n - 2; i >= 0; --i) {
+    stype[i] = s[i] < s[i + 1] || (s[i] == s[i + 1] && stype[i + 1]);
+  }
+  const auto is_lms = [&](int i) {
+    return i > 0 && stype[i] && !stype[i - 1];
+  };
+
+  std::vector<std::int32_t> bkt(k);
+
+  const auto induce = [&] {
+    sais_buckets(s, n, k, bkt, /*end=*/false);
+    for (int i = 0; i < n; ++i) {
+      const int j = sa[i] - 1;
+      if (sa[i] > 0 && !stype[j]) {
+        sa[bkt[s[j]]++] = j;
+      }
+    }
+    sais_buckets(s, n, k, bkt, /*end=*/true);
+    for (int i = n - 1; i >= 0; --i) {
+      const int j = sa[i] - 1;
+      if (sa[i] > 0 && stype[j]) {
+        sa[--bkt[s[j]]] = j;
+      }
+    }
+  };
+
+  // Stage 1: sort the LMS substrings by inducing from their bucket ends.
+  //
+  std::fill(sa, sa + n, -1);
+  sais_buckets(s, n, k, bkt, /*end=*/true);
+  for (int i = 1; i < n; ++i) {
+    if (is_lms(i)) {
+      sa[--bkt[s[i]]] = i;
+    }
+  }
+  induce();
+
+  // Compact the sorted LMS positions into the head of `sa`.
+  //
+  int n1 = 0;
+  for (int i = 0; i < n; ++i) {
+    if (is_lms(sa[i])) {
+      sa[n1++] = sa[i];
+    }
+  }
+
+  // Name the LMS substrings; equal substrings get equal names.
+  //
+  std::fill(sa + n1, sa + n, -1);
+  int name = 0;
+  int prev = -1;
+  for (int i = 0; i < n1; ++i) {
+    const int pos = sa[i];
+    bool diff = false;
+    for (int d = 0; d < n; ++d) {
+      if (prev == -1 || s[pos + d] != s[prev + d] ||
+          stype[pos + d] != stype[prev + d]) {
+        diff = true;
+        break;
+      }
+      if (d > 0 && (is_lms(pos + d) || is_lms(prev + d))) {
+        break;
+      }
+    }
+    if (diff) {
+      ++name;
+      prev = pos;
+    }
+    sa[n1 + pos / 2] = name - 1;
+  }
+  for (int i = n - 1, j = n - 1; i >= n1; --i) {
+    if (sa[i] >= 0) {
+      sa[j--] = sa[i];
+    }
+  }
+
+  // Stage 2: sort the reduced string, recursing if names are not unique.
+  //
+  std::int32_t *s1 = sa + n - n1;
+  std::int32_t *sa1 = sa;
+  if (name < n1) {
+    sais(s1, sa1, n1, name);
+  } else {
+    for (int i = 0; i < n1; ++i) {
+      sa1[s1[i]] = i;
+    }
+  }
+
+  // Stage 3: induce the full suffix array from the sorted LMS suffixes.
+  //
+  for (int i = 1, j = 0; i < n; ++i) {
+    if (is_lms(i)) {
+      s1[j++] = i;
+    }
+  }
+  for (int i = 0; i < n1; ++i) {
+    sa1[i] = s1[sa1[i]];
+  }
+  std::fill(sa + n1, sa + n, -1);
+  sais_buckets(s, n, k, bkt, /*end=*/true);
+  for (int i = n1 - 1; i >= 0; --i) {
+    const int j = sa[i];
+    sa[i] = -1;
+    sa[--bkt[s[j]]] = j;
+  }
+  induce();
+}
+
+} // namespace detail
+//------------------------------------------------------------------------------
+
+// Returns the suffix array of `text`: the start offsets of all its suffixes, in
+// ascending lexicographic (unsigned byte) order.
+//
+// Complexity: O(text.length())
+//
+inline std::vector<std::int32_t> build_suffix_array(std::string_view text) {
+  assert(text.size() < std::size_t(std::numeric_limits<std::int32_t>::max()));
+  if (text.empty()) {
+    return {};
+  }
+
+  const int n = int(text.size()) + 1;
+  std::vector<std::int32_t> s(n);
+  for (int i = 0; i + 1 < n; ++i) {
+    s[i] = int((unsigned char)text[i]) + 1;
+  }
+  s[n - 1] = 0;
+
+  std::vector<std::int32_t> sa(n);
+  detail::sais(s.data(), sa.data(), n, /*k=*/257);
+
+  // Drop the sentinel suffix, which always sorts first.
+  //
+  sa.erase(sa.begin());
+  return sa;
+}
+
+//------------------------------------------------------------------------------
+
+// Generalized suffix array mapping 8-bit char strings to values of type `T`.
+//
+template <typename T> class SuffixArrayIndex {
+private:
+  // Returns the index into `values_` of the key containing text offset `pos`.
+  //
+  std::size_t key_index(std::uint32_t pos) const {
+    return std::upper_bound(starts_.begin(), starts_.end(), pos) -
+           starts_.begin() - 1;
+  }
+
+  // Compares the suffix starting at `pos` with `pattern`, considering only
+  // the first `pattern.size()` characters of the suffix.
+  //
+  int compare_prefix(std::uint32_t pos, std::string_view pattern) const {
+    return std::string_view{text_}.substr(pos, pattern.size()).compare(
+        pattern);
+  }
+
+  // Computes `lcp_` from `sa_` using Kasai's algorithm.
+  //
+  void build_lcp() {
+    const std::size_t n = text_.size();
+    constexpr auto kNoRank = std::numeric_limits<std::uint32_t>::max();
+
+    std::vector<std::uint32_t> rank(n, kNoRank);
+    for (std::size_t i = 0; i < sa_.size(); ++i) {
+      rank[sa_[i]] = i;
+    }
+
+    lcp_.assign(sa_.size(), 0);
+    std::size_t h = 0;
+    for (std::size_t pos = 0; pos < n; ++pos) {
+      const std::uint32_t r = rank[pos];
+      if (r == 0 || r == kNoRank) {
+        h = 0;
+        continue;
+      }
+      const std::size_t prev = sa_[r - 1];
+      while (pos + h < n && prev + h < n &&
+             text_[pos + h] == text_[prev + h] && text_[pos + h] != '\0') {
+        ++h;
+      }
+      lcp_[r] = std::uint8_t(std::min<std::size_t>(h, kMaxLcp));
+      if (h > 0) {
+        --h;
+      }
+    }
+  }
+
+  // Returns the size of the prefix of `text_` covered by `sa_` and `lcp_`.
+  //
+  std::size_t built_size() const {
+    return built_keys_ == starts_.size() ? text_.size() : starts_[built_keys_];
+  }
+
+  // Invokes the visitor `fn` as `for_each_prefix_match` does, but only for
+  // the keys inserted since the last build, by searching each of them.
+  //
+  template <typename Fn>
+  bool for_each_unbuilt_match(std::string_view key_prefix, Fn &&fn) const {
+    for (std::size_t k = built_keys_; k < starts_.size(); ++k) {
+      const std::size_t end =
+          k + 1 == starts_.size() ? text_.size() - 1 : starts_[k + 1] - 1;
+      const std::string_view key =
+          std::string_view{text_}.substr(starts_[k], end - starts_[k]);
+      // An empty `key_prefix` matches each suffix once, as in `sa_`; the
+      // empty suffix is not indexed.
+      //
+      for (std::size_t pos = key.find(key_prefix);
+           pos != std::string_view::npos && pos < key.size();
+           pos = key.find(key_prefix, pos + 1)) {
+        if (!invoke_visitor(fn, values_[k])) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  // LCP values are saturated at this value.
+  //
+  static constexpr std::size_t kMaxLcp =
+      std::numeric_limits<std::uint8_t>::max();
+
+  // All keys, each followed by a NUL separator.
+  //
+  std::string text_;
+
+  // The offset in `text_` of each key, in insertion order.
+  //
+  std::vector<std::uint32_t> starts_;
+
+  // The value for each key, in insertion order.
+  //
+  std::vector<T> values_;
+
+  // Suffix array of `text_`, excluding suffixes that begin with NUL.
+  //
+  std::vector<std::uint32_t> sa_;
+
+  // `lcp_[i]` is the length of the longest common prefix of the suffixes at
+  // `sa_[i - 1]` and `sa_[i]`, not extending past a NUL, saturated at
+  // `kMaxLcp`; `lcp_[0]` is 0.
+  //
+  std::vector<std::uint8_t> lcp_;
+
+  // The number of keys covered by `sa_` and `lcp_`, i.e. inserted before the
+  // last build.
+  //
+  std::size_t built_keys_ = 0;
+
+  //============================================================================
+public:
+  SuffixArrayIndex() = default;
+  SuffixArrayIndex(const SuffixArrayIndex &) = delete;
+  SuffixArrayIndex &operator=(const SuffixArrayIndex &) = delete;
+
+  // The unbuilt text that makes `insert_suffixes` rebuild the arrays, at the
+  // least.
+  //
+  static constexpr std::size_t kMinRebuildSize = 64 * 1024;
+
+  //================================
+
+  // Adds `key` to the index under `value`, making all of its suffixes (and
+  // therefore substrings) searchable; see above for when this rebuilds the
+  // arrays.
+  //
+  // Complexity: O(key.length()), amortized.
+  //
+  void insert_suffixes(std::string_view key, const T &value) {
+    assert(text_.size() + key.size() + 1 <=
+           std::size_t(std::numeric_limits<std::int32_t>::max()));
+    starts_.emplace_back(text_.size());
+    values_.emplace_back(value);
+    text_.append(key);
+    text_.push_back('\0');
+
+    const std::size_t unbuilt = text_.size() - built_size();
+    if (unbuilt >= std::max(kMinRebuildSize, built_size() / 4)) {
+      build();
+    }
+  }
+
+  // Builds the suffix and LCP arrays for all keys inserted so far.
+  //
+  // Complexity: O(total length of all keys)
+  //
+  void build() {
+    const std::vector<std::int32_t> full_sa = build_suffix_array(text_);
+
+    // Suffixes starting with NUL sort before all others; drop them.
+    //
+    const auto first_searchable = std::find_if(
+        full_sa.begin(), full_sa.end(),
+        [&](std::int32_t pos) { return text_[pos] != '\0'; });
+    sa_.assign(first_searchable, full_sa.end());
+    sa_.shrink_to_fit();
+
+    build_lcp();
+    built_keys_ = starts_.size();
+  }
+
+  // Invokes the visitor `fn` (see visitor.hpp) for each mapped value, once for
+  // each of its key's suffixes that start with `key_prefix`: in suffix array
+  // order for the keys inserted before the last build, then in insertion order
+  // for the rest.  Returns false iff `fn` stopped the iteration early.
+  //
+  template <typename Fn /* void(const T &) */>
+  bool for_each_prefix_match(std::string_view key_prefix, Fn &&fn) const {
+    if (key_prefix.find('\0') != std::string_view::npos) {
+      return true;
+    }
+    // Binary search for the first suffix not less than `key_prefix`.
+    //
+    const auto first = std::partition_point(
+        sa_.begin(), sa_.end(), [&](std::uint32_t pos) {
+          return compare_prefix(pos, key_prefix) < 0;
+        });
+
+    // Find the end of the matching range; for short patterns, this is where
+    // the LCP with the previous suffix drops below the pattern length.
+    //
+    auto last = first;
+    if (key_prefix.size() <= kMaxLcp) {
+      if (last != sa_.end() && compare_prefix(*last, key_prefix) == 0) {
+        do {
+          ++last;
+        } while (last != sa_.end() && lcp_[last - sa_.begin()] >=
+                                          key_prefix.size());
+      }
+    } else {
+      last = std::partition_point(first, sa_.end(), [&](std::uint32_t pos) {
+        return compare_prefix(pos, key_prefix) == 0;
+      });
+    }
+
+    for (auto iter = first; iter != last; ++iter) {
+      if (!invoke_visitor(fn, values_[key_index(*iter)])) {
+        return false;
+      }
+    }
+    return for_each_unbuilt_match(key_prefix, fn);
+  }
+
+  // Returns the memory used by the index, with the number of suffixes in the
+  // suffix array as of the last build.
+  //
+  MemoryUsage memory_usage() const {
+    MemoryUsage usage;
+    usage.bytes = heap_bytes(text_) + heap_bytes(starts_) +
+                  heap_bytes(values_) + heap_bytes(sa_) + heap_bytes(lcp_);
+    usage.num_entries = sa_.size();
+    return usage;
+  }
+};
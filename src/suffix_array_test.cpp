@@ -0,0 +1,258 @@
+#include "suffix_array.hpp"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include <map>
+#include <numeric>
+#include <random>
+#include <set>
+#include <string>
+
+#include "heap_usage.hpp"
+#include "qb_column_lookup.hpp"
+#include "radix_trie.hpp"
+#include "string_trie.hpp"
+#include "words.hpp"
+
+namespace {
+
+std::vector<std::int32_t> naive_suffix_array(std::string_view text) {
+  std::vector<std::int32_t> sa(text.size());
+  std::iota(sa.begin(), sa.end(), 0);
+  std::sort(sa.begin(), sa.end(), [&](std::int32_t a, std::int32_t b) {
+    return text.substr(a) < text.substr(b);
+  });
+  return sa;
+}
+
+std::string random_string(std::default_random_engine &rng, int max_length,
+                          const std::string &alphabet) {
+  std::uniform_int_distribution<int> pick_length(0, max_length);
+  std::uniform_int_distribution<int> pick_char(0, alphabet.size() - 1);
+  std::string s(pick_length(rng), ' ');
+  for (char &ch : s) {
+    ch = alphabet[pick_char(rng)];
+  }
+  return s;
+}
+
+// Returns the number of (possibly overlapping) occurrences of `pattern` in
+// `s`.
+//
+int count_occurrences(std::string_view s, std::string_view pattern) {
+  int count = 0;
+  for (auto pos = s.find(pattern); pos != std::string_view::npos;
+       pos = s.find(pattern, pos + 1)) {
+    ++count;
+  }
+  return count;
+}
+
+TEST(SuffixArrayTest, BuildSuffixArray) {
+  EXPECT_THAT(build_suffix_array(""), ::testing::IsEmpty());
+  EXPECT_THAT(build_suffix_array("banana"),
+              ::testing::ElementsAre(5, 3, 1, 0, 4, 2));
+  EXPECT_EQ(build_suffix_array("mississippi"),
+            naive_suffix_array("mississippi"));
+
+  std::default_random_engine rng{/*seed=*/1};
+  for (const std::string &alphabet : std::vector<std::string>{
+           "a", "ab", "abc", "acgt", std::string("\0\x01\xff", 3)}) {
+    for (int i = 0; i < 200; ++i) {
+      const std::string text = random_string(rng, 300, alphabet);
+      ASSERT_EQ(build_suffix_array(text), naive_suffix_array(text))
+          << "text=" << text;
+    }
+  }
+}
+
+TEST(SuffixArrayTest, PrefixMatchCountsOccurrences) {
+  std::default_random_engine rng{/*seed=*/2};
+
+  std::vector<std::string> keys;
+  SuffixArrayIndex<int> index;
+  for (int i = 0; i < 500; ++i) {
+    keys.emplace_back(random_string(rng, 20, "abc"));
+    index.insert_suffixes(keys.back(), i);
+  }
+
+  // Long keys to exercise saturated LCP values.
+  //
+  keys.emplace_back(std::string(300, 'a'));
+  index.insert_suffixes(keys.back(), keys.size() - 1);
+  keys.emplace_back(std::string(280, 'a') + "b");
+  index.insert_suffixes(keys.back(), keys.size() - 1);
+
+  std::vector<std::string> patterns = {"", "a", "b", "ab", "cab", "abcabc",
+                                       "d", std::string(255, 'a'),
+                                       std::string(256, 'a'),
+                                       std::string(270, 'a') + "b"};
+  for (int i = 0; i < 100; ++i) {
+    patterns.emplace_back(random_string(rng, 6, "abc"));
+  }
+
+  for (const std::string &pattern : patterns) {
+    std::map<int, int> expected;
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+      const int n = pattern.empty() ? keys[i].size()
+                                    : count_occurrences(keys[i], pattern);
+      if (n) {
+        expected[i] = n;
+      }
+    }
+
+    std::map<int, int> actual;
+    index.for_each_prefix_match(pattern, [&](int i) { ++actual[i]; });
+
+    EXPECT_THAT(actual, ::testing::ContainerEq(expected))
+        << "pattern=" << pattern;
+  }
+}
+
+TEST(SuffixArrayTest, RebuildAfterInsert) {
+  SuffixArrayIndex<int> index;
+  std::set<int> actual;
+  const auto matches = [&](std::string_view pattern) {
+    actual.clear();
+    index.for_each_prefix_match(pattern, [&](int i) { actual.insert(i); });
+    return actual;
+  };
+
+  EXPECT_THAT(matches("an"), ::testing::IsEmpty());
+
+  index.insert_suffixes("banana", 1);
+  EXPECT_THAT(matches("an"), ::testing::ElementsAre(1));
+
+  index.insert_suffixes("bandana", 2);
+  index.build();
+  EXPECT_THAT(matches("an"), ::testing::ElementsAre(1, 2));
+  EXPECT_THAT(matches("nd"), ::testing::ElementsAre(2));
+  EXPECT_THAT(matches("nab"), ::testing::IsEmpty());
+  EXPECT_THAT(matches(std::string_view{"a\0b", 3}), ::testing::IsEmpty());
+}
+
+// Keys inserted since the last build are found by scanning them, without
+// building the index from the (const) query; inserts rebuild it once enough
+// keys are unbuilt.
+//
+TEST(SuffixArrayTest, QueriesDontBuild) {
+  std::default_random_engine rng{/*seed=*/3};
+  SuffixArrayIndex<int> index;
+  std::vector<std::string> keys;
+  const auto check = [&](const std::string &pattern) {
+    std::map<int, int> expected;
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+      const int n = pattern.empty() ? keys[i].size()
+                                    : count_occurrences(keys[i], pattern);
+      if (n) {
+        expected[i] = n;
+      }
+    }
+    std::map<int, int> actual;
+    index.for_each_prefix_match(pattern, [&](int i) { ++actual[i]; });
+    EXPECT_THAT(actual, ::testing::ContainerEq(expected))
+        << "pattern=" << pattern << " keys=" << keys.size();
+  };
+
+  for (int i = 0; i < 10; ++i) {
+    keys.emplace_back(random_string(rng, 20, "abc"));
+    index.insert_suffixes(keys.back(), i);
+  }
+  for (const char *pattern : {"", "a", "ab", "cab"}) {
+    check(pattern);
+  }
+  EXPECT_EQ(index.memory_usage().num_entries, 0u);
+
+  // Enough keys to trigger a rebuild, then some more left unbuilt.
+  //
+  while (index.memory_usage().num_entries == 0) {
+    keys.emplace_back(random_string(rng, 200, "abc"));
+    index.insert_suffixes(keys.back(), keys.size() - 1);
+  }
+  for (int i = 0; i < 10; ++i) {
+    keys.emplace_back(random_string(rng, 20, "abc"));
+    index.insert_suffixes(keys.back(), keys.size() - 1);
+  }
+  const std::size_t built = index.memory_usage().num_entries;
+  for (const char *pattern : {"", "a", "ab", "cab", "abcabc"}) {
+    check(pattern);
+  }
+  EXPECT_EQ(index.memory_usage().num_entries, built);
+
+  index.build();
+  check("bca");
+  EXPECT_GT(index.memory_usage().num_entries, built);
+}
+
+TEST(SuffixArrayTest, ColumnLookupBackend) {
+  QBColumnLookup<unsigned, std::string, SuffixArrayIndex<unsigned>> lookup;
+  lookup.insert(1, "banana");
+  lookup.insert(2, "bandana");
+  lookup.insert(3, "cabana");
+
+  std::multiset<unsigned> actual;
+  lookup.for_each_match("ana", [&](unsigned id) {
+    actual.insert(id);
+    return VisitResult::kContinue;
+  });
+
+  EXPECT_THAT(actual, ::testing::ElementsAre(1, 2, 3));
+}
+
+// Builds each index type over the same corpus and checks that it agrees with
+// a brute force search and doesn't report more memory than it allocated.
+// (BM_BuildIndex and BM_QueryIndex in qb_record_collection_benchmark.cpp
+// compare their footprint and speed.)
+//
+TEST(SuffixArrayTest, MatchesTries) {
+  const std::vector<std::string> words = load_words();
+
+  const std::vector<const char *> patterns = {
+      "x",  "ill", "zing", "uniquely", "notawordXYZ", "bob", "aa",
+      "niqu", "ly", "are", "ss", "ZZG", "raft", "th", "lo", "term",
+      "expect", "lease"};
+
+  std::vector<std::set<int>> expected(patterns.size());
+  for (std::size_t p = 0; p < patterns.size(); ++p) {
+    for (std::size_t i = 0; i < words.size(); ++i) {
+      if (words[i].find(patterns[p]) != std::string::npos) {
+        expected[p].insert(i);
+      }
+    }
+  }
+
+  const auto check = [&](const char *name, auto index_type) {
+    using Index = typename decltype(index_type)::type;
+
+    const std::size_t heap_before = heap_bytes_in_use();
+    auto index = std::make_unique<Index>();
+    for (std::size_t i = 0; i < words.size(); ++i) {
+      index->insert_suffixes(words[i], i);
+    }
+    if constexpr (std::is_same_v<Index, SuffixArrayIndex<int>>) {
+      index->build();
+    }
+    const std::size_t bytes = heap_bytes_in_use() - heap_before;
+    const std::size_t reported = index->memory_usage().bytes;
+    if (bytes != 0) {
+      // Allow for memory freed by other code while the index was built.
+      //
+      EXPECT_LE(reported, bytes * 1.01) << name;
+    }
+
+    for (std::size_t p = 0; p < patterns.size(); ++p) {
+      std::set<int> actual;
+      index->for_each_prefix_match(patterns[p],
+                                   [&](int i) { actual.insert(i); });
+      EXPECT_THAT(actual, ::testing::ContainerEq(expected[p]))
+          << name << " pattern=" << patterns[p];
+    }
+  };
+
+  check("StringTrie", TypeOf<StringTrie<int>>{});
+  check("RadixTrie", TypeOf<RadixTrie<int>>{});
+  check("SuffixArrayIndex", TypeOf<SuffixArrayIndex<int>>{});
+}
+
+} // namespace
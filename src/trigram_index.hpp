@@ -0,0 +1,406 @@
+// Implementation of TrigramIndex: an inverted index of 3-byte substrings, used
+// as a substring search filter.
+//
+// TrigramIndex<T> has the same `insert_suffixes` / `for_each_prefix_match`
+// interface as StringTrie<T>, so it can be used as the index behind a string
+// QBColumnLookup.  Unlike the suffix-based indices, its size is linear in the
+// total length of the indexed keys, which makes it the better choice for long
+// string values.
+//
+// Each inserted key is assigned an ordinal (its position in insertion order)
+// and copied into a contiguous text arena, unless the index is given a key
+// accessor to look keys up by value instead (e.g. in the caller's record
+// store).  For every distinct trigram in the key, the ordinal is appended to
+// that trigram's posting list.  Because
+// ordinals are assigned in increasing order, posting lists are always sorted
+// and can be compressed as they are built, without a separate sort/seal step:
+// entries are stored in blocks of `kBlockSize`, each block as a skip entry
+// (the block's first ordinal and its byte offset) followed by the varint
+// encoded deltas of the rest of the block.
+//
+// A query for a pattern of length >= 3 intersects the posting lists of the
+// pattern's distinct trigrams, shortest first, using galloping search over
+// each list's skip entries so that only the blocks that might contain a
+// candidate are decoded.  Having all trigrams of the pattern is necessary but
+// not sufficient for a match, so the surviving candidates are then verified
+// against the key text (except for patterns of exactly three bytes, where the
+// posting list is exact).  Patterns shorter than three bytes fall back to a
+// linear scan of the keys.
+//
+// The arena costs the total length of the keys (plus the string's spare
+// capacity) and four bytes per key: from a sixth of the index for dictionary
+// words to over a quarter for the benchmarks' records and long values.  A
+// caller that already stores the keys can pass an accessor to save that.
+// `QBColumnLookup` can't, as it doesn't see the record store, so an index
+// behind it keeps its own copy.
+//
+// Each matching value is emitted exactly once, in insertion order.
+//
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "memory_usage.hpp"
+#include "visitor.hpp"
+
+//------------------------------------------------------------------------------
+
+// Sorted list of 32-bit ordinals, stored as varint-encoded deltas in blocks
+// with an uncompressed skip table.
+//
+class PostingList {
+public:
+  // The number of entries per block.
+  //
+  static constexpr std::size_t kBlockSize = 128;
+
+  // Sequential reader, supporting forward seeks.
+  //
+  class Cursor {
+  public:
+    explicit Cursor(const PostingList &list) : list_{&list} {
+      if (list_->size_ != 0) {
+        load_block(0);
+      }
+    }
+
+    // Returns true iff all entries have been consumed.
+    //
+    bool at_end() const { return position_ >= list_->size_; }
+
+    // Returns the current entry; requires `!at_end()`.
+    //
+    std::uint32_t value() const { return value_; }
+
+    // Advances to the next entry.
+    //
+    void next() {
+      ++position_;
+      if (at_end()) {
+        return;
+      }
+      if (position_ % kBlockSize == 0) {
+        load_block(block_ + 1);
+      } else {
+        value_ += read_varint();
+      }
+    }
+
+    // Advances to the first entry not less than `target`, or to the end.
+    //
+    void seek(std::uint32_t target) {
+      if (at_end() || value_ >= target) {
+        return;
+      }
+
+      // Gallop forward through the skip table to bracket the last block whose
+      // first entry is <= `target`, then binary search within the bracket.
+      //
+      const std::vector<std::uint32_t> &firsts = list_->block_first_;
+      std::size_t lo = block_ + 1;
+      std::size_t hi = lo;
+      std::size_t step = 1;
+      while (hi < firsts.size() && firsts[hi] <= target) {
+        lo = hi + 1;
+        hi = lo + step;
+        step *= 2;
+      }
+      hi = std::min(hi, firsts.size());
+      const std::size_t block =
+          std::upper_bound(firsts.begin() + lo, firsts.begin() + hi, target) -
+          firsts.begin() - 1;
+      if (block != block_) {
+        load_block(block);
+      }
+
+      while (!at_end() && value_ < target) {
+        next();
+      }
+    }
+
+  private:
+    void load_block(std::size_t block) {
+      block_ = block;
+      position_ = block * kBlockSize;
+      value_ = list_->block_first_[block];
+      byte_offset_ = list_->block_offset_[block];
+    }
+
+    std::uint32_t read_varint() {
+      std::uint32_t delta = 0;
+      for (int shift = 0;; shift += 7) {
+        const std::uint8_t byte = list_->bytes_[byte_offset_++];
+        delta |= std::uint32_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+          return delta;
+        }
+      }
+    }
+
+    const PostingList *list_;
+    std::size_t block_ = 0;
+    std::size_t position_ = 0;
+    std::size_t byte_offset_ = 0;
+    std::uint32_t value_ = 0;
+  };
+
+  // Appends `ordinal`, which must be greater than all entries in the list.
+  //
+  void push_back(std::uint32_t ordinal) {
+    assert(size_ == 0 || ordinal > last_);
+    if (size_ % kBlockSize == 0) {
+      block_first_.emplace_back(ordinal);
+      block_offset_.emplace_back(bytes_.size());
+    } else {
+      for (std::uint32_t delta = ordinal - last_;; delta >>= 7) {
+        if (delta < 0x80) {
+          bytes_.emplace_back(std::uint8_t(delta));
+          break;
+        }
+        bytes_.emplace_back(std::uint8_t(delta | 0x80));
+      }
+    }
+    last_ = ordinal;
+    ++size_;
+  }
+
+  // Returns the number of entries in the list.
+  //
+  std::size_t size() const { return size_; }
+
+  // Returns the bytes allocated by the list.
+  //
+  std::size_t byte_size() const {
+    return heap_bytes(bytes_) + heap_bytes(block_first_) +
+           heap_bytes(block_offset_);
+  }
+
+  // Returns a cursor positioned at the first entry.
+  //
+  Cursor cursor() const { return Cursor{*this}; }
+
+private:
+  std::uint32_t size_ = 0;
+  std::uint32_t last_ = 0;
+  std::vector<std::uint8_t> bytes_;
+  std::vector<std::uint32_t> block_first_;
+  std::vector<std::uint32_t> block_offset_;
+};
+
+//------------------------------------------------------------------------------
+
+// Trigram inverted index mapping 8-bit char strings to values of type `T`.
+//
+template <typename T> class TrigramIndex {
+private:
+  static std::uint32_t trigram_at(std::string_view s, std::size_t i) {
+    return (std::uint32_t((unsigned char)s[i]) << 16) |
+           (std::uint32_t((unsigned char)s[i + 1]) << 8) |
+           std::uint32_t((unsigned char)s[i + 2]);
+  }
+
+  // Returns the distinct trigrams of `s`, in ascending order.
+  //
+  static std::vector<std::uint32_t> trigrams(std::string_view s) {
+    std::vector<std::uint32_t> result;
+    for (std::size_t i = 0; i + 3 <= s.size(); ++i) {
+      result.emplace_back(trigram_at(s, i));
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+  }
+
+  // Returns the key with the given ordinal.
+  //
+  std::string_view key(std::uint32_t ordinal) const {
+    if (key_of_) {
+      return key_of_(values_[ordinal]);
+    }
+    return std::string_view{text_}.substr(
+        starts_[ordinal], starts_[ordinal + 1] - starts_[ordinal]);
+  }
+
+  // Invokes the visitor `fn` on the ordinals of all keys containing all the
+  // trigrams of `pattern`, which must be at least 3 bytes long, in ascending
+  // order.  Returns false iff `fn` stopped the iteration early.
+  //
+  template <typename Fn /* void(std::uint32_t ordinal) */>
+  bool for_each_candidate(std::string_view pattern, Fn &&fn) const {
+    std::vector<const PostingList *> lists;
+    for (std::uint32_t trigram : trigrams(pattern)) {
+      const auto found = postings_.find(trigram);
+      if (found == postings_.end()) {
+        return true;
+      }
+      lists.emplace_back(&found->second);
+    }
+    std::sort(lists.begin(), lists.end(),
+              [](const PostingList *a, const PostingList *b) {
+                return a->size() < b->size();
+              });
+
+    std::vector<PostingList::Cursor> cursors;
+    for (const PostingList *list : lists) {
+      cursors.emplace_back(list->cursor());
+    }
+
+    // Leapfrog over the shortest list; every other list seeks to each of its
+    // entries in turn.
+    //
+    PostingList::Cursor &driver = cursors.front();
+    while (!driver.at_end()) {
+      const std::uint32_t candidate = driver.value();
+      std::uint32_t next = candidate;
+      for (std::size_t i = 1; i < cursors.size(); ++i) {
+        cursors[i].seek(candidate);
+        if (cursors[i].at_end()) {
+          return true;
+        }
+        next = std::max(next, cursors[i].value());
+      }
+      if (next == candidate) {
+        if (!invoke_visitor(fn, candidate)) {
+          return false;
+        }
+        driver.next();
+      } else {
+        driver.seek(next);
+      }
+    }
+    return true;
+  }
+
+  // Returns the key of a value, if the keys aren't copied into `text_`.
+  //
+  std::function<std::string_view(const T &)> key_of_;
+
+  // All keys, concatenated in insertion order (unless `key_of_` is set).
+  //
+  std::string text_;
+
+  // `starts_[i]` is the offset in `text_` of the key with ordinal `i`;
+  // `starts_.back()` is `text_.size()`.  Empty if `key_of_` is set.
+  //
+  std::vector<std::uint32_t> starts_{0};
+
+  // The value for each key, by ordinal.
+  //
+  std::vector<T> values_;
+
+  // Posting list of key ordinals for each trigram present in any key.
+  //
+  std::unordered_map<std::uint32_t, PostingList, std::hash<std::uint32_t>,
+                     std::equal_to<std::uint32_t>,
+                     CountingAllocator<std::pair<const std::uint32_t,
+                                                 PostingList>>>
+      postings_;
+
+  //============================================================================
+public:
+  TrigramIndex() = default;
+
+  // Constructs an index that doesn't copy its keys, but verifies candidate
+  // matches against `key_of(value)`, which must return the key `value` was
+  // inserted under for as long as the index is used.
+  //
+  explicit TrigramIndex(std::function<std::string_view(const T &)> key_of)
+      : key_of_{std::move(key_of)}, starts_{} {}
+
+  TrigramIndex(const TrigramIndex &) = delete;
+  TrigramIndex &operator=(const TrigramIndex &) = delete;
+
+  //================================
+
+  // Adds `key` to the index under `value`, making all of its substrings
+  // searchable.  (Named for compatibility with the suffix-based indices.)
+  //
+  // Complexity: O(key.length() * log(key.length()))
+  //
+  void insert_suffixes(std::string_view key, const T &value) {
+    const auto ordinal = std::uint32_t(values_.size());
+
+    if (!key_of_) {
+      assert(text_.size() + key.size() <=
+             std::numeric_limits<std::uint32_t>::max());
+      text_.append(key);
+      starts_.emplace_back(text_.size());
+    }
+    values_.emplace_back(value);
+
+    for (std::uint32_t trigram : trigrams(key)) {
+      postings_[trigram].push_back(ordinal);
+    }
+  }
+
+  // Returns an upper bound on the number of mapped values whose key contains
+  // `pattern`, without finding them: the length of the shortest posting list
+  // of the pattern's trigrams.
+  //
+  // Complexity: O(pattern.length() * log(pattern.length()))
+  //
+  std::size_t estimate_prefix_matches(std::string_view pattern) const {
+    if (pattern.size() < 3) {
+      return values_.size();
+    }
+    std::size_t estimate = values_.size();
+    for (std::uint32_t trigram : trigrams(pattern)) {
+      const auto found = postings_.find(trigram);
+      if (found == postings_.end()) {
+        return 0;
+      }
+      estimate = std::min(estimate, found->second.size());
+    }
+    return estimate;
+  }
+
+  // Invokes the visitor `fn` (see visitor.hpp) once for each mapped value whose
+  // key contains `pattern` (i.e., has a suffix starting with `pattern`).
+  // Returns false iff `fn` stopped the iteration early.
+  //
+  template <typename Fn /* void(const T &) */>
+  bool for_each_prefix_match(std::string_view pattern, Fn &&fn) const {
+    if (pattern.size() < 3) {
+      for (std::uint32_t ordinal = 0; ordinal < values_.size(); ++ordinal) {
+        if (key(ordinal).find(pattern) != std::string_view::npos &&
+            !invoke_visitor(fn, values_[ordinal])) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    const bool exact = pattern.size() == 3;
+    return for_each_candidate(pattern, [&](std::uint32_t ordinal) {
+      if (exact || key(ordinal).find(pattern) != std::string_view::npos) {
+        return invoke_visitor(fn, values_[ordinal]) ? VisitResult::kContinue
+                                                    : VisitResult::kStop;
+      }
+      return VisitResult::kContinue;
+    });
+  }
+
+  // Returns the memory used by the index, with the total number of posting
+  // list entries.
+  //
+  MemoryUsage memory_usage() const {
+    MemoryUsage usage;
+    usage.bytes = heap_bytes(text_) + heap_bytes(starts_) +
+                  heap_bytes(values_) +
+                  postings_.get_allocator().bytes_allocated();
+    for (const auto &[trigram, list] : postings_) {
+      usage.bytes += list.byte_size();
+      usage.num_entries += list.size();
+    }
+    return usage;
+  }
+};
@@ -0,0 +1,235 @@
+#include "trigram_index.hpp"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+
+#include <boost/optional/optional_io.hpp>
+
+#include "heap_usage.hpp"
+#include "qb_column_lookup.hpp"
+#include "radix_trie.hpp"
+#include "suffix_array.hpp"
+#include "words.hpp"
+
+namespace {
+
+TEST(PostingListTest, CursorSeek) {
+  PostingList list;
+  std::vector<std::uint32_t> expected;
+  for (std::uint32_t i = 0; i < 10000; ++i) {
+    const std::uint32_t ordinal = i * 3 + (i % 7) * (i % 7) * 200;
+    if (expected.empty() || ordinal > expected.back()) {
+      list.push_back(ordinal);
+      expected.emplace_back(ordinal);
+    }
+  }
+  ASSERT_EQ(list.size(), expected.size());
+
+  {
+    std::vector<std::uint32_t> actual;
+    for (auto cursor = list.cursor(); !cursor.at_end(); cursor.next()) {
+      actual.emplace_back(cursor.value());
+    }
+    EXPECT_EQ(actual, expected);
+  }
+
+  std::default_random_engine rng{/*seed=*/1};
+  for (int trial = 0; trial < 100; ++trial) {
+    auto cursor = list.cursor();
+    std::uint32_t target = 0;
+    std::uniform_int_distribution<std::uint32_t> pick_step(
+        0, 1000 << (trial % 8));
+    while (!cursor.at_end()) {
+      target += pick_step(rng);
+      cursor.seek(target);
+      const auto expected_pos =
+          std::lower_bound(expected.begin(), expected.end(), target);
+      if (expected_pos == expected.end()) {
+        EXPECT_TRUE(cursor.at_end());
+      } else {
+        ASSERT_FALSE(cursor.at_end());
+        ASSERT_EQ(cursor.value(), *expected_pos);
+      }
+    }
+  }
+}
+
+TEST(TrigramIndexTest, SubstringSearch) {
+  std::default_random_engine rng{/*seed=*/2};
+  std::uniform_int_distribution<int> pick_length(0, 40);
+  std::uniform_int_distribution<int> pick_char('a', 'd');
+
+  const auto random_string = [&](int length) {
+    std::string s(length, ' ');
+    for (char &ch : s) {
+      ch = pick_char(rng);
+    }
+    return s;
+  };
+
+  std::vector<std::string> keys;
+  TrigramIndex<int> index;
+  for (int i = 0; i < 2000; ++i) {
+    keys.emplace_back(random_string(pick_length(rng)));
+    index.insert_suffixes(keys.back(), i);
+  }
+
+  for (int length = 0; length <= 8; ++length) {
+    for (int trial = 0; trial < 20; ++trial) {
+      const std::string pattern = random_string(length);
+
+      std::vector<int> expected;
+      for (std::size_t i = 0; i < keys.size(); ++i) {
+        if (keys[i].find(pattern) != std::string::npos) {
+          expected.emplace_back(i);
+        }
+      }
+
+      std::vector<int> actual;
+      index.for_each_prefix_match(pattern,
+                                  [&](int i) { actual.emplace_back(i); });
+
+      EXPECT_EQ(actual, expected) << "pattern=" << pattern;
+      EXPECT_GE(index.estimate_prefix_matches(pattern), expected.size())
+          << "pattern=" << pattern;
+      if (length == 3) {
+        EXPECT_EQ(index.estimate_prefix_matches(pattern), expected.size())
+            << "pattern=" << pattern;
+      }
+    }
+  }
+}
+
+// An index given a key accessor finds the same matches without copying the
+// keys.
+//
+TEST(TrigramIndexTest, KeyAccessor) {
+  const std::vector<std::string> words = load_words();
+  std::vector<std::string> keys;
+  for (std::size_t i = 0; i < words.size(); i += 7) {
+    keys.emplace_back(words[i] + " " + words[i / 2]);
+  }
+
+  TrigramIndex<unsigned> copied;
+  TrigramIndex<unsigned> accessed{
+      [&](unsigned i) { return std::string_view{keys[i]}; }};
+  std::size_t key_bytes = 0;
+  for (unsigned i = 0; i < keys.size(); ++i) {
+    copied.insert_suffixes(keys[i], i);
+    accessed.insert_suffixes(keys[i], i);
+    key_bytes += keys[i].size();
+  }
+
+  for (const char *pattern : {"", "e", "th", "ing", "tion", "s a", "qzx"}) {
+    std::vector<unsigned> expected, actual;
+    copied.for_each_prefix_match(pattern,
+                                 [&](unsigned i) { expected.push_back(i); });
+    accessed.for_each_prefix_match(pattern,
+                                   [&](unsigned i) { actual.push_back(i); });
+    EXPECT_EQ(actual, expected) << "pattern=" << pattern;
+    EXPECT_EQ(accessed.estimate_prefix_matches(pattern),
+              copied.estimate_prefix_matches(pattern))
+        << "pattern=" << pattern;
+  }
+
+  EXPECT_LE(accessed.memory_usage().bytes + key_bytes,
+            copied.memory_usage().bytes);
+  EXPECT_EQ(accessed.memory_usage().num_entries,
+            copied.memory_usage().num_entries);
+}
+
+TEST(TrigramIndexTest, ColumnLookupBackend) {
+  QBColumnLookup<unsigned, std::string, TrigramIndex<unsigned>> lookup;
+  lookup.insert(1, "banana");
+  lookup.insert(2, "bandana");
+  lookup.insert(3, "cabana");
+
+  std::multiset<unsigned> actual;
+  lookup.for_each_match("ana", [&](unsigned id) {
+    actual.insert(id);
+    return VisitResult::kContinue;
+  });
+  EXPECT_THAT(actual, ::testing::ElementsAre(1, 2, 3));
+
+  actual.clear();
+  lookup.for_each_match("nan", [&](unsigned id) {
+    actual.insert(id);
+    return VisitResult::kContinue;
+  });
+  EXPECT_THAT(actual, ::testing::ElementsAre(1));
+
+  EXPECT_EQ(lookup.estimate_matches("ana"), std::size_t{3});
+  EXPECT_EQ(lookup.estimate_matches("xyz"), std::size_t{0});
+}
+
+// Checks each index against a brute force search on long string values, and
+// that it doesn't report more memory than it allocated.  (BM_BuildIndex and
+// BM_QueryIndex in qb_record_collection_benchmark.cpp compare their footprint
+// and speed on such values.)
+//
+TEST(TrigramIndexTest, LongValues) {
+  const std::vector<std::string> words = load_words();
+
+  std::default_random_engine rng{/*seed=*/3};
+  std::uniform_int_distribution<int> pick_word(0, words.size() - 1);
+
+  std::vector<std::string> values;
+  for (int i = 0; i < 1000; ++i) {
+    std::ostringstream oss;
+    for (int n = 0; n < 20; ++n) {
+      oss << words[pick_word(rng)] << ' ';
+    }
+    values.emplace_back(std::move(oss).str());
+  }
+
+  std::vector<std::string> patterns = {"x", "th", "ill", "zing", "term",
+                                       "expect", "lease", "notawordXYZ"};
+  for (int i = 0; i < 20; ++i) {
+    patterns.emplace_back(words[pick_word(rng)]);
+  }
+
+  const auto check = [&](const char *name, auto index_type) {
+    using Index = typename decltype(index_type)::type;
+
+    const std::size_t heap_before = heap_bytes_in_use();
+    auto index = std::make_unique<Index>();
+    for (std::size_t i = 0; i < values.size(); ++i) {
+      index->insert_suffixes(values[i], i);
+    }
+    if constexpr (std::is_same_v<Index, SuffixArrayIndex<int>>) {
+      index->build();
+    }
+    const std::size_t bytes = heap_bytes_in_use() - heap_before;
+    const std::size_t reported = index->memory_usage().bytes;
+    if (bytes != 0) {
+      // Allow for memory freed by other code while the index was built.
+      //
+      EXPECT_LE(reported, bytes * 1.01) << name;
+    }
+
+    for (const std::string &pattern : patterns) {
+      std::set<int> actual;
+      index->for_each_prefix_match(pattern, [&](int i) { actual.insert(i); });
+
+      std::set<int> expected;
+      for (std::size_t i = 0; i < values.size(); ++i) {
+        if (values[i].find(pattern) != std::string::npos) {
+          expected.insert(i);
+        }
+      }
+      EXPECT_THAT(actual, ::testing::ContainerEq(expected))
+          << name << " pattern=" << pattern;
+    }
+  };
+
+  check("RadixTrie", TypeOf<RadixTrie<int>>{});
+  check("SuffixArrayIndex", TypeOf<SuffixArrayIndex<int>>{});
+  check("TrigramIndex", TypeOf<TrigramIndex<int>>{});
+}
+
+} // namespace
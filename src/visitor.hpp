@@ -0,0 +1,26 @@
+// Early termination support for visitor callbacks.
+//
+#pragma once
+
+#include <type_traits>
+#include <utility>
+
+// The visitor callbacks passed to the `for_each*` functions in this project
+// may either return `void` (visit everything) or a `VisitResult`, in which
+// case returning `kStop` ends the iteration early.
+//
+enum struct VisitResult { kContinue, kStop };
+
+// Invokes the visitor `fn` on `args`, returning true iff the iteration should
+// continue.
+//
+template <typename Fn, typename... Args>
+bool invoke_visitor(Fn &&fn, Args &&... args) {
+  if constexpr (std::is_void_v<std::invoke_result_t<Fn, Args...>>) {
+    std::forward<Fn>(fn)(std::forward<Args>(args)...);
+    return true;
+  } else {
+    return std::forward<Fn>(fn)(std::forward<Args>(args)...) !=
+           VisitResult::kStop;
+  }
+}
@@ -0,0 +1,316 @@
+#include "write_ahead_log.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/crc.hpp>
+
+#include "file_sync.hpp"
+#include "tuples.hpp"
+
+// Local helper functions.
+//
+namespace {
+
+using record_type = WriteAheadLog::record_type;
+
+constexpr std::size_t kNumColumns = std::tuple_size<record_type>::value;
+constexpr std::size_t kEntryHeaderSize = 2 * sizeof(std::uint32_t);
+
+[[noreturn]] void throw_error(const std::string &what,
+                              const std::string &path) {
+  throw std::runtime_error{what + ": " + path};
+}
+
+// Same as `throw_error`, adding the description of `errno`.
+//
+[[noreturn]] void throw_system_error(const std::string &what,
+                                     const std::string &path) {
+  throw_error(what + " (" + std::strerror(errno) + ")", path);
+}
+
+std::uint32_t checksum(std::string_view data) {
+  boost::crc_32_type crc;
+  crc.process_bytes(data.data(), data.size());
+  return crc.checksum();
+}
+
+template <typename T> void put(std::string &buffer, const T &value) {
+  buffer.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+// Reads a `T` from the front of `in` into `value`.  Returns false if `in` is
+// too short.
+//
+template <typename T> bool get(std::string_view &in, T &value) {
+  if (in.size() < sizeof(T)) {
+    return false;
+  }
+  std::memcpy(&value, in.data(), sizeof(T));
+  in.remove_prefix(sizeof(T));
+  return true;
+}
+
+// Decodes the payload of an entry into `entry`.  Returns false if it is
+// malformed.
+//
+bool decode(std::string_view payload, WriteAheadLog::Entry &entry) {
+  bool ok = get(payload, entry.op) && entry.op <= LogOp::kUpdate;
+  for_each_upto<kNumColumns>([&](auto i) {
+    constexpr int I = decltype(i)::value;
+    auto &value = std::get<I>(entry.record);
+    if (!ok || (entry.op == LogOp::kErase &&
+                I != QBRecordTraits::unique_id_column())) {
+      return;
+    }
+    if constexpr (std::is_same_v<std::decay_t<decltype(value)>,
+                                 std::string>) {
+      std::uint32_t size = 0;
+      ok = get(payload, size) && payload.size() >= size;
+      if (ok) {
+        value.assign(payload.data(), size);
+        payload.remove_prefix(size);
+      }
+    } else {
+      ok = get(payload, value);
+    }
+  });
+  return ok && payload.empty();
+}
+
+// Invokes `fn` on each entry in `data` (the contents of a log file), up to
+// the first incomplete one.  Returns the size of the complete entries.
+//
+template <typename Fn /* void(WriteAheadLog::Entry &&) */>
+std::size_t decode_entries(std::string_view data, Fn &&fn) {
+  std::size_t complete = 0;
+  for (;;) {
+    std::string_view in = data.substr(complete);
+    std::uint32_t size = 0;
+    std::uint32_t crc = 0;
+    if (!get(in, size) || !get(in, crc) || in.size() < size) {
+      break;
+    }
+    const std::string_view payload = in.substr(0, size);
+    WriteAheadLog::Entry entry{};
+    if (checksum(payload) != crc || !decode(payload, entry)) {
+      break;
+    }
+    fn(std::move(entry));
+    complete += kEntryHeaderSize + size;
+  }
+  return complete;
+}
+
+// Sets `data` to the contents of the file `path`.  Returns false if there is
+// no such file.
+//
+bool read_file(const std::string &path, std::string &data) {
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    if (errno == ENOENT) {
+      return false;
+    }
+    throw_system_error("can't open write-ahead log", path);
+  }
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    ::close(fd);
+    throw_system_error("can't stat write-ahead log", path);
+  }
+  data.resize(st.st_size);
+  std::size_t done = 0;
+  while (done < data.size()) {
+    const ssize_t n = ::read(fd, &data[done], data.size() - done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      ::close(fd);
+      throw_system_error("can't read write-ahead log", path);
+    }
+    done += n;
+  }
+  ::close(fd);
+  return true;
+}
+
+} // namespace
+
+WriteAheadLog::WriteAheadLog(const std::string &path, SyncPolicy policy)
+    : path_{path}, policy_{policy} {
+  std::string data;
+  const bool exists = read_file(path, data);
+  const std::size_t complete =
+      decode_entries(data, [](WriteAheadLog::Entry &&) {});
+
+  fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+  if (fd_ < 0) {
+    throw_system_error("can't open write-ahead log", path);
+  }
+  if (complete < data.size() &&
+      (::ftruncate(fd_, complete) != 0 || ::fdatasync(fd_) != 0)) {
+    ::close(fd_);
+    throw_system_error("can't truncate write-ahead log", path);
+  }
+  if (!exists && !sync_parent_directory(path)) {
+    const int saved_errno = errno;
+    ::close(fd_);
+    errno = saved_errno;
+    throw_system_error("can't sync directory of write-ahead log", path);
+  }
+}
+
+WriteAheadLog::~WriteAheadLog() noexcept {
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+}
+
+auto WriteAheadLog::read(const std::string &path) -> std::vector<Entry> {
+  std::vector<Entry> entries;
+  std::string data;
+  if (read_file(path, data)) {
+    decode_entries(
+        data, [&](Entry &&entry) { entries.push_back(std::move(entry)); });
+  }
+  return entries;
+}
+
+void WriteAheadLog::append(const record_type &record) {
+  append_entry(LogOp::kInsert, record);
+}
+
+void WriteAheadLog::append(const std::vector<record_type> &records) {
+  std::unique_lock<std::mutex> lock{mutex_};
+  const std::size_t before = pending_.size();
+  for (const record_type &record : records) {
+    encode(LogOp::kInsert, record, pending_);
+  }
+  appended_ += pending_.size() - before;
+  commit(lock, appended_);
+}
+
+void WriteAheadLog::append_erase(unique_id_type id) {
+  record_type record;
+  std::get<QBRecordTraits::unique_id_column()>(record) = id;
+  append_entry(LogOp::kErase, record);
+}
+
+void WriteAheadLog::append_update(const record_type &record) {
+  append_entry(LogOp::kUpdate, record);
+}
+
+void WriteAheadLog::append_entry(LogOp op, const record_type &record) {
+  std::unique_lock<std::mutex> lock{mutex_};
+  const std::size_t before = pending_.size();
+  encode(op, record, pending_);
+  appended_ += pending_.size() - before;
+  commit(lock, appended_);
+}
+
+std::uint64_t WriteAheadLog::num_syncs() const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  return num_syncs_;
+}
+
+void WriteAheadLog::encode(LogOp op, const record_type &record,
+                           std::string &buffer) {
+  const std::size_t header = buffer.size();
+  buffer.append(kEntryHeaderSize, '\0');
+
+  put(buffer, op);
+  for_each_upto<kNumColumns>([&](auto i) {
+    constexpr int I = decltype(i)::value;
+    const auto &value = std::get<I>(record);
+    if (op == LogOp::kErase && I != QBRecordTraits::unique_id_column()) {
+      return;
+    }
+    if constexpr (std::is_same_v<std::decay_t<decltype(value)>,
+                                 std::string>) {
+      put(buffer, std::uint32_t(value.size()));
+      buffer += value;
+    } else {
+      put(buffer, value);
+    }
+  });
+
+  const std::string_view payload =
+      std::string_view{buffer}.substr(header + kEntryHeaderSize);
+  const std::uint32_t size = payload.size();
+  const std::uint32_t crc = checksum(payload);
+  std::memcpy(&buffer[header], &size, sizeof(size));
+  std::memcpy(&buffer[header + sizeof(size)], &crc, sizeof(crc));
+}
+
+void WriteAheadLog::write_out(const std::string &data, bool sync) {
+  if (!write_fully(fd_, data.data(), data.size())) {
+    throw_system_error("can't write write-ahead log", path_);
+  }
+  if (sync && ::fdatasync(fd_) != 0) {
+    throw_system_error("can't sync write-ahead log", path_);
+  }
+}
+
+void WriteAheadLog::commit(std::unique_lock<std::mutex> &lock,
+                           std::uint64_t end) {
+  while (durable_ < end) {
+    if (failed_) {
+      pending_.clear();
+      throw_error("write-ahead log failed earlier", path_);
+    }
+
+    if (policy_ != SyncPolicy::kGroupCommit) {
+      const bool sync = policy_ == SyncPolicy::kEveryAppend;
+      try {
+        write_out(pending_, sync);
+      } catch (...) {
+        failed_ = true;
+        throw;
+      }
+      pending_.clear();
+      durable_ = appended_;
+      num_syncs_ += sync;
+      break;
+    }
+
+    if (committing_) {
+      committed_.wait(lock);
+      continue;
+    }
+
+    // Lead a group commit of everything appended so far, letting further
+    // appends queue up in `pending_` while the file is written and synced.
+    //
+    committing_ = true;
+    std::string group;
+    group.swap(pending_);
+    const std::uint64_t group_end = appended_;
+    lock.unlock();
+    std::exception_ptr error;
+    try {
+      write_out(group, /*sync=*/true);
+    } catch (...) {
+      error = std::current_exception();
+    }
+    lock.lock();
+    committing_ = false;
+    committed_.notify_all();
+    if (error) {
+      failed_ = true;
+      std::rethrow_exception(error);
+    }
+    durable_ = group_end;
+    ++num_syncs_;
+  }
+}
@@ -0,0 +1,154 @@
+// WriteAheadLog - an append-only file of the mutations (insertions, erasures
+// and updates of records) made to an in-memory collection, so that they
+// survive a crash.
+//
+// Each entry of the log is the size of its payload (a `std::uint32_t`), the
+// CRC-32 of the payload, then the payload: the kind of mutation (a `LogOp`),
+// then the record's columns in order (only its unique id for an erasure),
+// numbers in host byte order, strings as their length (a `std::uint32_t`)
+// followed by their characters.  A crash can leave the last entries
+// incomplete, so reading stops at the first entry that is truncated or fails
+// its checksum, and opening a log for appending discards everything from that
+// entry on.
+//
+// Appends may come from several threads at once.  How durable each append is
+// when it returns depends on the log's `SyncPolicy`.
+//
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "qb_record.hpp"
+
+enum struct SyncPolicy {
+  // Appends are written to the file (so they survive the process crashing)
+  // but never explicitly synced (so they may not survive the machine
+  // crashing).
+  //
+  kNone,
+
+  // Each append is written and synced (`fdatasync`) before returning, one at
+  // a time.
+  //
+  kEveryAppend,
+
+  // Same guarantee as `kEveryAppend`, but appends that arrive while a sync is
+  // in progress are buffered, then written and synced together by the next
+  // one ("group commit"), so concurrent writers share the cost of each sync.
+  //
+  kGroupCommit,
+};
+
+// The kinds of mutation recorded in a write-ahead log.
+//
+enum struct LogOp : std::uint8_t { kInsert, kErase, kUpdate };
+
+class WriteAheadLog {
+public:
+  using record_type = QBRecordTraits::columns_type;
+  using unique_id_type = QBRecordTraits::unique_id_type;
+
+  // One mutation read back from a log.  For `LogOp::kErase`, only the unique
+  // id column of `record` is meaningful.
+  //
+  struct Entry {
+    LogOp op;
+    record_type record;
+  };
+
+  // Opens the log file `path` for appending, creating it if needed and
+  // discarding any incomplete entries at its end.  Throws
+  // `std::runtime_error` on failure.
+  //
+  WriteAheadLog(const std::string &path, SyncPolicy policy);
+
+  WriteAheadLog(const WriteAheadLog &) = delete;
+  WriteAheadLog &operator=(const WriteAheadLog &) = delete;
+
+  ~WriteAheadLog() noexcept;
+
+  // Returns the entries in the log file `path`, in the order they were
+  // appended, up to the first incomplete entry.  A missing file is an empty
+  // log.  Throws `std::runtime_error` if the file can't be read.
+  //
+  static std::vector<Entry> read(const std::string &path);
+
+  // Appends the insertion of `record` to the log, returning once it is as
+  // durable as the policy guarantees.  Thread-safe.  Throws
+  // `std::runtime_error` if the log can't be written, after which every
+  // append fails.
+  //
+  void append(const record_type &record);
+
+  // Same as `append` for each of `records`, in order, but written (and
+  // synced) together.
+  //
+  void append(const std::vector<record_type> &records);
+
+  // Same as `append`, for the erasure of the record with unique id `id`.
+  //
+  void append_erase(unique_id_type id);
+
+  // Same as `append`, for replacing the record with the unique id of
+  // `record` by `record`.
+  //
+  void append_update(const record_type &record);
+
+  // Returns the number of times the log has been synced.
+  //
+  std::uint64_t num_syncs() const;
+
+private:
+  // Appends the entry for mutation `op` of `record` to `buffer`.
+  //
+  static void encode(LogOp op, const record_type &record, std::string &buffer);
+
+  // Appends the entry for mutation `op` of `record` to the log; see `append`.
+  //
+  void append_entry(LogOp op, const record_type &record);
+
+  // Writes all of `data` to the file, then syncs it if `sync`.  Called with
+  // `mutex_` held, or by the group commit leader (see `commit`).
+  //
+  void write_out(const std::string &data, bool sync);
+
+  // Makes the entries in `pending_` durable as the policy requires, up to and
+  // including those ending at log position `end`.
+  //
+  void commit(std::unique_lock<std::mutex> &lock, std::uint64_t end);
+
+  const std::string path_;
+  const SyncPolicy policy_;
+  int fd_ = -1;
+
+  mutable std::mutex mutex_;
+
+  // Signalled when a group commit finishes.
+  //
+  std::condition_variable committed_;
+
+  // Encoded entries not yet written to the file.
+  //
+  std::string pending_;
+
+  // The log positions (in bytes since opening) up to which entries have been
+  // appended to `pending_`, and made durable.
+  //
+  std::uint64_t appended_ = 0;
+  std::uint64_t durable_ = 0;
+
+  // True while a group commit leader is writing and syncing, without holding
+  // `mutex_`.
+  //
+  bool committing_ = false;
+
+  // Set once a write or sync fails.
+  //
+  bool failed_ = false;
+
+  std::uint64_t num_syncs_ = 0;
+};
@@ -0,0 +1,302 @@
+#include "write_ahead_log.hpp"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include "qb_record_collection.hpp"
+#include "words.hpp"
+
+namespace {
+
+using record_type = WriteAheadLog::record_type;
+
+// Returns `count` records with ids 0..count-1 and random strings made of
+// three-letter words.
+//
+std::vector<record_type> random_records(int count) {
+  const std::vector<std::string> words =
+      load_words([](std::string_view word) { return word.length() == 3; });
+  std::default_random_engine rng{/*seed=*/1};
+  std::uniform_int_distribution<int> pick_word_index(0, words.size() - 1);
+  std::uniform_int_distribution<int> pick_word_count(0, 3);
+  std::uniform_int_distribution<long> pick_long(-count / 4, count / 4);
+
+  const auto random_string = [&] {
+    std::string s;
+    for (int n = pick_word_count(rng); n > 0; --n) {
+      s += words[pick_word_index(rng)];
+    }
+    return s;
+  };
+
+  std::vector<record_type> records;
+  for (int id = 0; id < count; ++id) {
+    records.emplace_back(id, random_string(), pick_long(rng), random_string());
+  }
+  return records;
+}
+
+// A log file path, removed when the test ends.
+//
+class LogFile {
+public:
+  explicit LogFile(const std::string &name)
+      : path_{::testing::TempDir() + name + "." + std::to_string(::getpid())} {
+    std::remove(path_.c_str());
+  }
+  ~LogFile() { std::remove(path_.c_str()); }
+
+  const std::string &path() const { return path_; }
+
+  // Returns the size of the file in bytes.
+  //
+  std::size_t size() const {
+    return std::ifstream{path_, std::ios::binary | std::ios::ate}.tellg();
+  }
+
+private:
+  std::string path_;
+};
+
+// Returns the records of the entries in the log file `path`, which must all
+// be insertions.
+//
+std::vector<record_type> logged_records(const std::string &path) {
+  std::vector<record_type> records;
+  for (WriteAheadLog::Entry &entry : WriteAheadLog::read(path)) {
+    EXPECT_EQ(entry.op, LogOp::kInsert);
+    records.push_back(std::move(entry.record));
+  }
+  return records;
+}
+
+TEST(WriteAheadLogTest, AppendAndRead) {
+  const LogFile file{"append_and_read.wal"};
+  EXPECT_THAT(logged_records(file.path()), ::testing::IsEmpty());
+
+  const std::vector<record_type> records = random_records(100);
+  for (const SyncPolicy policy : {SyncPolicy::kNone, SyncPolicy::kEveryAppend,
+                                  SyncPolicy::kGroupCommit}) {
+    std::remove(file.path().c_str());
+    {
+      WriteAheadLog log{file.path(), policy};
+      for (std::size_t i = 0; i < 50; ++i) {
+        log.append(records[i]);
+      }
+      log.append(std::vector<record_type>(records.begin() + 50, records.end()));
+      log.append(std::vector<record_type>{});
+      EXPECT_EQ(log.num_syncs(), policy == SyncPolicy::kNone ? 0u : 51u);
+    }
+    EXPECT_EQ(logged_records(file.path()), records);
+
+    // Reopening appends to the existing log.
+    //
+    WriteAheadLog{file.path(), policy}.append(records[0]);
+    EXPECT_EQ(logged_records(file.path()).size(), records.size() + 1);
+  }
+}
+
+TEST(WriteAheadLogTest, ErasuresAndUpdates) {
+  const LogFile file{"erasures_and_updates.wal"};
+  {
+    WriteAheadLog log{file.path(), SyncPolicy::kNone};
+    log.append(record_type{1, "one", 1, "uno"});
+    log.append_erase(1);
+    log.append_update(record_type{2, "two", 2, ""});
+  }
+
+  const std::vector<WriteAheadLog::Entry> entries =
+      WriteAheadLog::read(file.path());
+  ASSERT_EQ(entries.size(), 3u);
+  EXPECT_EQ(entries[0].op, LogOp::kInsert);
+  EXPECT_EQ(entries[0].record, (record_type{1, "one", 1, "uno"}));
+  EXPECT_EQ(entries[1].op, LogOp::kErase);
+  EXPECT_EQ(std::get<0>(entries[1].record), 1u);
+  EXPECT_EQ(entries[2].op, LogOp::kUpdate);
+  EXPECT_EQ(entries[2].record, (record_type{2, "two", 2, ""}));
+}
+
+TEST(WriteAheadLogTest, IncompleteEntries) {
+  const LogFile file{"incomplete_entries.wal"};
+  const std::vector<record_type> records = random_records(10);
+  std::vector<std::size_t> ends;
+  {
+    WriteAheadLog log{file.path(), SyncPolicy::kNone};
+    for (const record_type &record : records) {
+      log.append(record);
+      ends.push_back(file.size());
+    }
+  }
+
+  // A torn last entry is dropped on reading, and discarded by opening the log
+  // for appending.
+  //
+  ASSERT_EQ(::truncate(file.path().c_str(), ends[9] - 3), 0);
+  EXPECT_EQ(logged_records(file.path()),
+            std::vector<record_type>(records.begin(), records.begin() + 9));
+  WriteAheadLog{file.path(), SyncPolicy::kNone}.append(records[9]);
+  EXPECT_EQ(logged_records(file.path()), records);
+
+  // So is everything from an entry that fails its checksum on.
+  //
+  {
+    std::fstream f{file.path(),
+                   std::ios::binary | std::ios::in | std::ios::out};
+    f.seekp(ends[4] + 12);
+    f.put('\xff');
+  }
+  EXPECT_EQ(logged_records(file.path()),
+            std::vector<record_type>(records.begin(), records.begin() + 5));
+  WriteAheadLog{file.path(), SyncPolicy::kNone};
+  EXPECT_EQ(file.size(), ends[4]);
+}
+
+TEST(WriteAheadLogTest, ConcurrentAppends) {
+  constexpr int kThreads = 8;
+  constexpr int kPerThread = 50;
+  const LogFile file{"concurrent_appends.wal"};
+  const std::vector<record_type> records =
+      random_records(kThreads * kPerThread);
+
+  WriteAheadLog log{file.path(), SyncPolicy::kGroupCommit};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t] {
+      for (int i = t; i < int(records.size()); i += kThreads) {
+        log.append(records[i]);
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  EXPECT_LE(log.num_syncs(), records.size());
+
+  std::vector<record_type> logged = logged_records(file.path());
+  std::sort(logged.begin(), logged.end());
+  EXPECT_EQ(logged, records);
+}
+
+TEST(WriteAheadLogTest, CollectionReplay) {
+  const LogFile file{"collection_replay.wal"};
+  const std::vector<record_type> records = random_records(2000);
+
+  QBRecordCollection db;
+  EXPECT_EQ(db.open_write_ahead_log(file.path()), 0u);
+  for (std::size_t i = 0; i < 500; ++i) {
+    EXPECT_TRUE(db.insert(record_type{records[i]}));
+  }
+  EXPECT_FALSE(db.insert(record_type{records[0]}));
+  EXPECT_EQ(db.bulk_insert(records), 1500u);
+  EXPECT_EQ(logged_records(file.path()).size(), 2000u);
+
+  QBRecordCollection replayed;
+  EXPECT_EQ(replayed.open_write_ahead_log(file.path()), 2000u);
+  for (const auto &[column, match] :
+       std::vector<std::pair<std::string, std::string>>{
+           {"column0", "17"},
+           {"column1", "e"},
+           {"column3", "ab"},
+           {"column2", "BETWEEN -100 AND 100"},
+       }) {
+    EXPECT_EQ(replayed.find_matching_records(column, match),
+              db.find_matching_records(column, match))
+        << column << " " << match;
+  }
+
+  // The replayed collection logs new records after the replayed ones.
+  //
+  EXPECT_TRUE(replayed.insert(record_type{2000, "new", 0, ""}));
+  EXPECT_EQ(logged_records(file.path()).size(), 2001u);
+}
+
+TEST(WriteAheadLogTest, CollectionReplayErasuresAndUpdates) {
+  const LogFile file{"collection_replay_erasures.wal"};
+  const std::vector<record_type> records = random_records(2000);
+
+  // Interleave insertions, erasures and updates, including updates of erased
+  // records (which fail) and erasures of updated ones.  The first run of
+  // insertions is short enough to be replayed one at a time, the second long
+  // enough to be bulk loaded.
+  //
+  QBRecordCollection db;
+  db.open_write_ahead_log(file.path());
+  db.bulk_insert(std::vector<record_type>(records.begin(),
+                                          records.begin() + 500));
+  for (unsigned id = 0; id < 500; id += 3) {
+    EXPECT_TRUE(db.erase(id));
+  }
+  EXPECT_FALSE(db.erase(0));
+  for (unsigned id = 0; id < 500; id += 5) {
+    EXPECT_EQ(db.update(record_type{id, "updated", id, "x"}), id % 3 != 0);
+  }
+  for (std::size_t i = 500; i < records.size(); ++i) {
+    db.insert(record_type{records[i]});
+  }
+  for (unsigned id = 10; id < records.size(); id += 10) {
+    db.erase(id);
+  }
+
+  QBRecordCollection replayed;
+  EXPECT_EQ(replayed.open_write_ahead_log(file.path()),
+            WriteAheadLog::read(file.path()).size());
+  for (const auto &[column, match] :
+       std::vector<std::pair<std::string, std::string>>{
+           {"column0", "5"},
+           {"column0", "6"},
+           {"column1", "e"},
+           {"column1", "updated"},
+           {"column3", "ab"},
+           {"column2", "BETWEEN -100 AND 100"},
+       }) {
+    EXPECT_EQ(replayed.find_matching_records(column, match),
+              db.find_matching_records(column, match))
+        << column << " " << match;
+  }
+}
+
+// Appends from several threads are all replayed, whatever the sync policy.
+//
+TEST(WriteAheadLogTest, ConcurrentAppendsReplayUnderEveryPolicy) {
+  constexpr int kCount = 400;
+  constexpr int kThreads = 8;
+  const std::vector<record_type> records = random_records(kCount);
+  const LogFile file{"concurrent_appends_policies.wal"};
+
+  for (const SyncPolicy policy :
+       {SyncPolicy::kNone, SyncPolicy::kEveryAppend,
+        SyncPolicy::kGroupCommit}) {
+    std::remove(file.path().c_str());
+    {
+      WriteAheadLog log{file.path(), policy};
+      std::vector<std::thread> threads;
+      for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&, t] {
+          for (int i = t; i < kCount; i += kThreads) {
+            log.append(records[i]);
+          }
+        });
+      }
+      for (std::thread &thread : threads) {
+        thread.join();
+      }
+    }
+    QBRecordCollection db;
+    EXPECT_EQ(db.open_write_ahead_log(file.path()), std::size_t(kCount))
+        << int(policy);
+  }
+}
+
+} // namespace